@@ -1,30 +1,31 @@
 #!/bin/bash
-gcc -o ./bin/extract -O3 ./utility/extract.c
-gcc -o ./bin/ext-reader ./utility/ext-reader.c
+gcc -o ./bin/extract -O3 -pthread ./utility/extract.c ./utility/bz2blocks.c -lbz2
+gcc -o ./bin/ext-reader -O2 ./utility/ext-reader.c ./utility/extread.c
+gcc -o ./bin/extbench -O3 -pthread ./utility/extbench.c ./utility/bz2blocks.c -lbz2
+gcc -o ./bin/pairstats -O3 -pthread ./utility/pairstats.c ./utility/extread.c ./utility/pairsum.c ./utility/pairarc.c -lm
+gcc -o ./bin/backfill -O2 -pthread ./utility/backfill.c
+gcc -o ./bin/pairindex -O3 ./utility/pairindex.c ./utility/extread.c ./utility/pairarc.c
+gcc -o ./bin/idx-reader -O2 ./utility/idx-reader.c ./utility/pairidx.c ./utility/extread.c
+gcc -o ./bin/pairarchive -O3 ./utility/pairarchive.c ./utility/pairarc.c ./utility/extread.c
+gcc -o ./bin/arc-reader -O2 ./utility/arc-reader.c ./utility/pairarc.c ./utility/extread.c
+gcc -o ./bin/pairmerge -O3 ./utility/pairmerge.c ./utility/pairsum.c ./utility/extread.c -lm
+gcc -o ./bin/pairprofile -O3 ./utility/pairprofile.c ./utility/extread.c ./utility/pairarc.c -lm
+gcc -o ./bin/pairdist -O3 ./utility/pairdist.c ./utility/pairsum.c ./utility/extread.c -lm
+gcc -o ./bin/citymatrix -O3 -pthread ./utility/citymatrix.c ./utility/extread.c ./utility/pairsum.c ./utility/pairarc.c -lm
+gcc -o ./bin/ifcount -O2 ./utility/ifcount.c
 
-get_files() {
-    local month=$1
-    local day=$2
-    
-    for ((i=10000; i<=12300; i+=100)); do
-        local time="${i:1:4}"
-        local date="2026-${month}-${day}"
-        local fileName="ping-${date}T${time}.bz2"
-        
-        echo $fileName
-        curl "https://data-store.ripe.net/datasets/atlas-daily-dumps/${date}/${fileName}" | bzip2 -dc | ./bin/extract "./data/extract-ping-${date}T${time}"
-    done
-}
+# Fetches and extracts every hour from 2026-01-06 to 2026-02-05 into ./data,
+# then packs the finished hours of each day into ./data/archive/<day>.arc
+# with pairarchive -r and removes the hourly files, merging into the day's
+# archive when a rerun extracted more hours. Safe to rerun: finished and
+# archived hours are recorded in ./data/manifest and skipped.
+# Each extract's JSON totals (lines, records, rejects, stage times) are
+# appended to ./data/extract-summary.jsonl.
+./bin/backfill -j 4 -x 2 -s ./data/extract-summary.jsonl -o ./data -a ./data/archive 2026-01-06 2026-02-05
 
-# Call the function with parameters
-# get_files "01" "06"
-
-for i in {106..131}
-do
-    get_files "01" "${i:1:2}"
-done
-
-for i in {101..105}
-do
-    get_files "02" "${i:1:2}"
-done
\ No newline at end of file
+# To refresh the city links of the emulation config from the dump, build
+# an anchor map with anchors-by-city/main.py --map <abbr> for every city,
+# then:
+#   ./bin/citymatrix -m ./data/anchors.map -c ./mininet-control/city_config.json ./data/archive
+# and for the hour-of-day link profiles of setup.py --profile:
+#   ./bin/pairprofile -m ./data/anchors.map -o ./data/profile.bin ./data/archive
@@ -0,0 +1,87 @@
+package main
+
+import (
+	"log"
+	"os"
+	"path"
+)
+
+// Contact is what a peer publishes in the contact directory
+type Contact struct {
+	RootCertificate         string
+	HandshakeKeyCertificate string
+	ID                      string
+}
+
+// ContactTable holds the contacts of a scenario's target peers, read once
+// instead of on every add, dial and join
+type ContactTable struct {
+	contact_dir string
+	peers       map[uint32]string
+	contacts    map[uint32]*Contact
+}
+
+// NewContactTable creates an empty table for the given peer ids
+func NewContactTable(contact_dir string, peers map[uint32]string) *ContactTable {
+	return &ContactTable{
+		contact_dir: contact_dir,
+		peers:       peers,
+		contacts:    make(map[uint32]*Contact, len(peers)),
+	}
+}
+
+func (ct *ContactTable) read(peer uint32) (*Contact, error) {
+	peer_id := ct.peers[peer]
+	rc, err := os.ReadFile(path.Join(ct.contact_dir, peer_id+"_rc"))
+	if err != nil {
+		return nil, err
+	}
+	hs, err := os.ReadFile(path.Join(ct.contact_dir, peer_id+"_hs"))
+	if err != nil {
+		return nil, err
+	}
+	id_hash, err := os.ReadFile(path.Join(ct.contact_dir, peer_id+"_id"))
+	if err != nil {
+		return nil, err
+	}
+	return &Contact{RootCertificate: string(rc), HandshakeKeyCertificate: string(hs), ID: string(id_hash)}, nil
+}
+
+// Preload reads every contact that is already published; the others are
+// read when first used. Returns the number loaded.
+func (ct *ContactTable) Preload() int {
+	for peer := range ct.peers {
+		if _, ok := ct.contacts[peer]; ok {
+			continue
+		}
+		if contact, err := ct.read(peer); err == nil {
+			ct.contacts[peer] = contact
+		}
+	}
+	return len(ct.contacts)
+}
+
+// Get returns the contact of a peer, reading it if it was not preloaded
+func (ct *ContactTable) Get(peer uint32) *Contact {
+	if contact, ok := ct.contacts[peer]; ok {
+		return contact
+	}
+	contact, err := ct.read(peer)
+	if err != nil {
+		log.Fatalf("unable to read file: %v", err)
+	}
+	ct.contacts[peer] = contact
+	return contact
+}
+
+// WriteContactFile publishes one contact file; it is renamed into place so
+// a peer preloading contacts never reads it half written
+func WriteContactFile(contact_dir string, name string, content string) {
+	tmp_path := path.Join(contact_dir, "."+name+".tmp")
+	if err := os.WriteFile(tmp_path, []byte(content), 0644); err != nil {
+		log.Fatal(err)
+	}
+	if err := os.Rename(tmp_path, path.Join(contact_dir, name)); err != nil {
+		log.Fatal(err)
+	}
+}
@@ -0,0 +1,193 @@
+package main
+
+import (
+	"encoding"
+	"encoding/binary"
+	"encoding/hex"
+	"fmt"
+	"log"
+	"os"
+	"strings"
+	"sync"
+	"time"
+)
+
+// Binary event log of one peer, merged across peers by evmerge.
+//
+//	header   64 bytes: magic, byte_order u32, version u16, record_size u16,
+//	         anchor_ns i64, peer id [32]byte NUL-padded, reserved
+//	records  [n]{t_ns i64, kind u8, reserved [7]byte, session [16]byte}
+//
+// t_ns is read off the monotonic clock, in nanoseconds since the log was
+// opened, and anchor_ns is the wall-clock time at that moment; anchor_ns +
+// t_ns orders the events of all peers of a machine, whose wall clocks are
+// the same, without the steps a wall clock can take. kind is the letter of
+// the text log (E enter, J join, L leave, X close). Integers are in the
+// writer's native byte order.
+const (
+	eventMagic      = "ABYSSEV\x00"
+	eventVersion    = 1
+	eventByteOrder  = 0x01020304
+	eventHeaderSize = 64
+	eventRecordSize = 32
+
+	// Records held before a write; the flusher writes every
+	// eventFlushInterval or when the ring is half full
+	eventRingRecords   = 4096
+	eventFlushInterval = 200 * time.Millisecond
+)
+
+// EventLog buffers fixed-size event records in a ring that a background
+// goroutine writes out in large chunks, so logging an event is a copy
+// under a lock rather than a write system call
+type EventLog struct {
+	f    *os.File
+	base time.Time
+
+	mtx    sync.Mutex
+	space  *sync.Cond // signalled when the flusher frees ring records
+	ring   []byte
+	head   int // first unwritten record
+	count  int // unwritten records
+	stalls int // times Log waited for the flusher
+	closed bool
+
+	kick chan struct{}
+	stop chan struct{}
+	done chan struct{}
+}
+
+// NewEventLog creates the log file of peer id and starts its flusher
+func NewEventLog(output_path string, id string) (*EventLog, error) {
+	f, err := os.Create(output_path)
+	if err != nil {
+		return nil, err
+	}
+	el := &EventLog{
+		f:    f,
+		base: time.Now(),
+		ring: make([]byte, eventRingRecords*eventRecordSize),
+		kick: make(chan struct{}, 1),
+		stop: make(chan struct{}),
+		done: make(chan struct{}),
+	}
+	el.space = sync.NewCond(&el.mtx)
+
+	header := make([]byte, eventHeaderSize)
+	copy(header, eventMagic)
+	binary.NativeEndian.PutUint32(header[8:], eventByteOrder)
+	binary.NativeEndian.PutUint16(header[12:], eventVersion)
+	binary.NativeEndian.PutUint16(header[14:], eventRecordSize)
+	binary.NativeEndian.PutUint64(header[16:], uint64(el.base.UnixNano()))
+	copy(header[24:56], id)
+	if _, err := f.Write(header); err != nil {
+		f.Close()
+		return nil, err
+	}
+
+	go el.flusher()
+	return el, nil
+}
+
+// sessionBytes packs a session ID into 16 bytes: its binary form when it
+// has one of that size (a UUID), else its printed form as hex UUID or, if
+// it is not one, its first 16 bytes
+func sessionBytes(session any) [16]byte {
+	var out [16]byte
+	if m, ok := session.(encoding.BinaryMarshaler); ok {
+		if b, err := m.MarshalBinary(); err == nil && len(b) == len(out) {
+			copy(out[:], b)
+			return out
+		}
+	}
+	s := fmt.Sprint(session)
+	if b, err := hex.DecodeString(strings.ReplaceAll(s, "-", "")); err == nil && len(b) == len(out) {
+		copy(out[:], b)
+		return out
+	}
+	copy(out[:], s)
+	return out
+}
+
+// Log records an event of the given kind now
+func (el *EventLog) Log(kind byte, session any) {
+	id := sessionBytes(session)
+
+	el.mtx.Lock()
+	for !el.closed && el.count == eventRingRecords {
+		el.stalls++
+		el.space.Wait()
+	}
+	if el.closed {
+		// Events after the end of the scenario are not logged
+		el.mtx.Unlock()
+		return
+	}
+	// Taken under the lock, so the ring stays in time order for evmerge
+	t := time.Since(el.base).Nanoseconds()
+	rec := el.ring[((el.head+el.count)%eventRingRecords)*eventRecordSize:][:eventRecordSize]
+	binary.NativeEndian.PutUint64(rec, uint64(t))
+	rec[8] = kind
+	clear(rec[9:16])
+	copy(rec[16:], id[:])
+	el.count++
+	if el.count >= eventRingRecords/2 {
+		select {
+		case el.kick <- struct{}{}:
+		default:
+		}
+	}
+	el.mtx.Unlock()
+}
+
+// flush writes out the records that are in the ring now. Records are only
+// freed once written, so Log never touches the part being written.
+func (el *EventLog) flush() {
+	el.mtx.Lock()
+	head, count := el.head, el.count
+	el.mtx.Unlock()
+
+	for written := 0; written < count; {
+		first := (head + written) % eventRingRecords
+		n := min(count-written, eventRingRecords-first)
+		if _, err := el.f.Write(el.ring[first*eventRecordSize : (first+n)*eventRecordSize]); err != nil {
+			log.Fatalf("Error writing event log: %v", err)
+		}
+		written += n
+	}
+
+	el.mtx.Lock()
+	el.head = (head + count) % eventRingRecords
+	el.count -= count
+	el.space.Broadcast()
+	el.mtx.Unlock()
+}
+
+func (el *EventLog) flusher() {
+	defer close(el.done)
+	ticker := time.NewTicker(eventFlushInterval)
+	defer ticker.Stop()
+	for {
+		select {
+		case <-ticker.C:
+		case <-el.kick:
+		case <-el.stop:
+			el.flush()
+			return
+		}
+		el.flush()
+	}
+}
+
+// Close writes out what is left and closes the file
+func (el *EventLog) Close() error {
+	el.mtx.Lock()
+	el.closed = true
+	el.mtx.Unlock()
+	close(el.stop)
+	<-el.done
+	if el.stalls > 0 {
+		log.Printf("Event log: waited for the flusher %d times", el.stalls)
+	}
+	return el.f.Close()
+}
@@ -0,0 +1,158 @@
+// evmerge merges the binary event logs of scenario_run (../event_log.go)
+// into one time-ordered TSV stream: time, peer, kind, session.
+//
+// Each log is already in time order, so the logs are merged with a heap
+// over their next records. Times are anchor_ns + t_ns of each log, the
+// wall-clock time of the event in nanoseconds, or with -t the seconds
+// since the scenario start.
+//
+//	evmerge -t 1897157308 -o events.tsv results/300/1/evnt_*.ev
+package main
+
+import (
+	"bufio"
+	"container/heap"
+	"encoding/binary"
+	"flag"
+	"fmt"
+	"log"
+	"os"
+	"strings"
+)
+
+const (
+	eventMagic      = "ABYSSEV\x00"
+	eventVersion    = 1
+	eventByteOrder  = 0x01020304
+	eventHeaderSize = 64
+	eventRecordSize = 32
+)
+
+type event struct {
+	time    int64 // wall-clock ns
+	kind    byte
+	session [16]byte
+}
+
+type peerLog struct {
+	peer   string
+	events []event
+	next   int
+}
+
+// logHeap orders logs by the time of their next event
+type logHeap []*peerLog
+
+func (h logHeap) Len() int { return len(h) }
+func (h logHeap) Less(i, j int) bool {
+	return h[i].events[h[i].next].time < h[j].events[h[j].next].time
+}
+func (h logHeap) Swap(i, j int) { h[i], h[j] = h[j], h[i] }
+func (h *logHeap) Push(x any)   { *h = append(*h, x.(*peerLog)) }
+func (h *logHeap) Pop() any {
+	old := *h
+	x := old[len(old)-1]
+	*h = old[:len(old)-1]
+	return x
+}
+
+func readLog(path string) (*peerLog, error) {
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	ne := binary.NativeEndian
+	if len(data) < eventHeaderSize || string(data[:8]) != eventMagic {
+		return nil, fmt.Errorf("%s: not an event log", path)
+	}
+	if ne.Uint32(data[8:]) != eventByteOrder {
+		return nil, fmt.Errorf("%s: byte order does not match this machine", path)
+	}
+	if ne.Uint16(data[12:]) != eventVersion || ne.Uint16(data[14:]) != eventRecordSize {
+		return nil, fmt.Errorf("%s: unsupported version %d", path, ne.Uint16(data[12:]))
+	}
+	anchor := int64(ne.Uint64(data[16:]))
+	pl := &peerLog{peer: strings.TrimRight(string(data[24:56]), "\x00")}
+
+	// A peer that was killed may have left a partial record at the end
+	records := data[eventHeaderSize:]
+	pl.events = make([]event, len(records)/eventRecordSize)
+	for i := range pl.events {
+		rec := records[i*eventRecordSize:]
+		pl.events[i].time = anchor + int64(ne.Uint64(rec))
+		pl.events[i].kind = rec[8]
+		copy(pl.events[i].session[:], rec[16:32])
+	}
+	return pl, nil
+}
+
+func formatSession(s [16]byte) string {
+	return fmt.Sprintf("%x-%x-%x-%x-%x", s[0:4], s[4:6], s[6:8], s[8:10], s[10:16])
+}
+
+func main() {
+	var output_path string
+	var time_start int64
+	flag.StringVar(&output_path, "o", "-", "merged TSV output, - for stdout")
+	flag.Int64Var(&time_start, "t", 0, "scenario start (unix seconds); times are printed as seconds since it")
+	flag.Usage = func() {
+		fmt.Fprintf(os.Stderr, "Usage: %s [-o merged.tsv] [-t t_start] <event log>...\n", os.Args[0])
+		flag.PrintDefaults()
+	}
+	flag.Parse()
+	if flag.NArg() == 0 {
+		flag.Usage()
+		os.Exit(1)
+	}
+
+	h := make(logHeap, 0, flag.NArg())
+	total := 0
+	for _, path := range flag.Args() {
+		pl, err := readLog(path)
+		if err != nil {
+			log.Fatal(err)
+		}
+		total += len(pl.events)
+		if len(pl.events) > 0 {
+			h = append(h, pl)
+		}
+	}
+	heap.Init(&h)
+
+	out := os.Stdout
+	if output_path != "-" {
+		f, err := os.Create(output_path)
+		if err != nil {
+			log.Fatal(err)
+		}
+		out = f
+	}
+	w := bufio.NewWriterSize(out, 1<<20)
+	fmt.Fprintln(w, "time\tpeer\tkind\tsession")
+	for h.Len() > 0 {
+		pl := h[0]
+		ev := pl.events[pl.next]
+		if time_start != 0 {
+			t := ev.time - time_start*1000000000
+			sign := ""
+			if t < 0 {
+				sign, t = "-", -t
+			}
+			fmt.Fprintf(w, "%s%d.%09d\t%s\t%c\t%s\n", sign, t/1000000000, t%1000000000, pl.peer, ev.kind, formatSession(ev.session))
+		} else {
+			fmt.Fprintf(w, "%d\t%s\t%c\t%s\n", ev.time, pl.peer, ev.kind, formatSession(ev.session))
+		}
+		if pl.next++; pl.next < len(pl.events) {
+			heap.Fix(&h, 0)
+		} else {
+			heap.Pop(&h)
+		}
+	}
+	if err := w.Flush(); err != nil {
+		log.Fatal(err)
+	}
+	if err := out.Close(); err != nil {
+		log.Fatal(err)
+	}
+	fmt.Fprintf(os.Stderr, "%d events from %d logs\n", total, flag.NArg())
+}
@@ -2,12 +2,10 @@ package main
 
 import (
 	"crypto/ed25519"
-	"encoding/json"
 	"flag"
 	"fmt"
 	"log"
 	"os"
-	"path"
 
 	"github.com/kadmila/Abyss-Browser/abyss_core/ahost"
 	"golang.org/x/crypto/ssh"
@@ -25,22 +23,19 @@ func main() {
 	flag.StringVar(&contact_dir, "contact_dir", "", "path to directory for sharing contact information")
 	flag.Int64Var(&time_start, "t_start", 1897157308, "time to start the scenario")
 	flag.Int64Var(&duration, "duration", 0, "maximum execution duration")
-	flag.StringVar(&scenario_path, "scenario", "", "path to scenario JSON file")
-	flag.StringVar(&output_path, "out", "", "path to output file")
+	flag.StringVar(&scenario_path, "scenario", "", "path to compiled scenario or per-peer scenario JSON file")
+	flag.StringVar(&output_path, "out", "", "path to binary event log (event_log.go)")
 	flag.Parse()
 
-	// Parse scenario file if provided
-	var scenario []map[string]string
+	// Load this peer's steps of the scenario if provided
+	scenario := &Scenario{Peers: map[uint32]string{}}
 	if scenario_path != "" {
-		scenarioData, err := os.ReadFile(scenario_path)
+		var err error
+		scenario, err = LoadScenario(scenario_path, id)
 		if err != nil {
-			log.Fatalf("Error reading scenario file: %v", err)
+			log.Fatalf("Error loading scenario: %v", err)
 		}
-		err = json.Unmarshal(scenarioData, &scenario)
-		if err != nil {
-			log.Fatalf("Error parsing scenario JSON: %v", err)
-		}
-		log.Printf("Loaded scenario with %d entries", len(scenario))
+		log.Printf("Loaded scenario with %d entries", len(scenario.Steps))
 	}
 
 	// Read ../credentials/{id}.pem and parse key
@@ -72,31 +67,10 @@ func main() {
 	go host.Serve()
 
 	// Write contact information
-	rc_f, err := os.OpenFile(path.Join(contact_dir, id+"_rc"), os.O_CREATE|os.O_WRONLY, 0644)
-	if err != nil {
-		log.Fatal(err)
-	}
-	if _, err := rc_f.WriteString(host.RootCertificate()); err != nil {
-		log.Fatal(err)
-	}
-	rc_f.Close() // Ensure the file is closed
-	hs_f, err := os.OpenFile(path.Join(contact_dir, id+"_hs"), os.O_CREATE|os.O_WRONLY, 0644)
-	if err != nil {
-		log.Fatal(err)
-	}
-	if _, err := hs_f.WriteString(host.HandshakeKeyCertificate()); err != nil {
-		log.Fatal(err)
-	}
-	hs_f.Close() // Ensure the file is closed
-	id_f, err := os.OpenFile(path.Join(contact_dir, id+"_id"), os.O_CREATE|os.O_WRONLY, 0644)
-	if err != nil {
-		log.Fatal(err)
-	}
-	if _, err := id_f.WriteString(host.ID()); err != nil {
-		log.Fatal(err)
-	}
-	id_f.Close() // Ensure the file is closed
+	WriteContactFile(contact_dir, id+"_rc", host.RootCertificate())
+	WriteContactFile(contact_dir, id+"_hs", host.HandshakeKeyCertificate())
+	WriteContactFile(contact_dir, id+"_id", host.ID())
 
-	scenario_runner := NewScenarioRunner(contact_dir, time_start, duration, scenario, host, output_path)
+	scenario_runner := NewScenarioRunner(contact_dir, time_start, duration, scenario, host, output_path, id)
 	scenario_runner.Run()
 }
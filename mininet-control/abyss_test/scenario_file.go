@@ -0,0 +1,189 @@
+package main
+
+import (
+	"bytes"
+	"encoding/binary"
+	"encoding/json"
+	"fmt"
+	"os"
+	"strconv"
+	"syscall"
+)
+
+// Compiled scenario, written by gen_scenario_scale() in
+// mininet-control/setup.py. One file holds the steps of every peer and is
+// mapped read-only by all of them, so only the page cache is shared and
+// each peer decodes just its own steps.
+//
+//	header   64 bytes, see below
+//	peers    [npeers]{first_step u64, nsteps u32, name_offset u32}
+//	steps    [nsteps]{time i32, action u16, reserved u16, target u32}
+//	names    NUL-terminated peer ids, name_offset is relative to names_offset
+//
+// A peer's steps are contiguous and in time order; time is seconds from
+// t_start and target a peer index, NoTarget for open. Integers are in the
+// writer's native byte order; sections start 8-byte aligned.
+const (
+	scenarioMagic      = "ABYSSCN\x00"
+	scenarioVersion    = 1
+	scenarioByteOrder  = 0x01020304
+	scenarioHeaderSize = 64
+	scenarioPeerSize   = 16
+	scenarioStepSize   = 12
+	NoTarget           = 0xFFFFFFFF
+)
+
+// Action is what a scenario step does
+type Action uint16
+
+const (
+	ActionOpen Action = 1
+	ActionAdd  Action = 2
+	ActionDial Action = 3
+	ActionJoin Action = 4
+)
+
+var actionNames = map[string]Action{"open": ActionOpen, "add": ActionAdd, "dial": ActionDial, "join": ActionJoin}
+
+// Step is one scenario action at a time offset from t_start (seconds)
+type Step struct {
+	Time   int64
+	Do     Action
+	Target uint32
+}
+
+// Scenario is the steps of one peer; Peers names the targets they refer to
+type Scenario struct {
+	Steps []Step
+	Peers map[uint32]string
+}
+
+// LoadScenario reads the steps of peer id from a compiled scenario, or
+// from a per-peer JSON scenario of {"time", "do", "id"} string objects.
+func LoadScenario(path string, id string) (*Scenario, error) {
+	f, err := os.Open(path)
+	if err != nil {
+		return nil, err
+	}
+	defer f.Close()
+	magic := make([]byte, len(scenarioMagic))
+	if n, _ := f.ReadAt(magic, 0); n == len(magic) && string(magic) == scenarioMagic {
+		return loadCompiledScenario(f, id)
+	}
+	data, err := os.ReadFile(path)
+	if err != nil {
+		return nil, err
+	}
+	return parseJSONScenario(data)
+}
+
+func loadCompiledScenario(f *os.File, id string) (*Scenario, error) {
+	st, err := f.Stat()
+	if err != nil {
+		return nil, err
+	}
+	if st.Size() < scenarioHeaderSize {
+		return nil, fmt.Errorf("%s: truncated header", f.Name())
+	}
+	data, err := syscall.Mmap(int(f.Fd()), 0, int(st.Size()), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return nil, err
+	}
+	defer syscall.Munmap(data)
+
+	ne := binary.NativeEndian
+	if ne.Uint32(data[8:]) != scenarioByteOrder {
+		return nil, fmt.Errorf("%s: byte order does not match this machine", f.Name())
+	}
+	if ne.Uint16(data[12:]) != scenarioVersion {
+		return nil, fmt.Errorf("%s: unsupported version %d", f.Name(), ne.Uint16(data[12:]))
+	}
+	npeers := uint64(ne.Uint32(data[16:]))
+	nsteps := ne.Uint64(data[24:])
+	peersOffset := ne.Uint64(data[32:])
+	stepsOffset := ne.Uint64(data[40:])
+	namesOffset := ne.Uint64(data[48:])
+	namesSize := ne.Uint64(data[56:])
+	size := uint64(len(data))
+	if peersOffset > size || npeers > (size-peersOffset)/scenarioPeerSize ||
+		stepsOffset > size || nsteps > (size-stepsOffset)/scenarioStepSize ||
+		namesOffset > size || namesSize > size-namesOffset {
+		return nil, fmt.Errorf("%s: sections out of bounds", f.Name())
+	}
+	names := data[namesOffset : namesOffset+namesSize]
+	name := func(offset uint32) []byte {
+		if uint64(offset) >= namesSize {
+			return nil
+		}
+		s := names[offset:]
+		if end := bytes.IndexByte(s, 0); end >= 0 {
+			s = s[:end]
+		}
+		return s
+	}
+
+	for p := uint64(0); p < npeers; p++ {
+		entry := data[peersOffset+p*scenarioPeerSize:]
+		if !bytes.Equal(name(ne.Uint32(entry[12:])), []byte(id)) {
+			continue
+		}
+		first := ne.Uint64(entry)
+		count := uint64(ne.Uint32(entry[8:]))
+		if first > nsteps || count > nsteps-first {
+			return nil, fmt.Errorf("%s: steps of %s out of bounds", f.Name(), id)
+		}
+		sc := &Scenario{Steps: make([]Step, 0, count), Peers: map[uint32]string{}}
+		for i := first; i < first+count; i++ {
+			raw := data[stepsOffset+i*scenarioStepSize:]
+			step := Step{
+				Time:   int64(int32(ne.Uint32(raw))),
+				Do:     Action(ne.Uint16(raw[4:])),
+				Target: ne.Uint32(raw[8:]),
+			}
+			if step.Target != NoTarget {
+				if uint64(step.Target) >= npeers {
+					return nil, fmt.Errorf("%s: step %d of %s has no target peer", f.Name(), i-first, id)
+				}
+				if _, ok := sc.Peers[step.Target]; !ok {
+					target := data[peersOffset+uint64(step.Target)*scenarioPeerSize:]
+					sc.Peers[step.Target] = string(name(ne.Uint32(target[12:])))
+				}
+			}
+			sc.Steps = append(sc.Steps, step)
+		}
+		return sc, nil
+	}
+	// A peer with nothing to do is not in the file
+	return &Scenario{Peers: map[uint32]string{}}, nil
+}
+
+func parseJSONScenario(data []byte) (*Scenario, error) {
+	var raw []map[string]string
+	if err := json.Unmarshal(data, &raw); err != nil {
+		return nil, err
+	}
+	sc := &Scenario{Steps: make([]Step, 0, len(raw)), Peers: map[uint32]string{}}
+	targets := map[string]uint32{}
+	for i, entry := range raw {
+		timestamp, err := strconv.ParseInt(entry["time"], 10, 64)
+		if err != nil {
+			return nil, fmt.Errorf("step %d has invalid timestamp '%s': %v", i, entry["time"], err)
+		}
+		do, ok := actionNames[entry["do"]]
+		if !ok {
+			return nil, fmt.Errorf("step %d has unknown action '%s'", i, entry["do"])
+		}
+		step := Step{Time: timestamp, Do: do, Target: NoTarget}
+		if do != ActionOpen {
+			target, ok := targets[entry["id"]]
+			if !ok {
+				target = uint32(len(targets))
+				targets[entry["id"]] = target
+				sc.Peers[target] = entry["id"]
+			}
+			step.Target = target
+		}
+		sc.Steps = append(sc.Steps, step)
+	}
+	return sc, nil
+}
@@ -1,11 +1,7 @@
 package main
 
 import (
-	"fmt"
 	"log"
-	"os"
-	"path"
-	"strconv"
 	"sync"
 	"time"
 
@@ -15,30 +11,30 @@ import (
 
 // ScenarioRunner executes a sequence of actions defined in a scenario
 type ScenarioRunner struct {
-	contact_dir string
-	time_start  int64
-	time_end    int64
-	scenario    []map[string]string
-	host        *ahost.AbyssHost
-	out_f       *os.File
+	contacts   *ContactTable
+	time_start int64
+	time_end   int64
+	scenario   []Step
+	host       *ahost.AbyssHost
+	events     *EventLog
 
 	world_mtx sync.Mutex
 	world     *and.World
 }
 
 // NewScenarioRunner creates a new ScenarioRunner with the given scenario and host
-func NewScenarioRunner(contact_dir string, time_start int64, duration int64, scenario []map[string]string, host *ahost.AbyssHost, output_path string) *ScenarioRunner {
-	out_f, err := os.Create(output_path)
+func NewScenarioRunner(contact_dir string, time_start int64, duration int64, scenario *Scenario, host *ahost.AbyssHost, output_path string, id string) *ScenarioRunner {
+	events, err := NewEventLog(output_path, id)
 	if err != nil {
-		log.Fatalf("Error reading scenario file: %v", err)
+		log.Fatalf("Error creating event log: %v", err)
 	}
 	return &ScenarioRunner{
-		contact_dir: contact_dir,
-		time_start:  time_start,
-		time_end:    time_start + duration,
-		scenario:    scenario,
-		host:        host,
-		out_f:       out_f,
+		contacts:   NewContactTable(contact_dir, scenario.Peers),
+		time_start: time_start,
+		time_end:   time_start + duration,
+		scenario:   scenario.Steps,
+		host:       host,
+		events:     events,
 	}
 }
 
@@ -46,20 +42,16 @@ func NewScenarioRunner(contact_dir string, time_start int64, duration int64, sce
 func (sr *ScenarioRunner) Run() error {
 	go sr.HandleEvents()
 
-	for i, step := range sr.scenario {
-		timeStr, ok := step["time"]
-		if !ok {
-			log.Printf("Warning: Step %d missing 'time' field, skipping", i)
-			continue
-		}
-
-		timestamp, err := strconv.ParseInt(timeStr, 10, 64)
-		if err != nil {
-			log.Printf("Error: Step %d has invalid timestamp '%s': %v", i, timeStr, err)
-			continue
-		}
+	// Every peer publishes its contact when it starts, before t_start;
+	// read them all once, the scenario's first step is at t_start or later
+	startTime := time.Unix(sr.time_start, 0)
+	if now := time.Now(); startTime.After(now) {
+		time.Sleep(startTime.Sub(now))
+	}
+	log.Printf("Preloaded %d of %d contacts", sr.contacts.Preload(), len(sr.contacts.peers))
 
-		target_timestamp := sr.time_start + timestamp
+	for _, step := range sr.scenario {
+		target_timestamp := sr.time_start + step.Time
 		if target_timestamp >= sr.time_end {
 			break
 		}
@@ -73,41 +65,25 @@ func (sr *ScenarioRunner) Run() error {
 		}
 
 		// Action
-		switch step["do"] {
-		case "add":
+		switch step.Do {
+		case ActionAdd:
 
-			peer_id := step["id"]
-			rc, err := os.ReadFile(path.Join(sr.contact_dir, peer_id+"_rc"))
-			if err != nil {
-				log.Fatalf("unable to read file: %v", err)
-			}
-			hs, err := os.ReadFile(path.Join(sr.contact_dir, peer_id+"_hs"))
-			if err != nil {
-				log.Fatalf("unable to read file: %v", err)
-			}
-			sr.host.AppendKnownPeer(string(rc), string(hs))
+			contact := sr.contacts.Get(step.Target)
+			sr.host.AppendKnownPeer(contact.RootCertificate, contact.HandshakeKeyCertificate)
 
-		case "dial":
+		case ActionDial:
 
-			peer_id := step["id"]
-			id_hash, err := os.ReadFile(path.Join(sr.contact_dir, peer_id+"_id"))
-			if err != nil {
-				log.Fatalf("unable to read file: %v", err)
-			}
-			sr.host.Dial(string(id_hash))
+			sr.host.Dial(sr.contacts.Get(step.Target).ID)
 
-		case "join":
+		case ActionJoin:
 
-			peer_id := step["id"]
-			id_hash, err := os.ReadFile(path.Join(sr.contact_dir, peer_id+"_id"))
-			if err != nil {
-				log.Fatalf("unable to read file: %v", err)
-			}
+			id_hash := sr.contacts.Get(step.Target).ID
+			var err error
 
 			sr.world_mtx.Lock()
 			if sr.world != nil {
 				sr.host.CloseWorld(sr.world) // This automatically frees world path
-				fmt.Fprintf(sr.out_f, "%d X %v\n", time.Now().UnixMilli(), sr.world.SessionID())
+				sr.events.Log('X', sr.world.SessionID())
 			}
 			sr.world = nil
 			sr.world_mtx.Unlock()
@@ -119,7 +95,7 @@ func (sr *ScenarioRunner) Run() error {
 				}
 
 				sr.world_mtx.Lock()
-				sr.world, err = sr.host.JoinWorld(string(id_hash), "/")
+				sr.world, err = sr.host.JoinWorld(id_hash, "/")
 				sr.world_mtx.Unlock()
 
 				if err == nil {
@@ -128,12 +104,12 @@ func (sr *ScenarioRunner) Run() error {
 				time.Sleep(time.Millisecond * 100)
 			}
 
-		case "open":
+		case ActionOpen:
 
 			sr.world_mtx.Lock()
 			if sr.world != nil {
 				sr.host.CloseWorld(sr.world) // This automatically frees world path
-				fmt.Fprintf(sr.out_f, "%d X %v\n", time.Now().UnixMilli(), sr.world.SessionID())
+				sr.events.Log('X', sr.world.SessionID())
 			}
 			sr.world = sr.host.OpenWorld("https://www.example.com")
 			sr.world_mtx.Unlock()
@@ -149,7 +125,7 @@ func (sr *ScenarioRunner) Run() error {
 		time.Sleep(waitDuration)
 	}
 
-	sr.out_f.Close()
+	sr.events.Close()
 	return nil
 }
 
@@ -169,7 +145,7 @@ func (sr *ScenarioRunner) HandleEvents() {
 
 			if sr.world != nil && sr.world.SessionID() == event.World.SessionID() {
 				sr.host.ExposeWorldForJoin(sr.world, "/") // this should not fail.
-				fmt.Fprintf(sr.out_f, "%d E %v\n", time.Now().UnixMilli(), event.World.SessionID())
+				sr.events.Log('E', event.World.SessionID())
 			}
 
 		case *and.EANDSessionRequest:
@@ -181,13 +157,13 @@ func (sr *ScenarioRunner) HandleEvents() {
 		case *and.EANDSessionReady:
 
 			if sr.world != nil && sr.world.SessionID() == event.World.SessionID() {
-				fmt.Fprintf(sr.out_f, "%d J %v\n", time.Now().UnixMilli(), event.SessionID)
+				sr.events.Log('J', event.SessionID)
 			}
 
 		case *and.EANDSessionClose:
 
 			if sr.world != nil && sr.world.SessionID() == event.World.SessionID() {
-				fmt.Fprintf(sr.out_f, "%d L %v\n", time.Now().UnixMilli(), event.SessionID)
+				sr.events.Log('L', event.SessionID)
 			}
 
 		case *and.EANDObjectAppend:
@@ -196,16 +172,16 @@ func (sr *ScenarioRunner) HandleEvents() {
 
 			if sr.world != nil && sr.world.SessionID() == event.World.SessionID() {
 				sr.world = nil
-				fmt.Fprintf(sr.out_f, "%d X %v\n", time.Now().UnixMilli(), event.World.SessionID())
+				sr.events.Log('X', event.World.SessionID())
 			}
 			// case *ahost.EPeerConnected:
-			// 	fmt.Fprintf(sr.out_f, "%d Cn %v\n", time.Now().UnixMilli(), event.PeerID)
+			// 	sr.events.Log('C', event.PeerID)
 			// case *ahost.EPeerDisconnected:
-			// 	fmt.Fprintf(sr.out_f, "%d Dc %v\n", time.Now().UnixMilli(), event.PeerID)
+			// 	sr.events.Log('D', event.PeerID)
 			// case *ahost.EPeerFound:
-			// 	fmt.Fprintf(sr.out_f, "%d Fd %v\n", time.Now().UnixMilli(), event.PeerID)
+			// 	sr.events.Log('F', event.PeerID)
 			// case *ahost.EPeerForgot:
-			// 	fmt.Fprintf(sr.out_f, "%d Fg %v\n", time.Now().UnixMilli(), event.PeerID)
+			// 	sr.events.Log('G', event.PeerID)
 		}
 
 		sr.world_mtx.Unlock()
@@ -5,13 +5,24 @@ ulimit -u 65535
 sudo sysctl -w fs.file-max=2097152
 sudo sysctl -w net.ipv4.ip_local_port_range="1024 65535"
 
+# setup.py writes the compiled scenario and reads the binary event logs, so
+# scenario_run has to be built from the sources next to it.
+(cd abyss_test && go build -o scenario_run .) || {
+    echo "run.sh: failed to build abyss_test/scenario_run" >&2
+    exit 1
+}
+mkdir -p ../bin
+gcc -o ../bin/ifcount -O2 ../utility/ifcount.c || {
+    echo "run.sh: failed to build ../bin/ifcount" >&2
+    exit 1
+}
+
 run_experiment() {
     N_PEERS=$1
     SEED=$2
 
     sudo rm -rf ./tmp
     mkdir -p ./tmp/contact
-    mkdir -p ./tmp/scenario
 
     sudo rm -rf ./results/$N_PEERS/$SEED
     mkdir -p ./results/$N_PEERS/$SEED
@@ -10,6 +10,10 @@ import json
 import math
 import random
 import argparse
+import shlex
+import struct
+import subprocess
+import threading
 import time
 
 # Add mininet to path
@@ -19,10 +23,11 @@ if module_path not in sys.path:
 
 from mininet.topo import Topo
 from mininet.net import Mininet
-from mininet.link import TCLink
+from mininet.link import Intf, Link
 from mininet.cli import CLI
 from mininet.log import setLogLevel
 from mininet.node import OVSBridge
+from mininet.util import quietRun
 
 
 # ------------------------------------------------------------------
@@ -44,8 +49,82 @@ parser.add_argument(
     default=None,
     help='Random seed for peer placement (default: None)'
 )
+parser.add_argument(
+    '--profile',
+    default=None,
+    help='Hour-of-day latency profiles from utility/pairprofile; replayed on the inter-city links (default: static network_stats)'
+)
+parser.add_argument(
+    '--start_hour',
+    type=int,
+    default=0,
+    help='UTC hour of day the scenario starts at, with --profile (default: 0)'
+)
+parser.add_argument(
+    '--hour_length',
+    type=float,
+    default=3600.0,
+    help='Scenario seconds per profile hour, with --profile (default: 3600)'
+)
+parser.add_argument(
+    '--topology',
+    choices=['mesh', 'hub'],
+    default='mesh',
+    help='mesh: every city pair linked; hub: cities attach to regional hubs on a backbone mesh (default: mesh)'
+)
+parser.add_argument(
+    '--hubs',
+    default=None,
+    help='With --topology hub, number of hubs or comma-separated hub cities (default: 1.5 sqrt of city count)'
+)
+parser.add_argument(
+    '--dist_dir',
+    default=None,
+    help='Directory of netem delay distributions from utility/pairdist (default: netem default jitter)'
+)
+parser.add_argument(
+    '--cluster',
+    default=None,
+    help='Cluster description (JSON) to spread the cities over several machines; run on the controller (default: single host)'
+)
+parser.add_argument(
+    '--machine',
+    default=None,
+    help='With --cluster, run as the worker for this machine (set by the controller)'
+)
+parser.add_argument(
+    '--t_start',
+    type=int,
+    default=None,
+    help='With --machine, scenario start time chosen by the controller'
+)
+parser.add_argument(
+    '--duration',
+    type=int,
+    default=None,
+    help='With --machine, scenario duration chosen by the controller'
+)
+parser.add_argument(
+    '--bringup_lead',
+    type=int,
+    default=120,
+    help='With --cluster, seconds the workers get to bring up their part before the scenario starts (default: 120)'
+)
+parser.add_argument(
+    '--delay_classes',
+    type=float,
+    default=None,
+    metavar='BAND_MS',
+    help='Shape access links per city and BAND_MS-wide band of peer delay with shared netem classes on the router, '
+         'instead of netem on every peer link (default: per-peer netem)'
+)
 args = parser.parse_args()
 
+# Every machine of a cluster must place the same peers, so the controller
+# fixes a seed and passes it on
+if args.cluster and args.seed is None:
+    args.seed = random.SystemRandom().randrange(2**31)
+
 # Initialize random seed if provided
 if args.seed is not None:
     random.seed(args.seed)
@@ -107,45 +186,696 @@ CITY_NUMBERS = {abbr: idx + 1 for idx, abbr in enumerate(CITY_ABBRS)}  # Map abb
 LINK_ID_MAP = preprocess_city_links(CITY_CONFIG)
 
 
-def generate_peer_placements(n):
+REFRACTION_COEFFICIENT = 1.5
+DISTANCE_MULTIPLIER = 1.5
+def distance_to_delay(dist_km:float) -> float :
+    return (dist_km * DISTANCE_MULTIPLIER) / (299_792.458 / REFRACTION_COEFFICIENT) * 1000
+
+def alias_table(weights):
+    """
+    Build Vose's alias table, so that a weighted draw costs one uniform
+    number instead of a search through the cumulative weights.
+    
+    Returns:
+        (prob, alias) lists: column i is kept with probability prob[i],
+        otherwise alias[i] is drawn
+    """
+    n = len(weights)
+    total = sum(weights)
+    scaled = [w * n / total for w in weights]
+    prob = [1.0] * n
+    alias = list(range(n))
+    small = [i for i, p in enumerate(scaled) if p < 1.0]
+    large = [i for i, p in enumerate(scaled) if p >= 1.0]
+    while small and large:
+        s = small.pop()
+        l = large.pop()
+        prob[s] = scaled[s]
+        alias[s] = l
+        scaled[l] -= 1.0 - scaled[s]
+        (small if scaled[l] < 1.0 else large).append(l)
+    # Whatever is left is 1 up to rounding
+    return prob, alias
+
+def generate_peer_placements(n, seed):
     """
     Generate N peer placements by selecting cities and distances.
     
     Cities are selected with probability proportional to population.
     Distances are selected uniformly in 2D space within each city's circular area.
+    Placements come from their own generator, so a seed always places the
+    same peers and the scenario draws from the global one are not shifted
+    by the number of peers.
     
     Args:
         n: Number of peers to generate
+        seed: Seed of the placement, or None for a random one
         
     Returns:
-        List of tuples (city_abbr: str, distance: float)
+        List of tuples (city_abbr: str, distance: float, delay_ms: float)
     """
-    populations = [CITY_CONFIG[city]['population'] for city in CITY_ABBRS]
-    total_population = sum(populations)
+    rng = random.Random(f'placement-{seed}') if seed is not None else random.Random()
+    prob, alias = alias_table([CITY_CONFIG[city]['population'] for city in CITY_ABBRS])
+    n_cities = len(CITY_ABBRS)
     
-    # Calculate probability weights for each city
-    weights = [pop / total_population for pop in populations]
-    
-    placements = []
+    # Select cities with probability proportional to population
+    cities = []
     for _ in range(n):
-        # Select city with probability proportional to population
-        city_abbr = random.choices(CITY_ABBRS, weights=weights, k=1)[0]
+        u = rng.random() * n_cities
+        column = int(u)
+        cities.append(column if u - column < prob[column] else alias[column])
+    
+    # Select distance uniformly in 2D circular area
+    # For uniform distribution in a circle, distance ~ sqrt(uniform(0,1)) * radius
+    radii = [CITY_CONFIG[city]['radius'] for city in CITY_ABBRS]
+    distances = [math.sqrt(rng.random()) * radii[city] for city in cities]
+    delays = map(distance_to_delay, distances)
+    
+    return [(CITY_ABBRS[city], distance, delay_ms) for city, distance, delay_ms in zip(cities, distances, delays)]
+
+def write_placements(path, placements):
+    """Write the placements as a TSV, one peer per line in peer order."""
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    with open(path, 'w') as f:
+        f.write('peer\tcity\tdistance_km\tdelay_ms\n')
+        for peer_idx, (city_abbr, distance, delay_ms) in enumerate(placements):
+            f.write(f'h{peer_idx + 1}\t{city_abbr}\t{distance:.6f}\t{delay_ms:.6f}\n')
+
+PEER_CONFIG = generate_peer_placements(args.n_peers, args.seed)
+
+
+# ------------------------------------------------------------------
+# Link Latency Profiles
+# ------------------------------------------------------------------
+
+# Layout of utility/pairprof.h: header, pairs of (a, b, 24 hour slots of
+# count/mean/stddev), then the NUL-terminated name list.
+PROFILE_MAGIC = b'RIPEPRF\0'
+PROFILE_HEADER = struct.Struct('=8sIHHQQQQQQ')
+PROFILE_SLOT = struct.Struct('=Iff')
+PROFILE_MIN_SAMPLES = 10  # fewer samples in an hour fall back to network_stats
+
+def load_link_profiles(path):
+    """
+    Load hour-of-day RTT profiles written by utility/pairprofile.
+    Names must be city abbreviations (pairprofile -m with a city map).
+    
+    Args:
+        path: Profile table path, or None
+        
+    Returns:
+        Dictionary mapping (city1, city2) tuples to 24 (mean_rtt, stddev_rtt)
+        tuples, None for hours with too few samples
+    """
+    if path is None:
+        return {}
+    try:
+        with open(path, 'rb') as f:
+            data = f.read()
+        (magic, byte_order, version, hours, n_names, n_pairs, _,
+         pairs_offset, names_offset, names_size) = PROFILE_HEADER.unpack_from(data, 0)
+    except (OSError, struct.error) as e:
+        print(f'Error: Cannot read profile {path}: {e}')
+        sys.exit(1)
+    if magic != PROFILE_MAGIC or byte_order != 0x01020304 or version != 1 or hours != 24:
+        print(f'Error: {path} is not a version 1 profile table of this byte order')
+        sys.exit(1)
+
+    names = data[names_offset:names_offset + names_size].decode().split('\0')[:n_names]
+    pair_size = 8 + PROFILE_SLOT.size * hours
+    profiles = {}
+    for i in range(n_pairs):
+        offset = pairs_offset + i * pair_size
+        a, b = struct.unpack_from('=II', data, offset)
+        slots = []
+        for hour in range(hours):
+            count, mean, stddev = PROFILE_SLOT.unpack_from(data, offset + 8 + hour * PROFILE_SLOT.size)
+            slots.append((mean, stddev) if count >= PROFILE_MIN_SAMPLES else None)
+        # Store both orderings for easy lookup
+        profiles[(names[a], names[b])] = slots
+        profiles[(names[b], names[a])] = slots
+
+    covered = sum(1 for (c1, c2) in LINK_ID_MAP if (c1, c2) in profiles) // 2
+    print(f'Loaded {n_pairs} latency profiles from {path}, covering {covered} of {len(LINK_ID_MAP) // 2} city links')
+    return profiles
+
+LINK_PROFILES = load_link_profiles(args.profile)
+
+def load_link_distributions(dist_dir):
+    """
+    Load the index of netem distribution tables written by utility/pairdist.
+    Names must be city abbreviations (pairdist -m with a city map).
+    
+    Args:
+        dist_dir: Directory holding index.tsv and the .dist tables, or None
+        
+    Returns:
+        Dictionary mapping (city1, city2) tuples to (stddev_rtt, jitter_rtt,
+        table name) tuples
+    """
+    if dist_dir is None:
+        return {}
+    index_path = os.path.join(dist_dir, 'index.tsv')
+    tables = {}
+    try:
+        with open(index_path) as f:
+            next(f)  # header
+            for line in f:
+                city1, city2, _, _, stddev, jitter, table = line.rstrip('\n').split('\t')
+                # Store both orderings for easy lookup
+                tables[(city1, city2)] = (float(stddev), float(jitter), table)
+                tables[(city2, city1)] = tables[(city1, city2)]
+    except (OSError, StopIteration, ValueError) as e:
+        print(f'Error: Cannot read distribution index {index_path}: {e}')
+        sys.exit(1)
+
+    covered = sum(1 for (c1, c2) in LINK_ID_MAP if (c1, c2) in tables) // 2
+    print(f'Loaded distribution index {index_path}, covering {covered} of {len(LINK_ID_MAP) // 2} city links')
+    return tables
+
+LINK_DISTRIBUTIONS = load_link_distributions(args.dist_dir)
+# tc looks distribution tables up in TC_LIB_DIR
+DIST_DIR = os.path.abspath(args.dist_dir) if args.dist_dir else None
+
+def link_rtt(city1, city2, hour):
+    """
+    Measured RTT between two cities at an hour of day: the profile slot
+    when there is one, else the static network_stats.
+    
+    Returns:
+        Tuple (mean_rtt, stddev_rtt) in ms
+    """
+    slots = LINK_PROFILES.get((city1, city2))
+    slot = slots[hour % 24] if slots else None
+    if slot is None:
+        stats = CITY_CONFIG[city1]['network_stats'][city2]
+        slot = (stats['mean'], stats['stddev'])
+    return slot
+
+def link_delay(city1, city2, hour):
+    """
+    Delay of each end of an inter-city link at an hour of day, and the
+    jitter of its round trip. With a distribution table the jitter is that
+    table's netem scale.
+    
+    Returns:
+        Tuple (delay_ms, jitter_ms)
+    """
+    mean_rtt, stddev_rtt = link_rtt(city1, city2, hour)
+    dist = LINK_DISTRIBUTIONS.get((city1, city2))
+    if dist is not None:
+        # Tables are standardized by jitter, not stddev, to keep the tail
+        table_stddev, table_jitter, _ = dist
+        stddev_rtt *= table_jitter / table_stddev
+    # Each end delays by RTT / 2; the stddev is the jitter of the round trip
+    return mean_rtt / 2.0, stddev_rtt
+
+def netem_args(delay_ms, jitter_ms, end, offset_ms=0.0, table=None):
+    """
+    netem arguments of end 1 or 2 of a link.
+    
+    Both ends add the constant delay. Without a table each end draws half
+    the jitter from netem's default distribution, as links always have.
+    With one only end 1 draws, once per round trip: a draw on each end
+    would add two independent draws, which smooths the table's shape.
+    offset_ms is taken off the delay for what the link adds by itself (the
+    underlay of a cross-host tunnel).
+    """
+    netem = f'netem delay {max(0.0, delay_ms - offset_ms):.2f}ms'
+    if table is None:
+        netem += f' {jitter_ms / 2.0:.2f}ms'
+    elif end == 1:
+        netem += f' {jitter_ms:.2f}ms distribution {table}'
+    return netem
+
+def link_netem(city1, city2, hour, end, offset_ms=0.0):
+    """netem arguments of end 1 (city1) or 2 of an inter-city link at an hour of day."""
+    delay_ms, jitter_ms = link_delay(city1, city2, hour)
+    dist = LINK_DISTRIBUTIONS.get((city1, city2))
+    return netem_args(delay_ms, jitter_ms, end, offset_ms, dist[2] if dist is not None else None)
+
+
+# ------------------------------------------------------------------
+# Hierarchical Topology
+# ------------------------------------------------------------------
+
+# Embedding fit: coordinate descent sweeps and convergence threshold (ms)
+EMBED_SWEEPS = 200
+EMBED_TOLERANCE = 1e-4
+
+def choose_hubs(n_hubs):
+    """
+    Pick hub cities as k-medoids of the RTT matrix: greedy build, then
+    swaps while they lower the total RTT of cities to their nearest hub.
+    
+    Args:
+        n_hubs: Number of hubs
         
-        # Select distance uniformly in 2D circular area
-        # For uniform distribution in a circle, distance ~ sqrt(uniform(0,1)) * radius
-        city_radius = CITY_CONFIG[city_abbr]['radius']
-        distance = math.sqrt(random.random()) * city_radius
+    Returns:
+        List of hub city abbreviations
+    """
+    def rtt(c1, c2):
+        return 0.0 if c1 == c2 else CITY_CONFIG[c1]['network_stats'][c2]['mean']
+
+    def cost(hubs):
+        return sum(min(rtt(c, h) for h in hubs) for c in CITY_ABBRS)
+
+    hubs = []
+    while len(hubs) < n_hubs:
+        hubs.append(min((c for c in CITY_ABBRS if c not in hubs), key=lambda c: cost(hubs + [c])))
+
+    best = cost(hubs)
+    improved = True
+    while improved:
+        improved = False
+        for i in range(len(hubs)):
+            for c in CITY_ABBRS:
+                if c in hubs:
+                    continue
+                candidate = hubs[:i] + [c] + hubs[i + 1:]
+                candidate_cost = cost(candidate)
+                if candidate_cost < best - 1e-9:
+                    hubs, best, improved = candidate, candidate_cost, True
+    return hubs
+
+def plan_hub_topology():
+    """
+    Plan the hub topology: hubs, the hub of every city, and the peer network
+    number of every city. Cities of a region get a contiguous, aligned block
+    of networks so a region is routed as one aggregated prefix.
+    
+    Returns:
+        Dictionary with hubs, hub_of (city -> hub), regions (hub -> cities),
+        nets (city -> second octet of its 20.x.0.0/16) and prefixes
+        (hub -> aggregated prefix of its region)
+    """
+    if args.hubs is None:
+        # About 1.5 sqrt(C) hubs keeps both tiers O(C) links
+        hubs = choose_hubs(min(math.ceil(1.5 * math.sqrt(len(CITY_ABBRS))), len(CITY_ABBRS)))
+    elif args.hubs.isdigit():
+        hubs = choose_hubs(min(max(1, int(args.hubs)), len(CITY_ABBRS)))
+    else:
+        hubs = args.hubs.split(',')
+        unknown = [h for h in hubs if h not in CITY_CONFIG]
+        if unknown:
+            print(f'Error: Unknown hub cities: {", ".join(unknown)}')
+            sys.exit(1)
+
+    hub_of = {c: (c if c in hubs else min(hubs, key=lambda h: CITY_CONFIG[c]['network_stats'][h]['mean']))
+              for c in CITY_ABBRS}
+    regions = {h: [c for c in CITY_ABBRS if hub_of[c] == h] for h in hubs}
+
+    # Region block: the next power of two covering the largest region
+    block_bits = max(len(cities) for cities in regions.values()).bit_length()
+    if len(hubs) << block_bits > 256:
+        print(f'Error: {len(hubs)} regions of up to {1 << block_bits} cities do not fit in 20.0.0.0/8')
+        sys.exit(1)
+    nets = {}
+    prefixes = {}
+    for r, h in enumerate(hubs):
+        prefixes[h] = f'20.{r << block_bits}.0.0/{16 - block_bits}'
+        for j, c in enumerate(regions[h]):
+            nets[c] = (r << block_bits) + j
+
+    print(f'Hub topology: {len(hubs)} hubs ({", ".join(hubs)}), '
+          f'{len(CITY_ABBRS) - len(hubs)} access links, {len(hubs) * (len(hubs) - 1) // 2} backbone links')
+    return {'hubs': hubs, 'hub_of': hub_of, 'regions': regions, 'nets': nets, 'prefixes': prefixes}
+
+HUB_PLAN = plan_hub_topology() if args.topology == 'hub' else None
+
+def tier_path(c1, c2):
+    """Tier links on the route between two cities, as (kind, key) tuples."""
+    h1, h2 = HUB_PLAN['hub_of'][c1], HUB_PLAN['hub_of'][c2]
+    path = []
+    if c1 != h1:
+        path.append(('access', c1))
+    if c2 != h2:
+        path.append(('access', c2))
+    if h1 != h2:
+        path.append(('backbone', tuple(sorted((h1, h2)))))
+    return path
+
+def fit_tier_edges(measured):
+    """
+    Fit non-negative tier link weights so that the sum along every city
+    pair's route matches the measurement, in relative least squares.
+    Every route uses a weight with coefficient one, so each coordinate
+    step has a closed form: the weighted mean of what the pairs leave for it.
+    
+    Args:
+        measured: Dictionary mapping (city1, city2) to the value of the route
         
-        placements.append((city_abbr, distance))
+    Returns:
+        Dictionary mapping tier links to weights
+    """
+    paths = {pair: tier_path(*pair) for pair in measured}
+    uses = {}
+    for pair, path in paths.items():
+        for edge in path:
+            uses.setdefault(edge, []).append(pair)
+    # Start from the direct measurement of the link's own endpoints
+    weights = {}
+    for edge in uses:
+        c1, c2 = (edge[1], HUB_PLAN['hub_of'][edge[1]]) if edge[0] == 'access' else edge[1]
+        weights[edge] = measured.get((c1, c2), measured.get((c2, c1), 0.0))
+
+    for _ in range(EMBED_SWEEPS):
+        change = 0.0
+        for edge, pairs in uses.items():
+            num = den = 0.0
+            for pair in pairs:
+                target = measured[pair]
+                if target <= 0:
+                    continue
+                rest = sum(weights[e] for e in paths[pair] if e != edge)
+                w = 1.0 / (target * target)
+                num += w * (target - rest)
+                den += w
+            value = max(0.0, num / den) if den > 0 else weights[edge]
+            change = max(change, abs(value - weights[edge]))
+            weights[edge] = value
+        if change < EMBED_TOLERANCE:
+            break
+    return weights
+
+_tier_cache = {}
+
+def tier_embedding(hour):
+    """
+    Mean RTT and stddev of every tier link at an hour of day, embedding the
+    measured city RTT matrix into the hub topology. Means add along a route;
+    so do variances, which is how stddev is fitted.
     
-    return placements
+    Returns:
+        Dictionary mapping tier links to (mean_rtt, stddev_rtt)
+    """
+    key = hour % 24 if LINK_PROFILES else 0
+    if key not in _tier_cache:
+        means, variances = {}, {}
+        for i, c1 in enumerate(CITY_ABBRS):
+            for c2 in CITY_ABBRS[i + 1:]:
+                mean_rtt, stddev_rtt = link_rtt(c1, c2, hour)
+                means[(c1, c2)] = mean_rtt
+                variances[(c1, c2)] = stddev_rtt * stddev_rtt
+        mean_w = fit_tier_edges(means)
+        var_w = fit_tier_edges(variances)
+        _tier_cache[key] = {edge: (mean_w[edge], math.sqrt(var_w.get(edge, 0.0))) for edge in mean_w}
 
-PEER_CONFIG = generate_peer_placements(args.n_peers)
+        errors = [abs(sum(mean_w[e] for e in tier_path(*pair)) - m) / m
+                  for pair, m in means.items() if m > 0]
+        print(f'  Tier embedding (hour {key:02d}): mean RTT error {100 * sum(errors) / len(errors):.1f}%, '
+              f'max {100 * max(errors):.1f}%')
+    return _tier_cache[key]
+
+def topology_link_delay(link_info, hour):
+    """Delay of each end and round-trip jitter of any inter-router link of either topology."""
+    if 'tier' not in link_info:
+        return link_delay(link_info['city1'], link_info['city2'], hour)
+    mean_rtt, stddev_rtt = tier_embedding(hour)[link_info['tier']]
+    return mean_rtt / 2.0, stddev_rtt
+
+def topology_link_netem(link_info, hour, end):
+    """netem arguments of end 1 (intf1) or 2 of any inter-router link of either topology."""
+    # A tunnel end already carries half the underlay RTT
+    offset_ms = CLUSTER['underlay_rtt_ms'] / 2.0 if 'tunnel' in link_info else 0.0
+    if 'tier' not in link_info:
+        return link_netem(link_info['city1'], link_info['city2'], hour, end, offset_ms)
+    delay_ms, jitter_ms = topology_link_delay(link_info, hour)
+    return netem_args(delay_ms, jitter_ms, end, offset_ms)
+
+def city_net(city_abbr):
+    """Second octet of the city's peer network 20.x.0.0/16."""
+    return HUB_PLAN['nets'][city_abbr] if HUB_PLAN else CITY_NUMBERS[city_abbr]
+
+if HUB_PLAN and LINK_DISTRIBUTIONS:
+    print('Note: distribution tables are per city pair and are not used by the hub topology')
+
+def topology_links():
+    """
+    Inter-router links of the chosen topology, in link ID order.
+    
+    Returns:
+        List of (city1, city2, link_id, tier) tuples; tier is the tier link
+        key in the hub topology, None in the mesh
+    """
+    links = []
+    if HUB_PLAN:
+        # Non-hub cities attach to their hub; hubs form the backbone mesh
+        hubs = HUB_PLAN['hubs']
+        for city_abbr in CITY_ABBRS:
+            hub = HUB_PLAN['hub_of'][city_abbr]
+            if hub != city_abbr:
+                links.append((city_abbr, hub, len(links) + 1, ('access', city_abbr)))
+        for i, hub1 in enumerate(hubs):
+            for hub2 in hubs[i + 1:]:
+                links.append((hub1, hub2, len(links) + 1, ('backbone', tuple(sorted((hub1, hub2))))))
+    else:
+        # Fully-connected mesh with the pre-assigned incremental link IDs
+        for i, city1 in enumerate(CITY_ABBRS):
+            for city2 in CITY_ABBRS[i + 1:]:
+                links.append((city1, city2, LINK_ID_MAP[(city1, city2)], None))
+    return links
+
+if len(topology_links()) > 255:
+    # Also the hub mode: --hubs 25 alone makes a backbone of 300 links
+    print(f'Error: the {args.topology} topology of {len(CITY_ABBRS)} cities needs {len(topology_links())} links, '
+          f'more than the 10.{{link_id}}.0.0/30 plan holds; '
+          + ('use fewer --hubs' if HUB_PLAN else 'use --topology hub'))
+    sys.exit(1)
 
-REFRACTION_COEFFICIENT = 1.5
-DISTANCE_MULTIPLIER = 1.5
-def distance_to_delay(dist_km:float) -> float :
-    return (dist_km * DISTANCE_MULTIPLIER) / (299_792.458 / REFRACTION_COEFFICIENT) * 1000
+
+# ------------------------------------------------------------------
+# Multi-Host Cluster
+# ------------------------------------------------------------------
+
+# A machine may take this much more than its weighted share of the load
+PARTITION_SLACK = 0.1
+PARTITION_PASSES = 20
+
+# Overhead of the tunnel encapsulations, taken off the cross-host link MTU
+TUNNEL_OVERHEAD = {'vxlan': 50, 'gretap': 38}
+VXLAN_PORT = 4789
+
+def load_cluster(path):
+    """
+    Load the cluster description.
+    
+    The file is a JSON object:
+        machines        list of {name, address, ssh, workdir, weight}; address
+                        is the underlay address tunnels run between, ssh the
+                        login the controller uses (default: address), workdir
+                        this directory on that machine (default: the
+                        controller's), weight its share of the load (default: 1)
+        underlay_rtt_ms RTT between the machines, taken off the netem delay of
+                        cross-host links (default: 0)
+        tunnel          'vxlan' or 'gretap' (default: vxlan)
+        contact_dir     contact directory of the peers; must be one directory
+                        shared by all machines, e.g. on NFS (default: ./tmp/contact)
+    
+    Args:
+        path: Cluster file, or None for a single host
+        
+    Returns:
+        Cluster dictionary with defaults filled in, or None
+    """
+    if path is None:
+        return None
+    try:
+        with open(path) as f:
+            cluster = json.load(f)
+    except FileNotFoundError:
+        print(f'Error: Cluster file not found: {path}')
+        sys.exit(1)
+    except json.JSONDecodeError as e:
+        print(f'Error: Invalid JSON in {path}: {e}')
+        sys.exit(1)
+    
+    machines = cluster.get('machines', [])
+    names = [machine.get('name') for machine in machines]
+    if not machines or None in names or len(set(names)) != len(names):
+        print(f'Error: {path} must list machines with unique names')
+        sys.exit(1)
+    for machine in machines:
+        if 'address' not in machine:
+            print(f"Error: Machine {machine['name']} in {path} has no address")
+            sys.exit(1)
+        machine.setdefault('ssh', machine['address'])
+        machine.setdefault('workdir', os.getcwd())
+        machine.setdefault('weight', 1.0)
+    cluster.setdefault('underlay_rtt_ms', 0.0)
+    cluster.setdefault('tunnel', 'vxlan')
+    cluster.setdefault('contact_dir', './tmp/contact')
+    if cluster['tunnel'] not in TUNNEL_OVERHEAD:
+        print(f"Error: Unknown tunnel type in {path}: {cluster['tunnel']}")
+        sys.exit(1)
+    if args.machine is not None and args.machine not in names:
+        print(f'Error: Machine {args.machine} is not in {path}')
+        sys.exit(1)
+    print(f'Loaded cluster {path}: {len(machines)} machines')
+    return cluster
+
+def partition_cities(machines, links):
+    """
+    Assign every city, with its router, switch and peers, to a machine.
+    
+    A city's load is its router plus its peers, and each machine takes a
+    share of the total in proportion to its weight. A link between two
+    machines runs over the underlay, whose RTT can only be taken off the
+    netem delay while the link is longer than it, and the relative error is
+    largest on short links; so the cut is the sum of 1/RTT over the links
+    it separates. Cities are placed heaviest first next to their strongest
+    neighbours, then moved and swapped while that lowers the cut.
+    
+    Args:
+        machines: Cluster machines
+        links: Inter-router links from topology_links()
+        
+    Returns:
+        Dictionary {city_abbr: machine name}
+    """
+    names = [machine['name'] for machine in machines]
+    load = {city_abbr: 1 for city_abbr in CITY_ABBRS}
+    for city_abbr, _, _ in PEER_CONFIG:
+        load[city_abbr] += 1
+    total_weight = sum(machine['weight'] for machine in machines)
+    capacity = {machine['name']: sum(load.values()) * machine['weight'] / total_weight * (1 + PARTITION_SLACK)
+                for machine in machines}
+    
+    neighbours = {city_abbr: {} for city_abbr in CITY_ABBRS}
+    for city1, city2, link_id, tier in links:
+        link_info = {'city1': city1, 'city2': city2} if tier is None else {'city1': city1, 'city2': city2, 'tier': tier}
+        rtt = 2.0 * topology_link_delay(link_info, args.start_hour)[0]
+        neighbours[city1][city2] = neighbours[city2][city1] = 1.0 / max(rtt, 0.1)
+    
+    machine_of = {}
+    used = {name: 0 for name in names}
+    
+    def attach(city_abbr, name):
+        return sum(w for other, w in neighbours[city_abbr].items() if machine_of.get(other) == name)
+    
+    for city_abbr in sorted(CITY_ABBRS, key=lambda c: -load[c]):
+        fits = [name for name in names if used[name] + load[city_abbr] <= capacity[name]] or names
+        best = max(fits, key=lambda name: (attach(city_abbr, name), -used[name] / capacity[name]))
+        machine_of[city_abbr] = best
+        used[best] += load[city_abbr]
+    
+    for _ in range(PARTITION_PASSES):
+        improved = False
+        for city_abbr in CITY_ABBRS:
+            here = machine_of[city_abbr]
+            best, best_gain = None, 1e-12
+            for name in names:
+                if name != here and used[name] + load[city_abbr] <= capacity[name]:
+                    gain = attach(city_abbr, name) - attach(city_abbr, here)
+                    if gain > best_gain:
+                        best, best_gain = (name, None), gain
+            for other in CITY_ABBRS:
+                there = machine_of[other]
+                if there == here:
+                    continue
+                if (used[there] - load[other] + load[city_abbr] > capacity[there] or
+                        used[here] - load[city_abbr] + load[other] > capacity[here]):
+                    continue
+                # A link between the two stays cut after the swap
+                gain = (attach(city_abbr, there) - attach(city_abbr, here) + attach(other, here) -
+                        attach(other, there) - 2 * neighbours[city_abbr].get(other, 0.0))
+                if gain > best_gain:
+                    best, best_gain = (there, other), gain
+            if best is None:
+                continue
+            there, other = best
+            machine_of[city_abbr] = there
+            used[here] -= load[city_abbr]
+            used[there] += load[city_abbr]
+            if other is not None:
+                machine_of[other] = here
+                used[there] -= load[other]
+                used[here] += load[other]
+            improved = True
+        if not improved:
+            break
+    return machine_of
+
+def report_partition(links):
+    """Print the partition and how the cut links compare with the underlay RTT."""
+    for machine in CLUSTER['machines']:
+        cities = [city_abbr for city_abbr in CITY_ABBRS if MACHINE_OF[city_abbr] == machine['name']]
+        peers = sum(1 for city_abbr, _, _ in PEER_CONFIG if MACHINE_OF[city_abbr] == machine['name'])
+        print(f"  {machine['name']}: {len(cities)} cities, {peers} peers ({', '.join(cities)})")
+    underlay = CLUSTER['underlay_rtt_ms']
+    cut_rtts = []
+    for city1, city2, link_id, tier in links:
+        if MACHINE_OF[city1] == MACHINE_OF[city2]:
+            continue
+        link_info = {'city1': city1, 'city2': city2} if tier is None else {'city1': city1, 'city2': city2, 'tier': tier}
+        cut_rtts.append(2.0 * topology_link_delay(link_info, args.start_hour)[0])
+    if cut_rtts:
+        # Links shorter than the underlay cannot be made up for by netem
+        short = sum(1 for rtt in cut_rtts if rtt < underlay)
+        print(f'  {len(cut_rtts)} of {len(links)} links cross machines, shortest {min(cut_rtts):.1f} ms RTT; '
+              f'{short} shorter than the {underlay:g} ms underlay')
+
+def is_local(city_abbr):
+    """Whether the city's router runs on this machine."""
+    return MACHINE_OF is None or MACHINE_OF[city_abbr] == args.machine
+
+CLUSTER = load_cluster(args.cluster)
+MACHINES = {machine['name']: machine for machine in CLUSTER['machines']} if CLUSTER else {}
+MACHINE_OF = partition_cities(CLUSTER['machines'], topology_links()) if CLUSTER else None
+if CLUSTER:
+    report_partition(topology_links())
+
+# With --delay_classes every class takes an aligned block of the upper half
+# of the city's /16, so one prefix filter matches all of its peers
+DELAY_CLASS_BASE = 0x8000
+
+def plan_delay_classes(band_ms):
+    """
+    Group the peers of every city into delay classes of band_ms width and
+    number them by class.
+    
+    A class delays by the mean of its peers' delays, so no peer is off by
+    more than band_ms. All classes of a city get blocks of one size, the
+    smallest power of two that holds the largest class.
+    
+    Returns:
+        Dictionary with 'peers': per peer, a (class index, IP address)
+        tuple, and 'classes': per city, a list of (prefix, delay_ms) tuples
+    """
+    if band_ms <= 0:
+        print('Error: --delay_classes needs a positive band width')
+        sys.exit(1)
+    bands = {city_abbr: {} for city_abbr in CITY_ABBRS}
+    for peer_idx, (city_abbr, _, delay_ms) in enumerate(PEER_CONFIG):
+        bands[city_abbr].setdefault(int(delay_ms // band_ms), []).append(peer_idx)
+    
+    peers = [None] * len(PEER_CONFIG)
+    classes = {}
+    for city_abbr in CITY_ABBRS:
+        city_bands = [bands[city_abbr][band] for band in sorted(bands[city_abbr])]
+        classes[city_abbr] = []
+        if not city_bands:
+            continue
+        # The last address of a block stays free, so no peer gets the
+        # broadcast address of the /16
+        bits = max(len(members) for members in city_bands).bit_length()
+        if len(city_bands) << bits > 0x10000 - DELAY_CLASS_BASE:
+            print(f'Error: {len(city_bands)} delay classes of up to {(1 << bits) - 1} peers do not fit in '
+                  f'{CITY_NAMES[city_abbr]}; use a wider band')
+            sys.exit(1)
+        net = city_net(city_abbr)
+        for class_idx, members in enumerate(city_bands):
+            base = DELAY_CLASS_BASE + (class_idx << bits)
+            delay_ms = sum(PEER_CONFIG[peer_idx][2] for peer_idx in members) / len(members)
+            classes[city_abbr].append((f'20.{net}.{base >> 8}.{base & 255}/{32 - bits}', delay_ms))
+            for offset, peer_idx in enumerate(members, base):
+                peers[peer_idx] = (class_idx, f'20.{net}.{offset >> 8}.{offset & 255}')
+    
+    n_classes = sum(len(city_classes) for city_classes in classes.values())
+    print(f'Planned {n_classes} delay classes of {band_ms:g} ms for {len(PEER_CONFIG)} peers')
+    return {'peers': peers, 'classes': classes}
+
+DELAY_CLASSES = plan_delay_classes(args.delay_classes) if args.delay_classes is not None else None
 
 # ------------------------------------------------------------------
 # Topology Class
@@ -154,9 +884,50 @@ def distance_to_delay(dist_km:float) -> float :
 class GlobalWANTopo(Topo):
     """
     Global WAN topology with 19 cities.
-    Each city has a router (host with IP forwarding), fully connected with realistic latencies.
+    Each city has a router (host with IP forwarding), fully connected with realistic latencies,
+    or with --topology hub attached to a regional hub on a backbone mesh.
     """
 
+    def add_router_link(self, city1, city2, link_id, tier=None):
+        """
+        Link two city routers with named interfaces for explicit routing.
+        netem is set up by configure_routers(). When only one of the routers
+        runs on this machine the link is a tunnel to the other one's machine,
+        created by create_tunnels().
+        
+        Args:
+            city1, city2: City abbreviations
+            link_id: Link ID for the 10.{link_id}.0.0/30 subnet
+            tier: Tier link key in the hub topology, None in the mesh
+        """
+        if is_local(city1) and is_local(city2):
+            self.addLink(
+                f'r_{city1}',
+                f'r_{city2}',
+                intfName1=f'r_{city1}-{city2}',
+                intfName2=f'r_{city2}-{city1}',
+                cls=Link
+            )
+        elif not is_local(city1) and not is_local(city2):
+            return
+        
+        # Store link metadata for routing configuration
+        link_info = {
+            'city1': city1,
+            'city2': city2,
+            'link_id': link_id,
+            'intf1': f'r_{city1}-{city2}',
+            'intf2': f'r_{city2}-{city1}'
+        }
+        if tier is not None:
+            link_info['tier'] = tier
+        if not (is_local(city1) and is_local(city2)):
+            # Machine of the remote end
+            link_info['tunnel'] = MACHINE_OF[city2] if is_local(city1) else MACHINE_OF[city1]
+        # Delay and jitter at the starting hour when replaying profiles
+        link_info['delay_ms'], link_info['jitter_ms'] = topology_link_delay(link_info, args.start_hour)
+        self.links_info.append(link_info)
+
     def build(self):
         """Build the topology with city routers and inter-city links."""
         
@@ -166,9 +937,10 @@ class GlobalWANTopo(Topo):
         # Store link metadata for routing configuration
         self.links_info = []
         
-        # Create a router and switch for each city
+        # Create a router and switch for each city of this machine
         print("Creating city routers and switches...")
-        for city_abbr in CITY_ABBRS:
+        local_cities = [city_abbr for city_abbr in CITY_ABBRS if is_local(city_abbr)]
+        for city_abbr in local_cities:
             # Add host node that will act as a router
             # IP addresses will be configured later in configure_routers()
             self.addHost(f'r_{city_abbr}', ip=None)
@@ -184,54 +956,14 @@ class GlobalWANTopo(Topo):
                 intfName2=f's_{city_abbr}-r'
             )
         
-        # Create fully-connected mesh between all city routers
         print("\nCreating inter-city links...")
-        link_count = 0
+        for city1, city2, link_id, tier in topology_links():
+            self.add_router_link(city1, city2, link_id, tier)
+        link_count = len(self.links_info)
+        tunnel_count = sum(1 for link_info in self.links_info if 'tunnel' in link_info)
         
-        for i, city1 in enumerate(CITY_ABBRS):
-            for city2 in CITY_ABBRS[i + 1:]:
-                # Get network statistics from city1 to city2
-                stats = city_config[city1]['network_stats'][city2]
-                mean_rtt = stats['mean']
-                stddev_rtt = stats['stddev']
-                
-                # Calculate one-way delay (RTT / 2)
-                delay_ms = mean_rtt / 2.0
-                
-                # Add jitter based on standard deviation
-                # Use stddev as jitter to simulate variance
-                jitter_ms = stddev_rtt / 2.0
-                
-                # Get pre-assigned incremental link ID
-                link_id = LINK_ID_MAP[(city1, city2)]
-                
-                # Create link with named interfaces for explicit routing
-                self.addLink(
-                    f'r_{city1}',
-                    f'r_{city2}',
-                    intfName1=f'r_{city1}-{city2}',
-                    intfName2=f'r_{city2}-{city1}',
-                    cls=TCLink,
-                    delay=f'{delay_ms:.2f}ms',
-                    jitter=f'{jitter_ms:.2f}ms'
-                )
-                
-                # Store link metadata for routing configuration
-                self.links_info.append({
-                    'city1': city1,
-                    'city2': city2,
-                    'link_id': link_id,
-                    'intf1': f'r_{city1}-{city2}',
-                    'intf2': f'r_{city2}-{city1}',
-                    'delay_ms': delay_ms,
-                    'jitter_ms': jitter_ms
-                })
-                
-                link_count += 1
-                # print(f'  Link {link_count}: {city1} <-> {city2} '
-                #       f'(delay: {delay_ms:.2f}ms ± {jitter_ms:.2f}ms, link_id: {link_id})')
-        
-        print(f'\nTopology built: {len(CITY_ABBRS)} routers, {len(CITY_ABBRS)} switches, {link_count} inter-city links')
+        print(f'\nTopology built: {len(local_cities)} routers, {len(local_cities)} switches, {link_count} inter-city links'
+              + (f' ({tunnel_count} to other machines)' if MACHINE_OF else ''))
 
         # ----------------------------------------------------------
         # Peer Placement
@@ -241,26 +973,30 @@ class GlobalWANTopo(Topo):
         self.peers_info = []
         
         if len(PEER_CONFIG) > 0:
-            print(f"\nCreating {len(PEER_CONFIG)} peer hosts...")
+            print(f"\nCreating {sum(1 for city_abbr, _, _ in PEER_CONFIG if is_local(city_abbr))} peer hosts...")
             
-            for peer_idx, (city_abbr, distance) in enumerate(PEER_CONFIG):
+            city_peer_counts = {city_abbr: 0 for city_abbr in CITY_ABBRS}
+            for peer_idx, (city_abbr, _, delay_ms) in enumerate(PEER_CONFIG):
                 peer_number = peer_idx + 1
-                
-                # Calculate IP address: 20.{city_number}.{hi}.{lo}
-                city_number = CITY_NUMBERS[city_abbr]
-                hi_byte = (peer_number // 250) + 1  # High byte
-                lo_byte = (peer_number % 250) + 1  # Low byte
-                peer_ip = f'20.{city_number}.{hi_byte}.{lo_byte}'
+                if not is_local(city_abbr):
+                    continue
+                city_number = city_net(city_abbr)
+                if DELAY_CLASSES:
+                    # Numbered by delay class, see plan_delay_classes()
+                    delay_class, peer_ip = DELAY_CLASSES['peers'][peer_idx]
+                else:
+                    # Numbered within the city from 20.{city_number}.2.0, so a
+                    # city holds up to 64k peers
+                    offset = 512 + city_peer_counts[city_abbr]
+                    if offset >= 65535:
+                        print(f'Error: Too many peers in {CITY_NAMES[city_abbr]}')
+                        sys.exit(1)
+                    peer_ip = f'20.{city_number}.{offset >> 8}.{offset & 255}'
+                city_peer_counts[city_abbr] += 1
                 gateway_ip = f'20.{city_number}.1.1'
                 
-                # Add peer host with IP address
-                peer = self.addHost(
-                    f'h{peer_number}',
-                    ip=f'{peer_ip}/16',
-                    defaultRoute=f'via {gateway_ip}'
-                )
-
-                delay_ms = distance_to_delay(distance)
+                # Add peer host; address and route are set by configure_peers()
+                peer = self.addHost(f'h{peer_number}', ip=None)
                 
                 # Connect peer to city switch
                 self.addLink(
@@ -268,8 +1004,7 @@ class GlobalWANTopo(Topo):
                     f's_{city_abbr}',
                     intfName1=f'h_eth1',
                     intfName2=f's_{city_abbr}-h{peer_number}',
-                    cls=TCLink,
-                    delay=f'{delay_ms:.2f}ms'
+                    cls=Link  # netem is set up by configure_peers()
                 )
                 
                 # Store peer metadata
@@ -279,57 +1014,163 @@ class GlobalWANTopo(Topo):
                     'city_abbr': city_abbr,
                     'city_number': city_number,
                     'delay_ms': delay_ms,
+                    'delay_class': delay_class if DELAY_CLASSES else None,
                     'ip': peer_ip,
                     'gateway': gateway_ip
                 })
 
                 #print(f'  Peer {peer_number}: {CITY_NAMES[city_abbr]} delay: {delay_ms:.2f} ms, IP: {peer_ip}')
             
-            print(f'  Created {len(PEER_CONFIG)} peers across {len(set(p[0] for p in PEER_CONFIG))} cities')
+            print(f'  Created {len(self.peers_info)} peers across {len(set(p["city_abbr"] for p in self.peers_info))} cities')
 
 # ------------------------------------------------------------------
 # Network Setup and Configuration
 # ------------------------------------------------------------------
 
-def router_internal_config(router, city_abbr):
+# Per-node ip/tc batch scripts are written here and run in one go per node
+NETCFG_DIR = './tmp/netcfg'
+
+# netem sits at the root of every shaped interface under this handle
+NETEM_HANDLE = '10:'
+
+def tc_env():
+    """Environment prefix for tc, so it finds the distribution tables."""
+    return f'TC_LIB_DIR={DIST_DIR} ' if DIST_DIR else ''
+
+def write_batch(name, lines):
     """
-    Configure router internal settings including IP forwarding and switch interface.
+    Write an ip/tc batch script (one command per line, without the tool name).
+    
+    Returns:
+        Path of the script
+    """
+    path = os.path.join(NETCFG_DIR, name)
+    with open(path, 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+    return path
+
+def run_parallel(node_cmds):
+    """
+    Run one command on each node concurrently and wait for all of them.
+    Every Mininet node has its own shell, so sending all commands before
+    collecting any output overlaps them instead of paying one round trip
+    per command.
     
     Args:
-        router: Mininet router node
-        city_abbr: City abbreviation for this router
+        node_cmds: List of (node, command) tuples, at most one per node
+    """
+    for node, cmd in node_cmds:
+        node.sendCmd(cmd)
+    for node, _ in node_cmds:
+        output = node.waitOutput().strip()
+        if output:
+            print(f'  {node.name}: {output}')
+
+def delay_class_tc(dev, side, classes):
     """
-    # Enable IP forwarding
-    router.cmd('sysctl -w net.ipv4.ip_forward=1 > /dev/null')
+    tc batch lines that shape dev with a DRR qdisc holding one netem class
+    per delay class, picked by the peer address on the given side of the
+    packet ('src' or 'dst'); everything else goes to class 1:1 undelayed.
     
-    # Configure router-switch interface with peer network IP
-    # Peer network: 20.{city_number}.0.0/16
-    # Router gets 20.{city_number}.0.1/16 as gateway
-    city_number = CITY_NUMBERS[city_abbr]
-    router_to_switch_intf = f'r_{city_abbr}-s'
-    router_to_switch_ip = f'20.{city_number}.1.1'
-    router_inbound_range = f'20.{city_number}.0.0/16'
+    Args:
+        dev: Interface name
+        side: IP header field the class prefixes are matched against
+        classes: The city's (prefix, delay_ms) tuples from plan_delay_classes()
+    """
+    lines = [f'qdisc replace dev {dev} root handle 1: drr',
+             f'class replace dev {dev} parent 1: classid 1:1 drr',
+             f'filter add dev {dev} parent 1: protocol all prio 2 u32 match u32 0 0 flowid 1:1']
+    for class_idx, (prefix, delay_ms) in enumerate(classes):
+        minor = f'{class_idx + 2:x}'
+        # A class holds the packets of all its peers, so its queue is
+        # much longer than netem's default of 1000
+        lines += [f'class replace dev {dev} parent 1: classid 1:{minor} drr',
+                  f'qdisc replace dev {dev} parent 1:{minor} handle {minor}: netem delay {delay_ms:.3f}ms limit 100000',
+                  f'filter add dev {dev} parent 1: protocol ip prio 1 u32 match ip {side} {prefix} flowid 1:{minor}']
+    return lines
+
+def intf_mac(node, intf_name):
+    """MAC address of a node's interface, as set by autoSetMacs."""
+    intf = node.intf(intf_name)
+    return intf.MAC() or intf.updateMAC()
+
+def create_tunnels(net, topo):
+    """
+    Create the cross-host links of a cluster worker.
+    
+    Each link that leaves this machine becomes a vxlan or gretap device to
+    the remote end's machine, keyed by its link ID and named like a local
+    link's interface, which is then moved into the router's namespace; the
+    addressing, routes and netem of configure_routers() apply to it as to a
+    local link.
     
-    # Assign IP address to switch interface
-    router.cmd(f'ifconfig {router_to_switch_intf} {router_to_switch_ip} netmask 255.255.0.0')
-    router.cmd(f'ip route add {router_inbound_range} dev {router_to_switch_intf}')
+    Args:
+        net: Mininet network instance
+        topo: GlobalWANTopo instance with links_info
+    """
+    tunnel = CLUSTER['tunnel']
+    local_address = MACHINES[args.machine]['address']
+    count = 0
+    for link_info in topo.links_info:
+        if 'tunnel' not in link_info:
+            continue
+        city, intf = ((link_info['city1'], link_info['intf1']) if is_local(link_info['city1'])
+                      else (link_info['city2'], link_info['intf2']))
+        remote_address = MACHINES[link_info['tunnel']]['address']
+        if tunnel == 'vxlan':
+            device = (f"vxlan id {link_info['link_id']} remote {remote_address} local {local_address} "
+                      f"dstport {VXLAN_PORT}")
+        else:
+            device = f"gretap key {link_info['link_id']} remote {remote_address} local {local_address}"
+        output = quietRun(f'ip link add {intf} mtu {1500 - TUNNEL_OVERHEAD[tunnel]} type {device}').strip()
+        if output:
+            raise RuntimeError(f'Failed to create tunnel {intf}: {output}')
+        Intf(intf, node=net.get(f'r_{city}'))
+        count += 1
+    print(f'\n  Created {count} {tunnel} tunnels from {local_address}')
 
 def configure_routers(net, topo):
     """
     Configure routers with IP addresses, enable IP forwarding, and set up routing tables.
+    Each router gets one ip batch (addresses, routes, neighbours of its peers)
+    and one tc batch (netem of its inter-city links); all routers run them at
+    once, so bring-up does not grow with the number of links.
+    
+    With --delay_classes the router also delays its peers: traffic to them
+    by their class on the egress of its switch interface, traffic from them
+    by their class on an ifb device its ingress is redirected to. Peers of
+    a city reach each other through the router, so both delays apply as
+    with netem on the access links.
     
     Args:
         net: Mininet network instance
         topo: GlobalWANTopo instance with links_info
     """
     print("\nConfiguring routers...")
+    os.makedirs(NETCFG_DIR, exist_ok=True)
+    
+    local_cities = [city_abbr for city_abbr in CITY_ABBRS if is_local(city_abbr)]
+    ip_batch = {city_abbr: [] for city_abbr in local_cities}
+    tc_batch = {city_abbr: [] for city_abbr in local_cities}
     
-    # Track which routers we've already configured IP forwarding for
-    routers_configured = set()
+    # Router-switch interface is the gateway of the peer network
+    # 20.{city_number}.0.0/16; the address brings its connected route
+    for city_abbr in local_cities:
+        ip_batch[city_abbr].append(f'addr replace 20.{city_net(city_abbr)}.1.1/16 dev r_{city_abbr}-s')
     
-    print("  Configuring links (IP forwarding, IP addresses, and routes)...")
+    if DELAY_CLASSES:
+        quietRun('modprobe ifb numifbs=0')
+        for city_abbr in local_cities:
+            lan, ifb = f'r_{city_abbr}-s', f'r_{city_abbr}-ifb'
+            ip_batch[city_abbr] += [f'link add {ifb} type ifb', f'link set dev {ifb} up']
+            classes = DELAY_CLASSES['classes'][city_abbr]
+            tc_batch[city_abbr] += delay_class_tc(lan, 'dst', classes)
+            tc_batch[city_abbr] += [
+                f'qdisc replace dev {lan} handle ffff: ingress',
+                f'filter add dev {lan} parent ffff: protocol ip prio 1 u32 match u32 0 0 action mirred egress redirect dev {ifb}',
+            ]
+            tc_batch[city_abbr] += delay_class_tc(ifb, 'src', classes)
     
-    # Single iteration over all links
     for link_info in topo.links_info:
         city1 = link_info['city1']
         city2 = link_info['city2']
@@ -337,145 +1178,287 @@ def configure_routers(net, topo):
         intf1 = link_info['intf1']
         intf2 = link_info['intf2']
         
-        # Get routers
-        router1 = net.get(f'r_{city1}')
-        router2 = net.get(f'r_{city2}')
-        
-        # Configure router internal settings (only once per router)
-        if city1 not in routers_configured:
-            router_internal_config(router1, city1)
-            routers_configured.add(city1)
-        
-        if city2 not in routers_configured:
-            router_internal_config(router2, city2)
-            routers_configured.add(city2)
-        
-        # Assign IP addresses to point-to-point interfaces
-        # Point-to-point /30 subnet: 10.{link_id}.0.{1,2}/30
+        # Point-to-point /30 subnet: 10.{link_id}.0.{1,2}/30; its connected
+        # route also reaches the other router's IP
         ip1 = f'10.{link_id}.0.1'
         ip2 = f'10.{link_id}.0.2'
-
-        subnet_mask = f'255.255.255.3/30'
+        lines1 = [f'addr replace {ip1}/30 dev {intf1}']
+        lines2 = [f'addr replace {ip2}/30 dev {intf2}']
         
-        router1.cmd(f'ifconfig {intf1} {ip1} netmask {subnet_mask}')
-        router2.cmd(f'ifconfig {intf2} {ip2} netmask {subnet_mask}')
+        # Route peer traffic via the other router
+        peer_network1 = f'20.{city_net(city1)}.0.0/16'
+        peer_network2 = f'20.{city_net(city2)}.0.0/16'
+        if 'tier' not in link_info:
+            lines1.append(f'route replace {peer_network2} via {ip2} dev {intf1}')
+            lines2.append(f'route replace {peer_network1} via {ip1} dev {intf2}')
+        elif link_info['tier'][0] == 'access':
+            # city1 is the member city: everything else is behind its hub
+            lines1.append(f'route replace 20.0.0.0/8 via {ip2} dev {intf1}')
+            lines2.append(f'route replace {peer_network1} via {ip1} dev {intf2}')
+        else:
+            # Backbone: one aggregated prefix per remote region
+            lines1.append(f"route replace {HUB_PLAN['prefixes'][city2]} via {ip2} dev {intf1}")
+            lines2.append(f"route replace {HUB_PLAN['prefixes'][city1]} via {ip1} dev {intf2}")
         
-        # Add routes: each router adds a route to reach the other router's IP
-        router1.cmd(f'ip route add {ip2} dev {intf1}')
-        router2.cmd(f'ip route add {ip1} dev {intf2}')
-
-        # Add routes: route peer traffic via the other router
-        city1_number = CITY_NUMBERS[city1]
-        city2_number = CITY_NUMBERS[city2]
-        peer_network1 = f'20.{city1_number}.0.0/16'
-        peer_network2 = f'20.{city2_number}.0.0/16'
-        router1.cmd(f'ip route add {peer_network2} via {ip2} dev {intf1}')
-        router2.cmd(f'ip route add {peer_network1} via {ip1} dev {intf2}')
+        # Half the delay on each end, the jitter split as netem_args does;
+        # only the ends on this machine are configured here
+        for end, city_abbr, intf, lines in ((1, city1, intf1, lines1), (2, city2, intf2, lines2)):
+            if not is_local(city_abbr):
+                continue
+            netem = topology_link_netem(link_info, args.start_hour, end)
+            if 'tunnel' in link_info:
+                # Moving the tunnel into the namespace took it down
+                lines.insert(0, f'link set dev {intf} up')
+            ip_batch[city_abbr] += lines
+            tc_batch[city_abbr].append(f'qdisc replace dev {intf} root handle {NETEM_HANDLE} {netem}')
+    
+    # Static neighbours for the peers, in place of Mininet's all-pairs autoStaticArp
+    for peer_info in topo.peers_info:
+        peer_mac = intf_mac(net.get(peer_info['peer_name']), 'h_eth1')
+        ip_batch[peer_info['city_abbr']].append(
+            f"neigh replace {peer_info['ip']} lladdr {peer_mac} dev r_{peer_info['city_abbr']}-s nud permanent")
+    
+    node_cmds = []
+    for city_abbr in local_cities:
+        ip_path = write_batch(f'r_{city_abbr}.ip', ip_batch[city_abbr])
+        tc_path = write_batch(f'r_{city_abbr}.tc', tc_batch[city_abbr])
+        sysctls = 'net.ipv4.ip_forward=1'
+        if DELAY_CLASSES:
+            # Peer to peer traffic turns around at the router; a redirect
+            # would send it past the delay classes
+            sysctls += f' net.ipv4.conf.all.send_redirects=0 net.ipv4.conf.r_{city_abbr}-s.send_redirects=0'
+        node_cmds.append((net.get(f'r_{city_abbr}'),
+                          f'sysctl -w {sysctls} > /dev/null; '
+                          f'ip -force -batch {ip_path}; {tc_env()}tc -force -batch {tc_path}'))
+    run_parallel(node_cmds)
+    
+    print(f'\n  Configuration complete: {len(local_cities)} routers, {len(topo.links_info)} links')
+
+def configure_peers(net, topo):
+    """
+    Configure peer addresses, default routes, neighbours and access-link delay.
+    The switch ends of all access links are in the root namespace and are
+    shaped by a single tc batch; every peer configures its own end in
+    parallel with the others.
+    
+    With --delay_classes the routers do the shaping and peers get no qdisc.
+    A peer's address is a /32 with its router as the only neighbour, so it
+    sends everything, its city's peers included, through the delay classes,
+    and no peer needs the neighbours of the rest of its city.
+    
+    Args:
+        net: Mininet network instance
+        topo: GlobalWANTopo instance with peers_info
+    """
+    if not topo.peers_info:
+        return
+    print("\nConfiguring peers...")
+    os.makedirs(NETCFG_DIR, exist_ok=True)
+    
+    # Peers of a city share its /16 and reach each other directly
+    city_peers = {city_abbr: [] for city_abbr in CITY_ABBRS}
+    for peer_info in ([] if DELAY_CLASSES else topo.peers_info):
+        peer_mac = intf_mac(net.get(peer_info['peer_name']), 'h_eth1')
+        city_peers[peer_info['city_abbr']].append((peer_info['ip'], peer_mac))
+    gateway_macs = {city_abbr: intf_mac(net.get(f'r_{city_abbr}'), f'r_{city_abbr}-s')
+                    for city_abbr in CITY_ABBRS if is_local(city_abbr)}
+    
+    switch_tc = []
+    node_cmds = []
+    for peer_info in topo.peers_info:
+        peer_name = peer_info['peer_name']
+        city_abbr = peer_info['city_abbr']
+        gateway_neigh = f"neigh replace {peer_info['gateway']} lladdr {gateway_macs[city_abbr]} dev h_eth1 nud permanent"
+        if DELAY_CLASSES:
+            ip_path = write_batch(f'{peer_name}.ip', [
+                f"addr replace {peer_info['ip']}/32 dev h_eth1",
+                f"route replace default via {peer_info['gateway']} dev h_eth1 onlink",
+                gateway_neigh,
+            ])
+            node_cmds.append((net.get(peer_name), f'ip -force -batch {ip_path}'))
+            continue
         
-        # print(f'    Link {link_id}: {city1} ({ip1}) <-> {city2} ({ip2})')
+        netem = f"netem delay {peer_info['delay_ms']:.2f}ms"
+        switch_tc.append(f"qdisc replace dev s_{city_abbr}-{peer_name} root handle {NETEM_HANDLE} {netem}")
+        
+        ip_lines = [
+            f"addr replace {peer_info['ip']}/16 dev h_eth1",
+            f"route replace default via {peer_info['gateway']}",
+            gateway_neigh,
+        ]
+        ip_lines += [f'neigh replace {ip} lladdr {mac} dev h_eth1 nud permanent'
+                     for ip, mac in city_peers[city_abbr] if ip != peer_info['ip']]
+        ip_path = write_batch(f'{peer_name}.ip', ip_lines)
+        node_cmds.append((net.get(peer_name),
+                          f'ip -force -batch {ip_path}; tc qdisc replace dev h_eth1 root handle {NETEM_HANDLE} {netem}'))
+    
+    if switch_tc:
+        switch_path = write_batch('switches.tc', switch_tc)
+        output = quietRun(f'tc -force -batch {switch_path}').strip()
+        if output:
+            print(f'  switches: {output}')
+    run_parallel(node_cmds)
     
-    print(f'\n  Configuration complete: {len(routers_configured)} routers, {len(topo.links_info)} links')
+    print(f'  Configuration complete: {len(topo.peers_info)} peers')
+
+
+class LinkProfileUpdater(threading.Thread):
+    """
+    Replays the hour-of-day latency profiles on the live inter-city links.
+    
+    The scenario clock starts at t_start; every hour_length seconds of it
+    move the profile one hour on from start_hour. At each hour boundary the
+    netem qdisc of both ends of every link is changed in place, so the
+    network does not have to be rebuilt and connections survive. Only this
+    thread talks to the routers while the scenario runs.
+    """
+
+    def __init__(self, net, topo, t_start, start_hour, hour_length):
+        super().__init__(daemon=True)
+        self.t_start = t_start
+        self.start_hour = start_hour
+        self.hour_length = hour_length
+        self.stop_event = threading.Event()
+        # Ends on other machines are replayed by their own workers
+        self.links = [(net.get(f"r_{info['city1']}") if is_local(info['city1']) else None,
+                       net.get(f"r_{info['city2']}") if is_local(info['city2']) else None, info)
+                      for info in topo.links_info]
+
+    def apply(self, hour):
+        # One tc batch per router, changing only the links that move
+        tc_batch = {}
+        changed = 0
+        for router1, router2, info in self.links:
+            delay_ms, jitter_ms = topology_link_delay(info, hour)
+            if (delay_ms, jitter_ms) == (info['delay_ms'], info['jitter_ms']):
+                continue
+            if router1 is not None:
+                tc_batch.setdefault(router1, []).append(
+                    f"qdisc change dev {info['intf1']} handle {NETEM_HANDLE} {topology_link_netem(info, hour, 1)}")
+            if router2 is not None:
+                tc_batch.setdefault(router2, []).append(
+                    f"qdisc change dev {info['intf2']} handle {NETEM_HANDLE} {topology_link_netem(info, hour, 2)}")
+            info['delay_ms'], info['jitter_ms'] = delay_ms, jitter_ms
+            changed += 1
+        run_parallel([(router, f'{tc_env()}tc -force -batch {write_batch(f"{router.name}.hour.tc", lines)}')
+                      for router, lines in tc_batch.items()])
+        print(f'  Profile hour {hour:02d}: {changed} links changed')
+
+    def run(self):
+        step = 0  # the links were built at start_hour
+        while True:
+            # Sleep until the scenario clock reaches the next hour
+            wake = self.t_start + (step + 1) * self.hour_length
+            if self.stop_event.wait(max(0.0, wake - time.time())):
+                return
+            step = int((time.time() - self.t_start) // self.hour_length)
+            self.apply((self.start_hour + step) % 24)
+
+    def stop(self):
+        self.stop_event.set()
+        self.join()
 
 # ------------------------------------------------------------------
 # Application Configuration
 # ------------------------------------------------------------------
 
-def gen_scenario_scale(net, topo) -> int:
+# Traffic collector from utility/ifcount.c, built by run.sh
+IFCOUNT_PATH = '../bin/ifcount'
+IFCOUNT_INTERVAL_MS = 100
+
+# Compiled scenario of all peers, read by abyss_test/scenario_file.go
+SCENARIO_PATH = './tmp/scenario.bin'
+SCENARIO_MAGIC = b'ABYSSCN\0'
+SCENARIO_HEADER = struct.Struct('=8sIHHIIQQQQQ')
+SCENARIO_PEER = struct.Struct('=QII')
+SCENARIO_STEP = struct.Struct('=iHHI')
+SCENARIO_OPEN, SCENARIO_ADD, SCENARIO_DIAL, SCENARIO_JOIN = 1, 2, 3, 4
+SCENARIO_NO_TARGET = 0xFFFFFFFF
+
+def write_scenario(path, peer_names, steps):
     """
-    Generate scenario files for each peer.
-    Creates files h1 to h{n_peers} in ./tmp/scenario directory.
-    Each file contains a JSON array.
+    Write a compiled scenario in one file.
+    
+    Args:
+        path: Output file
+        peer_names: Peer ids; steps refer to peers by their index here
+        steps: Per-peer lists of (time, action, target index) tuples in time order
     """
-    scenario_dir = './tmp/scenario'
-    peer_names = [peer_info['peer_name'] for peer_info in topo.peers_info]
+    names = b''
+    name_offsets = []
+    for peer_name in peer_names:
+        name_offsets.append(len(names))
+        names += peer_name.encode() + b'\0'
+    nsteps = sum(len(peer_steps) for peer_steps in steps)
+    peers_offset = SCENARIO_HEADER.size
+    steps_offset = peers_offset + SCENARIO_PEER.size * len(peer_names)
+    names_offset = (steps_offset + SCENARIO_STEP.size * nsteps + 7) & ~7
+    
+    data = bytearray(names_offset + len(names))
+    SCENARIO_HEADER.pack_into(data, 0, SCENARIO_MAGIC, 0x01020304, 1, 0, len(peer_names), 0, nsteps,
+                              peers_offset, steps_offset, names_offset, len(names))
+    first = 0
+    for peer_idx, peer_steps in enumerate(steps):
+        SCENARIO_PEER.pack_into(data, peers_offset + SCENARIO_PEER.size * peer_idx,
+                                first, len(peer_steps), name_offsets[peer_idx])
+        for time_s, action, target in peer_steps:
+            SCENARIO_STEP.pack_into(data, steps_offset + SCENARIO_STEP.size * first, time_s, action, 0, target)
+            first += 1
+    data[names_offset:] = names
+    
+    with open(path, 'wb') as f:
+        f.write(data)
+
+def gen_scenario_scale(peer_names) -> int:
+    """
+    Generate the scenario of every peer and write it to SCENARIO_PATH.
+    """
+    peer = {peer_name: peer_idx for peer_idx, peer_name in enumerate(peer_names)}
 
     time_now = 0
-    scenario_data = {peer_name: [] for peer_name in peer_names}
+    scenario_data = [[] for _ in peer_names]
 
     # initial world
-    scenario_data['h1'].append({
-        'time': f'{time_now}',
-        'do': 'open',
-    })
+    scenario_data[peer['h1']].append((time_now, SCENARIO_OPEN, SCENARIO_NO_TARGET))
 
     # prepare for dial
     for i in range(2, 11):
-        scenario_data['h1'].append({
-            'time': f'{time_now}',
-            'do': 'add',
-            'id': f'h{i}',
-        })
+        scenario_data[peer['h1']].append((time_now, SCENARIO_ADD, peer[f'h{i}']))
     for i in range(2, 11):
-        scenario_data[f'h{i}'].append({
-            'time': f'{time_now}',
-            'do': 'add',
-            'id': 'h1',
-        })
+        scenario_data[peer[f'h{i}']].append((time_now, SCENARIO_ADD, peer['h1']))
 
     # initial 10: join to first one.
     time_now += 1
     for i in range(2, 11):
-        scenario_data[f'h{i}'].append({
-            'time': f'{time_now}',
-            'do': 'dial',
-            'id': 'h1',
-        })
+        scenario_data[peer[f'h{i}']].append((time_now, SCENARIO_DIAL, peer['h1']))
 
     time_now += 1
     for i in range(2, 11):
-        scenario_data[f'h{i}'].append({
-            'time': f'{time_now}',
-            'do': 'join',
-            'id': 'h1',
-        })
+        scenario_data[peer[f'h{i}']].append((time_now, SCENARIO_JOIN, peer['h1']))
     
     # followings: join to one of the previous ones. (h11 ~ )
     for cycle in range(1, args.n_peers // 10):
         time_now += 10 # 10 - second gap for stabilization
 
-        # (joiner id, target id)[10]
-        join_targets_ids = [(f'h{10 * cycle + i}', f'h{random.randint(1, 10 * cycle)}') for i in range(1, 11)]
-
-        for joiner_id, target_id in join_targets_ids:
-            scenario_data[target_id].append({
-                'time': f'{time_now}',
-                'do': 'add',
-                'id': joiner_id
-            })
-            scenario_data[joiner_id].append({
-                'time': f'{time_now}',
-                'do': 'add',
-                'id': target_id
-            })
+        # (joiner, target)[10]
+        join_targets = [(peer[f'h{10 * cycle + i}'], peer[f'h{random.randint(1, 10 * cycle)}']) for i in range(1, 11)]
+
+        for joiner, target in join_targets:
+            scenario_data[target].append((time_now, SCENARIO_ADD, joiner))
+            scenario_data[joiner].append((time_now, SCENARIO_ADD, target))
 
         time_now += 1
 
-        for joiner_id, target_id in join_targets_ids:
-            scenario_data[target_id].append({
-                'time': f'{time_now}',
-                'do': 'dial',
-                'id': joiner_id
-            })
-            scenario_data[joiner_id].append({
-                'time': f'{time_now}',
-                'do': 'dial',
-                'id': target_id
-            })
+        for joiner, target in join_targets:
+            scenario_data[target].append((time_now, SCENARIO_DIAL, joiner))
+            scenario_data[joiner].append((time_now, SCENARIO_DIAL, target))
 
         time_now += 1
         
-        for joiner_id, target_id in join_targets_ids:
-            scenario_data[joiner_id].append({
-                'time': f'{time_now}',
-                'do': 'join',
-                'id': target_id,
-            })
+        for joiner, target in join_targets:
+            scenario_data[joiner].append((time_now, SCENARIO_JOIN, target))
     
-    for peer_name in peer_names:
-        file_path = os.path.join(scenario_dir, peer_name)
-        
-        with open(file_path, 'w') as f:
-            json.dump(scenario_data[peer_name], f)
+    write_scenario(SCENARIO_PATH, peer_names, scenario_data)
 
     time_now += 10
     return time_now
@@ -483,71 +1466,196 @@ def gen_scenario_scale(net, topo) -> int:
 def run_peer_applications(net, topo) -> int:
     peers = [(net.get(peer_info['peer_name']), peer_info['peer_name']) for peer_info in topo.peers_info]
     results_path = f'./results/{args.n_peers}/{args.seed}'
-    scenario_dir = './tmp/scenario'
-    contact_dir = './tmp/contact'
+    contact_dir = CLUSTER['contact_dir'] if CLUSTER else './tmp/contact'
 
-    print("Generating scenario...")
-    scenario_duration = gen_scenario_scale(net, topo)
+    if args.machine is None:
+        print("Generating scenario...")
+        scenario_duration = gen_scenario_scale([peer_info['peer_name'] for peer_info in topo.peers_info])
+    else:
+        # The controller generated and copied the scenario
+        scenario_duration = args.duration
 
-    print("Starting ifstat...")
-    for peer, peer_name in peers:
-        peer.cmd(f'ifstat -i h_eth1 -n 0.1 > {results_path}/ifstat_{peer_name}.log &')
+    # One collector samples the switch ends of all access links from the
+    # root namespace, instead of a process in every peer
+    print("Starting traffic collector...")
+    series_name = f'ifcount_{args.machine}' if args.machine else 'ifcount'
+    collector = None
+    if peers:
+        if not os.access(IFCOUNT_PATH, os.X_OK):
+            raise RuntimeError(f'{IFCOUNT_PATH} not found; build it with '
+                               f'gcc -O2 -o {IFCOUNT_PATH} ../utility/ifcount.c')
+        # The interface list goes through a file: one argument per peer
+        # would overrun the argument size limit at large peer counts
+        list_path = f'./tmp/{series_name}.list'
+        with open(list_path, 'w') as f:
+            for peer_info in topo.peers_info:
+                f.write(f"s_{peer_info['city_abbr']}-{peer_info['peer_name']}\n")
+        collector = subprocess.Popen(
+            [IFCOUNT_PATH, '-i', str(IFCOUNT_INTERVAL_MS), '-f', list_path, '-o', f'{results_path}/{series_name}.ifs'])
         
-    time_start = int(time.time()) + 10
+    if args.machine is None:
+        time_start = int(time.time()) + 10
+    else:
+        time_start = args.t_start
+        if time.time() >= time_start:
+            raise RuntimeError(f'{args.machine} came up {time.time() - time_start:.0f}s after the scenario start; '
+                               f'raise --bringup_lead')
     print("Starting application...")
     for peer, peer_name in peers:
-        peer.cmd(f'./abyss_test/scenario_run --id={peer_name} --contact_dir={contact_dir} --t_start={time_start} --duration={scenario_duration} --scenario={scenario_dir}/{peer_name} --out {results_path}/evnt_{peer_name}.log  &> {results_path}/out_{peer_name}.log &')
+        peer.cmd(f'./abyss_test/scenario_run --id={peer_name} --contact_dir={contact_dir} --t_start={time_start} --duration={scenario_duration} --scenario={SCENARIO_PATH} --out {results_path}/evnt_{peer_name}.ev  &> {results_path}/out_{peer_name}.log &')
     
-    return scenario_duration
+    return scenario_duration, time_start, collector
 
-def stop_peer_applications(net, topo):
+def stop_peer_applications(net, topo, collector):
     peer_names = [peer_info['peer_name'] for peer_info in topo.peers_info]
-    for peer_name in peer_names:
-        peer = net.get(peer_name)
-        peer.cmd('pkill ifstat')
+    if collector is not None:
+        collector.terminate()
+        collector.wait()
     
     for peer_name in peer_names:
         peer = net.get(peer_name)
         peer.cmd('wait')
 
+def remote(machine, command):
+    """Run a shell command in a cluster machine's workdir over ssh."""
+    result = subprocess.run(['ssh', machine['ssh'], f"cd {shlex.quote(machine['workdir'])} && {command}"])
+    if result.returncode != 0:
+        raise RuntimeError(f"{machine['name']}: '{command}' exited with {result.returncode}")
+
+def copy_to(machine, paths, remote_dir):
+    """Copy local files into a directory under a cluster machine's workdir."""
+    if not paths:
+        return
+    target = f"{machine['ssh']}:{os.path.join(machine['workdir'], remote_dir)}/"
+    result = subprocess.run(['scp', '-q'] + paths + [target])
+    if result.returncode != 0:
+        raise RuntimeError(f"{machine['name']}: copying to {remote_dir} exited with {result.returncode}")
+
+def run_cluster_controller():
+    """
+    Run the simulation spread over the machines of the cluster.
+    
+    The controller generates the scenario of every peer and copies it,
+    with the cluster file, into every machine's workdir. It then starts a
+    worker on every machine over ssh with the same arguments and seed, so
+    all of them place the same peers and partition the cities the same
+    way, and one start time far enough ahead for all of them to come up. When the workers are done their results are copied
+    back here; each worker's output is in worker_<machine>.log. Workers
+    clear their ./tmp and results, so the controller must not run in a
+    workdir of its own host's worker.
+    """
+    machines = CLUSTER['machines']
+    results_path = f'./results/{args.n_peers}/{args.seed}'
+    os.makedirs(results_path, exist_ok=True)
+    os.makedirs(os.path.dirname(SCENARIO_PATH), exist_ok=True)
+    
+    print("Generating scenario...")
+    peer_names = [f'h{peer_idx + 1}' for peer_idx in range(len(PEER_CONFIG))]
+    scenario_duration = gen_scenario_scale(peer_names)
+    
+    print("\nPreparing machines...")
+    for machine in machines:
+        remote(machine, f'sudo rm -rf ./tmp {results_path} && mkdir -p ./tmp {results_path}')
+        copy_to(machine, [args.cluster, SCENARIO_PATH], 'tmp')
+    # One contact directory for all peers
+    contact_dir = shlex.quote(CLUSTER['contact_dir'])
+    remote(machines[0], f'sudo rm -rf {contact_dir} && mkdir -p {contact_dir}')
+    
+    time_start = int(time.time()) + args.bringup_lead
+    worker_args = ['--n_peers', str(args.n_peers), '--seed', str(args.seed),
+                   '--topology', args.topology, '--start_hour', str(args.start_hour),
+                   '--hour_length', str(args.hour_length), '--cluster', f'tmp/{os.path.basename(args.cluster)}',
+                   '--t_start', str(time_start), '--duration', str(scenario_duration)]
+    for option, value in (('--hubs', args.hubs), ('--profile', args.profile), ('--dist_dir', args.dist_dir),
+                          ('--delay_classes', args.delay_classes)):
+        if value is not None:
+            worker_args += [option, str(value)]
+    
+    print(f"Starting {len(machines)} workers, scenario starts in {args.bringup_lead}s...")
+    workers = []
+    for machine in machines:
+        log = open(f"{results_path}/worker_{machine['name']}.log", 'w')
+        command = f"sudo python3 setup.py {shlex.join(worker_args + ['--machine', machine['name']])}"
+        workers.append((machine, log, subprocess.Popen(
+            ['ssh', machine['ssh'], f"cd {shlex.quote(machine['workdir'])} && {command}"],
+            stdout=log, stderr=subprocess.STDOUT)))
+    
+    failed = []
+    for machine, log, worker in workers:
+        if worker.wait() != 0:
+            failed.append(machine['name'])
+        log.close()
+    
+    print("\nCollecting results...")
+    for machine in machines:
+        source = f"{machine['ssh']}:{os.path.join(machine['workdir'], results_path)}/*"
+        if subprocess.run(['scp', '-q', '-r', source, f'{results_path}/']).returncode != 0:
+            failed.append(machine['name'])
+    if failed:
+        print(f"Error: Workers failed on {', '.join(sorted(set(failed)))}; see {results_path}/worker_*.log")
+        sys.exit(1)
+    print("Done.")
+
 def run_simulation():
     """Main function to set up and run the simulation."""
     
     # Set log level
     setLogLevel('output')
     
+    # A record of the run next to its results; cluster workers place the
+    # same peers as their controller
+    if args.seed is not None and args.machine is None:
+        write_placements(f'./results/{args.n_peers}/{args.seed}/placements.tsv', PEER_CONFIG)
+    
+    if CLUSTER and args.machine is None:
+        run_cluster_controller()
+        return
+    
     # Create topology
     print("\nBuilding topology...")
     topo = GlobalWANTopo()
     
-    # Create network with TC link support for delay/bandwidth
+    # Create network; links are plain veths, delay is set up by the batches
     print("\nStarting network...")
     net = Mininet(
         topo=topo,
-        link=TCLink,
+        link=Link,
         controller=None,
         autoSetMacs=True,
-        autoStaticArp=True
+        autoStaticArp=False
     )
     
-    # Configure routers (IP addresses, forwarding, routing tables)
+    if MACHINE_OF:
+        create_tunnels(net, topo)
+    
+    # Configure routers and peers (addresses, routes, neighbours, netem)
     configure_routers(net, topo)
+    configure_peers(net, topo)
     
     # Start network
     net.start()
     time.sleep(3)
 
     print("\nRunning peer applications...")
-    scenario_duration = run_peer_applications(net, topo)
+    scenario_duration, time_start, collector = run_peer_applications(net, topo)
     print("Peer applications started.")
+
+    updater = None
+    if LINK_PROFILES:
+        print(f"Replaying latency profiles from hour {args.start_hour:02d}, {args.hour_length:g}s per hour...")
+        updater = LinkProfileUpdater(net, topo, time_start, args.start_hour, args.hour_length)
+        updater.start()
         
     # Start CLI
     #CLI(net)
     
-    time.sleep(scenario_duration + 12)
+    time.sleep(max(0.0, time_start + scenario_duration + 2 - time.time()))
+
+    if updater is not None:
+        updater.stop()
 
     print("\nStopping peer applications...")
-    stop_peer_applications(net, topo)
+    stop_peer_applications(net, topo, collector)
     print("Peer applications stopped.")
     
     # Cleanup
@@ -1,3 +1,7 @@
 module addrs
 
 go 1.24.3
+
+require extfile v0.0.0
+
+replace extfile => ../extfile
@@ -1,12 +1,12 @@
 package main
 
 import (
-	"encoding/binary"
 	"fmt"
-	"io"
 	"net/netip"
 	"os"
 	"path/filepath"
+
+	"extfile"
 )
 
 func main() {
@@ -33,7 +33,7 @@ func main() {
 		filePaths = append(filePaths, filepath.Join(dirPath, file.Name()))
 	}
 
-	dictionary := make(map[uint32]bool)
+	dictionary := make(map[netip.Addr]bool)
 
 	// Process each file
 	for _, filePath := range filePaths {
@@ -44,46 +44,31 @@ func main() {
 		}
 	}
 
-	for address, _ := range dictionary {
-		var bytes [4]byte
-		binary.NativeEndian.PutUint32(bytes[:], address)
-		addr := netip.AddrFrom4(bytes)
+	for addr, _ := range dictionary {
 		fmt.Printf("%s\n", addr.String())
 	}
 }
 
-func processFile(filename string, dictionary map[uint32]bool) error {
-	file, err := os.Open(filename)
-	if err != nil {
-		return err
-	}
-	defer file.Close()
-
-	const structSize = 20
-	buffer := make([]byte, structSize*1024*1024) // 10MB buffer
-
-	for {
-		n, err := file.Read(buffer)
-		if n == 0 {
-			break
+func processFile(filename string, dictionary map[netip.Addr]bool) error {
+	fields := []uint16{extfile.FieldSrcAddr, extfile.FieldDstAddr}
+	return extfile.Read(filename, fields, func(b *extfile.Block) error {
+		// Version 3 files list each address once, in the block that first
+		// uses it, so the records need not be read at all.
+		if table := b.Column(extfile.FieldAddrTable); table != nil {
+			for ; len(table) >= 16; table = table[16:] {
+				dictionary[netip.AddrFrom16([16]byte(table[:16])).Unmap()] = false
+			}
+			return nil
 		}
 
-		count := n / structSize
-		for i := range count {
-			offset := i * structSize
-
-			dstAddr := binary.NativeEndian.Uint32(buffer[offset+12:])
-			srcAddr := binary.NativeEndian.Uint32(buffer[offset+16:])
-			dictionary[dstAddr] = false
-			dictionary[srcAddr] = false
+		for i := range b.NRecords {
+			src, dst, err := b.Endpoints(i)
+			if err != nil {
+				return err
+			}
+			dictionary[dst] = false
+			dictionary[src] = false
 		}
-
-		if err == io.EOF {
-			break
-		}
-		if err != nil {
-			return err
-		}
-	}
-	return nil
+		return nil
+	})
 }
@@ -4,6 +4,7 @@ import argparse
 
 parser = argparse.ArgumentParser(description='Read and parse anchors/[name].anchors file')
 parser.add_argument('name', help='City name (in ./anchors/)')
+parser.add_argument('--map', metavar='ABBR', help='print "address ABBR" lines for citymatrix -m instead')
 args = parser.parse_args()
 
 path = '../../anchors/' + args.name + '.anchors'
@@ -16,8 +17,13 @@ try:
                 continue
             if result['date_decommissioned'] != None:
                 continue
-            anchors.append({'fqdn':result['fqdn'], 'probe':result['probe']})
+            anchors.append({'fqdn':result['fqdn'], 'probe':result['probe'], 'ip_v4':result.get('ip_v4')})
 except Exception as e:
     print(f"Error message: {str(e)}", file=sys.stderr)
 
-print(anchors)
\ No newline at end of file
+if args.map:
+    for anchor in anchors:
+        if anchor['ip_v4']:
+            print(anchor['ip_v4'], args.map)
+else:
+    print([{'fqdn':a['fqdn'], 'probe':a['probe']} for a in anchors])
\ No newline at end of file
@@ -0,0 +1,115 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "pairarc.h"
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-i] [-l] [-a src -b dst [-f from] [-t to]] <archive>\n"
+        "  -i  print the header\n"
+        "  -l  list every pair with its records, chunks and encoded bytes\n"
+        "  -a  with -b, print the records from src to dst:\n"
+        "      timestamp, prb_id, msm_id and the RTTs in ms\n"
+        "  -f  only records at or after this unix time\n"
+        "  -t  only records before this unix time\n",
+        argv0);
+}
+
+static int lookup(const struct parc *a, const char *s, uint32_t *id) {
+    uint8_t addr[16];
+    if (ext_parse_addr(s, addr)) {
+        fprintf(stderr, "invalid address: %s\n", s);
+        return -1;
+    }
+    int64_t i = parc_find_addr(a, addr);
+    if (i < 0) {
+        fprintf(stderr, "%s is not in the archive\n", s);
+        return -1;
+    }
+    *id = (uint32_t)i;
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    int info = 0, list = 0;
+    const char *addr_a = NULL, *addr_b = NULL;
+    uint64_t from = 0, to = UINT64_MAX;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ila:b:f:t:")) != -1) {
+        switch (opt) {
+        case 'i': info = 1; break;
+        case 'l': list = 1; break;
+        case 'a': addr_a = optarg; break;
+        case 'b': addr_b = optarg; break;
+        case 'f': from = strtoull(optarg, NULL, 10); break;
+        case 't': to = strtoull(optarg, NULL, 10); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1 || !addr_a != !addr_b) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct parc a;
+    if (parc_open(&a, argv[optind])) {
+        fprintf(stderr, "%s: %s\n", argv[optind], a.error);
+        return 1;
+    }
+
+    char buf[INET6_ADDRSTRLEN], buf2[INET6_ADDRSTRLEN];
+    if (info) {
+        printf("version %u, %llu addresses, %llu pairs, %llu chunks of up to %u records, %llu records, "
+            "%llu samples, %llu data bytes, time %llu to %llu\n", a.hdr->version,
+            (unsigned long long)a.hdr->naddrs, (unsigned long long)a.hdr->npairs, (unsigned long long)a.hdr->nchunks,
+            a.hdr->chunk_records, (unsigned long long)a.hdr->nrecords, (unsigned long long)a.hdr->nsamples,
+            (unsigned long long)a.hdr->data_size, (unsigned long long)a.hdr->t_min, (unsigned long long)a.hdr->t_max);
+    }
+    if (list) {
+        for (uint64_t i = 0; i < a.hdr->npairs; i++) {
+            const struct parc_pair *p = &a.pairs[i];
+            uint64_t bytes = 0;
+            for (uint64_t c = 0; c < p->nchunks; c++) bytes += a.chunks[p->first_chunk + c].size;
+            printf("%s\t%s\t%llu\t%llu\t%llu\n", ext_format_addr(a.addrs[p->src], buf, sizeof(buf)),
+                ext_format_addr(a.addrs[p->dst], buf2, sizeof(buf2)), (unsigned long long)p->nrecords,
+                (unsigned long long)p->nchunks, (unsigned long long)bytes);
+        }
+    }
+
+    int rc = 0;
+    uint32_t src, dst;
+    if (addr_a) {
+        if (lookup(&a, addr_a, &src) || lookup(&a, addr_b, &dst)) {
+            rc = 1;
+        } else {
+            const struct parc_pair *p = parc_find_pair(&a, src, dst);
+            struct parc_cursor c;
+            struct parc_record r;
+            int k;
+            parc_cursor_init(&c, &a, p, from, to);
+            while ((k = parc_cursor_next(&c, &r)) == 1) {
+                printf("%llu\t%u\t%u\t", (unsigned long long)r.timestamp, r.prb_id, r.msm_id);
+                for (uint32_t i = 0; i < r.rtt_count; i++) printf("%s%.3f", i ? "," : "", r.rtt_us[i] / 1000.0);
+                putchar('\n');
+            }
+            if (k < 0) {
+                fprintf(stderr, "%s: corrupt chunk\n", argv[optind]);
+                rc = 1;
+            } else if (!p) {
+                fprintf(stderr, "no records from %s to %s\n", addr_a, addr_b);
+                rc = 1;
+            }
+        }
+    }
+
+    parc_close(&a);
+    return rc;
+}
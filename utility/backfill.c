@@ -0,0 +1,646 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+// Parallel, resumable download + extract of RIPE Atlas daily ping dumps.
+//
+// Download slots fetch ping-<date>T<time>.bz2 with curl into a .part file
+// and hand finished files to extract slots, which run extract -z on them,
+// so the network and the CPUs are busy at the same time. Downloads stay
+// at most two files per extract slot ahead of extraction; past that a
+// download slot waits, so a slow extract does not fill the disk with
+// compressed hours. A failed transfer is retried with -C -, i.e. an HTTP
+// Range request for the bytes still missing.
+//
+// Every finished output is appended to a manifest as name, size and a
+// 64-bit FNV-1a checksum. A rerun skips hours whose output is still on
+// disk with the recorded size and checksum, and picks up any .bz2 that
+// was downloaded but not extracted yet. With -a the finished hours of
+// each day are then folded into <dir>/<YYYY-MM-DD>.arc with pairarchive
+// -r, which removes them, and every hour that went in is recorded in the
+// manifest again as <output>.arc. An hour whose output is gone counts as
+// done only with that record and while its day's archive exists.
+//
+// With -s every extract keeps a live status file, <output>.status, and
+// its final JSON summary (extract -J) is appended to the given file, one
+// line per hour, whether it succeeded or not.
+
+#define URL_BASE "https://data-store.ripe.net/datasets/atlas-daily-dumps"
+#define MANIFEST_NAME "manifest"
+#define MAX_ATTEMPTS 6
+#define MAX_SLOTS 64
+#define HOURS_PER_DAY 24
+#define STAGED_PER_EXTRACT 2    // downloaded or downloading hours per extract slot
+
+struct job {
+    char date[11];              // YYYY-MM-DD
+    char time[5];               // HHMM
+    int attempts;               // extract failures, each forcing a fresh download
+    struct job *next;
+};
+
+struct manifest_entry {
+    char name[64];
+    uint64_t size;
+    uint64_t sum;
+    size_t line;                // position in the manifest
+};
+
+struct backfill {
+    const char *dir;
+    const char *extract_bin;
+    unsigned long rate_kib;     // per download slot, 0 = unlimited
+    int extract_threads;
+    int keep;
+    const char *archive_dir;    // -a
+    const char *archive_bin;
+
+    struct manifest_entry *entries;
+    size_t nentries, entries_cap;
+    size_t nlines;              // read or appended
+    FILE *manifest;
+    pthread_mutex_t manifest_mtx;
+
+    FILE *summaries;            // -s
+    pthread_mutex_t summaries_mtx;
+
+    // download queue: jobs[next_job..njobs)
+    struct job *jobs;
+    size_t njobs;
+    size_t next_job;
+
+    // extract queue
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    struct job *ready, *ready_tail;
+    int downloads_left;         // slots still running
+    int in_extract;             // jobs popped by extract slots, not finished
+    int staged;                 // jobs being downloaded or in ready
+    int max_staged;             // download slots wait while staged reaches this
+
+    int failed;                 // under mtx
+};
+
+// ------------------------------------------------------------------
+// Helpers
+// ------------------------------------------------------------------
+
+static void output_name(const struct job *j, char *out, size_t n) {
+    snprintf(out, n, "extract-ping-%sT%s", j->date, j->time);
+}
+
+static void path_of(const struct backfill *bf, const char *name, const char *suffix, char *out, size_t n) {
+    snprintf(out, n, "%s/%s%s", bf->dir, name, suffix);
+}
+
+static int file_checksum(const char *path, uint64_t *size, uint64_t *sum) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    static __thread char buf[1 << 20];
+    uint64_t h = 0xcbf29ce484222325ULL, total = 0;
+    ssize_t n;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            h ^= (unsigned char)buf[i];
+            h *= 0x100000001b3ULL;
+        }
+        total += n;
+    }
+    close(fd);
+    if (n < 0) return -1;
+    *size = total;
+    *sum = h;
+    return 0;
+}
+
+// Runs argv to completion; returns its exit status, or -1.
+static int run(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        fprintf(stderr, "failed to run %s: %s\n", argv[0], strerror(errno));
+        _exit(127);
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+}
+
+static int file_exists(const char *path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+// ------------------------------------------------------------------
+// Manifest
+// ------------------------------------------------------------------
+
+static int entry_cmp(const void *a, const void *b) {
+    return strcmp(((const struct manifest_entry *)a)->name, ((const struct manifest_entry *)b)->name);
+}
+
+static int entry_line_cmp(const void *a, const void *b) {
+    const struct manifest_entry *x = a, *y = b;
+    int c = strcmp(x->name, y->name);
+    return c ? c : (x->line > y->line) - (x->line < y->line);
+}
+
+static int manifest_add(struct backfill *bf, const char *name, uint64_t size, uint64_t sum) {
+    if (bf->nentries == bf->entries_cap) {
+        size_t cap = bf->entries_cap ? bf->entries_cap * 2 : 1024;
+        struct manifest_entry *n = realloc(bf->entries, cap * sizeof(*n));
+        if (!n) return -1;
+        bf->entries = n;
+        bf->entries_cap = cap;
+    }
+    struct manifest_entry *e = &bf->entries[bf->nentries++];
+    snprintf(e->name, sizeof(e->name), "%s", name);
+    e->size = size;
+    e->sum = sum;
+    e->line = bf->nlines++;
+    return 0;
+}
+
+// The manifest is append-only, so a name may appear more than once when
+// an hour was redone; the last line wins.
+static void manifest_sort(struct backfill *bf) {
+    qsort(bf->entries, bf->nentries, sizeof(*bf->entries), entry_line_cmp);
+    size_t kept = 0;
+    for (size_t i = 0; i < bf->nentries; i++) {
+        if (i + 1 < bf->nentries && strcmp(bf->entries[i].name, bf->entries[i + 1].name) == 0) continue;
+        bf->entries[kept++] = bf->entries[i];
+    }
+    bf->nentries = kept;
+}
+
+static int manifest_load(struct backfill *bf) {
+    char path[4096];
+    path_of(bf, MANIFEST_NAME, "", path, sizeof(path));
+
+    FILE *f = fopen(path, "r");
+    if (f) {
+        char name[64];
+        unsigned long long size, sum;
+        while (fscanf(f, "%63s %llu %llx", name, &size, &sum) == 3) {
+            if (manifest_add(bf, name, size, sum)) {
+                fclose(f);
+                return -1;
+            }
+        }
+        fclose(f);
+        manifest_sort(bf);
+    }
+
+    bf->manifest = fopen(path, "a");
+    if (!bf->manifest) return -1;
+    return 0;
+}
+
+static int manifest_done(const struct backfill *bf, const struct job *j) {
+    struct manifest_entry key;
+    output_name(j, key.name, sizeof(key.name));
+    const struct manifest_entry *e = bsearch(&key, bf->entries, bf->nentries, sizeof(*e), entry_cmp);
+    if (!e) return 0;
+
+    char path[4096];
+    uint64_t size, sum;
+    path_of(bf, key.name, "", path, sizeof(path));
+    struct stat st;
+    if (stat(path, &st)) {
+        if (errno != ENOENT || !bf->archive_dir) return 0;
+        // Extracted, then archived and removed. The day's archive exists
+        // as soon as one hour is in it, so this hour must be on record.
+        strcat(key.name, ".arc");
+        if (!bsearch(&key, bf->entries, bf->nentries, sizeof(*e), entry_cmp)) return 0;
+        snprintf(path, sizeof(path), "%s/%s.arc", bf->archive_dir, j->date);
+        return file_exists(path);
+    }
+    if ((uint64_t)st.st_size != e->size) return 0;
+    if (file_checksum(path, &size, &sum)) return 0;
+    return size == e->size && sum == e->sum;
+}
+
+// Also adds the line to entries, which need manifest_sort before the
+// next lookup.
+static int manifest_append(struct backfill *bf, const char *name, uint64_t size, uint64_t sum) {
+    pthread_mutex_lock(&bf->manifest_mtx);
+    int rc = fprintf(bf->manifest, "%s %llu %016llx\n", name, (unsigned long long)size, (unsigned long long)sum) < 0
+        || fflush(bf->manifest) || fsync(fileno(bf->manifest)) || manifest_add(bf, name, size, sum);
+    pthread_mutex_unlock(&bf->manifest_mtx);
+    return rc ? -1 : 0;
+}
+
+// Moves one extract summary into the -s file.
+static void summary_collect(struct backfill *bf, const char *path) {
+    char line[16384];
+    FILE *f = fopen(path, "r");
+    if (!f) return;
+    pthread_mutex_lock(&bf->summaries_mtx);
+    while (fgets(line, sizeof(line), f)) fputs(line, bf->summaries);
+    if (fflush(bf->summaries)) perror("failed to write summary");
+    pthread_mutex_unlock(&bf->summaries_mtx);
+    fclose(f);
+    unlink(path);
+}
+
+// ------------------------------------------------------------------
+// Slots
+// ------------------------------------------------------------------
+
+static void set_failed(struct backfill *bf) {
+    pthread_mutex_lock(&bf->mtx);
+    bf->failed = 1;
+    pthread_mutex_unlock(&bf->mtx);
+}
+
+static void push_ready(struct backfill *bf, struct job *j) {
+    pthread_mutex_lock(&bf->mtx);
+    j->next = NULL;
+    if (bf->ready_tail) bf->ready_tail->next = j;
+    else bf->ready = j;
+    bf->ready_tail = j;
+    pthread_cond_broadcast(&bf->cond);
+    pthread_mutex_unlock(&bf->mtx);
+}
+
+static int download(struct backfill *bf, struct job *j) {
+    char url[512], part[4096], final[4096], rate[32];
+    char name[64];
+    snprintf(name, sizeof(name), "ping-%sT%s.bz2", j->date, j->time);
+    snprintf(url, sizeof(url), "%s/%s/%s", URL_BASE, j->date, name);
+    path_of(bf, name, ".part", part, sizeof(part));
+    path_of(bf, name, "", final, sizeof(final));
+    snprintf(rate, sizeof(rate), "%luK", bf->rate_kib);
+
+    if (file_exists(final)) return 0;
+
+    for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+        if (attempt) {
+            fprintf(stderr, "%s: retrying in %ds\n", name, 1 << attempt);
+            sleep(1 << attempt);
+        }
+        char *argv[16];
+        int n = 0;
+        argv[n++] = "curl";
+        argv[n++] = "-sSfL";
+        argv[n++] = "-C";
+        argv[n++] = "-";
+        if (bf->rate_kib) {
+            argv[n++] = "--limit-rate";
+            argv[n++] = rate;
+        }
+        argv[n++] = "-o";
+        argv[n++] = part;
+        argv[n++] = url;
+        argv[n] = NULL;
+
+        if (run(argv) == 0) {
+            if (rename(part, final) == 0) return 0;
+            perror(final);
+            return -1;
+        }
+    }
+    fprintf(stderr, "%s: giving up after %d attempts\n", name, MAX_ATTEMPTS);
+    return -1;
+}
+
+static void *download_main(void *arg) {
+    struct backfill *bf = arg;
+    while (1) {
+        pthread_mutex_lock(&bf->mtx);
+        while (bf->staged >= bf->max_staged && bf->next_job < bf->njobs) pthread_cond_wait(&bf->cond, &bf->mtx);
+        struct job *j = bf->next_job < bf->njobs ? &bf->jobs[bf->next_job++] : NULL;
+        if (j) bf->staged++;
+        pthread_mutex_unlock(&bf->mtx);
+        if (!j) break;
+
+        if (download(bf, j) == 0) {
+            push_ready(bf, j);
+            continue;
+        }
+        pthread_mutex_lock(&bf->mtx);
+        bf->staged--;
+        bf->failed = 1;
+        pthread_cond_broadcast(&bf->cond);
+        pthread_mutex_unlock(&bf->mtx);
+    }
+
+    pthread_mutex_lock(&bf->mtx);
+    bf->downloads_left--;
+    pthread_cond_broadcast(&bf->cond);
+    pthread_mutex_unlock(&bf->mtx);
+    return NULL;
+}
+
+static int extract(struct backfill *bf, struct job *j) {
+    char name[64], out[4096], tmp[4096], in[4096], threads[16];
+    char in_name[64], status[4096], summary[4096];
+    output_name(j, name, sizeof(name));
+    snprintf(in_name, sizeof(in_name), "ping-%sT%s.bz2", j->date, j->time);
+    path_of(bf, name, "", out, sizeof(out));
+    path_of(bf, name, ".tmp", tmp, sizeof(tmp));
+    path_of(bf, in_name, "", in, sizeof(in));
+    path_of(bf, name, ".status", status, sizeof(status));
+    path_of(bf, name, ".json", summary, sizeof(summary));
+    snprintf(threads, sizeof(threads), "%d", bf->extract_threads);
+
+    char *argv[12];
+    int n = 0;
+    argv[n++] = (char *)bf->extract_bin;
+    argv[n++] = "-j";
+    argv[n++] = threads;
+    argv[n++] = "-z";
+    argv[n++] = in;
+    if (bf->summaries) {
+        argv[n++] = "-S";
+        argv[n++] = status;
+        argv[n++] = "-J";
+        argv[n++] = summary;
+    }
+    argv[n++] = tmp;
+    argv[n] = NULL;
+    int rc = run(argv);
+    if (bf->summaries) {
+        summary_collect(bf, summary);
+        unlink(status);
+    }
+    if (rc != 0) {
+        fprintf(stderr, "%s: extract failed\n", in_name);
+        unlink(tmp);
+        // A corrupt download looks the same; fetch it again from scratch.
+        unlink(in);
+        return -1;
+    }
+
+    uint64_t size, sum;
+    if (file_checksum(tmp, &size, &sum) || rename(tmp, out) || manifest_append(bf, name, size, sum)) {
+        perror(out);
+        return -2;
+    }
+    if (!bf->keep) unlink(in);
+    fprintf(stderr, "%s: %llu bytes\n", name, (unsigned long long)size);
+    return 0;
+}
+
+static void *extract_main(void *arg) {
+    struct backfill *bf = arg;
+    while (1) {
+        pthread_mutex_lock(&bf->mtx);
+        // A retried job goes back through a download slot, so wait until
+        // neither downloads nor other extracts could still queue work.
+        while (!bf->ready && (bf->downloads_left > 0 || bf->in_extract > 0)) {
+            pthread_cond_wait(&bf->cond, &bf->mtx);
+        }
+        struct job *j = bf->ready;
+        if (j) {
+            bf->ready = j->next;
+            if (!bf->ready) bf->ready_tail = NULL;
+            bf->in_extract++;
+            bf->staged--;
+            // A staged place is free for the download slots
+            pthread_cond_broadcast(&bf->cond);
+        }
+        pthread_mutex_unlock(&bf->mtx);
+        if (!j) break;
+
+        int rc = extract(bf, j);
+        if (rc == -1 && ++j->attempts < 2) {
+            // Counted as staged, but never waits: only extract slots
+            // could make room
+            if (download(bf, j) == 0) {
+                pthread_mutex_lock(&bf->mtx);
+                bf->staged++;
+                pthread_mutex_unlock(&bf->mtx);
+                push_ready(bf, j);
+            } else {
+                set_failed(bf);
+            }
+        } else if (rc) {
+            set_failed(bf);
+        }
+
+        pthread_mutex_lock(&bf->mtx);
+        bf->in_extract--;
+        pthread_cond_broadcast(&bf->cond);
+        pthread_mutex_unlock(&bf->mtx);
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------------------
+// Archive
+// ------------------------------------------------------------------
+
+// Folds the finished hours of every day into its archive, merging into
+// the archive of an earlier run, and records them as <output>.arc. An
+// interruption between the two only makes a rerun extract those hours
+// again; pairarchive drops the duplicates.
+static int archive_days(struct backfill *bf, time_t first, size_t ndays) {
+    manifest_sort(bf);
+    int rc = 0;
+    for (size_t d = 0; d < ndays; d++) {
+        time_t t = first + (time_t)d * 86400;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        struct job j;
+        char arc[4096];
+        strftime(j.date, sizeof(j.date), "%Y-%m-%d", &tm);
+        snprintf(arc, sizeof(arc), "%s/%s.arc", bf->archive_dir, j.date);
+
+        // Entries are copied: recording them grows the table
+        struct manifest_entry hours[HOURS_PER_DAY];
+        char paths[HOURS_PER_DAY][4096];
+        char *argv[HOURS_PER_DAY + 6];
+        int n = 0, nhours = 0;
+        argv[n++] = (char *)bf->archive_bin;
+        argv[n++] = "-r";
+        argv[n++] = "-o";
+        argv[n++] = arc;
+        for (int h = 0; h < HOURS_PER_DAY; h++) {
+            struct manifest_entry key;
+            snprintf(j.time, sizeof(j.time), "%02d00", h);
+            output_name(&j, key.name, sizeof(key.name));
+            const struct manifest_entry *e = bsearch(&key, bf->entries, bf->nentries, sizeof(*e), entry_cmp);
+            path_of(bf, key.name, "", paths[nhours], sizeof(paths[nhours]));
+            if (!e || !file_exists(paths[nhours])) continue;
+            hours[nhours] = *e;
+            argv[n++] = paths[nhours++];
+        }
+        if (!nhours) continue;
+        if (file_exists(arc)) argv[n++] = arc;
+        argv[n] = NULL;
+
+        if (run(argv) != 0) {
+            fprintf(stderr, "%s: archive failed\n", arc);
+            rc = -1;
+            continue;
+        }
+        for (int h = 0; h < nhours; h++) {
+            strcat(hours[h].name, ".arc");
+            if (manifest_append(bf, hours[h].name, hours[h].size, hours[h].sum)) {
+                perror("failed to write manifest");
+                return -1;
+            }
+        }
+        fprintf(stderr, "%s: %d hours archived\n", arc, nhours);
+    }
+    return rc;
+}
+
+// ------------------------------------------------------------------
+// Main
+// ------------------------------------------------------------------
+
+static int parse_date(const char *s, time_t *out) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(s, "%Y-%m-%d", &tm);
+    if (!end || *end) return -1;
+    *out = timegm(&tm);
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-j downloads] [-x extracts] [-t threads] [-r KiB/s] [-o dir] [-e extract] [-k] [-s summaries]\n"
+        "          [-a archive-dir] [-p pairarchive]\n"
+        "          <start YYYY-MM-DD> [end YYYY-MM-DD]\n"
+        "  -j  concurrent downloads (default 4)\n"
+        "  -x  concurrent extracts (default 2)\n"
+        "  -t  threads per extract (default cores / extracts)\n"
+        "  -r  total download bandwidth cap, split evenly over the downloads\n"
+        "  -o  output directory (default ./data)\n"
+        "  -e  extract binary (default ./bin/extract)\n"
+        "  -k  keep the .bz2 files after extracting\n"
+        "  -s  append the JSON summary of every extract to this file\n"
+        "  -a  fold the finished hours of each day into <YYYY-MM-DD>.arc in this\n"
+        "      directory and remove them\n"
+        "  -p  pairarchive binary (default ./bin/pairarchive)\n", argv0);
+}
+
+int main(int argc, char* argv[]) {
+    struct backfill bf = { .dir = "./data", .extract_bin = "./bin/extract", .archive_bin = "./bin/pairarchive" };
+    int downloads = 4, extracts = 2;
+    unsigned long rate_kib = 0;
+    const char *summaries_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "j:x:t:r:o:e:ks:a:p:")) != -1) {
+        switch (opt) {
+        case 'j': downloads = atoi(optarg); break;
+        case 'x': extracts = atoi(optarg); break;
+        case 't': bf.extract_threads = atoi(optarg); break;
+        case 'r': rate_kib = strtoul(optarg, NULL, 10); break;
+        case 'o': bf.dir = optarg; break;
+        case 'e': bf.extract_bin = optarg; break;
+        case 'k': bf.keep = 1; break;
+        case 's': summaries_path = optarg; break;
+        case 'a': bf.archive_dir = optarg; break;
+        case 'p': bf.archive_bin = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (downloads < 1) downloads = 1;
+    if (downloads > MAX_SLOTS) downloads = MAX_SLOTS;
+    if (extracts < 1) extracts = 1;
+    if (extracts > MAX_SLOTS) extracts = MAX_SLOTS;
+    if (bf.extract_threads < 1) {
+        bf.extract_threads = (int)sysconf(_SC_NPROCESSORS_ONLN) / extracts;
+        if (bf.extract_threads < 1) bf.extract_threads = 1;
+    }
+    if (rate_kib) {
+        bf.rate_kib = rate_kib / downloads;
+        if (!bf.rate_kib) bf.rate_kib = 1;
+    }
+
+    time_t first, last;
+    if (parse_date(argv[optind], &first) || parse_date(argv[argc - 1], &last) || last < first) {
+        fprintf(stderr, "invalid date range\n");
+        return 1;
+    }
+
+    if (mkdir(bf.dir, 0755) && errno != EEXIST) {
+        perror(bf.dir);
+        return 1;
+    }
+    if (bf.archive_dir && mkdir(bf.archive_dir, 0755) && errno != EEXIST) {
+        perror(bf.archive_dir);
+        return 1;
+    }
+    pthread_mutex_init(&bf.manifest_mtx, NULL);
+    if (manifest_load(&bf)) {
+        perror("failed to open manifest");
+        return 1;
+    }
+    pthread_mutex_init(&bf.summaries_mtx, NULL);
+    if (summaries_path && !(bf.summaries = fopen(summaries_path, "a"))) {
+        perror(summaries_path);
+        return 1;
+    }
+
+    size_t ndays = (last - first) / 86400 + 1;
+    bf.jobs = calloc(ndays * HOURS_PER_DAY, sizeof(*bf.jobs));
+    if (!bf.jobs) {
+        perror("failed to allocate");
+        return 1;
+    }
+    size_t skipped = 0;
+    for (size_t d = 0; d < ndays; d++) {
+        time_t t = first + (time_t)d * 86400;
+        struct tm tm;
+        gmtime_r(&t, &tm);
+        for (int h = 0; h < HOURS_PER_DAY; h++) {
+            struct job *j = &bf.jobs[bf.njobs];
+            strftime(j->date, sizeof(j->date), "%Y-%m-%d", &tm);
+            snprintf(j->time, sizeof(j->time), "%02d00", h);
+            if (manifest_done(&bf, j)) skipped++;
+            else bf.njobs++;
+        }
+    }
+    fprintf(stderr, "%zu files to fetch, %zu already done\n", bf.njobs, skipped);
+
+    pthread_mutex_init(&bf.mtx, NULL);
+    pthread_cond_init(&bf.cond, NULL);
+    bf.downloads_left = downloads;
+    bf.max_staged = STAGED_PER_EXTRACT * extracts;
+
+    pthread_t tids[2 * MAX_SLOTS];
+    for (int i = 0; i < downloads; i++) pthread_create(&tids[i], NULL, download_main, &bf);
+    for (int i = 0; i < extracts; i++) pthread_create(&tids[downloads + i], NULL, extract_main, &bf);
+    for (int i = 0; i < downloads + extracts; i++) pthread_join(tids[i], NULL);
+    if (bf.archive_dir && archive_days(&bf, first, ndays)) bf.failed = 1;
+
+    fclose(bf.manifest);
+    if (bf.summaries) fclose(bf.summaries);
+    free(bf.entries);
+    free(bf.jobs);
+    pthread_mutex_destroy(&bf.mtx);
+    pthread_cond_destroy(&bf.cond);
+    pthread_mutex_destroy(&bf.manifest_mtx);
+    pthread_mutex_destroy(&bf.summaries_mtx);
+
+    if (bf.failed) {
+        fprintf(stderr, "some files failed; rerun to retry them\n");
+        return 1;
+    }
+    return 0;
+}
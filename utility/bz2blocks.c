@@ -0,0 +1,327 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <bzlib.h>
+
+#include "bz2blocks.h"
+
+#define BLOCK_MAGIC 0x314159265359ULL
+#define EOS_MAGIC 0x177245385090ULL
+#define MASK48 0xFFFFFFFFFFFFULL
+
+#define SCAN_RANGE (4 * 1024 * 1024)
+
+// A false hit can only shorten a block, so a handful of merges is plenty;
+// more than that means the data itself is damaged.
+#define MAX_MERGE 8
+
+// ------------------------------------------------------------------
+// Magic scanner
+//
+// A 48-bit window starting at bit s of byte i fully covers byte i+1, whose
+// value is then fixed by the magic and s. shift_tab[v] lists the shifts
+// for which byte value v can start a block (low byte) or end-of-stream
+// (high byte) magic, so most bytes are rejected with one table lookup.
+// ------------------------------------------------------------------
+
+static uint16_t shift_tab[256];
+
+static void shift_tab_init(void) {
+    for (int s = 0; s < 8; s++) {
+        shift_tab[(BLOCK_MAGIC >> (32 + s)) & 0xFF] |= 1 << s;
+        shift_tab[(EOS_MAGIC >> (32 + s)) & 0xFF] |= 0x100 << s;
+    }
+}
+
+static inline uint64_t load_be64(const unsigned char *p) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return __builtin_bswap64(v);
+}
+
+struct hit_vec {
+    uint64_t *hits;
+    uint8_t *kinds;
+    size_t n, cap;
+};
+
+static int hit_vec_push(struct hit_vec *v, uint64_t bit, uint8_t kind) {
+    if (v->n == v->cap) {
+        size_t cap = v->cap ? v->cap * 2 : 64;
+        uint64_t *hits = realloc(v->hits, cap * sizeof(*hits));
+        if (!hits) return -1;
+        v->hits = hits;
+        uint8_t *kinds = realloc(v->kinds, cap);
+        if (!kinds) return -1;
+        v->kinds = kinds;
+        v->cap = cap;
+    }
+    v->hits[v->n] = bit;
+    v->kinds[v->n] = kind;
+    v->n++;
+    return 0;
+}
+
+// Collects magics whose first bit lies in bytes [from, to).
+static int scan_range(const unsigned char *data, size_t size, size_t from, size_t to, struct hit_vec *out) {
+    unsigned char tail[16];
+
+    for (size_t i = from; i < to; i++) {
+        if (i + 1 >= size) break;
+        uint16_t m = shift_tab[data[i + 1]];
+        if (!m) continue;
+
+        uint64_t w;
+        if (i + 8 <= size) {
+            w = load_be64(data + i);
+        } else {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, data + i, size - i);
+            w = load_be64(tail);
+        }
+
+        for (int s = 0; s < 8; s++) {
+            if (!(m & (0x101 << s))) continue;
+            // Bits past the end of the file read as zero; reject windows
+            // that would need them.
+            if ((i * 8 + s + 48) > size * 8) continue;
+            uint64_t win = (w >> (16 - s)) & MASK48;
+            uint8_t kind = win == BLOCK_MAGIC ? BZ2_HIT_BLOCK : win == EOS_MAGIC ? BZ2_HIT_EOS : 0;
+            if (kind && hit_vec_push(out, i * 8 + s, kind)) return -1;
+        }
+    }
+    return 0;
+}
+
+struct scan_job {
+    const unsigned char *data;
+    size_t size;
+    struct hit_vec *ranges;
+    size_t nranges;
+    size_t next;
+    pthread_mutex_t mtx;
+    int failed;
+};
+
+static void *scan_main(void *arg) {
+    struct scan_job *job = arg;
+    while (1) {
+        pthread_mutex_lock(&job->mtx);
+        size_t r = job->next++;
+        pthread_mutex_unlock(&job->mtx);
+        if (r >= job->nranges) break;
+
+        size_t from = r * SCAN_RANGE;
+        size_t to = from + SCAN_RANGE < job->size ? from + SCAN_RANGE : job->size;
+        if (scan_range(job->data, job->size, from, to, &job->ranges[r])) job->failed = 1;
+    }
+    return NULL;
+}
+
+int bz2_open(struct bz2_file *bz, const char *path, int threads) {
+    struct stat st;
+
+    memset(bz, 0, sizeof(*bz));
+    bz->fd = open(path, O_RDONLY);
+    if (bz->fd < 0) return -1;
+    if (fstat(bz->fd, &st)) goto FAIL;
+
+    bz->size = st.st_size;
+    if (bz->size < 4) {
+        errno = EINVAL;
+        goto FAIL;
+    }
+    bz->data = mmap(NULL, bz->size, PROT_READ, MAP_PRIVATE, bz->fd, 0);
+    if (bz->data == MAP_FAILED) {
+        bz->data = NULL;
+        goto FAIL;
+    }
+    madvise((void *)bz->data, bz->size, MADV_SEQUENTIAL);
+
+    if (memcmp(bz->data, "BZh", 3) != 0 || bz->data[3] < '1' || bz->data[3] > '9') {
+        errno = EINVAL;
+        goto FAIL;
+    }
+
+    static pthread_once_t once = PTHREAD_ONCE_INIT;
+    pthread_once(&once, shift_tab_init);
+
+    struct scan_job job = { .data = bz->data, .size = bz->size };
+    job.nranges = (bz->size + SCAN_RANGE - 1) / SCAN_RANGE;
+    job.ranges = calloc(job.nranges, sizeof(*job.ranges));
+    if (!job.ranges) goto FAIL;
+    pthread_mutex_init(&job.mtx, NULL);
+
+    if (threads < 1) threads = 1;
+    if ((size_t)threads > job.nranges) threads = job.nranges;
+    pthread_t *tids = calloc(threads, sizeof(*tids));
+    if (!tids) {
+        free(job.ranges);
+        goto FAIL;
+    }
+    for (int t = 0; t < threads; t++) pthread_create(&tids[t], NULL, scan_main, &job);
+    for (int t = 0; t < threads; t++) pthread_join(tids[t], NULL);
+    free(tids);
+    pthread_mutex_destroy(&job.mtx);
+
+    size_t total = 0;
+    for (size_t r = 0; r < job.nranges; r++) total += job.ranges[r].n;
+    bz->hits = malloc((total ? total : 1) * sizeof(*bz->hits));
+    bz->kinds = malloc(total ? total : 1);
+    if (!job.failed && bz->hits && bz->kinds) {
+        for (size_t r = 0; r < job.nranges; r++) {
+            memcpy(bz->hits + bz->nhits, job.ranges[r].hits, job.ranges[r].n * sizeof(*bz->hits));
+            memcpy(bz->kinds + bz->nhits, job.ranges[r].kinds, job.ranges[r].n);
+            bz->nhits += job.ranges[r].n;
+        }
+    }
+    for (size_t r = 0; r < job.nranges; r++) {
+        free(job.ranges[r].hits);
+        free(job.ranges[r].kinds);
+    }
+    free(job.ranges);
+    if (job.failed || !bz->hits || !bz->kinds) {
+        errno = ENOMEM;
+        goto FAIL;
+    }
+    return 0;
+
+FAIL:
+    {
+        int err = errno;
+        bz2_close(bz);
+        errno = err;
+    }
+    return -1;
+}
+
+void bz2_close(struct bz2_file *bz) {
+    if (bz->data) munmap((void *)bz->data, bz->size);
+    if (bz->fd >= 0) close(bz->fd);
+    free(bz->hits);
+    free(bz->kinds);
+    memset(bz, 0, sizeof(*bz));
+    bz->fd = -1;
+}
+
+// ------------------------------------------------------------------
+// Block decoder
+// ------------------------------------------------------------------
+
+static inline unsigned get_bit(const unsigned char *p, uint64_t bit) {
+    return (p[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+static inline void put_bits(unsigned char *p, uint64_t *bit, uint64_t value, int n) {
+    for (int i = n - 1; i >= 0; i--, (*bit)++) {
+        if ((value >> i) & 1) p[*bit >> 3] |= 0x80 >> (*bit & 7);
+    }
+}
+
+// Wraps bits [from, to) of the file as "BZh9" + block + end-of-stream.
+// A one-block stream's combined CRC equals the block CRC stored right
+// after the block magic.
+static unsigned char *wrap_block(const struct bz2_file *bz, uint64_t from, uint64_t to, size_t *out_len) {
+    uint64_t nbits = to - from;
+    size_t len = 4 + (nbits + 80 + 7) / 8;
+    unsigned char *s = calloc(len + 1, 1);
+    if (!s) return NULL;
+
+    memcpy(s, "BZh9", 4);
+
+    const unsigned char *src = bz->data + (from >> 3);
+    unsigned shift = from & 7;
+    size_t full = nbits / 8;
+    if (shift == 0) {
+        memcpy(s + 4, src, full);
+    } else {
+        // src[full] may lie past the end of the file when the block ends
+        // there, so the last byte is assembled bit by bit below.
+        for (size_t j = 0; j + 1 < full; j++) {
+            s[4 + j] = (unsigned char)((src[j] << shift) | (src[j + 1] >> (8 - shift)));
+        }
+        if (full) full--;
+    }
+    uint64_t bit = 32 + full * 8;
+    for (uint64_t b = from + full * 8; b < to; b++, bit++) {
+        if (get_bit(bz->data, b)) s[bit >> 3] |= 0x80 >> (bit & 7);
+    }
+
+    uint64_t crc = 0;
+    for (int i = 0; i < 32; i++) crc = (crc << 1) | get_bit(bz->data, from + 48 + i);
+    put_bits(s, &bit, EOS_MAGIC, 48);
+    put_bits(s, &bit, crc, 32);
+
+    *out_len = len;
+    return s;
+}
+
+static int inflate_stream(unsigned char *in, size_t in_len, char **buf, size_t *len, size_t *cap, size_t pad) {
+    bz_stream strm;
+    size_t start = *len;
+    int ret;
+
+    memset(&strm, 0, sizeof(strm));
+    if (BZ2_bzDecompressInit(&strm, 0, 0) != BZ_OK) return -1;
+    strm.next_in = (char *)in;
+    strm.avail_in = in_len;
+
+    while (1) {
+        if (*cap - *len < pad + 64 * 1024) {
+            size_t ncap = *cap ? *cap * 2 : 4 * 1024 * 1024;
+            char *nbuf = realloc(*buf, ncap);
+            if (!nbuf) {
+                ret = BZ_MEM_ERROR;
+                break;
+            }
+            *buf = nbuf;
+            *cap = ncap;
+        }
+        strm.next_out = *buf + *len;
+        strm.avail_out = *cap - *len - pad;
+
+        ret = BZ2_bzDecompress(&strm);
+        *len = strm.next_out - *buf;
+        if (ret != BZ_OK) break;
+        if (strm.avail_in == 0 && strm.avail_out != 0) {
+            ret = BZ_UNEXPECTED_EOF;
+            break;
+        }
+    }
+
+    BZ2_bzDecompressEnd(&strm);
+    if (ret != BZ_STREAM_END) {
+        *len = start;
+        return -1;
+    }
+    return 0;
+}
+
+int bz2_decode_block(const struct bz2_file *bz, size_t hit,
+                     char **buf, size_t *len, size_t *cap, size_t pad,
+                     size_t *merged) {
+    if (hit >= bz->nhits || bz->kinds[hit] != BZ2_HIT_BLOCK) return -1;
+
+    for (size_t m = 0; m <= MAX_MERGE; m++) {
+        uint64_t to = hit + 1 + m < bz->nhits ? bz->hits[hit + 1 + m] : (uint64_t)bz->size * 8;
+        size_t in_len;
+        unsigned char *in = wrap_block(bz, bz->hits[hit], to, &in_len);
+        if (!in) return -1;
+        int rc = inflate_stream(in, in_len, buf, len, cap, pad);
+        free(in);
+        if (rc == 0) {
+            *merged = m;
+            return 0;
+        }
+        if (hit + 1 + m >= bz->nhits) break;
+    }
+    return -1;
+}
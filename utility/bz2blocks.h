@@ -0,0 +1,45 @@
+#ifndef BZ2BLOCKS_H
+#define BZ2BLOCKS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Random access to the compressed blocks of a .bz2 file, so that blocks can
+// be decompressed independently on several threads (as lbzip2 does).
+//
+// bzip2 blocks are not byte aligned; each starts with the 48-bit magic
+// 0x314159265359 and a stream ends with 0x177245385090. The file is mapped
+// and scanned for both magics at every bit offset. A block runs from its
+// magic to the next magic of either kind. A block is decoded by rewrapping
+// its bits as a one-block stream and handing that to libbz2.
+//
+// Compressed data can contain the block magic by chance. A block cut short
+// by such a false hit fails to decode, so bz2_decode_block retries with the
+// following hits merged in and reports how many it swallowed.
+
+struct bz2_file {
+    int fd;
+    const unsigned char *data;
+    size_t size;
+    uint64_t *hits;     // bit offsets of all magics, ascending
+    uint8_t *kinds;     // BZ2_HIT_* per hit
+    size_t nhits;
+};
+
+#define BZ2_HIT_BLOCK 1
+#define BZ2_HIT_EOS 2
+
+// Maps path and finds all magics using up to threads scanner threads.
+// Returns 0, or -1 with errno set (EINVAL if it is not a bzip2 file).
+int bz2_open(struct bz2_file *bz, const char *path, int threads);
+void bz2_close(struct bz2_file *bz);
+
+// Decompresses the block starting at hits[hit] and appends its output to
+// *buf (*len bytes used of *cap), keeping pad spare bytes after the data.
+// *merged receives the number of following hits that turned out to lie
+// inside this block. Returns 0, or -1 if the block does not decode.
+int bz2_decode_block(const struct bz2_file *bz, size_t hit,
+                     char **buf, size_t *len, size_t *cap, size_t pad,
+                     size_t *merged);
+
+#endif
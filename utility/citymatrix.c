@@ -0,0 +1,731 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "pairsum.h"
+#include "rtthist.h"
+#include "pairarc.h"
+
+// Inter-city RTT matrix between the anchors of each city; the native
+// replacement for utility/anchors-by-city/main.ipynb and the network_stats
+// part of mininet-control/config_gen.ipynb.
+//
+// -m maps anchor addresses to city abbreviations ("address name" lines, as
+// printed by anchors-by-city/main.py --map). Every (probe anchor, target
+// anchor) pair of two different cities is a series; as in the notebook,
+// each city pair takes the series with the lowest minimum RTT, the best
+// connected probe, and its mean and sample stddev become the link's
+// network_stats. Threads take blocks from all files and count into
+// private series tables, which are summed once at the end. Archives
+// (pairarc.h) are read by lookup: only the chunks of anchor pairs are
+// decoded.
+//
+// -s reads a pairsum summary (pairsum.h) instead of extract files. Its
+// pairs are unordered, so both directions of an anchor pair are one
+// series, and the minimum is only known to the histogram bin.
+//
+// The matrix is printed as TSV; -c rewrites the network_stats objects of a
+// city_config.json in place. Links without a series keep their old value,
+// and everything outside network_stats is copied through byte for byte.
+
+#define MAX_THREADS 256
+#define DEFAULT_MIN_SAMPLES 2
+
+struct series {
+    uint64_t count;
+    uint64_t sum_us;
+    unsigned __int128 sumsq;
+    uint32_t min_us;
+};
+
+struct link {
+    uint64_t count;             // 0 = no series
+    uint32_t min_us;
+    uint32_t nseries;           // candidate series
+    uint32_t probe, target;     // index ids of the best series
+    double mean, stddev;
+};
+
+// ------------------------------------------------------------------
+// Series counting
+// ------------------------------------------------------------------
+
+struct work {
+    struct ext_file *files;
+    uint32_t **gids;            // per file, from ext_addr_index_map_file
+    size_t nfiles;
+    struct parc_list archives;
+    int64_t **archive_ids;      // per archive, index id - 1 -> archive id or -1
+    struct ext_addr_index addrs;    // the mapped anchors only
+    const uint32_t *group;      // by index id
+    uint32_t n;                 // anchors; series are probe * n + target
+
+    // block cursor, then (archive, probe anchor) cursor
+    pthread_mutex_t mtx;
+    size_t file_i;
+    struct ext_block block;
+    size_t archive_i;
+    uint32_t probe_i;
+};
+
+struct thread_arg {
+    struct work *w;
+    struct series *series;      // [n * n]
+};
+
+static int next_block(struct work *w, size_t *fi, struct ext_block *b) {
+    int ok = 0;
+    pthread_mutex_lock(&w->mtx);
+    while (w->file_i < w->nfiles) {
+        if (ext_next_block(&w->files[w->file_i], &w->block)) {
+            *fi = w->file_i;
+            *b = w->block;
+            ok = 1;
+            break;
+        }
+        w->file_i++;
+        memset(&w->block, 0, sizeof(w->block));
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return ok;
+}
+
+static int next_probe(struct work *w, size_t *ai, uint32_t *probe) {
+    int ok = 0;
+    pthread_mutex_lock(&w->mtx);
+    while (w->archive_i < w->archives.n) {
+        if (w->probe_i < w->n) {
+            *ai = w->archive_i;
+            *probe = w->probe_i++;
+            ok = 1;
+            break;
+        }
+        w->archive_i++;
+        w->probe_i = 0;
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return ok;
+}
+
+static void series_add(struct series *e, uint64_t us) {
+    if (!e->count || us < e->min_us) e->min_us = (uint32_t)us;
+    e->count++;
+    e->sum_us += us;
+    e->sumsq += (unsigned __int128)us * us;
+}
+
+static void *count_main(void *arg) {
+    struct thread_arg *ta = arg;
+    struct work *w = ta->w;
+    size_t fi;
+    struct ext_block b;
+    uint8_t a[16];
+    memcpy(a, ext_v4_prefix, 12);
+
+    while (next_block(w, &fi, &b)) {
+        const struct ext_file *f = &w->files[fi];
+        const uint32_t *gid = w->gids[fi];
+        const uint32_t *src_id = ext_block_column(f, &b, EXT_FIELD_SRC_ID, NULL);
+        const uint32_t *dst_id = ext_block_column(f, &b, EXT_FIELD_DST_ID, NULL);
+        const uint8_t *src = ext_block_column(f, &b, EXT_FIELD_SRC_ADDR, NULL);
+        const uint8_t *dst = ext_block_column(f, &b, EXT_FIELD_DST_ADDR, NULL);
+        const uint8_t *cnt = ext_block_column(f, &b, EXT_FIELD_RTT_COUNT, NULL);
+        const void *rtt = ext_block_column(f, &b, EXT_FIELD_RTT, NULL);
+        const struct ext_column *rtt_col = ext_block_find_column(&b, EXT_FIELD_RTT);
+        int by_id = gid && src_id && dst_id;
+        if (!(by_id || (src && dst)) || !cnt || !rtt) continue;
+        uint32_t v = 0;
+
+        for (uint32_t i = 0; i < b.hdr->nrecords; i++) {
+            uint32_t s, d;
+            if (by_id) {
+                s = gid[src_id[i]];
+                d = gid[dst_id[i]];
+            } else {
+                memcpy(a + 12, src + i * 4, 4);
+                s = ext_addr_index_get(&w->addrs, a);
+                memcpy(a + 12, dst + i * 4, 4);
+                d = ext_addr_index_get(&w->addrs, a);
+            }
+            if (!s || !d || w->group[s] == w->group[d]) {
+                v += cnt[i];
+                continue;
+            }
+            struct series *e = &ta->series[(size_t)(s - 1) * w->n + (d - 1)];
+            for (uint32_t k = 0; k < cnt[i]; k++) {
+                series_add(e, (uint64_t)(ext_rtt_ms(rtt, rtt_col->type, v++) * 1000.0 + 0.5));
+            }
+        }
+    }
+
+    size_t ai;
+    uint32_t p;
+    while (next_probe(w, &ai, &p)) {
+        const struct parc *arc = &w->archives.a[ai];
+        const int64_t *id = w->archive_ids[ai];
+        if (id[p] < 0) continue;
+        for (uint32_t q = 0; q < w->n; q++) {
+            if (id[q] < 0 || w->group[p + 1] == w->group[q + 1]) continue;
+            const struct parc_pair *pair = parc_find_pair(arc, (uint32_t)id[p], (uint32_t)id[q]);
+            if (!pair) continue;
+            struct series *e = &ta->series[(size_t)p * w->n + q];
+            struct parc_cursor c;
+            struct parc_record r;
+            int rc;
+            parc_cursor_init(&c, arc, pair, 0, UINT64_MAX);
+            while ((rc = parc_cursor_next(&c, &r)) == 1) {
+                for (uint32_t k = 0; k < r.rtt_count; k++) series_add(e, r.rtt_us[k]);
+            }
+            if (rc < 0) {
+                fprintf(stderr, "corrupt chunk in archive pair %llu\n", (unsigned long long)(pair - arc->pairs));
+                exit(1);
+            }
+        }
+    }
+    return NULL;
+}
+
+// Adds the pairs of a summary whose anchors are both mapped.
+static uint64_t add_summary(const struct psum *s, const struct ext_addr_index *ix, const uint32_t *group,
+                            struct series *series, uint32_t n) {
+    uint64_t used = 0;
+    for (uint64_t i = 0; i < s->hdr->npairs; i++) {
+        const struct psum_pair *p = &s->pairs[i];
+        uint32_t a = ext_addr_index_get(ix, s->addrs[p->a]), b = ext_addr_index_get(ix, s->addrs[p->b]);
+        if (!a || !b || group[a] == group[b] || !p->count) continue;
+        uint32_t k = 0;
+        while (k < p->nbins && !s->bins[p->bins_first + k]) k++;
+        struct series *e = &series[(size_t)(a - 1) * n + (b - 1)];
+        e->count = p->count;
+        e->sum_us = p->sum_us;
+        e->sumsq = psum_sumsq(p);
+        e->min_us = (uint32_t)(hist_value(p->lo + k) * 1000.0 + 0.5);
+        used++;
+    }
+    return used;
+}
+
+// ------------------------------------------------------------------
+// city_config.json rewriting
+//
+// Just enough JSON to find the network_stats member of every city and
+// the members inside it; values are kept as raw text.
+// ------------------------------------------------------------------
+
+struct span {
+    const char *p;
+    size_t n;
+};
+
+struct config_city {
+    struct span name;
+    const char *stats, *stats_end;  // network_stats value, NULL if none
+    int indent;                 // column of the "network_stats" key
+};
+
+static const char *json_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) p++;
+    return p;
+}
+
+// p is at the opening quote; returns the position after the closing one.
+static const char *json_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') p++;
+        else if (*p == '"') return p + 1;
+    }
+    return NULL;
+}
+
+static const char *json_value(const char *p, const char *end) {
+    if (p >= end) return NULL;
+    if (*p == '"') return json_string(p, end);
+    if (*p != '{' && *p != '[') {
+        while (p < end && !strchr(",}] \t\r\n", *p)) p++;
+        return p;
+    }
+    int depth = 0;
+    while (p < end) {
+        if (*p == '"') {
+            if (!(p = json_string(p, end))) return NULL;
+            continue;
+        }
+        if (*p == '{' || *p == '[') depth++;
+        else if ((*p == '}' || *p == ']') && --depth == 0) return p + 1;
+        p++;
+    }
+    return NULL;
+}
+
+// Steps over one "key": value member of an object, or its closing brace.
+// Returns 1 with key and value filled in, 0 at the end of the object
+// (*pp past the brace), or -1 on a syntax error.
+static int json_member(const char **pp, const char *end, struct span *key, struct span *value) {
+    const char *p = json_ws(*pp, end);
+    if (p < end && *p == ',') p = json_ws(p + 1, end);
+    if (p < end && *p == '}') {
+        *pp = p + 1;
+        return 0;
+    }
+    const char *k = p;
+    if (p >= end || *p != '"' || !(p = json_string(p, end))) return -1;
+    key->p = k + 1;
+    key->n = p - k - 2;
+    p = json_ws(p, end);
+    if (p >= end || *p != ':') return -1;
+    p = json_ws(p + 1, end);
+    value->p = p;
+    if (!(p = json_value(p, end))) return -1;
+    value->n = p - value->p;
+    *pp = p;
+    return 1;
+}
+
+static int span_is(struct span s, const char *str) {
+    return s.n == strlen(str) && !memcmp(s.p, str, s.n);
+}
+
+static struct config_city *parse_config(const char *data, size_t size, size_t *n_out) {
+    const char *p = json_ws(data, data + size), *end = data + size;
+    if (p >= end || *p != '{') return NULL;
+    p++;
+
+    struct config_city *cities = NULL;
+    size_t n = 0;
+    struct span key, value;
+    int rc;
+    while ((rc = json_member(&p, end, &key, &value)) == 1) {
+        if (!value.n || *value.p != '{') break;
+        struct config_city *nc = realloc(cities, (n + 1) * sizeof(*nc));
+        if (!nc) {
+            perror("failed to allocate");
+            exit(1);
+        }
+        cities = nc;
+        struct config_city *c = &cities[n++];
+        memset(c, 0, sizeof(*c));
+        c->name = key;
+
+        const char *q = value.p + 1, *qend = value.p + value.n;
+        struct span k, v;
+        int rc2;
+        while ((rc2 = json_member(&q, qend, &k, &v)) == 1) {
+            if (!span_is(k, "network_stats") || !v.n || *v.p != '{') continue;
+            c->stats = v.p;
+            c->stats_end = v.p + v.n;
+            const char *line = k.p - 1;
+            while (line > data && line[-1] != '\n') line--;
+            c->indent = (int)(k.p - 1 - line);
+        }
+        if (rc2 < 0) break;
+    }
+    if (rc != 0) {
+        free(cities);
+        return NULL;
+    }
+    *n_out = n;
+    return cities;
+}
+
+// Formats v like Python's repr(), the shortest text that reads back as v,
+// so a rewritten config only differs where the numbers do.
+static void format_double(double v, char *buf, size_t len) {
+    char e[32];
+    for (int prec = 1; prec <= 17; prec++) {
+        snprintf(e, sizeof(e), "%.*e", prec - 1, v);
+        if (strtod(e, NULL) == v) break;
+    }
+    char digits[24];
+    int nd = 0, neg = e[0] == '-';
+    const char *c = e + neg;
+    for (; *c && *c != 'e'; c++) {
+        if (*c != '.') digits[nd++] = *c;
+    }
+    digits[nd] = 0;
+    int exp = atoi(c + 1);
+    while (nd > 1 && digits[nd - 1] == '0') digits[--nd] = 0;
+
+    if (exp < -4 || exp >= 16) {
+        snprintf(buf, len, "%s%c%s%se%c%02d", neg ? "-" : "", digits[0], nd > 1 ? "." : "", digits + 1,
+            exp < 0 ? '-' : '+', abs(exp));
+    } else if (exp < 0) {
+        snprintf(buf, len, "%s0.%.*s%s", neg ? "-" : "", -exp - 1, "0000", digits);
+    } else if (nd > exp + 1) {
+        snprintf(buf, len, "%s%.*s.%s", neg ? "-" : "", exp + 1, digits, digits + exp + 1);
+    } else {
+        snprintf(buf, len, "%s%s%.*s.0", neg ? "-" : "", digits, exp + 1 - nd, "0000000000000000");
+    }
+}
+
+static int find_name(char **names, uint32_t nnames, struct span s) {
+    for (uint32_t g = 0; g < nnames; g++) {
+        if (span_is(s, names[g])) return (int)g;
+    }
+    return -1;
+}
+
+// Writes the new network_stats object of city c, in json.dump(indent=4)
+// layout. Counts links taken from links, kept from the old object, and
+// found in neither.
+static void write_stats(FILE *out, const struct config_city *cities, size_t ncities, size_t c, char **names,
+                        uint32_t nnames, const struct link *links, uint64_t counts[3]) {
+    const struct config_city *city = &cities[c];
+    int ga = find_name(names, nnames, city->name);
+    int first = 1;
+
+    fputc('{', out);
+    for (size_t o = 0; o < ncities; o++) {
+        if (o == c) continue;
+        int gb = find_name(names, nnames, cities[o].name);
+        const struct link *l = NULL;
+        if (ga >= 0 && gb >= 0) {
+            l = ga < gb ? &links[(size_t)ga * nnames + gb] : &links[(size_t)gb * nnames + ga];
+            if (!l->count) l = NULL;
+        }
+
+        struct span old = { NULL, 0 };
+        if (!l) {
+            const char *q = city->stats + 1;
+            struct span k, v;
+            while (json_member(&q, city->stats_end, &k, &v) == 1) {
+                if (k.n == cities[o].name.n && !memcmp(k.p, cities[o].name.p, k.n)) old = v;
+            }
+            if (!old.p) {
+                counts[2]++;
+                continue;
+            }
+        }
+
+        fprintf(out, "%s%*s\"%.*s\": ", first ? "\n" : ",\n", city->indent + 4, "", (int)cities[o].name.n,
+            cities[o].name.p);
+        first = 0;
+        if (l) {
+            char mean[48], stddev[48];
+            format_double(l->mean, mean, sizeof(mean));
+            format_double(l->stddev, stddev, sizeof(stddev));
+            fprintf(out, "{\n%*s\"mean\": %s,\n%*s\"stddev\": %s\n%*s}", city->indent + 8, "", mean,
+                city->indent + 8, "", stddev, city->indent + 4, "");
+            counts[0]++;
+        } else {
+            fwrite(old.p, 1, old.n, out);
+            counts[1]++;
+        }
+    }
+    if (!first) fprintf(out, "\n%*s", city->indent, "");
+    fputc('}', out);
+}
+
+static char *read_file(const char *path, size_t *size) {
+    FILE *f = fopen(path, "r");
+    if (!f) return NULL;
+    char *data = NULL;
+    size_t n = 0, cap = 0, k;
+    do {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 65536;
+            char *nd = realloc(data, cap);
+            if (!nd) {
+                free(data);
+                fclose(f);
+                return NULL;
+            }
+            data = nd;
+        }
+        k = fread(data + n, 1, cap - n, f);
+        n += k;
+    } while (k);
+    int err = ferror(f);
+    fclose(f);
+    if (err) {
+        free(data);
+        return NULL;
+    }
+    *size = n;
+    return data;
+}
+
+static int update_config(const char *path, char **names, uint32_t nnames, const struct link *links) {
+    size_t size;
+    char *data = read_file(path, &size);
+    if (!data) {
+        perror(path);
+        return -1;
+    }
+    size_t ncities;
+    struct config_city *cities = parse_config(data, size, &ncities);
+    if (!cities) {
+        fprintf(stderr, "%s: not a city config\n", path);
+        free(data);
+        return -1;
+    }
+    for (uint32_t g = 0; g < nnames; g++) {
+        size_t c = 0;
+        while (c < ncities && !span_is(cities[c].name, names[g])) c++;
+        if (c == ncities) fprintf(stderr, "%s: mapped city %s is not in the config\n", path, names[g]);
+    }
+
+    char tmp[4096 + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *out = fopen(tmp, "w");
+    if (!out) {
+        perror(tmp);
+        free(cities);
+        free(data);
+        return -1;
+    }
+    uint64_t counts[3] = { 0, 0, 0 };
+    const char *cur = data;
+    for (size_t c = 0; c < ncities; c++) {
+        if (!cities[c].stats) continue;
+        fwrite(cur, 1, cities[c].stats - cur, out);
+        write_stats(out, cities, ncities, c, names, nnames, links, counts);
+        cur = cities[c].stats_end;
+    }
+    fwrite(cur, 1, data + size - cur, out);
+
+    int rc = ferror(out) ? -1 : 0;
+    if (fclose(out)) rc = -1;
+    if (!rc && rename(tmp, path)) rc = -1;
+    if (rc) {
+        perror(path);
+        unlink(tmp);
+    } else {
+        fprintf(stderr, "%s: %llu links updated, %llu kept without data, %llu missing\n", path,
+            (unsigned long long)counts[0] / 2, (unsigned long long)counts[1] / 2, (unsigned long long)counts[2] / 2);
+    }
+    free(cities);
+    free(data);
+    return rc;
+}
+
+// ------------------------------------------------------------------
+// Driver
+// ------------------------------------------------------------------
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s -m address-map [-n min-samples=%d] [-j threads] [-o matrix.tsv] [-c city_config.json]\n"
+        "          (-s summary | <directory|file|archive>...)\n"
+        "  -m  anchor addresses and the city of each, as \"address name\" lines\n"
+        "  -n  skip series with fewer samples\n"
+        "  -o  write the matrix here instead of stdout\n"
+        "  -c  update the network_stats of this config; prints no matrix without -o\n"
+        "  -s  read a pairsum summary instead of extract files\n",
+        argv0, DEFAULT_MIN_SAMPLES);
+}
+
+int main(int argc, char* argv[]) {
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    const char *map_path = NULL, *out_path = NULL, *config_path = NULL, *summary_path = NULL;
+    uint64_t min_samples = DEFAULT_MIN_SAMPLES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:j:m:n:o:s:")) != -1) {
+        switch (opt) {
+        case 'c': config_path = optarg; break;
+        case 'j': nthreads = atoi(optarg); break;
+        case 'm': map_path = optarg; break;
+        case 'n': min_samples = strtoull(optarg, NULL, 10); break;
+        case 'o': out_path = optarg; break;
+        case 's': summary_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!map_path || (summary_path ? optind != argc : optind >= argc)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    if (min_samples < 2) min_samples = 2;     // a stddev needs two
+
+    struct ext_addr_map map;
+    if (ext_addr_map_load(&map, map_path)) return 1;
+    char **names = map.names;
+    uint32_t nnames = map.nnames;
+
+    struct work w = { 0 };
+    pthread_mutex_init(&w.mtx, NULL);
+    for (size_t i = 0; i < map.n; i++) {
+        if (ext_addr_index_add(&w.addrs, map.entries[i].addr)) {
+            perror("failed to index addresses");
+            return 1;
+        }
+    }
+    if (ext_addr_index_sort(&w.addrs)) {
+        perror("failed to index addresses");
+        return 1;
+    }
+    w.n = w.addrs.n;
+    uint32_t *group = calloc(w.n + 1, sizeof(*group));
+    if (!group) {
+        perror("failed to allocate");
+        return 1;
+    }
+    for (size_t i = 0; i < map.n; i++) group[ext_addr_index_get(&w.addrs, map.entries[i].addr)] = map.entries[i].group;
+    w.group = group;
+
+    size_t nseries = (size_t)w.n * w.n;
+    struct series *series;
+    uint64_t inputs;
+    if (summary_path) {
+        struct psum s;
+        if (psum_open(&s, summary_path)) {
+            fprintf(stderr, "%s: %s\n", summary_path, s.error);
+            return 1;
+        }
+        if (!(series = calloc(nseries ? nseries : 1, sizeof(*series)))) {
+            perror("failed to allocate");
+            return 1;
+        }
+        inputs = add_summary(&s, &w.addrs, group, series, w.n);
+        fprintf(stderr, "%llu anchor pairs of %llu in %s\n", (unsigned long long)inputs,
+            (unsigned long long)s.hdr->npairs, summary_path);
+        psum_close(&s);
+    } else {
+        struct parc_inputs in = { 0 };
+        for (int i = optind; i < argc; i++) {
+            if (ext_walk(argv[i], parc_inputs_add, &in)) return 1;
+        }
+        w.files = in.files;
+        w.nfiles = in.nfiles;
+        w.archives = in.archives;
+        w.gids = calloc(w.nfiles ? w.nfiles : 1, sizeof(*w.gids));
+        w.archive_ids = calloc(w.archives.n ? w.archives.n : 1, sizeof(*w.archive_ids));
+        if (!w.gids || !w.archive_ids) {
+            perror("failed to allocate");
+            return 1;
+        }
+        for (size_t i = 0; i < w.archives.n; i++) {
+            if (!(w.archive_ids[i] = malloc((w.n ? w.n : 1) * sizeof(**w.archive_ids)))) {
+                perror("failed to allocate");
+                return 1;
+            }
+            for (uint32_t k = 0; k < w.n; k++) w.archive_ids[i][k] = parc_find_addr(&w.archives.a[i], w.addrs.addr[k]);
+        }
+        for (size_t i = 0; i < w.nfiles; i++) {
+            if (ext_addr_index_map_file(&w.addrs, &w.files[i], &w.gids[i])) {
+                perror("failed to index addresses");
+                return 1;
+            }
+        }
+
+        struct thread_arg *args = calloc(nthreads, sizeof(*args));
+        pthread_t *tids = calloc(nthreads, sizeof(*tids));
+        if (!args || !tids) {
+            perror("failed to allocate");
+            return 1;
+        }
+        for (int t = 0; t < nthreads; t++) {
+            args[t].w = &w;
+            if (!(args[t].series = calloc(nseries ? nseries : 1, sizeof(struct series)))) {
+                perror("failed to allocate");
+                return 1;
+            }
+            pthread_create(&tids[t], NULL, count_main, &args[t]);
+        }
+        for (int t = 0; t < nthreads; t++) pthread_join(tids[t], NULL);
+
+        series = args[0].series;
+        for (int t = 1; t < nthreads; t++) {
+            for (size_t i = 0; i < nseries; i++) {
+                const struct series *e = &args[t].series[i];
+                if (!e->count) continue;
+                if (!series[i].count || e->min_us < series[i].min_us) series[i].min_us = e->min_us;
+                series[i].count += e->count;
+                series[i].sum_us += e->sum_us;
+                series[i].sumsq += e->sumsq;
+            }
+            free(args[t].series);
+        }
+        for (size_t i = 0; i < w.nfiles; i++) {
+            ext_close(&w.files[i]);
+            free(w.gids[i]);
+        }
+        for (size_t i = 0; i < w.archives.n; i++) {
+            parc_close(&w.archives.a[i]);
+            free(w.archive_ids[i]);
+        }
+        inputs = w.nfiles + w.archives.n;
+        free(args);
+        free(tids);
+        free(w.files);
+        free(w.gids);
+        free(w.archives.a);
+        free(w.archive_ids);
+    }
+
+    // Best series of each city pair: lowest minimum, then most samples
+    struct link *links = calloc((size_t)nnames * nnames + 1, sizeof(*links));
+    if (!links) {
+        perror("failed to allocate");
+        return 1;
+    }
+    uint64_t used = 0;
+    for (uint32_t p = 0; p < w.n; p++) {
+        for (uint32_t q = 0; q < w.n; q++) {
+            const struct series *e = &series[(size_t)p * w.n + q];
+            uint32_t ga = group[p + 1], gb = group[q + 1];
+            if (e->count < min_samples || ga == gb) continue;
+            struct link *l = ga < gb ? &links[(size_t)ga * nnames + gb] : &links[(size_t)gb * nnames + ga];
+            l->nseries++;
+            used++;
+            if (l->count && (e->min_us > l->min_us || (e->min_us == l->min_us && e->count <= l->count))) continue;
+            unsigned __int128 sum = e->sum_us;
+            l->count = e->count;
+            l->min_us = e->min_us;
+            l->probe = p + 1;
+            l->target = q + 1;
+            l->mean = (double)sum / e->count / 1000.0;
+            l->stddev = sqrt((double)(e->sumsq * e->count - sum * sum) / e->count / (e->count - 1)) / 1000.0;
+        }
+    }
+
+    int rc = 0;
+    FILE *out = NULL;
+    if ((out_path || !config_path) && !(out = out_path ? fopen(out_path, "w") : stdout)) {
+        perror(out_path);
+        return 1;
+    }
+    uint32_t nlinks = 0;
+    if (out) fprintf(out, "city_a\tcity_b\tseries\tsamples\tmean_ms\tstddev_ms\tmin_ms\tprobe\ttarget\n");
+    for (uint32_t ga = 0; ga < nnames; ga++) {
+        for (uint32_t gb = ga + 1; gb < nnames; gb++) {
+            const struct link *l = &links[(size_t)ga * nnames + gb];
+            if (!l->count) continue;
+            nlinks++;
+            if (!out) continue;
+            char a[INET6_ADDRSTRLEN], b[INET6_ADDRSTRLEN];
+            fprintf(out, "%s\t%s\t%u\t%llu\t%f\t%f\t%.3f\t%s\t%s\n", names[ga], names[gb], l->nseries,
+                (unsigned long long)l->count, l->mean, l->stddev, l->min_us / 1000.0,
+                ext_format_addr(w.addrs.addr[l->probe - 1], a, sizeof(a)),
+                ext_format_addr(w.addrs.addr[l->target - 1], b, sizeof(b)));
+        }
+    }
+    if (out && out != stdout && fclose(out)) {
+        perror(out_path);
+        rc = 1;
+    }
+    fprintf(stderr, "%u of %u city links from %llu series in %llu %s\n", nlinks, nnames ? nnames * (nnames - 1) / 2 : 0,
+        (unsigned long long)used, (unsigned long long)inputs, summary_path ? "summary pairs" : "files");
+
+    if (!rc && config_path && update_config(config_path, names, nnames, links)) rc = 1;
+
+    ext_addr_map_free(&map);
+    free(links);
+    free(series);
+    free(group);
+    ext_addr_index_free(&w.addrs);
+    pthread_mutex_destroy(&w.mtx);
+    return rc;
+}
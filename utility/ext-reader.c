@@ -1,33 +1,112 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
 
-struct pingdata_s
-{
-    float rtt1, rtt2, rtt3;
-    uint8_t dst_addr_1, dst_addr_2, dst_addr_3, dst_addr_4;
-    uint8_t src_addr_1, src_addr_2, src_addr_3, src_addr_4;
-};
+#include "extread.h"
+
+#define DEFAULT_PRINT_RECORDS 10
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-i] [-c] [-l] [-H] [-n max] [-r start[:count]] [-s addr] [-d addr] [-a addr] <filename>\n"
+        "  -i  print the header and field schema\n"
+        "  -l  also print timestamp, prb_id and msm_id before each record\n"
+        "  -c  only count the matching records\n"
+        "  -H  ask for huge pages on the mapping\n"
+        "  -n  print at most max records (default %d, 0 = all)\n"
+        "  -r  only look at records [start, start+count)\n"
+        "  -s  source address must be addr\n"
+        "  -d  destination address must be addr\n"
+        "  -a  either endpoint must be addr\n",
+        argv0, DEFAULT_PRINT_RECORDS);
+}
+
+static int parse_addr(const char *s, uint8_t out[16]) {
+    if (ext_parse_addr(s, out)) {
+        fprintf(stderr, "invalid address: %s\n", s);
+        return -1;
+    }
+    return 0;
+}
+
+static void print_info(const struct ext_file *f) {
+    printf("version %u, %llu records in %llu blocks, %u addresses\n", f->hdr->version,
+        (unsigned long long)f->record_count, (unsigned long long)f->block_count, f->naddrs);
+    for (uint16_t i = 0; i < f->hdr->nfields; i++) {
+        const struct ext_field *fd = &f->fields[i];
+        printf("  field %u %-.24s type %u encoding %u%s\n", fd->id, fd->name, fd->type, fd->encoding,
+            fd->flags & EXT_FIELD_PER_REPLY ? " per-reply" : fd->flags & EXT_FIELD_TABLE ? " table" : "");
+    }
+    printf("\n");
+}
 
 int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
+    int info = 0, count_only = 0, long_format = 0, flags = 0;
+    long long max_print = DEFAULT_PRINT_RECORDS;
+    uint64_t start = 0, count = UINT64_MAX;
+    uint8_t src[16], dst[16], any[16];
+    int has_src = 0, has_dst = 0, has_any = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "iclHn:r:s:d:a:")) != -1) {
+        switch (opt) {
+        case 'i': info = 1; break;
+        case 'c': count_only = 1; break;
+        case 'l': long_format = 1; break;
+        case 'H': flags |= EXT_OPEN_HUGEPAGE; break;
+        case 'n': max_print = atoll(optarg); break;
+        case 'r': {
+            char *end;
+            start = strtoull(optarg, &end, 10);
+            if (*end == ':') count = strtoull(end + 1, NULL, 10);
+            break;
+        }
+        case 's': if (parse_addr(optarg, src)) return 1; has_src = 1; break;
+        case 'd': if (parse_addr(optarg, dst)) return 1; has_dst = 1; break;
+        case 'a': if (parse_addr(optarg, any)) return 1; has_any = 1; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct ext_file f;
+    if (ext_open(&f, argv[optind], flags)) {
+        fprintf(stderr, "%s: %s\n", argv[optind], f.error);
         return 1;
     }
+    if (info) print_info(&f);
 
-    FILE* fp;
-    struct pingdata_s buf[10];
-    
-    fp = fopen(argv[1], "rb");
-    fread(buf, sizeof(struct pingdata_s), 10, fp);
+    struct ext_iter it;
+    struct ext_record r;
+    uint64_t matched = 0;
+    long long printed = 0;
 
-    struct pingdata_s pingdata;
+    ext_iter_init(&it, &f, start);
+    while (ext_iter_next(&it, &r) && r.index - start < count) {
+        if (has_src && memcmp(r.src_addr, src, 16) != 0) continue;
+        if (has_dst && memcmp(r.dst_addr, dst, 16) != 0) continue;
+        if (has_any && memcmp(r.src_addr, any, 16) != 0 && memcmp(r.dst_addr, any, 16) != 0) continue;
+        matched++;
 
-    for (int i = 0; i < 10; i++) {
-        pingdata = buf[i];
-        printf("%d.%d.%d.%d|%d.%d.%d.%d|%f|%f|%f\n\n", 
-            pingdata.dst_addr_1, pingdata.dst_addr_2, pingdata.dst_addr_3, pingdata.dst_addr_4, 
-            pingdata.src_addr_1, pingdata.src_addr_2, pingdata.src_addr_3, pingdata.src_addr_4, 
-            pingdata.rtt1, pingdata.rtt2, pingdata.rtt3);
+        if (count_only) continue;
+        if (max_print && printed >= max_print) break;
+        printed++;
+        if (long_format) printf("%llu|%u|%u|", (unsigned long long)r.timestamp, r.prb_id, r.msm_id);
+        char a[INET6_ADDRSTRLEN], b[INET6_ADDRSTRLEN];
+        printf("%s|%s", ext_format_addr(r.dst_addr, a, sizeof(a)), ext_format_addr(r.src_addr, b, sizeof(b)));
+        for (uint32_t k = 0; k < r.rtt_count; k++) printf("|%f", ext_rtt_ms(r.rtt, r.rtt_type, k));
+        printf("\n\n");
     }
-}
\ No newline at end of file
+    if (count_only) printf("%llu\n", (unsigned long long)matched);
+
+    ext_close(&f);
+    return 0;
+}
@@ -0,0 +1,639 @@
+// Throughput benchmark of the extract pipeline, so that changes to the
+// scanners, parsers, writer or threading can be compared run against run.
+//
+// extract.c is compiled into this file (with its main left out), so the
+// stages measured are exactly the ones extract runs. Input is either a
+// synthetic RIPE ping dump with a configurable mix of IPv4/IPv6 lines,
+// timeouts and reply counts, or a real dump given on the command line
+// (plain or .bz2). It is written to a temporary file first, so every run
+// reads from the page cache and the numbers are CPU, not disk, bound.
+//
+// Two kinds of runs are made, each repeated, keeping the fastest:
+//
+// stages   serial passes over the input with every scanner built in, each
+//          pass doing one stage more than the last: read lines, then
+//          prefilter_line (scan), then the full process_line (parse), then
+//          run_serial (write). A stage's time is the difference to the pass
+//          before it. Stages overlap in the threaded modes, so they are
+//          only split here.
+// modes    end-to-end runs as extract does them: serial, -j N ordered,
+//          -j N -u and, with -z, -z input.bz2 -j N, for every N of -j.
+//
+// Before them the address hash shared by the dictionary of extract and
+// ext_addr_index is checked on a million addresses of each of a few
+// shapes; with more than HASH_MAX_PROBES probes per lookup the benchmark
+// reports the runs but exits with 1.
+//
+// Results go to stdout (or -o) as one JSON object, with a table on stderr.
+
+#define EXTRACT_NO_MAIN
+#include "extract.c"
+
+#include <time.h>
+#include <bzlib.h>
+#include <sys/stat.h>
+
+#define DEFAULT_SIZE_MB 256
+#define DEFAULT_REPEAT 3
+#define DEFAULT_JOBS "1,2,4,8"
+#define MAX_JOB_COUNTS 32
+#define GEN_BUF (1 << 20)
+#define NDST 256                // anchors in the synthetic mix
+
+struct mix {
+    int v6_pct;                 // lines with "af":6
+    int timeout_pct;            // replies that are {"x":"*"}
+    int lost_pct;               // lines with only timeouts
+    int min_replies, max_replies;
+    uint64_t seed;
+};
+
+struct scanner {
+    const char *name;
+    scan_key_fn key;
+    scan_byte_fn byte;
+};
+
+static const struct scanner scanners[] = {
+    { "scalar", scan_key_scalar, scan_byte_scalar },
+#if defined(SCAN_X86)
+    { "sse2", scan_key_sse2, scan_byte_sse2 },
+    { "avx2", scan_key_avx2, scan_byte_avx2 },
+#elif defined(SCAN_NEON)
+    { "neon", scan_key_neon, scan_byte_neon },
+#endif
+};
+#define NSCANNERS (sizeof(scanners) / sizeof(scanners[0]))
+
+static double now_s(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static uint64_t rng_next(uint64_t *s) {
+    // xorshift64*
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1DULL;
+}
+
+static inline uint32_t rng_below(uint64_t *s, uint32_t n) {
+    return (uint32_t)((rng_next(s) >> 32) * n >> 32);
+}
+
+// ------------------------------------------------------------------
+// Input
+// ------------------------------------------------------------------
+
+static int format_addr(char *out, size_t cap, int v6, uint32_t id) {
+    if (v6) return snprintf(out, cap, "2001:67c:%x:%x::%x", (id >> 16) & 0xffff, id & 0xffff, (id * 2654435761u) >> 20);
+    return snprintf(out, cap, "%u.%u.%u.%u", 1 + (id >> 24) % 223, (id >> 16) & 0xff, (id >> 8) & 0xff, 1 + (id & 0xff) % 254);
+}
+
+// Writes one ping result line in the field order of RIPE Atlas dumps.
+static int format_line(char *out, size_t cap, const struct mix *m, uint64_t *rng) {
+    int v6 = rng_below(rng, 100) < (uint32_t)m->v6_pct;
+    int lost = rng_below(rng, 100) < (uint32_t)m->lost_pct;
+    int sent = m->min_replies + rng_below(rng, m->max_replies - m->min_replies + 1);
+    uint32_t dst = rng_below(rng, NDST) * 7919 + 101;
+    uint32_t src = (uint32_t)rng_next(rng);
+    uint32_t prb = 1000 + rng_below(rng, 30000);
+    uint32_t base_us = 500 + rng_below(rng, 300000);
+    char dst_s[48], src_s[48], result[MAX_REPLIES * 24 + 64];
+    format_addr(dst_s, sizeof(dst_s), v6, dst);
+    format_addr(src_s, sizeof(src_s), v6, src);
+
+    int rlen = 0, rcvd = 0;
+    uint32_t min_us = UINT32_MAX, max_us = 0;
+    uint64_t sum_us = 0;
+    for (int i = 0; i < sent; i++) {
+        const char *sep = i ? "," : "";
+        if (lost || rng_below(rng, 100) < (uint32_t)m->timeout_pct) {
+            rlen += snprintf(result + rlen, sizeof(result) - rlen, "%s{\"x\":\"*\"}", sep);
+            continue;
+        }
+        uint32_t us = base_us + rng_below(rng, base_us / 8 + 1);
+        rlen += snprintf(result + rlen, sizeof(result) - rlen, "%s{\"rtt\":%u.%03u}", sep, us / 1000, us % 1000);
+        rcvd++;
+        sum_us += us;
+        if (us < min_us) min_us = us;
+        if (us > max_us) max_us = us;
+    }
+    double mn = rcvd ? min_us / 1e3 : -1, mx = rcvd ? max_us / 1e3 : -1, avg = rcvd ? sum_us / 1e3 / rcvd : -1;
+    uint32_t ts = 1767657600 + rng_below(rng, 3600);
+
+    return snprintf(out, cap,
+        "{\"fw\":5080,\"mver\":\"2.6.2\",\"lts\":%u,\"dst_name\":\"%s\",\"af\":%d,\"dst_addr\":\"%s\","
+        "\"src_addr\":\"%s\",\"proto\":\"ICMP\",\"ttl\":%u,\"size\":48,\"result\":[%s],\"dup\":0,"
+        "\"rcvd\":%d,\"sent\":%d,\"min\":%.3f,\"max\":%.3f,\"avg\":%.3f,\"msm_id\":%u,\"prb_id\":%u,"
+        "\"timestamp\":%u,\"msm_name\":\"Ping\",\"from\":\"%s\",\"type\":\"ping\",\"group_id\":%u,"
+        "\"step\":240,\"stored_timestamp\":%u}\n",
+        rng_below(rng, 120), dst_s, v6 ? 6 : 4, dst_s, src_s, 40 + rng_below(rng, 24), result,
+        rcvd, sent, mn, mx, avg, 1000000 + dst % 5000, prb, ts, src_s, 1000000 + dst % 5000, ts + 5);
+}
+
+static int generate(int fd, uint64_t size, const struct mix *m) {
+    char *buf = malloc(GEN_BUF);
+    uint64_t rng = m->seed ? m->seed : 1, written = 0;
+    size_t used = 0;
+    if (!buf) return -1;
+    while (written + used < size) {
+        if (GEN_BUF - used < 4096) {
+            if (write_all(fd, buf, used)) {
+                free(buf);
+                return -1;
+            }
+            written += used;
+            used = 0;
+        }
+        used += format_line(buf + used, GEN_BUF - used, m, &rng);
+    }
+    int rc = write_all(fd, buf, used);
+    free(buf);
+    return rc;
+}
+
+// Decompresses (to_plain) or compresses a whole file through libbz2.
+static int bz2_convert(const char *from, const char *to, int to_plain) {
+    FILE *in = fopen(from, "rb"), *out = fopen(to, "wb");
+    char *buf = malloc(GEN_BUF);
+    int bzerr = BZ_OK, rc = -1;
+    BZFILE *b = NULL;
+    if (!in || !out || !buf) goto DONE;
+
+    if (to_plain) {
+        // Concatenated streams are read one after the other, like bzcat;
+        // the bytes read past the end of one start the next.
+        char rest[BZ_MAX_UNUSED];
+        int nrest = 0;
+        while (1) {
+            if (!(b = BZ2_bzReadOpen(&bzerr, in, 0, 0, rest, nrest))) goto DONE;
+            do {
+                int n = BZ2_bzRead(&bzerr, b, buf, GEN_BUF);
+                if ((bzerr == BZ_OK || bzerr == BZ_STREAM_END) && fwrite(buf, 1, n, out) != (size_t)n) goto DONE;
+            } while (bzerr == BZ_OK);
+            if (bzerr != BZ_STREAM_END) goto DONE;
+            void *unused;
+            BZ2_bzReadGetUnused(&bzerr, b, &unused, &nrest);
+            memcpy(rest, unused, nrest);
+            BZ2_bzReadClose(&bzerr, b);
+            b = NULL;
+            if (nrest == 0) {
+                int c = fgetc(in);
+                if (c == EOF) break;
+                ungetc(c, in);
+            }
+        }
+    } else {
+        if (!(b = BZ2_bzWriteOpen(&bzerr, out, 9, 0, 0))) goto DONE;
+        size_t n;
+        while ((n = fread(buf, 1, GEN_BUF, in)) > 0) {
+            BZ2_bzWrite(&bzerr, b, buf, (int)n);
+            if (bzerr != BZ_OK) goto DONE;
+        }
+        BZ2_bzWriteClose(&bzerr, b, 0, NULL, NULL);
+        b = NULL;
+        if (bzerr != BZ_OK) goto DONE;
+    }
+    rc = ferror(in) ? -1 : 0;
+
+DONE:
+    if (b && to_plain) BZ2_bzReadClose(&bzerr, b);
+    if (b && !to_plain) BZ2_bzWriteClose(&bzerr, b, 1, NULL, NULL);
+    if (out && fclose(out)) rc = -1;
+    if (in) fclose(in);
+    free(buf);
+    return rc;
+}
+
+static int ends_with(const char *s, const char *suffix) {
+    size_t n = strlen(s), k = strlen(suffix);
+    return n >= k && !strcmp(s + n - k, suffix);
+}
+
+// ------------------------------------------------------------------
+// Runs
+// ------------------------------------------------------------------
+
+enum pass { PASS_READ, PASS_SCAN, PASS_PARSE, PASS_WRITE, NPASSES };
+
+static const char *const pass_names[NPASSES] = { "read", "scan", "parse", "write" };
+
+static int rewind_fds(int in_fd, int out_fd) {
+    if (in_fd >= 0 && lseek(in_fd, 0, SEEK_SET) < 0) return -1;
+    if (ftruncate(out_fd, 0) || lseek(out_fd, 0, SEEK_SET) < 0) return -1;
+    return 0;
+}
+
+// One serial pass up to the given stage; returns seconds or -1.
+static double run_pass(enum pass pass, int in_fd, int out_fd, size_t batch_records, struct line_stats *st) {
+    memset(st, 0, sizeof(*st));
+    if (rewind_fds(in_fd, out_fd)) return -1;
+    if (pass == PASS_WRITE) {
+        struct run_stats rs = { 0 };
+        double t0 = now_s();
+        if (run_serial(in_fd, out_fd, batch_records, &rs)) return -1;
+        double t = now_s() - t0;
+        *st = rs.lines;
+        return t;
+    }
+
+    char *buf = malloc(BUFFER_SIZE + SCAN_PAD);
+    if (!buf) return -1;
+    struct line_reader reader;
+    struct pingdata_s rec;
+    char *line;
+    size_t len;
+    int rc;
+    line_reader_init(&reader, in_fd, buf);
+
+    double t0 = now_s();
+    while ((rc = line_reader_next(&reader, &line, &len)) > 0) {
+        if (pass == PASS_READ) {
+            st->lines++;
+        } else if (pass == PASS_SCAN) {
+            st->lines++;
+            st->verdicts[prefilter_line(line)]++;
+        } else {
+            process_line(line, &rec, st);
+        }
+    }
+    double t = now_s() - t0;
+    free(buf);
+    return rc < 0 ? -1 : t;
+}
+
+enum mode { MODE_SERIAL, MODE_ORDERED, MODE_UNORDERED, MODE_BZ2, NMODES };
+
+static const char *const mode_names[NMODES] = { "serial", "ordered", "unordered", "bz2" };
+
+static double run_mode(enum mode mode, int jobs, int in_fd, const char *bz2_path, int out_fd,
+                       size_t batch_records, struct line_stats *st) {
+    struct run_stats rs = { 0 };
+    memset(st, 0, sizeof(*st));
+    if (rewind_fds(mode == MODE_BZ2 ? -1 : in_fd, out_fd)) return -1;
+    double t0 = now_s();
+    int rc;
+    if (mode == MODE_BZ2) {
+        // Opening includes the magic scan, which extract -z pays too
+        struct bz2_file bz;
+        if (bz2_open(&bz, bz2_path, jobs)) return -1;
+        rc = run_parallel(-1, &bz, out_fd, batch_records, jobs, 1, &rs);
+        bz2_close(&bz);
+    } else if (mode == MODE_SERIAL) {
+        rc = run_serial(in_fd, out_fd, batch_records, &rs);
+    } else {
+        rc = run_parallel(in_fd, NULL, out_fd, batch_records, jobs, mode == MODE_ORDERED, &rs);
+    }
+    double t = now_s() - t0;
+    *st = rs.lines;
+    return rc ? -1 : t;
+}
+
+// ------------------------------------------------------------------
+// Address hash
+// ------------------------------------------------------------------
+
+// Extract's dictionary and ext_addr_index share ext_addr_hash and the 0.7
+// load limit, so the probe lengths of one stand for both. Linear probing
+// at that load expects about 2.2 probes per hit with a good hash.
+#define HASH_ADDRS 1000000
+#define HASH_MAX_PROBES 3.0
+
+enum hash_set { HASH_V4_SEQ, HASH_V4_SUBNETS, HASH_V4_RANDOM, HASH_V6, NHASH_SETS };
+
+static const char *const hash_set_names[NHASH_SETS] = { "v4_seq", "v4_subnets", "v4_random", "v6" };
+
+// Address i of one shape of real dictionaries: a block of consecutive
+// IPv4 addresses, one host per /24 across a few /8s, spread IPv4, and
+// IPv6 hosts differing in their last bits.
+static void hash_addr(enum hash_set set, uint32_t i, uint64_t *rng, uint8_t *a) {
+    uint32_t v4;
+    memcpy(a, v4_mapped_prefix, 12);
+    switch (set) {
+    case HASH_V4_SEQ: v4 = 0x0a000000u + i; break;
+    case HASH_V4_SUBNETS: v4 = (uint32_t)(8 + i % 4) << 24 | (i / 4) << 8 | 1; break;
+    case HASH_V4_RANDOM: v4 = (uint32_t)rng_next(rng); break;
+    default:
+        memset(a, 0, 16);
+        a[0] = 0x20, a[1] = 0x01, a[2] = 0x06, a[3] = 0x7c;
+        a[12] = i >> 24, a[13] = i >> 16, a[14] = i >> 8, a[15] = i;
+        return;
+    }
+    a[12] = v4 >> 24, a[13] = v4 >> 16, a[14] = v4 >> 8, a[15] = v4;
+}
+
+// Fills a dictionary with one address set; returns the seconds taken and
+// the mean probes of a lookup of every address, or -1 without memory.
+static double run_hash(enum hash_set set, double *probes) {
+    struct addr_dict d = { 0 };
+    uint64_t rng = 1;
+    uint8_t a[16];
+    double t0 = now_s();
+    for (uint32_t i = 0; i < HASH_ADDRS; i++) {
+        hash_addr(set, i, &rng, a);
+        if (addr_dict_intern(&d, a) == UINT32_MAX) {
+            free(d.addr);
+            free(d.slots);
+            return -1;
+        }
+    }
+    double t = now_s() - t0;
+    uint64_t total = 0;
+    for (uint32_t id = 0; id < d.n; id++) {
+        size_t h = ext_addr_hash(d.addr[id]) & d.mask;
+        for (total++; d.slots[h] != id + 1; h = (h + 1) & d.mask) total++;
+    }
+    *probes = d.n ? (double)total / d.n : 0;
+    free(d.addr);
+    free(d.slots);
+    return t;
+}
+
+static int parse_jobs(const char *s, int *out) {
+    int n = 0;
+    while (*s) {
+        char *end;
+        long j = strtol(s, &end, 10);
+        if (end == s || j < 1 || j > MAX_JOBS || n == MAX_JOB_COUNTS) return -1;
+        out[n++] = (int)j;
+        s = *end == ',' ? end + 1 : end;
+        if (*end && *end != ',') return -1;
+    }
+    return n;
+}
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void json_rates(FILE *f, double secs, uint64_t bytes, const struct line_stats *st) {
+    fprintf(f, "\"seconds\": %.6f, \"mb_per_s\": %.2f, \"lines_per_s\": %.0f, \"records_per_s\": %.0f",
+        secs, bytes / secs / 1e6, st->lines / secs, st->verdicts[LINE_RECORD] / secs);
+}
+
+static void bench_usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-s size_mb=%d] [-S seed] [-6 v6_pct=30] [-x timeout_pct=5] [-L lost_pct=10]\n"
+        "          [-c min_replies-max_replies=1-16] [-j jobs=%s] [-r repeat=%d] [-b block_records]\n"
+        "          [-z] [-d tmpdir=/tmp] [-l label] [-o result.json] [sample dump]\n"
+        "  -s -S -6 -x -L -c  size and line mix of the synthetic input\n"
+        "  -j  thread counts of the threaded modes, comma separated\n"
+        "  -r  runs of each measurement; the fastest is kept\n"
+        "  -z  also time -z on a bzip2 copy of the input (compressed once)\n"
+        "  -l  label stored in the result, e.g. the commit being measured\n"
+        "  sample dump: replay a real RIPE dump (plain or .bz2) instead\n",
+        argv0, DEFAULT_SIZE_MB, DEFAULT_JOBS, DEFAULT_REPEAT);
+}
+
+int main(int argc, char* argv[]) {
+    struct mix mix = { .v6_pct = 30, .timeout_pct = 5, .lost_pct = 10, .min_replies = 1, .max_replies = 16, .seed = 1 };
+    uint64_t size_mb = DEFAULT_SIZE_MB;
+    int job_counts[MAX_JOB_COUNTS];
+    int njobs = parse_jobs(DEFAULT_JOBS, job_counts);
+    int repeat = DEFAULT_REPEAT;
+    size_t batch_records = DEFAULT_BATCH_RECORDS;
+    int with_bz2 = 0;
+    const char *tmpdir = "/tmp", *label = "", *out_path = NULL, *sample = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:S:6:x:L:c:j:r:b:zd:l:o:")) != -1) {
+        switch (opt) {
+        case 's': size_mb = strtoull(optarg, NULL, 10); break;
+        case 'S': mix.seed = strtoull(optarg, NULL, 10); break;
+        case '6': mix.v6_pct = atoi(optarg); break;
+        case 'x': mix.timeout_pct = atoi(optarg); break;
+        case 'L': mix.lost_pct = atoi(optarg); break;
+        case 'c':
+            if (sscanf(optarg, "%d-%d", &mix.min_replies, &mix.max_replies) == 1) mix.max_replies = mix.min_replies;
+            break;
+        case 'j':
+            if ((njobs = parse_jobs(optarg, job_counts)) <= 0) {
+                fprintf(stderr, "invalid job counts: %s (1-%d each)\n", optarg, MAX_JOBS);
+                return 1;
+            }
+            break;
+        case 'r': repeat = atoi(optarg); break;
+        case 'b':
+            batch_records = strtoul(optarg, NULL, 10);
+            if (batch_records == 0 || batch_records > MAX_BLOCK_RECORDS) {
+                fprintf(stderr, "invalid batch size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'z': with_bz2 = 1; break;
+        case 'd': tmpdir = optarg; break;
+        case 'l': label = optarg; break;
+        case 'o': out_path = optarg; break;
+        default:
+            bench_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind > 1 || size_mb == 0 || repeat < 1 || mix.min_replies < 1 || mix.max_replies > MAX_REPLIES ||
+        mix.min_replies > mix.max_replies || mix.v6_pct < 0 || mix.v6_pct > 100 || mix.timeout_pct < 0 ||
+        mix.timeout_pct > 100 || mix.lost_pct < 0 || mix.lost_pct > 100) {
+        bench_usage(argv[0]);
+        return 1;
+    }
+    if (optind < argc) sample = argv[optind];
+
+    char plain_path[4096], bz2_path[4096 + 8], out_tmp[4096];
+    snprintf(plain_path, sizeof(plain_path), "%s/extbench-in.XXXXXX", tmpdir);
+    snprintf(out_tmp, sizeof(out_tmp), "%s/extbench-out.XXXXXX", tmpdir);
+    bz2_path[0] = 0;
+    int in_fd = mkstemp(plain_path);
+    int out_fd = mkstemp(out_tmp);
+    if (in_fd < 0 || out_fd < 0) {
+        perror(tmpdir);
+        return 1;
+    }
+    unlink(out_tmp);
+
+    int rc = 1;
+    FILE *out = stdout;
+    if (sample && ends_with(sample, ".bz2")) {
+        fprintf(stderr, "decompressing %s\n", sample);
+        if (bz2_convert(sample, plain_path, 1)) {
+            perror(sample);
+            goto DONE;
+        }
+        if (with_bz2) snprintf(bz2_path, sizeof(bz2_path), "%s", sample);
+    } else if (sample) {
+        int fd = open(sample, O_RDONLY);
+        char *buf = malloc(GEN_BUF);
+        ssize_t n = 0;
+        while (fd >= 0 && buf && (n = read(fd, buf, GEN_BUF)) > 0) {
+            if (write_all(in_fd, buf, n)) break;
+        }
+        free(buf);
+        if (fd < 0 || n != 0) {
+            perror(sample);
+            if (fd >= 0) close(fd);
+            goto DONE;
+        }
+        close(fd);
+    } else {
+        fprintf(stderr, "generating %llu MB of synthetic pings\n", (unsigned long long)size_mb);
+        if (generate(in_fd, size_mb << 20, &mix)) {
+            perror(plain_path);
+            goto DONE;
+        }
+    }
+    if (with_bz2 && !bz2_path[0]) {
+        fprintf(stderr, "compressing the input for -z\n");
+        snprintf(bz2_path, sizeof(bz2_path), "%s.bz2", plain_path);
+        if (bz2_convert(plain_path, bz2_path, 0)) {
+            perror(bz2_path);
+            unlink(bz2_path);
+            bz2_path[0] = 0;
+            goto DONE;
+        }
+    }
+
+    // Only the descriptors are used from here on
+    unlink(plain_path);
+    plain_path[0] = 0;
+
+    struct stat sb;
+    if (fstat(in_fd, &sb)) {
+        perror(plain_path);
+        goto DONE;
+    }
+    uint64_t bytes = sb.st_size;
+    uint64_t bz2_bytes = 0;
+    if (bz2_path[0] && !stat(bz2_path, &sb)) bz2_bytes = sb.st_size;
+    if (out_path && !(out = fopen(out_path, "w"))) {
+        perror(out_path);
+        goto DONE;
+    }
+
+    fprintf(out, "{\n  \"label\": ");
+    json_string(out, label);
+    fprintf(out, ",\n  \"input\": {\"source\": ");
+    json_string(out, sample ? sample : "synthetic");
+    fprintf(out, ", \"bytes\": %llu", (unsigned long long)bytes);
+    if (bz2_bytes) fprintf(out, ", \"bz2_bytes\": %llu", (unsigned long long)bz2_bytes);
+    if (!sample) {
+        fprintf(out, ", \"seed\": %llu, \"v6_pct\": %d, \"timeout_pct\": %d, \"lost_pct\": %d, \"replies\": [%d, %d]",
+            (unsigned long long)mix.seed, mix.v6_pct, mix.timeout_pct, mix.lost_pct, mix.min_replies, mix.max_replies);
+    }
+    fprintf(out, "},\n  \"repeat\": %d, \"block_records\": %zu, \"cpus\": %ld,\n", repeat, batch_records,
+        sysconf(_SC_NPROCESSORS_ONLN));
+
+    // A weak address hash shows up as long probe runs long before it does
+    // in any throughput number, so it fails the run
+    int hash_ok = 1;
+    fprintf(out, "  \"addr_hash\": [");
+    fprintf(stderr, "%-10s %10s %10s\n", "addresses", "seconds", "probes");
+    for (int h = 0; h < NHASH_SETS; h++) {
+        double probes;
+        double t = run_hash(h, &probes);
+        if (t < 0) {
+            perror("address hash");
+            goto DONE;
+        }
+        if (probes > HASH_MAX_PROBES) hash_ok = 0;
+        fprintf(out, "%s\n    {\"addresses\": \"%s\", \"count\": %d, \"seconds\": %.6f, \"probes\": %.3f}",
+            h ? "," : "", hash_set_names[h], HASH_ADDRS, t, probes);
+        fprintf(stderr, "%-10s %10.3f %10.3f%s\n", hash_set_names[h], t, probes,
+            probes > HASH_MAX_PROBES ? "  too many probes" : "");
+    }
+    fprintf(out, "\n  ],\n");
+    fprintf(stderr, "\n");
+
+    // Stage split, per scanner
+    fprintf(out, "  \"stages\": [");
+    fprintf(stderr, "%-8s %10s %10s %10s %10s %10s\n", "scanner", "read s", "scan s", "parse s", "write s", "MB/s");
+    struct line_stats st;
+    for (size_t s = 0; s < NSCANNERS; s++) {
+#if defined(SCAN_X86)
+        __builtin_cpu_init();
+        if (!strcmp(scanners[s].name, "avx2") && !__builtin_cpu_supports("avx2")) continue;
+#endif
+        scan_key = scanners[s].key;
+        scan_byte = scanners[s].byte;
+        double best[NPASSES];
+        for (int p = 0; p < NPASSES; p++) {
+            best[p] = -1;
+            for (int r = 0; r < repeat; r++) {
+                double t = run_pass(p, in_fd, out_fd, batch_records, &st);
+                if (t < 0) {
+                    perror("benchmark pass");
+                    goto DONE;
+                }
+                if (best[p] < 0 || t < best[p]) best[p] = t;
+            }
+        }
+        fprintf(out, "%s\n    {\"scanner\": \"%s\", ", s ? "," : "", scanners[s].name);
+        json_rates(out, best[PASS_WRITE], bytes, &st);
+        fprintf(out, ",\n     \"stage_seconds\": {");
+        fprintf(stderr, "%-8s", scanners[s].name);
+        for (int p = 0; p < NPASSES; p++) {
+            // Timer noise can make a cheap stage come out negative
+            double t = p ? best[p] - best[p - 1] : best[p];
+            if (t < 0) t = 0;
+            fprintf(out, "%s\"%s\": %.6f", p ? ", " : "", pass_names[p], t);
+            fprintf(stderr, " %10.3f", t);
+        }
+        fprintf(out, "}}");
+        fprintf(stderr, " %10.1f\n", bytes / best[PASS_WRITE] / 1e6);
+    }
+
+    // End to end, with the scanner extract would pick
+    scanner_init();
+    fprintf(out, "\n  ],\n  \"modes\": [");
+    fprintf(stderr, "\n%-10s %5s %10s %10s %12s %12s %8s\n", "mode", "jobs", "seconds", "MB/s", "lines/s", "records/s", "speedup");
+    double serial_best = -1;
+    int first = 1;
+    for (int m = 0; m < NMODES; m++) {
+        if (m == MODE_BZ2 && !bz2_path[0]) continue;
+        for (int j = 0; j < (m == MODE_SERIAL ? 1 : njobs); j++) {
+            int jobs = m == MODE_SERIAL ? 1 : job_counts[j];
+            double best = -1;
+            for (int r = 0; r < repeat; r++) {
+                double t = run_mode(m, jobs, in_fd, bz2_path, out_fd, batch_records, &st);
+                if (t < 0) {
+                    perror(mode_names[m]);
+                    goto DONE;
+                }
+                if (best < 0 || t < best) best = t;
+            }
+            if (m == MODE_SERIAL) serial_best = best;
+            fprintf(out, "%s\n    {\"mode\": \"%s\", \"jobs\": %d, ", first ? "" : ",", mode_names[m], jobs);
+            json_rates(out, best, bytes, &st);
+            fprintf(out, ", \"records\": %llu, \"speedup\": %.2f}",
+                (unsigned long long)st.verdicts[LINE_RECORD], serial_best / best);
+            fprintf(stderr, "%-10s %5d %10.3f %10.1f %12.0f %12.0f %8.2f\n", mode_names[m], jobs, best,
+                bytes / best / 1e6, st.lines / best, st.verdicts[LINE_RECORD] / best, serial_best / best);
+            first = 0;
+        }
+    }
+    fprintf(out, "\n  ],\n  \"verdicts\": {");
+    for (int i = 0; i < LINE_VERDICTS; i++) {
+        fprintf(out, "%s\"%s\": %llu", i ? ", " : "", line_verdict_names[i], (unsigned long long)st.verdicts[i]);
+    }
+    fprintf(out, "}\n}\n");
+    if (hash_ok) rc = 0;
+    else fprintf(stderr, "address hash: more than %.1f probes per lookup\n", HASH_MAX_PROBES);
+
+DONE:
+    if (out != stdout && out && fclose(out)) {
+        perror(out_path);
+        rc = 1;
+    }
+    close(in_fd);
+    close(out_fd);
+    if (plain_path[0]) unlink(plain_path);
+    // A replayed .bz2 sample is used in place and must not be removed
+    if (bz2_path[0] && strcmp(bz2_path, sample ? sample : "")) unlink(bz2_path);
+    return rc;
+}
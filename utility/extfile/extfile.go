@@ -0,0 +1,262 @@
+// Package extfile reads extract output files in place. The layout is
+// defined in utility/extfmt.h: a file header and field schema, then
+// columnar blocks that each start with a column table.
+package extfile
+
+import (
+	"encoding/binary"
+	"errors"
+	"fmt"
+	"net/netip"
+	"os"
+	"syscall"
+)
+
+const (
+	magic      = "RIPEEXT\x00"
+	version    = 3
+	minVersion = 1
+	byteOrder  = 0x01020304
+	blockMagic = 0x004b4c42
+
+	FieldSrcAddr   = 1
+	FieldDstAddr   = 2
+	FieldRttCount  = 3
+	FieldRtt       = 4
+	FieldTimestamp = 5
+	FieldPrbID     = 6
+	FieldMsmID     = 7
+	FieldSrcID     = 8
+	FieldDstID     = 9
+	FieldAddrTable = 10
+
+	TypeU8   = 1
+	TypeU16  = 2
+	TypeU32  = 3
+	TypeU64  = 4
+	TypeF32  = 5
+	TypeIPv4 = 6
+	TypeIPv6 = 7
+
+	EncRaw  = 0
+	EncFOR  = 1
+	EncUsec = 2
+
+	fileHeaderSize  = 32
+	fieldSize       = 32
+	blockHeaderSize = 24
+	columnSize      = 24
+)
+
+type column struct {
+	Type     uint8
+	Encoding uint8
+	Data     []byte
+}
+
+type Block struct {
+	NRecords int
+	NValues  int
+	columns  map[uint16]column
+	addrs    [][]byte
+}
+
+// Column returns the raw bytes of a column, or nil if the block does not
+// have it. The slice points into the file mapping and is only valid
+// during the Read callback.
+func (b *Block) Column(field uint16) []byte {
+	return b.columns[field].Data
+}
+
+// ColumnInfo returns the stored type and encoding of a column, which may
+// be narrower than its schema type (see extfmt.h).
+func (b *Block) ColumnInfo(field uint16) (typ, encoding uint8) {
+	c := b.columns[field]
+	return c.Type, c.Encoding
+}
+
+// Dictionary returns the file's address dictionary as far as this block
+// defines it: 16-byte addresses by id, IPv4 as ::ffff:a.b.c.d. It is empty
+// for files older than version 3. The slices are only valid during the
+// Read call.
+func (b *Block) Dictionary() [][]byte {
+	return b.addrs
+}
+
+// Endpoints returns the addresses of record i from the id columns of
+// version 3 files or the IPv4 columns of older ones; all four fields must
+// have been requested. IPv4 addresses come back unmapped.
+func (b *Block) Endpoints(i int) (src, dst netip.Addr, err error) {
+	if srcID, dstID := b.Column(FieldSrcID), b.Column(FieldDstID); srcID != nil && dstID != nil {
+		s := int(binary.NativeEndian.Uint32(srcID[i*4:]))
+		d := int(binary.NativeEndian.Uint32(dstID[i*4:]))
+		src = netip.AddrFrom16([16]byte(b.addrs[s])).Unmap()
+		dst = netip.AddrFrom16([16]byte(b.addrs[d])).Unmap()
+		return src, dst, nil
+	}
+	srcAddr, dstAddr := b.Column(FieldSrcAddr), b.Column(FieldDstAddr)
+	if srcAddr == nil || dstAddr == nil {
+		return src, dst, errors.New("block lacks address columns")
+	}
+	src = netip.AddrFrom4([4]byte(srcAddr[i*4 : i*4+4]))
+	dst = netip.AddrFrom4([4]byte(dstAddr[i*4 : i*4+4]))
+	return src, dst, nil
+}
+
+// typeSize is the stored width of one value, or 0 for an unknown type.
+func typeSize(typ uint8) uint64 {
+	switch typ {
+	case TypeU8:
+		return 1
+	case TypeU16:
+		return 2
+	case TypeU32, TypeF32, TypeIPv4:
+		return 4
+	case TypeU64:
+		return 8
+	case TypeIPv6:
+		return 16
+	}
+	return 0
+}
+
+// shapeOK mirrors shape_ok in extread.c: the count, type and encoding a
+// known field must have before its values can be indexed by record.
+func shapeOK(b *Block, field uint16, c column, count uint64) bool {
+	nrecords, nvalues := uint64(b.NRecords), uint64(b.NValues)
+	switch field {
+	case FieldSrcAddr, FieldDstAddr:
+		return count == nrecords && c.Type == TypeIPv4 && c.Encoding == EncRaw
+	case FieldRttCount:
+		return count == nrecords && c.Type == TypeU8 && c.Encoding == EncRaw
+	case FieldSrcID, FieldDstID, FieldPrbID, FieldMsmID:
+		return count == nrecords && c.Type == TypeU32 && c.Encoding == EncRaw
+	case FieldRtt:
+		return count == nvalues && ((c.Type == TypeF32 && c.Encoding == EncRaw) ||
+			(c.Type == TypeU32 && c.Encoding == EncUsec))
+	case FieldTimestamp:
+		return count == nrecords && c.Type >= TypeU8 && c.Type <= TypeU64 &&
+			(c.Encoding == EncRaw || c.Encoding == EncFOR)
+	case FieldAddrTable:
+		return c.Type == TypeIPv6 && c.Encoding == EncRaw
+	}
+	return true
+}
+
+// Read maps filename and calls fn for every block. Only the
+// columns listed in fields are exposed, so pages of other columns are
+// never touched. Exposed columns are checked against the block's record
+// and value counts and ids against the dictionary, as extread.c does, so
+// indexing them by record cannot go out of range.
+func Read(filename string, fields []uint16, fn func(b *Block) error) error {
+	file, err := os.Open(filename)
+	if err != nil {
+		return err
+	}
+	defer file.Close()
+
+	info, err := file.Stat()
+	if err != nil {
+		return err
+	}
+	size := info.Size()
+	if size < fileHeaderSize {
+		return errors.New("not an extract file")
+	}
+	data, err := syscall.Mmap(int(file.Fd()), 0, int(size), syscall.PROT_READ, syscall.MAP_SHARED)
+	if err != nil {
+		return fmt.Errorf("mmap: %w", err)
+	}
+	defer syscall.Munmap(data)
+	syscall.Madvise(data, syscall.MADV_SEQUENTIAL)
+
+	if string(data[:8]) != magic {
+		return errors.New("not an extract file")
+	}
+	if binary.NativeEndian.Uint32(data[8:]) != byteOrder {
+		return errors.New("extract file has foreign byte order")
+	}
+	if v := binary.NativeEndian.Uint16(data[12:]); v < minVersion || v > version {
+		return fmt.Errorf("unsupported extract format version %d", v)
+	}
+	nfields := int64(binary.NativeEndian.Uint16(data[14:]))
+
+	wanted := make(map[uint16]bool, len(fields))
+	for _, f := range fields {
+		wanted[f] = true
+	}
+	block := &Block{columns: make(map[uint16]column, len(fields))}
+	// The dictionary is needed to resolve ids whether or not it was asked for.
+	wanted[FieldAddrTable] = true
+
+	offset := fileHeaderSize + nfields*fieldSize
+	for offset < size {
+		if size-offset < blockHeaderSize {
+			return fmt.Errorf("truncated block header at %d", offset)
+		}
+		bh := data[offset:]
+		if binary.NativeEndian.Uint32(bh[0:]) != blockMagic {
+			return fmt.Errorf("bad block magic at %d", offset)
+		}
+		ncols := int64(binary.NativeEndian.Uint32(bh[4:]))
+		block.NRecords = int(binary.NativeEndian.Uint32(bh[8:]))
+		block.NValues = int(binary.NativeEndian.Uint32(bh[12:]))
+		blockSize := int64(binary.NativeEndian.Uint64(bh[16:]))
+		if blockSize > size-offset || blockSize < blockHeaderSize+ncols*columnSize {
+			return fmt.Errorf("bad block size at %d", offset)
+		}
+		bh = bh[:blockSize]
+
+		clear(block.columns)
+		for i := range ncols {
+			col := bh[blockHeaderSize+i*columnSize:]
+			field := binary.NativeEndian.Uint16(col[0:])
+			if !wanted[field] {
+				continue
+			}
+			count := uint64(binary.NativeEndian.Uint32(col[4:]))
+			colOffset := binary.NativeEndian.Uint64(col[8:])
+			colSize := binary.NativeEndian.Uint64(col[16:])
+			if colOffset > uint64(blockSize) || colSize > uint64(blockSize)-colOffset {
+				return fmt.Errorf("column %d out of bounds in block at %d", field, offset)
+			}
+			c := column{Type: col[2], Encoding: col[3], Data: bh[colOffset : colOffset+colSize]}
+			var head uint64
+			if c.Encoding == EncFOR {
+				head = 8
+			}
+			known := c.Encoding == EncRaw || c.Encoding == EncFOR || c.Encoding == EncUsec
+			if ts := typeSize(c.Type); !shapeOK(block, field, c, count) ||
+				(known && ts != 0 && colSize != head+count*ts) {
+				return fmt.Errorf("column %d has the wrong size or type in block at %d", field, offset)
+			}
+			block.columns[field] = c
+		}
+		for a := block.Column(FieldAddrTable); len(a) > 0; a = a[16:] {
+			block.addrs = append(block.addrs, a[:16])
+		}
+		if counts := block.Column(FieldRttCount); counts != nil {
+			total := 0
+			for _, n := range counts {
+				total += int(n)
+			}
+			if total != block.NValues {
+				return fmt.Errorf("rtt counts do not match values in block at %d", offset)
+			}
+		}
+		for _, f := range []uint16{FieldSrcID, FieldDstID} {
+			ids := block.Column(f)
+			for ; len(ids) > 0; ids = ids[4:] {
+				if int(binary.NativeEndian.Uint32(ids)) >= len(block.addrs) {
+					return fmt.Errorf("address id out of range in block at %d", offset)
+				}
+			}
+		}
+
+		if err := fn(block); err != nil {
+			return err
+		}
+		offset += blockSize
+	}
+	return nil
+}
@@ -0,0 +1,3 @@
+module extfile
+
+go 1.24.3
@@ -0,0 +1,140 @@
+#ifndef EXTFMT_H
+#define EXTFMT_H
+
+#include <stdint.h>
+#include <string.h>
+
+// On-disk format of extract output.
+//
+//   ext_file_header
+//   ext_field[nfields]        schema: every field that may appear
+//   block*                    until end of file
+//
+// A block holds up to a few hundred thousand records stored column by
+// column:
+//
+//   ext_block_header
+//   ext_column[ncols]
+//   column data               each column starts 8-byte aligned
+//
+// Per-record columns have nrecords values. Per-reply columns (flag
+// EXT_FIELD_PER_REPLY) have nvalues values, where record i owns the next
+// rtt_count[i] of them. Readers locate the columns they need through the
+// block's column table and skip the rest, so new fields can be added
+// without breaking old readers.
+//
+// All integers are in the writer's native byte order. byte_order shows
+// which that was; readers reject files of a foreign byte order rather than
+// swap them.
+//
+// From version 3 records carry 32-bit ids (src_id, dst_id) into a per-file
+// dictionary of 16-byte addresses in network order, IPv4 as ::ffff:a.b.c.d.
+// Ids are handed out in order of first use, and each block's addr_table
+// column (flag EXT_FIELD_TABLE, count independent of nrecords) holds the
+// addresses first used in that block. The dictionary is the concatenation
+// of those columns in block order, so it is never rewritten and every id a
+// block uses is defined by the time the block is read. Versions 1 and 2
+// store src_addr and dst_addr as four octets in address order instead.
+//
+// A column's type and encoding may differ from its schema entry: the
+// schema gives the logical type, the column the stored one. That lets a
+// writer pick the narrowest width per block, e.g. timestamps in one hourly
+// block are stored as EXT_ENC_FOR with 16-bit offsets.
+//
+// Versions:
+//   1  src_addr, dst_addr, rtt_count (always 3), rtt as F32 ms
+//   2  every reply (rtt_count 1..16), rtt as U32 microseconds
+//      (EXT_ENC_USEC), timestamp, prb_id and msm_id
+//   3  IPv6; src_id, dst_id and addr_table replace src_addr and dst_addr
+
+#define EXT_MAGIC "RIPEEXT\0"
+#define EXT_VERSION 3
+#define EXT_MIN_VERSION 1           // oldest version readers still accept
+#define EXT_BYTE_ORDER 0x01020304u
+#define EXT_BLOCK_MAGIC 0x004b4c42u     // "BLK\0" little-endian
+
+struct ext_file_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t nfields;
+    uint64_t record_count;      // patched when the writer closes
+    uint64_t block_count;
+};
+
+struct ext_field {
+    uint16_t id;                // EXT_FIELD_*
+    uint8_t type;               // EXT_TYPE_*
+    uint8_t encoding;           // EXT_ENC_*
+    uint32_t flags;             // EXT_FIELD_*
+    char name[24];
+};
+
+struct ext_block_header {
+    uint32_t magic;
+    uint32_t ncols;
+    uint32_t nrecords;
+    uint32_t nvalues;           // replies in the block
+    uint64_t size;              // whole block including this header
+};
+
+struct ext_column {
+    uint16_t field;
+    uint8_t type;
+    uint8_t encoding;
+    uint32_t count;
+    uint64_t offset;            // from the start of the block
+    uint64_t size;
+};
+
+_Static_assert(sizeof(struct ext_file_header) == 32, "ext_file_header layout");
+_Static_assert(sizeof(struct ext_field) == 32, "ext_field layout");
+_Static_assert(sizeof(struct ext_block_header) == 24, "ext_block_header layout");
+_Static_assert(sizeof(struct ext_column) == 24, "ext_column layout");
+
+// Field ids
+#define EXT_FIELD_SRC_ADDR 1
+#define EXT_FIELD_DST_ADDR 2
+#define EXT_FIELD_RTT_COUNT 3
+#define EXT_FIELD_RTT 4
+#define EXT_FIELD_TIMESTAMP 5       // unix seconds
+#define EXT_FIELD_PRB_ID 6
+#define EXT_FIELD_MSM_ID 7
+#define EXT_FIELD_SRC_ID 8          // index into the address dictionary
+#define EXT_FIELD_DST_ID 9
+#define EXT_FIELD_ADDR_TABLE 10     // addresses first used in this block
+
+// Field flags
+#define EXT_FIELD_PER_REPLY 0x1
+#define EXT_FIELD_TABLE 0x2         // column has its own count
+
+// Value types
+#define EXT_TYPE_U8 1
+#define EXT_TYPE_U16 2
+#define EXT_TYPE_U32 3
+#define EXT_TYPE_U64 4
+#define EXT_TYPE_F32 5
+#define EXT_TYPE_IPV4 6         // 4 octets
+#define EXT_TYPE_IPV6 7         // 16 octets
+
+// Encodings
+#define EXT_ENC_RAW 0
+#define EXT_ENC_FOR 1               // u64 base, then count offsets from it
+#define EXT_ENC_USEC 2              // integer microseconds
+
+// Hash of a 16-byte address for the open-addressing tables keyed on them
+// (extract's dictionary, ext_addr_index). The varying bytes of an address
+// are usually its last ones, and all of an IPv4 address sits in the top
+// half of the second word, so every bit is mixed down into the low bits a
+// table mask keeps.
+static inline uint64_t ext_addr_hash(const uint8_t *a) {
+    uint64_t hi, lo;
+    memcpy(&hi, a, 8);
+    memcpy(&lo, a + 8, 8);
+    uint64_t h = hi * 0x9e3779b97f4a7c15ull ^ lo;
+    h = (h ^ h >> 33) * 0xff51afd7ed558ccdull;
+    h = (h ^ h >> 33) * 0xc4ceb9fe1a85ec53ull;
+    return h ^ h >> 33;
+}
+
+#endif
@@ -1,10 +1,39 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <endian.h>
+
+#include "bz2blocks.h"
+#include "extfmt.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define SCAN_NEON 1
+#endif
 
 #define BUFFER_SIZE (16 * 1024 * 1024)
-#define MAX_LINE_SIZE (4 * 1024)
+#define DEFAULT_BATCH_RECORDS (256 * 1024)
+#define MAX_BLOCK_RECORDS (16 * 1024 * 1024)
+#define CHUNK_SIZE (4 * 1024 * 1024)
+#define MAX_LINE (CHUNK_SIZE - 1)   // longest line kept, whichever the mode
+#define MAX_JOBS 256
+
+// The vector scanners load whole blocks past the terminating NUL (and, for
+// keys, up to key length further), so every buffer handed to iter_search
+// must have this much readable slack after the string.
+#define SCAN_PAD 64
 
 // "dst_addr":"
 static const char str_dst_addr[] = "\"dst_addr\":\"";
@@ -26,203 +55,1885 @@ static const size_t len_rtt = sizeof(str_rtt) - 1;
 static const char str_prb_id[] = "\"prb_id\":";
 static const size_t len_prb_id = sizeof(str_prb_id) - 1;
 
-static inline int iter_search(char* line, const char* target, int target_len, char stop, char **next_out) {
-    char* p = line;
-    while (1) {
-        if (*p == 0 || *p == stop) return -1;
-        if (strncmp(p, target, target_len) == 0) {
-            *next_out = p + target_len;
-            return 0;
+// "msm_id":
+static const char str_msm_id[] = "\"msm_id\":";
+static const size_t len_msm_id = sizeof(str_msm_id) - 1;
+
+// "timestamp":
+static const char str_timestamp[] = "\"timestamp\":";
+static const size_t len_timestamp = sizeof(str_timestamp) - 1;
+
+// "af":
+static const char str_af[] = "\"af\":";
+static const size_t len_af = sizeof(str_af) - 1;
+
+// ------------------------------------------------------------------
+// Block scanners
+//
+// scan_key:  first occurrence of key[0..len) before NUL/stop, or NULL
+// scan_byte: first occurrence of c before NUL/stop, or NULL
+//
+// Candidates for a key are positions where both its first and last byte
+// match, so only a handful of memcmp calls happen per line instead of one
+// strncmp per byte. Implementations are chosen once by scanner_init().
+// ------------------------------------------------------------------
+
+typedef const char *(*scan_key_fn)(const char *p, const char *key, size_t len, char stop);
+typedef const char *(*scan_byte_fn)(const char *p, char c, char stop);
+
+static const char *scan_key_scalar(const char *p, const char *key, size_t len, char stop) {
+    for (;; p++) {
+        if (*p == 0 || *p == stop) return NULL;
+        if (*p == key[0] && memcmp(p + 1, key + 1, len - 1) == 0) return p;
+    }
+}
+
+static const char *scan_byte_scalar(const char *p, char c, char stop) {
+    for (;; p++) {
+        if (*p == 0 || *p == stop) return NULL;
+        if (*p == c) return p;
+    }
+}
+
+// Shared tail of the vector key scanners: walk candidate bits that lie
+// before the first terminator bit and confirm them with memcmp.
+static inline const char *scan_key_resolve(const char *p, uint64_t cand, uint64_t term, const char *key, size_t len) {
+    if (term) cand &= (term & -term) - 1;
+    while (cand) {
+        const char *q = p + __builtin_ctzll(cand);
+        if (memcmp(q + 1, key + 1, len - 2) == 0) return q;
+        cand &= cand - 1;
+    }
+    return NULL;
+}
+
+#ifdef SCAN_X86
+
+static const char *scan_key_sse2(const char *p, const char *key, size_t len, char stop) {
+    const __m128i first = _mm_set1_epi8(key[0]);
+    const __m128i last = _mm_set1_epi8(key[len - 1]);
+    const __m128i vstop = _mm_set1_epi8(stop);
+    const __m128i zero = _mm_setzero_si128();
+    for (;; p += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        __m128i b = _mm_loadu_si128((const __m128i *)(p + len - 1));
+        uint64_t cand = (uint32_t)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        uint64_t term = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(a, vstop)));
+        const char *q = scan_key_resolve(p, cand, term, key, len);
+        if (q) return q;
+        if (term) return NULL;
+    }
+}
+
+static const char *scan_byte_sse2(const char *p, char c, char stop) {
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vstop = _mm_set1_epi8(stop);
+    const __m128i zero = _mm_setzero_si128();
+    for (;; p += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)p);
+        uint32_t hit = (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, vc));
+        uint32_t term = (uint32_t)_mm_movemask_epi8(
+            _mm_or_si128(_mm_cmpeq_epi8(a, zero), _mm_cmpeq_epi8(a, vstop)));
+        if (hit | term) {
+            int i = __builtin_ctz(hit | term);
+            return (hit >> i) & 1 ? p + i : NULL;
         }
-        p++;
     }
 }
 
+__attribute__((target("avx2")))
+static const char *scan_key_avx2(const char *p, const char *key, size_t len, char stop) {
+    const __m256i first = _mm256_set1_epi8(key[0]);
+    const __m256i last = _mm256_set1_epi8(key[len - 1]);
+    const __m256i vstop = _mm256_set1_epi8(stop);
+    const __m256i zero = _mm256_setzero_si256();
+    for (;; p += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        __m256i b = _mm256_loadu_si256((const __m256i *)(p + len - 1));
+        uint64_t cand = (uint32_t)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        uint64_t term = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(a, vstop)));
+        const char *q = scan_key_resolve(p, cand, term, key, len);
+        if (q) return q;
+        if (term) return NULL;
+    }
+}
+
+__attribute__((target("avx2")))
+static const char *scan_byte_avx2(const char *p, char c, char stop) {
+    const __m256i vc = _mm256_set1_epi8(c);
+    const __m256i vstop = _mm256_set1_epi8(stop);
+    const __m256i zero = _mm256_setzero_si256();
+    for (;; p += 32) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t hit = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, vc));
+        uint32_t term = (uint32_t)_mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(a, zero), _mm256_cmpeq_epi8(a, vstop)));
+        if (hit | term) {
+            int i = __builtin_ctz(hit | term);
+            return (hit >> i) & 1 ? p + i : NULL;
+        }
+    }
+}
+
+#endif // SCAN_X86
+
+#ifdef SCAN_NEON
+
+// NEON has no movemask; narrowing each 16-bit lane by 4 leaves one nibble
+// per byte, i.e. a 64-bit mask with 4 bits per position.
+static inline uint64_t neon_mask(uint8x16_t v) {
+    return vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(v), 4)), 0);
+}
+
+static const char *scan_key_neon(const char *p, const char *key, size_t len, char stop) {
+    const uint8x16_t first = vdupq_n_u8((uint8_t)key[0]);
+    const uint8x16_t last = vdupq_n_u8((uint8_t)key[len - 1]);
+    const uint8x16_t vstop = vdupq_n_u8((uint8_t)stop);
+    for (;; p += 16) {
+        uint8x16_t a = vld1q_u8((const uint8_t *)p);
+        uint8x16_t b = vld1q_u8((const uint8_t *)(p + len - 1));
+        uint64_t cand = neon_mask(vandq_u8(vceqq_u8(a, first), vceqq_u8(b, last)));
+        uint64_t term = neon_mask(vorrq_u8(vceqzq_u8(a), vceqq_u8(a, vstop)));
+        if (term) cand &= (term & -term) - 1;
+        while (cand) {
+            const char *q = p + (__builtin_ctzll(cand) >> 2);
+            if (memcmp(q + 1, key + 1, len - 2) == 0) return q;
+            cand &= ~(0xFULL << (__builtin_ctzll(cand) & ~3));
+        }
+        if (term) return NULL;
+    }
+}
+
+static const char *scan_byte_neon(const char *p, char c, char stop) {
+    const uint8x16_t vc = vdupq_n_u8((uint8_t)c);
+    const uint8x16_t vstop = vdupq_n_u8((uint8_t)stop);
+    for (;; p += 16) {
+        uint8x16_t a = vld1q_u8((const uint8_t *)p);
+        uint64_t hit = neon_mask(vceqq_u8(a, vc));
+        uint64_t term = neon_mask(vorrq_u8(vceqzq_u8(a), vceqq_u8(a, vstop)));
+        if (hit | term) {
+            int i = __builtin_ctzll(hit | term);
+            return (hit >> i) & 1 ? p + (i >> 2) : NULL;
+        }
+    }
+}
+
+#endif // SCAN_NEON
+
+static scan_key_fn scan_key = scan_key_scalar;
+static scan_byte_fn scan_byte = scan_byte_scalar;
+
+static void scanner_init(void) {
+#if defined(SCAN_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        scan_key = scan_key_avx2;
+        scan_byte = scan_byte_avx2;
+    } else {
+        scan_key = scan_key_sse2;
+        scan_byte = scan_byte_sse2;
+    }
+#elif defined(SCAN_NEON)
+    scan_key = scan_key_neon;
+    scan_byte = scan_byte_neon;
+#endif
+}
+
+static inline int iter_search(char* line, const char* target, int target_len, char stop, char **next_out) {
+    const char *p = scan_key(line, target, target_len, stop);
+    if (!p) return -1;
+    *next_out = (char *)p + target_len;
+    return 0;
+}
+
 static inline int iter_search_single(char* line, char target, char stop, char **next_out) {
-    char* p = line;
-    while (1) {
-        if (*p == 0 || *p == stop) return -1;
-        if (*p == target) {
-            *next_out = p + 1;
-            return 0;
+    const char *p = scan_byte(line, target, stop);
+    if (!p) return -1;
+    *next_out = (char *)p + 1;
+    return 0;
+}
+
+// RIPE Atlas pings send at most 16 packets.
+#define MAX_REPLIES 16
+
+struct pingdata_s
+{
+    uint32_t rtt_us[MAX_REPLIES];
+    uint32_t timestamp, prb_id, msm_id;
+    uint8_t dst_addr[16], src_addr[16];     // IPv4 as ::ffff:a.b.c.d
+    uint8_t rtt_count;
+};
+
+// ------------------------------------------------------------------
+// Field parsers
+// ------------------------------------------------------------------
+
+// Parses a dotted quad terminated by '"' straight into out[0..3].
+// Returns the position after the closing quote, or NULL.
+static inline char *parse_ipv4(char *p, uint8_t *out) {
+    for (int i = 0; i < 4; i++) {
+        unsigned v = (unsigned)(*p - '0');
+        if (v > 9) return NULL;
+        p++;
+        for (int d = 1; d < 3 && (unsigned)(*p - '0') <= 9; d++, p++) {
+            v = v * 10 + (unsigned)(*p - '0');
         }
+        if (v > 255) return NULL;
+        out[i] = (uint8_t)v;
+        if (*p++ != (i < 3 ? '.' : '"')) return NULL;
+    }
+    return p;
+}
+
+static inline int hex_digit(char c) {
+    if ((unsigned)(c - '0') <= 9) return c - '0';
+    c |= 0x20;
+    if ((unsigned)(c - 'a') <= 5) return c - 'a' + 10;
+    return -1;
+}
+
+// Parses an IPv6 address terminated by '"' into out[0..15]: up to eight
+// hex groups, at most one "::", optionally ending in a dotted quad.
+// Returns the position after the closing quote, or NULL.
+static inline char *parse_ipv6(char *p, uint8_t *out) {
+    uint16_t g[8];
+    int n = 0, gap = -1;
+
+    if (p[0] == ':' && p[1] == ':') {
+        gap = 0;
+        p += 2;
+    }
+    while (*p != '"') {
+        char *start = p;
+        unsigned v = 0;
+        int d, x;
+        for (d = 0; d < 4 && (x = hex_digit(*p)) >= 0; d++, p++) v = v << 4 | (unsigned)x;
+        if (d == 0) return NULL;
+        if (*p == '.') {
+            if (n > 6 || !(p = parse_ipv4(start, out + 2 * n))) return NULL;
+            g[n] = (uint16_t)(out[2 * n] << 8 | out[2 * n + 1]);
+            g[n + 1] = (uint16_t)(out[2 * n + 2] << 8 | out[2 * n + 3]);
+            n += 2;
+            goto DONE;
+        }
+        if (n == 8) return NULL;
+        g[n++] = (uint16_t)v;
+        if (*p == '"') break;
+        if (*p++ != ':') return NULL;
+        if (*p == ':') {
+            if (gap >= 0) return NULL;
+            gap = n;
+            p++;
+        } else if (*p == '"') {
+            return NULL;
+        }
+    }
+    p++;
+DONE:
+    if (gap < 0 ? n != 8 : n == 8) return NULL;
+    int zeros = 8 - n;
+    for (int i = 0, k = 0; i < 8; i++) {
+        uint16_t v = 0;
+        if (i < gap || i >= gap + zeros || gap < 0) v = g[k++];
+        out[2 * i] = (uint8_t)(v >> 8);
+        out[2 * i + 1] = (uint8_t)v;
+    }
+    return p;
+}
+
+static const uint8_t v4_mapped_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+// Either address family into the 16-byte form records use.
+static inline char *parse_addr(char *p, uint8_t *out) {
+    char *q = parse_ipv4(p, out + 12);
+    if (q) {
+        memcpy(out, v4_mapped_prefix, 12);
+        return q;
+    }
+    return parse_ipv6(p, out);
+}
+
+// Decimal "ddd[.ddd]" ms ending at 'end' to integer microseconds, rounded
+// half up. RIPE prints three decimals, so the common case is exact and
+// never touches floating point; anything else goes through strtod.
+static inline int parse_rtt_us(const char *p, const char *end, uint32_t *out) {
+    const char *s = p;
+    uint64_t ms = 0;
+    uint32_t frac = 0;
+    int digits = 0, frac_digits = 0, round_up = 0;
+
+    while (p < end && (unsigned)(*p - '0') <= 9 && digits < 10) {
+        ms = ms * 10 + (unsigned)(*p++ - '0');
+        digits++;
+    }
+    if (p < end && *p == '.') {
         p++;
+        for (; p < end && (unsigned)(*p - '0') <= 9; p++, frac_digits++) {
+            if (frac_digits < 3) frac = frac * 10 + (unsigned)(*p - '0');
+            else if (frac_digits == 3) round_up = *p >= '5';
+        }
+    }
+    for (int i = frac_digits; i < 3; i++) frac *= 10;
+
+    uint64_t us = ms * 1000 + frac + round_up;
+    if (p == end && digits > 0 && us <= UINT32_MAX) {
+        *out = (uint32_t)us;
+        return 0;
+    }
+
+    char *endptr;
+    double v = strtod(s, &endptr);
+    if (endptr == s || endptr != end || !(v >= 0) || v * 1000 >= UINT32_MAX) return -1;
+    *out = (uint32_t)(v * 1000 + 0.5);
+    return 0;
+}
+
+// ------------------------------------------------------------------
+// Whitelists
+//
+// With -a only pings whose source and destination are both listed are
+// kept; with -p only pings from listed probes. Each list is a sorted array
+// searched without branches, checked as soon as the field is parsed so a
+// rejected line costs little more than finding its addresses.
+// ------------------------------------------------------------------
+
+struct id_set {
+    uint32_t *v;                // NULL = no filter
+    size_t n;
+};
+
+// Addresses in the 16-byte record form, compared as two big-endian
+// halves so the order matches memcmp.
+struct addr_key {
+    uint64_t hi, lo;
+};
+
+struct addr_set {
+    struct addr_key *v;         // NULL = no filter
+    size_t n;
+};
+
+static struct id_set probe_whitelist;
+static struct addr_set addr_whitelist;
+
+static inline int id_set_has(const struct id_set *s, uint32_t x) {
+    const uint32_t *base = s->v;
+    size_t n = s->n;
+    if (!n) return 0;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = base[half - 1] < x ? base + half : base;
+        n -= half;
+    }
+    return *base == x;
+}
+
+static inline struct addr_key addr_key_of(const uint8_t *a) {
+    uint64_t hi, lo;
+    memcpy(&hi, a, 8);
+    memcpy(&lo, a + 8, 8);
+    return (struct addr_key){ be64toh(hi), be64toh(lo) };
+}
+
+static inline int addr_key_less(struct addr_key a, struct addr_key b) {
+    return a.hi < b.hi || (a.hi == b.hi && a.lo < b.lo);
+}
+
+static inline int addr_set_has(const struct addr_set *s, const uint8_t *a) {
+    struct addr_key x = addr_key_of(a);
+    const struct addr_key *base = s->v;
+    size_t n = s->n;
+    if (!n) return 0;
+    while (n > 1) {
+        size_t half = n / 2;
+        base = addr_key_less(base[half - 1], x) ? base + half : base;
+        n -= half;
+    }
+    return base->hi == x.hi && base->lo == x.lo;
+}
+
+// Loading the -a and -p lists is main's, so extbench goes without it.
+#ifndef EXTRACT_NO_MAIN
+
+static int u32_cmp(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static int addr_key_cmp(const void *a, const void *b) {
+    struct addr_key x = *(const struct addr_key *)a, y = *(const struct addr_key *)b;
+    return addr_key_less(x, y) ? -1 : addr_key_less(y, x);
+}
+
+// Reads the next entry of a list file into tok: one per line, blank lines
+// and text after '#' ignored. Returns 0 at end of file.
+static int next_list_entry(FILE *f, char tok[64], int *lineno) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        (*lineno)++;
+        char *hash = strchr(line, '#');
+        if (hash) *hash = '\0';
+        if (sscanf(line, "%63s", tok) == 1) return 1;
+    }
+    return 0;
+}
+
+// Grows *v (of element size elem) so that it holds at least n + 1.
+static int list_reserve(void *v, size_t *cap, size_t n, size_t elem) {
+    if (n < *cap) return 0;
+    size_t ncap = *cap ? *cap * 2 : 1024;
+    void *nv = realloc(*(void **)v, ncap * elem);
+    if (!nv) return -1;
+    *(void **)v = nv;
+    *cap = ncap;
+    return 0;
+}
+
+static int id_set_load(struct id_set *s, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    size_t cap = 0;
+    char tok[64];
+    int lineno = 0;
+    s->v = NULL;
+    s->n = 0;
+    while (next_list_entry(f, tok, &lineno)) {
+        char *end;
+        unsigned long id = strtoul(tok, &end, 10);
+        if (*end || id > UINT32_MAX) {
+            fprintf(stderr, "%s:%d: invalid probe id: %s\n", path, lineno, tok);
+            fclose(f);
+            return -1;
+        }
+        if (list_reserve(&s->v, &cap, s->n, sizeof(*s->v))) {
+            fclose(f);
+            return -1;
+        }
+        s->v[s->n++] = (uint32_t)id;
+    }
+    fclose(f);
+    // An empty list still filters, so keep v non-NULL.
+    if (!s->v && !(s->v = malloc(sizeof(*s->v)))) return -1;
+
+    qsort(s->v, s->n, sizeof(*s->v), u32_cmp);
+    size_t kept = 0;
+    for (size_t i = 0; i < s->n; i++) {
+        if (!kept || s->v[kept - 1] != s->v[i]) s->v[kept++] = s->v[i];
+    }
+    s->n = kept;
+    return 0;
+}
+
+// IPv4 and IPv6 addresses may be mixed in one list.
+static int addr_set_load(struct addr_set *s, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+
+    size_t cap = 0;
+    char tok[64];
+    int lineno = 0;
+    s->v = NULL;
+    s->n = 0;
+    while (next_list_entry(f, tok, &lineno)) {
+        uint8_t a[16];
+        memcpy(a, v4_mapped_prefix, 12);
+        if (inet_pton(AF_INET, tok, a + 12) != 1 && inet_pton(AF_INET6, tok, a) != 1) {
+            fprintf(stderr, "%s:%d: invalid address: %s\n", path, lineno, tok);
+            fclose(f);
+            return -1;
+        }
+        if (list_reserve(&s->v, &cap, s->n, sizeof(*s->v))) {
+            fclose(f);
+            return -1;
+        }
+        s->v[s->n++] = addr_key_of(a);
+    }
+    fclose(f);
+    if (!s->v && !(s->v = malloc(sizeof(*s->v)))) return -1;
+
+    qsort(s->v, s->n, sizeof(*s->v), addr_key_cmp);
+    size_t kept = 0;
+    for (size_t i = 0; i < s->n; i++) {
+        if (!kept || addr_key_cmp(&s->v[kept - 1], &s->v[i])) s->v[kept++] = s->v[i];
+    }
+    s->n = kept;
+    return 0;
+}
+
+#endif
+
+// Returns the unsigned 32-bit value of key, searching from p, or -1.
+// "prb_id", "msm_id" and "timestamp" come after "result" in RIPE lines, so
+// each is found by scanning ahead of the parse position.
+static inline int64_t find_u32_field(char *p, const char *key, size_t len) {
+    if (iter_search(p, key, len, 0, &p)) return -1;
+    if ((unsigned)(*p - '0') > 9) return -1;
+    int64_t v = 0;
+    for (int d = 0; (unsigned)(*p - '0') <= 9; d++, p++) {
+        if (d == 10) return -1;
+        v = v * 10 + (*p - '0');
     }
+    return v <= UINT32_MAX ? v : -1;
+}
+
+// What became of a line. Every line gets exactly one verdict; -v prints
+// how many got each. The malformed ones are told apart by where the
+// parse gave up.
+enum line_verdict {
+    LINE_RECORD,                // produced a record
+    LINE_OTHER_AF,              // "af" neither 4 nor 6 (or not 4 with -4)
+    LINE_NO_REPLY,              // no {"rtt": reply
+    LINE_ADDR_FILTERED,         // rejected by -a
+    LINE_PROBE_FILTERED,        // rejected by -p
+    LINE_NO_RESULT,             // no "result" array
+    LINE_NO_DST,                // no "dst_addr"
+    LINE_BAD_DST,               // dst_addr does not parse (e.g. a bad octet)
+    LINE_NO_SRC,
+    LINE_BAD_SRC,
+    LINE_BAD_ID,                // prb_id, msm_id or timestamp missing or out of range
+    LINE_TRUNCATED,             // line ends inside a reply
+    LINE_BAD_RTT,               // an rtt value does not parse
+    LINE_OVERLONG,              // longer than MAX_LINE, skipped unread
+    LINE_VERDICTS
+};
+
+static const char *const line_verdict_names[LINE_VERDICTS] = {
+    "records", "other_af", "no_reply", "addr_filtered", "probe_filtered", "no_result",
+    "no_dst_addr", "bad_dst_addr", "no_src_addr", "bad_src_addr", "bad_id", "truncated",
+    "bad_rtt", "overlong",
+};
+
+// RIPE pings send 3 packets unless configured otherwise; records with
+// fewer replies are kept but counted.
+#define FULL_REPLIES 3
+
+struct line_stats {
+    uint64_t lines;
+    uint64_t verdicts[LINE_VERDICTS];
+    uint64_t partial;           // records with fewer than FULL_REPLIES RTTs
+};
+
+static void line_stats_add(struct line_stats *to, const struct line_stats *from) {
+    to->lines += from->lines;
+    for (int i = 0; i < LINE_VERDICTS; i++) to->verdicts[i] += from->verdicts[i];
+    to->partial += from->partial;
+}
+
+static inline void line_stats_overlong(struct line_stats *st, uint64_t n) {
+    st->lines += n;
+    st->verdicts[LINE_OVERLONG] += n;
+}
+
+// Totals of a run, for -P/-S progress and the -J summary. Stage times are
+// taken once per read(), chunk or output block, never per line, and are
+// summed over threads, so a stage that is busy as long as the run itself
+// (times its threads) is the bottleneck.
+enum stage { STAGE_READ, STAGE_DECOMPRESS, STAGE_PARSE, STAGE_WRITE, STAGES };
+
+static const char *const stage_names[STAGES] = { "read", "decompress", "parse", "write" };
+
+struct run_stats {
+    struct line_stats lines;
+    uint64_t bytes_in;          // input parsed (decompressed with -z)
+    uint64_t bz2_bytes_in;      // -z: compressed size of the blocks done
+    uint64_t stage_ns[STAGES];
+};
+
+static inline uint64_t mono_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
 }
 
+static int ipv4_only;            // -4
+
+// Cheap first pass that throws out timeouts without touching the address
+// or RTT parsers. "af" and the start of "result" sit within the
+// first couple of hundred bytes of a RIPE line, and the first reply must
+// be an rtt object for the line to be worth a full parse; a result of
+// only {"x":"*"} ends at ']' before any "{"rtt":" is found.
+static inline int prefilter_line(char *line) {
+    char *p;
+    if (iter_search(line, str_af, len_af, 0, &p)) return LINE_OTHER_AF;
+    if ((p[0] != '4' && (p[0] != '6' || ipv4_only)) || (unsigned)(p[1] - '0') <= 9) return LINE_OTHER_AF;
+    if (iter_search(p, str_result, len_result, 0, &p)) return LINE_NO_RESULT;
+    if (iter_search(p, str_rtt, len_rtt, ']', &p)) return LINE_NO_REPLY;
+    return LINE_RECORD;
+}
+
+// Locates the fields of one ping result line. Addresses and ids are
+// parsed into target on the way; the target->rtt_count RTT values are
+// left as [rtt[i], rtt_end[i]) spans for parse_pingdata. Replies past
+// MAX_REPLIES are ignored. The line is not modified. Returns a
+// line_verdict; LINE_RECORD means the spans are set.
 static inline int extract_all(
     char *line,
-    char **dst_addr_1, char **dst_addr_2, char **dst_addr_3, char **dst_addr_4,
-    char **src_addr_1, char **src_addr_2, char **src_addr_3, char **src_addr_4,
-    char **rtt1, char **rtt2, char **rtt3
+    struct pingdata_s *target,
+    const char **rtt, const char **rtt_end
 ) {
     char* p = line;
 
-    if (iter_search(p, str_dst_addr, len_dst_addr, 0, &p)) return -1;
-    *dst_addr_1 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *dst_addr_2 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *dst_addr_3 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *dst_addr_4 = p;
-    if (iter_search_single(p, '"', 0, &p)) return -1;
-    p[-1] = 0;
+    if (iter_search(p, str_dst_addr, len_dst_addr, 0, &p)) return LINE_NO_DST;
+    if (!(p = parse_addr(p, target->dst_addr))) return LINE_BAD_DST;
+    if (addr_whitelist.v && !addr_set_has(&addr_whitelist, target->dst_addr)) return LINE_ADDR_FILTERED;
     
-    if (iter_search(p, str_src_addr, len_src_addr, 0, &p)) return -1;
-    *src_addr_1 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *src_addr_2 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *src_addr_3 = p;
-    if (iter_search_single(p, '.', '"', &p)) return -1;
-    p[-1] = 0;
-    *src_addr_4 = p;
-    if (iter_search_single(p, '"', 0, &p)) return -1;
-    p[-1] = 0;
-
-    if (iter_search(p, str_result, len_result, 0, &p)) return -1;
-    if (iter_search(p, str_rtt, len_rtt, ']', &p)) return -1;
-    *rtt1 = p;
-    if (iter_search_single(p, '}', ',', &p)) return -1;
-    p[-1] = 0;
-    if (iter_search(p, str_rtt, len_rtt, ']', &p)) return -1;
-    *rtt2 = p;
-    if (iter_search_single(p, '}', ',', &p)) return -1;
-    p[-1] = 0;
-    if (iter_search(p, str_rtt, len_rtt, ']', &p)) return -1;
-    *rtt3 = p;
-    if (iter_search_single(p, '}', ',', &p)) return -1;
-    p[-1] = 0;
+    if (iter_search(p, str_src_addr, len_src_addr, 0, &p)) return LINE_NO_SRC;
+    if (!(p = parse_addr(p, target->src_addr))) return LINE_BAD_SRC;
+    if (addr_whitelist.v && !addr_set_has(&addr_whitelist, target->src_addr)) return LINE_ADDR_FILTERED;
 
-    return 0;
-}
+    int64_t prb_id = find_u32_field(p, str_prb_id, len_prb_id);
+    if (prb_id < 0) return LINE_BAD_ID;
+    if (probe_whitelist.v && !id_set_has(&probe_whitelist, (uint32_t)prb_id)) return LINE_PROBE_FILTERED;
+    int64_t msm_id = find_u32_field(p, str_msm_id, len_msm_id);
+    int64_t timestamp = find_u32_field(p, str_timestamp, len_timestamp);
+    if (msm_id < 0 || timestamp < 0) return LINE_BAD_ID;
+    target->prb_id = (uint32_t)prb_id;
+    target->msm_id = (uint32_t)msm_id;
+    target->timestamp = (uint32_t)timestamp;
 
-struct pingdata_s
-{
-    float rtt1, rtt2, rtt3;
-    uint8_t dst_addr_1, dst_addr_2, dst_addr_3, dst_addr_4;
-    uint8_t src_addr_1, src_addr_2, src_addr_3, src_addr_4;
-};
+    // A reply is {"rtt":v} possibly followed by more members; timeouts
+    // ({"x":"*"}) and errors are skipped by the search.
+    if (iter_search(p, str_result, len_result, 0, &p)) return LINE_NO_RESULT;
+    int n = 0;
+    while (n < MAX_REPLIES && !iter_search(p, str_rtt, len_rtt, ']', &p)) {
+        rtt[n] = p;
+        while (*p && *p != ',' && *p != '}') p++;
+        if (!*p) return LINE_TRUNCATED;
+        rtt_end[n++] = p;
+    }
+    if (n == 0) return LINE_NO_REPLY;
+    target->rtt_count = (uint8_t)n;
+
+    return LINE_RECORD;
+}
 
 static inline int parse_pingdata(
     struct pingdata_s *target, 
-    const char *dst_addr_1, const char *dst_addr_2, const char *dst_addr_3, const char *dst_addr_4, 
-    const char *src_addr_1, const char *src_addr_2, const char *src_addr_3, const char *src_addr_4, 
-    const char *rtt1, const char *rtt2, const char *rtt3
+    const char **rtt, const char **rtt_end
 ) {
-    char *endptr;
-    long v_l;
-    float v_f;
-    
-    v_l = strtol(dst_addr_1, &endptr, 10);
-    if (endptr == dst_addr_1 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->dst_addr_1 = (uint8_t)v_l;
-    
-    v_l = strtol(dst_addr_2, &endptr, 10);
-    if (endptr == dst_addr_2 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->dst_addr_2 = (uint8_t)v_l;
-    
-    v_l = strtol(dst_addr_3, &endptr, 10);
-    if (endptr == dst_addr_3 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->dst_addr_3 = (uint8_t)v_l;
-    
-    v_l = strtol(dst_addr_4, &endptr, 10);
-    if (endptr == dst_addr_4 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->dst_addr_4 = (uint8_t)v_l;
-    
-    v_l = strtol(src_addr_1, &endptr, 10);
-    if (endptr == src_addr_1 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->src_addr_1 = (uint8_t)v_l;
-    
-    v_l = strtol(src_addr_2, &endptr, 10);
-    if (endptr == src_addr_2 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->src_addr_2 = (uint8_t)v_l;
-    
-    v_l = strtol(src_addr_3, &endptr, 10);
-    if (endptr == src_addr_3 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->src_addr_3 = (uint8_t)v_l;
-    
-    v_l = strtol(src_addr_4, &endptr, 10);
-    if (endptr == src_addr_4 || *endptr != 0 || v_l < 0 || v_l > 255) return -1;
-    target->src_addr_4 = (uint8_t)v_l;
+    for (int i = 0; i < target->rtt_count; i++) {
+        if (parse_rtt_us(rtt[i], rtt_end[i], &target->rtt_us[i])) return -1;
+    }
+    return 0;
+}
+
+// Runs one NUL-terminated line through all stages and counts its verdict.
+// Returns 1 if *out now holds a record.
+static inline int process_line(char *line, struct pingdata_s *out, struct line_stats *st) {
+    const char *rtt[MAX_REPLIES], *rtt_end[MAX_REPLIES];
+    int v = prefilter_line(line);
+    if (v == LINE_RECORD) v = extract_all(line, out, rtt, rtt_end);
+    if (v == LINE_RECORD && parse_pingdata(out, rtt, rtt_end)) v = LINE_BAD_RTT;
+    st->lines++;
+    st->verdicts[v]++;
+    if (v == LINE_RECORD && out->rtt_count < FULL_REPLIES) st->partial++;
+    return v == LINE_RECORD;
+}
 
-    v_f = strtof(rtt1, &endptr);
-    if (endptr == rtt1 || *endptr != 0 || v_f < 0.0f) return -1;
-    target->rtt1 = v_f;
+// ------------------------------------------------------------------
+// Block line reader
+//
+// Input is read() in BUFFER_SIZE blocks and split on '\n' in place; each
+// line is NUL-terminated inside the buffer and handed out without a copy.
+// The unfinished tail of a block is moved to the front before the next
+// read, so lines come out whole. A line longer than MAX_LINE is skipped
+// up to its newline, as in the -j and -z modes.
+// ------------------------------------------------------------------
 
-    v_f = strtof(rtt2, &endptr);
-    if (endptr == rtt2 || *endptr != 0 || v_f < 0.0f) return -1;
-    target->rtt2 = v_f;
+struct line_reader {
+    int fd;
+    char *buf;      // BUFFER_SIZE + SCAN_PAD bytes
+    size_t pos;     // start of the next unconsumed line
+    size_t end;     // end of valid data
+    int eof;
+    int skipping;   // inside an overlong line, dropping until '\n'
+    uint64_t bytes;             // read so far
+    uint64_t read_ns;           // spent in read()
+    struct line_stats *stats;   // counts skipped lines, if set
+};
 
-    v_f = strtof(rtt3, &endptr);
-    if (endptr == rtt3 || *endptr != 0 || v_f < 0.0f) return -1;
-    target->rtt3 = v_f;
+static void line_reader_init(struct line_reader *r, int fd, char *buf) {
+    r->fd = fd;
+    r->buf = buf;
+    r->pos = 0;
+    r->end = 0;
+    r->eof = 0;
+    r->skipping = 0;
+    r->bytes = 0;
+    r->read_ns = 0;
+    r->stats = NULL;
+}
 
+// Returns 1 with *line/*len set, 0 at end of input, -1 on read error.
+static int line_reader_next(struct line_reader *r, char **line, size_t *len) {
+    while (1) {
+        char *start = r->buf + r->pos;
+        char *nl = memchr(start, '\n', r->end - r->pos);
+        if (nl) {
+            *nl = 0;
+            r->pos = nl - r->buf + 1;
+            if (r->skipping) {
+                r->skipping = 0;
+                continue;
+            }
+            if (nl - start > MAX_LINE) {
+                if (r->stats) line_stats_overlong(r->stats, 1);
+                continue;
+            }
+            *line = start;
+            *len = nl - start;
+            return 1;
+        }
+
+        if (r->eof) {
+            // Last line without a trailing newline
+            if (r->pos == r->end || r->skipping) return 0;
+            if (r->end - r->pos > MAX_LINE) {
+                if (r->stats) line_stats_overlong(r->stats, 1);
+                return 0;
+            }
+            r->buf[r->end] = 0;
+            *line = start;
+            *len = r->end - r->pos;
+            r->pos = r->end;
+            return 1;
+        }
+
+        // Move the partial line to the front, or drop it if it already
+        // fills the whole buffer.
+        if (r->pos == 0 && r->end == BUFFER_SIZE) {
+            r->skipping = 1;
+            r->end = 0;
+            if (r->stats) line_stats_overlong(r->stats, 1);
+        } else {
+            memmove(r->buf, start, r->end - r->pos);
+            r->end -= r->pos;
+        }
+        r->pos = 0;
+
+        uint64_t t0 = mono_ns();
+        ssize_t n = read(r->fd, r->buf + r->end, BUFFER_SIZE - r->end);
+        r->read_ns += mono_ns() - t0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) r->eof = 1;
+        r->end += n;
+        r->bytes += n;
+        memset(r->buf + r->end, 0, SCAN_PAD);
+    }
+}
+
+// ------------------------------------------------------------------
+// Batch record writer
+//
+// Records are parsed straight into a page-aligned batch. When the batch
+// is full it is turned into one columnar block (see extfmt.h) and goes
+// out with a single write(), instead of one stdio call per record. The
+// file header is written up front and its counts are patched on close.
+// ------------------------------------------------------------------
+
+static const struct ext_field ext_schema[] = {
+    { EXT_FIELD_SRC_ID, EXT_TYPE_U32, EXT_ENC_RAW, 0, "src_id" },
+    { EXT_FIELD_DST_ID, EXT_TYPE_U32, EXT_ENC_RAW, 0, "dst_id" },
+    { EXT_FIELD_RTT_COUNT, EXT_TYPE_U8, EXT_ENC_RAW, 0, "rtt_count" },
+    { EXT_FIELD_RTT, EXT_TYPE_U32, EXT_ENC_USEC, EXT_FIELD_PER_REPLY, "rtt_us" },
+    { EXT_FIELD_TIMESTAMP, EXT_TYPE_U64, EXT_ENC_FOR, 0, "timestamp" },
+    { EXT_FIELD_PRB_ID, EXT_TYPE_U32, EXT_ENC_RAW, 0, "prb_id" },
+    { EXT_FIELD_MSM_ID, EXT_TYPE_U32, EXT_ENC_RAW, 0, "msm_id" },
+    { EXT_FIELD_ADDR_TABLE, EXT_TYPE_IPV6, EXT_ENC_RAW, EXT_FIELD_TABLE, "addr_table" },
+};
+#define EXT_NCOLS (sizeof(ext_schema) / sizeof(ext_schema[0]))
+
+#define ALIGN8(x) (((x) + 7) & ~(size_t)7)
+
+// The file's address dictionary: addresses by id, plus an open-addressing
+// index from address to id + 1. A day of anchor pings has a few tens of
+// thousands of addresses, so the index stays cache resident.
+struct addr_dict {
+    uint8_t (*addr)[16];
+    uint32_t n, cap;
+    uint32_t *slots;            // id + 1, 0 = empty
+    size_t mask;
+};
+
+static int addr_dict_grow(struct addr_dict *d) {
+    size_t nmask = d->mask ? d->mask * 2 + 1 : 4095;
+    uint32_t *slots = calloc(nmask + 1, sizeof(*slots));
+    if (!slots) return -1;
+    for (uint32_t id = 0; id < d->n; id++) {
+        size_t h = ext_addr_hash(d->addr[id]) & nmask;
+        while (slots[h]) h = (h + 1) & nmask;
+        slots[h] = id + 1;
+    }
+    free(d->slots);
+    d->slots = slots;
+    d->mask = nmask;
     return 0;
 }
 
-int main(int argc, char* argv[]) {
-    if (argc != 2) {
-        fprintf(stderr, "Usage: %s <filename>\n", argv[0]);
-        return 1;
+// Returns the id of a, adding it if new, or UINT32_MAX without memory.
+static inline uint32_t addr_dict_intern(struct addr_dict *d, const uint8_t *a) {
+    if ((size_t)d->n * 10 >= d->mask * 7 && addr_dict_grow(d)) return UINT32_MAX;
+    size_t h = ext_addr_hash(a) & d->mask;
+    for (uint32_t s; (s = d->slots[h]); h = (h + 1) & d->mask) {
+        if (memcmp(d->addr[s - 1], a, 16) == 0) return s - 1;
     }
-    
-    FILE* wfp;
-    char* file_buffer;
+    if (d->n == d->cap) {
+        uint32_t ncap = d->cap ? d->cap * 2 : 4096;
+        void *na = realloc(d->addr, (size_t)ncap * 16);
+        if (!na) return UINT32_MAX;
+        d->addr = na;
+        d->cap = ncap;
+    }
+    memcpy(d->addr[d->n], a, 16);
+    d->slots[h] = ++d->n;
+    return d->n - 1;
+}
 
-    wfp = fopen(argv[1], "wb");
-    if (!wfp) {
-        perror("Failed to open file");
-        goto FAIL;
+struct record_writer {
+    int fd;
+    struct pingdata_s *batch;
+    size_t count;
+    size_t cap;
+    char *block;                // encoded block for up to cap records
+    uint64_t records;
+    uint64_t blocks;
+    uint64_t flush_ns;          // encoding and writing blocks
+    struct addr_dict dict;
+};
+
+static int write_all(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len) {
+        ssize_t n = write(fd, p, len);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static size_t block_bytes(size_t records) {
+    return ALIGN8(sizeof(struct ext_block_header) + EXT_NCOLS * sizeof(struct ext_column))
+        + ALIGN8(records * 4) * 4 + ALIGN8(records) + ALIGN8(records * MAX_REPLIES * 4)
+        + ALIGN8(8 + records * 4) + ALIGN8(records * 2 * 16);
+}
+
+static int write_file_header(struct record_writer *w, int patch) {
+    struct {
+        struct ext_file_header hdr;
+        struct ext_field fields[EXT_NCOLS];
+    } head;
+
+    memset(&head, 0, sizeof(head));
+    memcpy(head.hdr.magic, EXT_MAGIC, sizeof(head.hdr.magic));
+    head.hdr.byte_order = EXT_BYTE_ORDER;
+    head.hdr.version = EXT_VERSION;
+    head.hdr.nfields = EXT_NCOLS;
+    head.hdr.record_count = w->records;
+    head.hdr.block_count = w->blocks;
+    memcpy(head.fields, ext_schema, sizeof(ext_schema));
+
+    if (!patch) return write_all(w->fd, &head, sizeof(head));
+    return pwrite(w->fd, &head.hdr, sizeof(head.hdr), 0) == sizeof(head.hdr) ? 0 : -1;
+}
+
+static int record_writer_init(struct record_writer *w, int fd, size_t cap) {
+    size_t bytes = cap * sizeof(struct pingdata_s);
+    bytes = (bytes + 4095) & ~(size_t)4095;
+    memset(w, 0, sizeof(*w));
+    w->fd = fd;
+    w->cap = cap;
+    w->batch = aligned_alloc(4096, bytes);
+    w->block = aligned_alloc(4096, (block_bytes(cap) + 4095) & ~(size_t)4095);
+    if (!w->batch || !w->block) return -1;
+    return write_file_header(w, 0);
+}
+
+// Appends a column entry to the block being built and returns where its
+// data goes.
+static void *put_column(char *block, size_t *off, struct ext_column *col, const struct ext_field *f, uint32_t count, size_t size) {
+    col->field = f->id;
+    col->type = f->type;
+    col->encoding = f->encoding;
+    col->count = count;
+    col->offset = *off;
+    col->size = size;
+    void *data = block + *off;
+    memset(block + *off + size, 0, ALIGN8(size) - size);
+    *off += ALIGN8(size);
+    return data;
+}
+
+static int record_writer_flush(struct record_writer *w) {
+    size_t n = w->count;
+    if (n == 0) return 0;
+
+    uint64_t t0 = mono_ns();
+    size_t nvalues = 0;
+    uint32_t ts_min = UINT32_MAX, ts_max = 0;
+    for (size_t i = 0; i < n; i++) {
+        const struct pingdata_s *r = &w->batch[i];
+        nvalues += r->rtt_count;
+        if (r->timestamp < ts_min) ts_min = r->timestamp;
+        if (r->timestamp > ts_max) ts_max = r->timestamp;
+    }
+    // An hourly dump spans 3600 s, so 16-bit offsets are the normal case.
+    int ts_wide = ts_max - ts_min > UINT16_MAX;
+    size_t ts_width = ts_wide ? 4 : 2;
+
+    struct ext_block_header *hdr = (struct ext_block_header *)w->block;
+    struct ext_column *cols = (struct ext_column *)(hdr + 1);
+    size_t off = ALIGN8(sizeof(*hdr) + EXT_NCOLS * sizeof(*cols));
+
+    uint32_t *src = put_column(w->block, &off, &cols[0], &ext_schema[0], n, n * 4);
+    uint32_t *dst = put_column(w->block, &off, &cols[1], &ext_schema[1], n, n * 4);
+    uint8_t *rtt_count = put_column(w->block, &off, &cols[2], &ext_schema[2], n, n);
+    uint32_t *rtt = put_column(w->block, &off, &cols[3], &ext_schema[3], nvalues, nvalues * 4);
+    char *ts = put_column(w->block, &off, &cols[4], &ext_schema[4], n, 8 + n * ts_width);
+    uint32_t *prb_id = put_column(w->block, &off, &cols[5], &ext_schema[5], n, n * 4);
+    uint32_t *msm_id = put_column(w->block, &off, &cols[6], &ext_schema[6], n, n * 4);
+    cols[4].type = ts_wide ? EXT_TYPE_U32 : EXT_TYPE_U16;
+
+    uint64_t ts_base = ts_min;
+    memcpy(ts, &ts_base, 8);
+    uint16_t *ts16 = (uint16_t *)(ts + 8);
+    uint32_t *ts32 = (uint32_t *)(ts + 8);
+    uint32_t first_new = w->dict.n;
+
+    for (size_t i = 0; i < n; i++) {
+        const struct pingdata_s *r = &w->batch[i];
+        src[i] = addr_dict_intern(&w->dict, r->src_addr);
+        dst[i] = addr_dict_intern(&w->dict, r->dst_addr);
+        if (src[i] == UINT32_MAX || dst[i] == UINT32_MAX) {
+            errno = ENOMEM;
+            return -1;
+        }
+        rtt_count[i] = r->rtt_count;
+        memcpy(rtt, r->rtt_us, r->rtt_count * sizeof(*rtt));
+        rtt += r->rtt_count;
+        if (ts_wide) ts32[i] = r->timestamp - ts_min;
+        else ts16[i] = (uint16_t)(r->timestamp - ts_min);
+        prb_id[i] = r->prb_id;
+        msm_id[i] = r->msm_id;
+    }
+
+    // The addresses this block added, now that they are known.
+    uint32_t added = w->dict.n - first_new;
+    void *table = put_column(w->block, &off, &cols[7], &ext_schema[7], added, (size_t)added * 16);
+    if (added) memcpy(table, w->dict.addr[first_new], (size_t)added * 16);
+
+    hdr->magic = EXT_BLOCK_MAGIC;
+    hdr->ncols = EXT_NCOLS;
+    hdr->nrecords = n;
+    hdr->nvalues = nvalues;
+    hdr->size = off;
+    if (write_all(w->fd, w->block, off)) return -1;
+
+    w->records += n;
+    w->blocks++;
+    w->count = 0;
+    w->flush_ns += mono_ns() - t0;
+    return 0;
+}
+
+// Slot for the next record; it only counts once record_writer_commit()
+// is called, so a failed parse can simply leave it behind.
+static inline struct pingdata_s *record_writer_slot(struct record_writer *w) {
+    return &w->batch[w->count];
+}
+
+static inline int record_writer_commit(struct record_writer *w) {
+    if (++w->count == w->cap) return record_writer_flush(w);
+    return 0;
+}
+
+static int record_writer_append(struct record_writer *w, const struct pingdata_s *recs, size_t n) {
+    while (n) {
+        size_t k = w->cap - w->count < n ? w->cap - w->count : n;
+        memcpy(&w->batch[w->count], recs, k * sizeof(*recs));
+        w->count += k;
+        recs += k;
+        n -= k;
+        if (w->count == w->cap && record_writer_flush(w)) return -1;
+    }
+    return 0;
+}
+
+// Flushes the last block and fills in the header counts.
+static int record_writer_finish(struct record_writer *w) {
+    if (record_writer_flush(w)) return -1;
+    return write_file_header(w, 1);
+}
+
+static void record_writer_free(struct record_writer *w) {
+    free(w->batch);
+    free(w->block);
+    free(w->dict.addr);
+    free(w->dict.slots);
+    w->batch = NULL;
+    w->block = NULL;
+    memset(&w->dict, 0, sizeof(w->dict));
+}
+
+// ------------------------------------------------------------------
+// Parallel pipeline (-j N)
+//
+// reader:  cuts the input into newline-aligned chunks, numbered in order
+// workers: parse every line of a chunk into that chunk's own record array
+// writer:  adds each chunk's records to the output blocks, either in
+//          chunk order or as soon as a chunk is done (-u)
+//
+// Chunks cycle free -> work -> done -> free, so memory stays bounded at
+// the pool size and a worker only touches the chunk it popped.
+//
+// With -z there is no reader: each worker takes the next bzip2 block,
+// decompresses it straight into its chunk and parses the lines that lie
+// wholly inside it. The partial first and last lines of every block are
+// joined by the writer, which therefore always runs in block order.
+// ------------------------------------------------------------------
+
+struct chunk {
+    char *data;                 // data_cap bytes, of which SCAN_PAD + 1 spare
+    size_t len;
+    size_t data_cap;
+    struct pingdata_s *recs;    // recs[0] is reserved for the joined line
+    size_t nrec, rec_cap;
+    uint64_t seq;
+
+    // -z only
+    size_t hit;                 // bz2 hit index of this block
+    size_t merged;              // hits swallowed by this block
+    int bad;                    // block failed to decode
+    size_t head_len;            // bytes before the first '\n'
+    size_t tail_off;            // start of the bytes after the last '\n'
+    int no_newline;
+
+    struct line_stats stats;    // lines parsed by the worker
+    uint64_t overlong;          // lines the reader dropped while filling it
+    uint64_t read_ns, decode_ns, parse_ns;
+    struct chunk *next;
+};
+
+struct chunk_queue {
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    struct chunk *head, *tail;
+    int closed;
+};
+
+static void chunk_queue_init(struct chunk_queue *q) {
+    pthread_mutex_init(&q->mtx, NULL);
+    pthread_cond_init(&q->cond, NULL);
+    q->head = q->tail = NULL;
+    q->closed = 0;
+}
+
+static void chunk_queue_destroy(struct chunk_queue *q) {
+    pthread_mutex_destroy(&q->mtx);
+    pthread_cond_destroy(&q->cond);
+}
+
+static void chunk_queue_push(struct chunk_queue *q, struct chunk *c) {
+    c->next = NULL;
+    pthread_mutex_lock(&q->mtx);
+    if (q->tail) q->tail->next = c;
+    else q->head = c;
+    q->tail = c;
+    pthread_cond_signal(&q->cond);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+// Blocks until a chunk is available; NULL once the queue is closed and empty.
+static struct chunk *chunk_queue_pop(struct chunk_queue *q) {
+    pthread_mutex_lock(&q->mtx);
+    while (!q->head && !q->closed) pthread_cond_wait(&q->cond, &q->mtx);
+    struct chunk *c = q->head;
+    if (c) {
+        q->head = c->next;
+        if (!q->head) q->tail = NULL;
+    }
+    pthread_mutex_unlock(&q->mtx);
+    return c;
+}
+
+static void chunk_queue_close(struct chunk_queue *q) {
+    pthread_mutex_lock(&q->mtx);
+    q->closed = 1;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->mtx);
+}
+
+struct pipeline {
+    int in_fd;
+    const struct bz2_file *bz;  // set for -z
+    size_t *blocks;             // hit indices of the bz2 blocks
+    size_t nblocks;
+    size_t next_block;
+
+    struct chunk_queue free_q, work_q, done_q;
+    pthread_mutex_t workers_mtx;
+    int workers_left;
+    int read_error;
+};
+
+static void *reader_main(void *arg) {
+    struct pipeline *pl = arg;
+    struct chunk *cur = chunk_queue_pop(&pl->free_q);
+    uint64_t seq = 0;
+    int skipping = 0;   // dropping an overlong line up to its newline
+    int eof = 0;
+
+    cur->len = 0;
+    cur->overlong = 0;
+    cur->read_ns = 0;
+    while (!eof) {
+        uint64_t t0 = mono_ns();
+        ssize_t n = read(pl->in_fd, cur->data + cur->len, CHUNK_SIZE - cur->len);
+        cur->read_ns += mono_ns() - t0;
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            pl->read_error = errno;
+            break;
+        }
+        if (n == 0) eof = 1;
+
+        if (skipping) {
+            char *nl = memchr(cur->data + cur->len, '\n', n);
+            if (!nl) continue;
+            size_t rest = cur->data + cur->len + n - (nl + 1);
+            memmove(cur->data, nl + 1, rest);
+            cur->len = rest;
+            skipping = 0;
+        } else {
+            cur->len += n;
+        }
+        if (cur->len < CHUNK_SIZE && !eof) continue;
+        if (cur->len == 0) break;
+
+        size_t tail = 0;
+        if (eof) {
+            if (cur->data[cur->len - 1] != '\n') cur->data[cur->len++] = '\n';
+        } else {
+            char *last = memrchr(cur->data, '\n', cur->len);
+            if (!last) {
+                // A single line fills the whole chunk
+                skipping = 1;
+                cur->len = 0;
+                cur->overlong++;
+                continue;
+            }
+            tail = cur->data + cur->len - (last + 1);
+            cur->len -= tail;
+        }
+
+        struct chunk *next = chunk_queue_pop(&pl->free_q);
+        memcpy(next->data, cur->data + cur->len, tail);
+        next->len = tail;
+        next->overlong = 0;
+        next->read_ns = 0;
+
+        cur->seq = seq++;
+        chunk_queue_push(&pl->work_q, cur);
+        cur = next;
+    }
+
+    chunk_queue_push(&pl->free_q, cur);
+    chunk_queue_close(&pl->work_q);
+    return NULL;
+}
+
+static int chunk_reserve_recs(struct chunk *c) {
+    if (c->nrec < c->rec_cap) return 0;
+    size_t cap = c->rec_cap ? c->rec_cap * 2 : 16 * 1024;
+    struct pingdata_s *recs = realloc(c->recs, cap * sizeof(*recs));
+    if (!recs) return -1;
+    c->recs = recs;
+    c->rec_cap = cap;
+    return 0;
+}
+
+// Parses the complete lines in [from, to); to must follow a '\n'.
+static int chunk_parse(struct chunk *c, size_t from, size_t to) {
+    char *p = c->data + from;
+    char *end = c->data + to;
+
+    memset(c->data + c->len, 0, SCAN_PAD);
+    c->nrec = 1;
+    if (chunk_reserve_recs(c)) return -1;
+    while (p < end) {
+        char *nl = memchr(p, '\n', end - p);
+        *nl = 0;
+
+        if (chunk_reserve_recs(c)) return -1;
+        if (nl - p > MAX_LINE) line_stats_overlong(&c->stats, 1);
+        else if (process_line(p, &c->recs[c->nrec], &c->stats)) c->nrec++;
+
+        p = nl + 1;
+    }
+    return 0;
+}
+
+static int chunk_decode_block(struct pipeline *pl, struct chunk *c, size_t job) {
+    c->seq = job;
+    c->hit = pl->blocks[job];
+    c->len = 0;
+    c->nrec = 1;
+    c->overlong = 0;
+    c->read_ns = 0;
+    c->parse_ns = 0;
+    memset(&c->stats, 0, sizeof(c->stats));
+    uint64_t t0 = mono_ns();
+    c->bad = bz2_decode_block(pl->bz, c->hit, &c->data, &c->len, &c->data_cap, SCAN_PAD + 1, &c->merged) != 0;
+    c->decode_ns = mono_ns() - t0;
+    if (c->bad) return 0;
+
+    char *first = memchr(c->data, '\n', c->len);
+    c->no_newline = first == NULL;
+    if (c->no_newline) return 0;
+
+    char *last = memrchr(c->data, '\n', c->len);
+    c->head_len = first - c->data;
+    c->tail_off = last + 1 - c->data;
+    t0 = mono_ns();
+    int rc = chunk_parse(c, c->head_len + 1, c->tail_off);
+    c->parse_ns = mono_ns() - t0;
+    return rc;
+}
+
+static void *worker_main(void *arg) {
+    struct pipeline *pl = arg;
+    struct chunk *c;
+
+    while (1) {
+        int rc;
+        if (pl->bz) {
+            // Take a chunk before a job, so that the lowest pending block
+            // always has a buffer and the ordered writer cannot starve.
+            if (!(c = chunk_queue_pop(&pl->free_q))) break;
+            pthread_mutex_lock(&pl->workers_mtx);
+            size_t job = pl->next_block++;
+            pthread_mutex_unlock(&pl->workers_mtx);
+            if (job >= pl->nblocks) {
+                chunk_queue_push(&pl->free_q, c);
+                break;
+            }
+            rc = chunk_decode_block(pl, c, job);
+        } else {
+            if (!(c = chunk_queue_pop(&pl->work_q))) break;
+            memset(&c->stats, 0, sizeof(c->stats));
+            c->decode_ns = 0;
+            uint64_t t0 = mono_ns();
+            rc = chunk_parse(c, 0, c->len);
+            c->parse_ns = mono_ns() - t0;
+        }
+        if (rc) {
+            perror("failed to allocate records");
+            exit(1);
+        }
+        chunk_queue_push(&pl->done_q, c);
+    }
+
+    pthread_mutex_lock(&pl->workers_mtx);
+    if (--pl->workers_left == 0) chunk_queue_close(&pl->done_q);
+    pthread_mutex_unlock(&pl->workers_mtx);
+    return NULL;
+}
+
+// Writer-side state for joining lines that span two bz2 blocks.
+struct line_joiner {
+    char *buf;
+    size_t len, cap;
+    int skipping;       // current line exceeded MAX_LINE
+};
+
+static int line_joiner_append(struct line_joiner *j, const char *p, size_t n) {
+    if (j->skipping) return 0;
+    if (j->len + n > MAX_LINE) {
+        j->skipping = 1;
+        j->len = 0;
+        return 0;
+    }
+    if (j->len + n + 1 + SCAN_PAD > j->cap) {
+        size_t cap = j->cap ? j->cap : 64 * 1024;
+        while (cap < j->len + n + 1 + SCAN_PAD) cap *= 2;
+        char *buf = realloc(j->buf, cap);
+        if (!buf) return -1;
+        j->buf = buf;
+        j->cap = cap;
+    }
+    memcpy(j->buf + j->len, p, n);
+    j->len += n;
+    return 0;
+}
+
+// Parses the joined line into *out and starts a new one. Returns 1 if a
+// record was produced.
+static int line_joiner_finish(struct line_joiner *j, struct pingdata_s *out, struct line_stats *st) {
+    int ok = 0;
+
+    if (j->skipping) {
+        line_stats_overlong(st, 1);
+    } else if (j->len) {
+        memset(j->buf + j->len, 0, 1 + SCAN_PAD);
+        ok = process_line(j->buf, out, st);
+    }
+    j->len = 0;
+    j->skipping = 0;
+    return ok;
+}
+
+// Handles one -z chunk in block order. Returns the index of the first
+// record to write, or -1 if the chunk contributes nothing.
+static int join_block(struct line_joiner *j, struct chunk *c, size_t *skip_through, int *fatal, struct line_stats *st) {
+    if (*skip_through != SIZE_MAX && c->hit <= *skip_through) return -1;
+    if (c->bad) {
+        fprintf(stderr, "bzip2 block at bit %llu does not decode\n", (unsigned long long)c->hit);
+        *fatal = 1;
+        return -1;
+    }
+    if (c->merged) *skip_through = c->hit + c->merged;
+
+    if (c->no_newline) {
+        if (line_joiner_append(j, c->data, c->len)) *fatal = 1;
+        return -1;
+    }
+    if (line_joiner_append(j, c->data, c->head_len)) *fatal = 1;
+    int first = line_joiner_finish(j, &c->recs[0], st) ? 0 : 1;
+    if (line_joiner_append(j, c->data + c->tail_off, c->len - c->tail_off)) *fatal = 1;
+    return first;
+}
+
+// ------------------------------------------------------------------
+// Live totals
+//
+// The thread that writes the output sees every chunk, so it alone keeps
+// the run_stats and copies them here as it goes; the -P/-S reporter reads
+// the copy. Relaxed atomics make both sides plain loads and stores.
+// ------------------------------------------------------------------
+
+static struct run_stats live_stats;
+
+_Static_assert(sizeof(struct run_stats) % sizeof(uint64_t) == 0, "run_stats must be all uint64_t");
+
+static void run_stats_publish(const struct run_stats *s) {
+    const uint64_t *from = (const uint64_t *)s;
+    uint64_t *to = (uint64_t *)&live_stats;
+    for (size_t i = 0; i < sizeof(*s) / sizeof(uint64_t); i++) __atomic_store_n(&to[i], from[i], __ATOMIC_RELAXED);
+}
+
+// Adds what the reader and a worker did for c. A block swallowed by the
+// one before it (see join_block) only adds its time.
+static void run_stats_add_chunk(struct run_stats *s, const struct pipeline *pl, const struct chunk *c, int counted) {
+    s->stage_ns[STAGE_READ] += c->read_ns;
+    s->stage_ns[STAGE_DECOMPRESS] += c->decode_ns;
+    s->stage_ns[STAGE_PARSE] += c->parse_ns;
+    if (!counted || c->bad) return;
+    line_stats_add(&s->lines, &c->stats);
+    line_stats_overlong(&s->lines, c->overlong);
+    s->bytes_in += c->len;
+    if (pl->bz) {
+        size_t end = c->hit + 1 + c->merged;
+        uint64_t end_bit = end < pl->bz->nhits ? pl->bz->hits[end] : (uint64_t)pl->bz->size * 8;
+        s->bz2_bytes_in += (end_bit - pl->bz->hits[c->hit]) / 8;
+    }
+}
+
+static int run_parallel(int in_fd, const struct bz2_file *bz, int wfd, size_t batch_records, int jobs, int ordered,
+                        struct run_stats *stats) {
+    struct pipeline pl = { .in_fd = in_fd, .bz = bz, .workers_left = jobs };
+    size_t pool_size = 2 * (size_t)jobs + 2;
+    struct chunk *pool = calloc(pool_size, sizeof(*pool));
+    struct chunk **pending = calloc(pool_size, sizeof(*pending));
+    struct line_joiner joiner = { 0 };
+    struct record_writer writer;
+    pthread_t reader, workers[MAX_JOBS];
+    int write_error = 0;
+    int fatal = 0;
+
+    if (!pool || !pending) {
+        perror("failed to allocate chunks");
+        free(pool);
+        free(pending);
+        return -1;
+    }
+    if (record_writer_init(&writer, wfd, batch_records)) {
+        perror("failed to start output");
+        record_writer_free(&writer);
+        free(pool);
+        free(pending);
+        return -1;
+    }
+
+    if (bz) {
+        ordered = 1;
+        pl.blocks = malloc((bz->nhits ? bz->nhits : 1) * sizeof(*pl.blocks));
+        if (!pl.blocks) {
+            perror("failed to allocate block list");
+            exit(1);
+        }
+        for (size_t i = 0; i < bz->nhits; i++) {
+            if (bz->kinds[i] == BZ2_HIT_BLOCK) pl.blocks[pl.nblocks++] = i;
+        }
+    }
+
+    chunk_queue_init(&pl.free_q);
+    chunk_queue_init(&pl.work_q);
+    chunk_queue_init(&pl.done_q);
+    pthread_mutex_init(&pl.workers_mtx, NULL);
+
+    for (size_t i = 0; i < pool_size; i++) {
+        pool[i].data_cap = CHUNK_SIZE + 1 + SCAN_PAD;
+        pool[i].data = malloc(pool[i].data_cap);
+        if (!pool[i].data) {
+            perror("failed to allocate chunks");
+            exit(1);
+        }
+        memset(pool[i].data + CHUNK_SIZE, 0, 1 + SCAN_PAD);
+        chunk_queue_push(&pl.free_q, &pool[i]);
+    }
+
+    if (!bz) pthread_create(&reader, NULL, reader_main, &pl);
+    for (int i = 0; i < jobs; i++) pthread_create(&workers[i], NULL, worker_main, &pl);
+
+    // The pool bounds how far ahead of the writer a chunk can be, so
+    // seq % pool_size names a free slot while waiting for its turn.
+    uint64_t next_seq = 0;
+    size_t skip_through = SIZE_MAX;
+    struct chunk *c;
+    while ((c = chunk_queue_pop(&pl.done_q))) {
+        if (!ordered) {
+            run_stats_add_chunk(stats, &pl, c, 1);
+            if (!write_error && record_writer_append(&writer, c->recs + 1, c->nrec - 1)) write_error = errno;
+            chunk_queue_push(&pl.free_q, c);
+            stats->stage_ns[STAGE_WRITE] = writer.flush_ns;
+            run_stats_publish(stats);
+            continue;
+        }
+
+        pending[c->seq % pool_size] = c;
+        while ((c = pending[next_seq % pool_size]) && c->seq == next_seq) {
+            pending[next_seq % pool_size] = NULL;
+            int swallowed = bz && skip_through != SIZE_MAX && c->hit <= skip_through;
+            int first = bz ? join_block(&joiner, c, &skip_through, &fatal, &stats->lines) : 1;
+            run_stats_add_chunk(stats, &pl, c, !swallowed);
+            if (first >= 0 && !write_error && !fatal &&
+                record_writer_append(&writer, c->recs + first, c->nrec - first)) write_error = errno;
+            chunk_queue_push(&pl.free_q, c);
+            next_seq++;
+        }
+        stats->stage_ns[STAGE_WRITE] = writer.flush_ns;
+        run_stats_publish(stats);
+    }
+
+    if (bz && !write_error && !fatal) {
+        struct pingdata_s last;
+        if (line_joiner_finish(&joiner, &last, &stats->lines) && record_writer_append(&writer, &last, 1)) write_error = errno;
+    }
+    if (!write_error && record_writer_finish(&writer)) write_error = errno;
+    stats->stage_ns[STAGE_WRITE] = writer.flush_ns;
+    run_stats_publish(stats);
+
+    if (!bz) pthread_join(reader, NULL);
+    for (int i = 0; i < jobs; i++) pthread_join(workers[i], NULL);
+
+    for (size_t i = 0; i < pool_size; i++) {
+        free(pool[i].data);
+        free(pool[i].recs);
     }
+    free(pool);
+    free(pending);
+    free(pl.blocks);
+    free(joiner.buf);
+    record_writer_free(&writer);
+    chunk_queue_destroy(&pl.free_q);
+    chunk_queue_destroy(&pl.work_q);
+    chunk_queue_destroy(&pl.done_q);
+    pthread_mutex_destroy(&pl.workers_mtx);
 
-    file_buffer = malloc(BUFFER_SIZE);
+    if (pl.read_error) {
+        errno = pl.read_error;
+        perror("failed to read input");
+        return -1;
+    }
+    if (write_error) {
+        errno = write_error;
+        perror("failed to write output");
+        return -1;
+    }
+    return fatal ? -1 : 0;
+}
+
+// Lines between two run_stats_publish() calls of run_serial
+#define SERIAL_PUBLISH_LINES (64 * 1024)
+
+// Serial stage times: reading and writing are timed, parsing is the rest.
+static void serial_totals(struct run_stats *s, const struct line_reader *r, const struct record_writer *w, uint64_t t0) {
+    uint64_t elapsed = mono_ns() - t0;
+    uint64_t other = r->read_ns + w->flush_ns;
+    s->bytes_in = r->bytes;
+    s->stage_ns[STAGE_READ] = r->read_ns;
+    s->stage_ns[STAGE_WRITE] = w->flush_ns;
+    s->stage_ns[STAGE_PARSE] = elapsed > other ? elapsed - other : 0;
+}
+
+static int run_serial(int in_fd, int wfd, size_t batch_records, struct run_stats *stats) {
+    char *file_buffer = NULL;
+    struct record_writer writer = { 0 };
+    struct line_reader reader;
+    uint64_t t0 = mono_ns();
+    int ret = -1;
+
+    file_buffer = malloc(BUFFER_SIZE + SCAN_PAD);
+    line_reader_init(&reader, in_fd, file_buffer);
+    reader.stats = &stats->lines;
     if (!file_buffer) {
         perror("failed to allocate buffer");
-        goto FAIL;
+        goto DONE;
+    }
+
+    if (record_writer_init(&writer, wfd, batch_records)) {
+        perror("failed to start output");
+        goto DONE;
     }
     
-    char line[MAX_LINE_SIZE+1];
-    line[MAX_LINE_SIZE] = 0;
-    char *dst_addr_1, *dst_addr_2, *dst_addr_3, *dst_addr_4, *src_addr_1, *src_addr_2, *src_addr_3, *src_addr_4, *rtt1, *rtt2, *rtt3;
-    struct pingdata_s pingdata;
+    char *line;
+    size_t line_len;
+    int rc;
     
-    while (fgets(line, MAX_LINE_SIZE, stdin)) {
-        //printf("%s", line);
-
-        if (extract_all(
-            line, 
-            &dst_addr_1, &dst_addr_2, &dst_addr_3, &dst_addr_4, 
-            &src_addr_1, &src_addr_2, &src_addr_3, &src_addr_4, 
-            &rtt1, &rtt2, &rtt3)) continue;
-
-        if (parse_pingdata(
-            &pingdata, 
-            dst_addr_1, dst_addr_2, dst_addr_3, dst_addr_4, 
-            src_addr_1, src_addr_2, src_addr_3, src_addr_4, 
-            rtt1, rtt2, rtt3)) continue;
-
-        // printf(">>>>>%d.%d.%d.%d|%d.%d.%d.%d|%f|%f|%f\n\n", 
-        //     pingdata.dst_addr_1, pingdata.dst_addr_2, pingdata.dst_addr_3, pingdata.dst_addr_4, 
-        //     pingdata.src_addr_1, pingdata.src_addr_2, pingdata.src_addr_3, pingdata.src_addr_4, 
-        //     pingdata.rtt1, pingdata.rtt2, pingdata.rtt3);
-        fwrite(&pingdata, sizeof(struct pingdata_s), 1, wfp);
+    while ((rc = line_reader_next(&reader, &line, &line_len)) > 0) {
+        //printf("%s\n", line);
+
+        struct pingdata_s *pingdata = record_writer_slot(&writer);
+        if (stats->lines.lines % SERIAL_PUBLISH_LINES == 0) {
+            serial_totals(stats, &reader, &writer, t0);
+            run_stats_publish(stats);
+        }
+        if (!process_line(line, pingdata, &stats->lines)) continue;
+
+        // printf(">>>>>%d.%d.%d.%d|%d.%d.%d.%d|%u|%u\n\n", 
+        //     pingdata->dst_addr[12], pingdata->dst_addr[13], pingdata->dst_addr[14], pingdata->dst_addr[15], 
+        //     pingdata->src_addr[12], pingdata->src_addr[13], pingdata->src_addr[14], pingdata->src_addr[15], 
+        //     pingdata->rtt_count, pingdata->rtt_us[0]);
+        if (record_writer_commit(&writer)) {
+            perror("failed to write output");
+            goto DONE;
+        }
     }
-    
-    fclose(wfp);
+    if (rc < 0) {
+        perror("failed to read input");
+        goto DONE;
+    }
+    if (record_writer_finish(&writer)) {
+        perror("failed to write output");
+        goto DONE;
+    }
+    ret = 0;
+
+DONE:
+    serial_totals(stats, &reader, &writer, t0);
+    run_stats_publish(stats);
+    record_writer_free(&writer);
     free(file_buffer);
+    return ret;
+}
+
+// extbench.c includes this file to time its stages and has its own main.
+#ifndef EXTRACT_NO_MAIN
+
+// ------------------------------------------------------------------
+// Progress and summary
+//
+// With -P a thread prints the live totals to stderr every interval, and
+// with -S it rewrites a status file (by rename, so readers never see half
+// of one) with the JSON that -J writes once at the end.
+// ------------------------------------------------------------------
+
+#define DEFAULT_STATUS_INTERVAL 10
+
+struct progress {
+    const char *input;          // bz2 path, or "-" for stdin
+    const char *output;
+    const char *mode;           // serial, parallel or bz2
+    int jobs;
+    uint64_t input_size;        // compressed with -z; 0 if not known
+    uint64_t start_ns;
+
+    double interval;            // seconds
+    int print;                  // -P given
+    const char *status_path;    // -S
+
+    pthread_mutex_t mtx;
+    pthread_cond_t cond;
+    int done;
+};
+
+static void json_string(FILE *f, const char *s) {
+    fputc('"', f);
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') fprintf(f, "\\%c", *s);
+        else if ((unsigned char)*s < 0x20) fprintf(f, "\\u%04x", *s);
+        else fputc(*s, f);
+    }
+    fputc('"', f);
+}
+
+static void summary_json(FILE *f, const struct progress *p, const struct run_stats *s, int final, int ok) {
+    double elapsed = (mono_ns() - p->start_ns) * 1e-9;
+    const struct line_stats *ls = &s->lines;
+    uint64_t records = ls->verdicts[LINE_RECORD];
+
+    fprintf(f, "{\"input\":");
+    json_string(f, p->input);
+    fprintf(f, ",\"output\":");
+    json_string(f, p->output);
+    fprintf(f, ",\"mode\":\"%s\",\"jobs\":%d,\"final\":%s", p->mode, p->jobs, final ? "true" : "false");
+    if (final) fprintf(f, ",\"ok\":%s", ok ? "true" : "false");
+    fprintf(f, ",\"elapsed_s\":%.3f,\"bytes_in\":%llu", elapsed, (unsigned long long)s->bytes_in);
+    if (s->bz2_bytes_in) fprintf(f, ",\"bz2_bytes_in\":%llu", (unsigned long long)s->bz2_bytes_in);
+    if (p->input_size) fprintf(f, ",\"input_size\":%llu", (unsigned long long)p->input_size);
+    fprintf(f, ",\"lines\":%llu,\"records\":%llu,\"partial_records\":%llu,\"rejects\":{",
+        (unsigned long long)ls->lines, (unsigned long long)records, (unsigned long long)ls->partial);
+    for (int i = 1; i < LINE_VERDICTS; i++) {
+        fprintf(f, "%s\"%s\":%llu", i > 1 ? "," : "", line_verdict_names[i], (unsigned long long)ls->verdicts[i]);
+    }
+    fprintf(f, "},\"stage_s\":{");
+    for (int i = 0; i < STAGES; i++) fprintf(f, "%s\"%s\":%.3f", i ? "," : "", stage_names[i], s->stage_ns[i] * 1e-9);
+    if (elapsed <= 0) elapsed = 1e-9;
+    fprintf(f, "},\"mb_per_s\":%.2f,\"lines_per_s\":%.0f,\"records_per_s\":%.0f}\n",
+        s->bytes_in / elapsed / 1e6, ls->lines / elapsed, records / elapsed);
+}
+
+static int write_status(const struct progress *p, const struct run_stats *s, const char *path, int final, int ok) {
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    summary_json(f, p, s, final, ok);
+    if (fclose(f)) return -1;
+    return rename(tmp, path);
+}
+
+static void run_stats_snapshot(struct run_stats *s) {
+    const uint64_t *from = (const uint64_t *)&live_stats;
+    uint64_t *to = (uint64_t *)s;
+    for (size_t i = 0; i < sizeof(*s) / sizeof(uint64_t); i++) to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
+
+static void *progress_main(void *arg) {
+    struct progress *p = arg;
+    struct run_stats s, last = { 0 };
+    uint64_t last_ns = p->start_ns;
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    pthread_mutex_lock(&p->mtx);
+    while (!p->done) {
+        deadline.tv_sec += (time_t)p->interval;
+        deadline.tv_nsec += (long)((p->interval - (time_t)p->interval) * 1e9);
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        while (!p->done && pthread_cond_timedwait(&p->cond, &p->mtx, &deadline) != ETIMEDOUT) {}
+        if (p->done) break;
+        pthread_mutex_unlock(&p->mtx);
+
+        run_stats_snapshot(&s);
+        uint64_t now = mono_ns();
+        if (p->print) {
+            double dt = (now - last_ns) * 1e-9;
+            uint64_t records = s.lines.verdicts[LINE_RECORD];
+            fprintf(stderr, "extract: %.0f s, %.1f MB in (%.1f MB/s), %llu lines (%.0f/s), %llu records, %llu rejected",
+                (now - p->start_ns) * 1e-9, s.bytes_in / 1e6, (s.bytes_in - last.bytes_in) / dt / 1e6,
+                (unsigned long long)s.lines.lines, (s.lines.lines - last.lines.lines) / dt,
+                (unsigned long long)records, (unsigned long long)(s.lines.lines - records));
+            uint64_t done_bytes = s.bz2_bytes_in ? s.bz2_bytes_in : s.bytes_in;
+            if (p->input_size) fprintf(stderr, ", %.1f%%", 100.0 * done_bytes / p->input_size);
+            fprintf(stderr, "\n");
+        }
+        if (p->status_path && write_status(p, &s, p->status_path, 0, 0)) perror(p->status_path);
+        last = s;
+        last_ns = now;
+
+        pthread_mutex_lock(&p->mtx);
+    }
+    pthread_mutex_unlock(&p->mtx);
+    return NULL;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-b block_records] [-j jobs [-u]] [-z input.bz2] [-a addrs] [-p probes] [-4] [-v]\n"
+        "          [-P seconds] [-S status.json] [-J summary.json] <filename>\n"
+        "  -z  decompress input.bz2 directly, one block per job, instead of\n"
+        "      reading stdin (output is always in input order)\n"
+        "  -a  keep only pings between addresses listed in the file\n"
+        "  -p  keep only pings from probe ids listed in the file\n"
+        "  -4  skip IPv6 measurements\n"
+        "  -v  print how many lines each filter rejected\n"
+        "  -P  print throughput and totals to stderr every so many seconds\n"
+        "  -S  keep the totals in this JSON file, rewritten every -P seconds\n"
+        "      (default %d)\n"
+        "  -J  write the final totals, stage times and rejects as one JSON line\n",
+        argv0, DEFAULT_STATUS_INTERVAL);
+}
+
+int main(int argc, char* argv[]) {
+    size_t batch_records = DEFAULT_BATCH_RECORDS;
+    int jobs = 1;
+    int ordered = 1;
+    const char *bz2_path = NULL;
+    int verbose = 0;
+    const char *summary_path = NULL;
+    struct progress progress = { .interval = DEFAULT_STATUS_INTERVAL };
+    struct run_stats stats = { 0 };
+    int opt;
+
+    while ((opt = getopt(argc, argv, "b:j:uz:a:p:4vP:S:J:")) != -1) {
+        switch (opt) {
+        case 'b':
+            batch_records = strtoul(optarg, NULL, 10);
+            if (batch_records == 0 || batch_records > MAX_BLOCK_RECORDS) {
+                fprintf(stderr, "invalid batch size: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'j':
+            jobs = atoi(optarg);
+            if (jobs < 1 || jobs > MAX_JOBS) {
+                fprintf(stderr, "invalid job count: %s (1-%d)\n", optarg, MAX_JOBS);
+                return 1;
+            }
+            break;
+        case 'u':
+            ordered = 0;
+            break;
+        case 'z':
+            bz2_path = optarg;
+            break;
+        case 'a':
+            if (addr_set_load(&addr_whitelist, optarg)) return 1;
+            break;
+        case 'p':
+            if (id_set_load(&probe_whitelist, optarg)) return 1;
+            break;
+        case '4':
+            ipv4_only = 1;
+            break;
+        case 'v':
+            verbose = 1;
+            break;
+        case 'P':
+            progress.interval = strtod(optarg, NULL);
+            progress.print = 1;
+            if (!(progress.interval >= 0.1)) {
+                fprintf(stderr, "invalid progress interval: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'S':
+            progress.status_path = optarg;
+            break;
+        case 'J':
+            summary_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1) {
+        usage(argv[0]);
+        return 1;
+    }
     
-    return 0;
+    int wfd = open(argv[optind], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (wfd < 0) {
+        perror("Failed to open file");
+        return 1;
+    }
+
+    scanner_init();
 
-FAIL:
-    if(wfp) fclose(wfp);
-    if(file_buffer) free(file_buffer);
+    progress.input = bz2_path ? bz2_path : "-";
+    progress.output = argv[optind];
+    progress.mode = bz2_path ? "bz2" : jobs > 1 ? "parallel" : "serial";
+    progress.jobs = jobs;
+    progress.start_ns = mono_ns();
+    struct stat st;
+    if (!bz2_path && !fstat(STDIN_FILENO, &st) && S_ISREG(st.st_mode)) progress.input_size = st.st_size;
+
+    pthread_t progress_thread;
+    int reporting = progress.print || progress.status_path;
+    if (reporting) {
+        pthread_condattr_t attr;
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_mutex_init(&progress.mtx, NULL);
+        pthread_cond_init(&progress.cond, &attr);
+        pthread_condattr_destroy(&attr);
+    }
+
+    int rc;
+    if (bz2_path) {
+        struct bz2_file bz;
+        if (bz2_open(&bz, bz2_path, jobs)) {
+            perror(bz2_path);
+            close(wfd);
+            return 1;
+        }
+        progress.input_size = bz.size;
+        if (reporting) pthread_create(&progress_thread, NULL, progress_main, &progress);
+        rc = run_parallel(-1, &bz, wfd, batch_records, jobs, ordered, &stats);
+        bz2_close(&bz);
+    } else {
+        if (reporting) pthread_create(&progress_thread, NULL, progress_main, &progress);
+        if (jobs > 1) rc = run_parallel(STDIN_FILENO, NULL, wfd, batch_records, jobs, ordered, &stats);
+        else rc = run_serial(STDIN_FILENO, wfd, batch_records, &stats);
+    }
     
-    return 1;
-}
\ No newline at end of file
+    close(wfd);
+
+    if (reporting) {
+        pthread_mutex_lock(&progress.mtx);
+        progress.done = 1;
+        pthread_cond_signal(&progress.cond);
+        pthread_mutex_unlock(&progress.mtx);
+        pthread_join(progress_thread, NULL);
+        if (progress.status_path && write_status(&progress, &stats, progress.status_path, 1, rc == 0)) {
+            perror(progress.status_path);
+        }
+    }
+    if (summary_path && write_status(&progress, &stats, summary_path, 1, rc == 0)) {
+        perror(summary_path);
+        rc = -1;
+    }
+
+    if (verbose) {
+        const struct line_stats *ls = &stats.lines;
+        fprintf(stderr, "%llu lines", (unsigned long long)ls->lines);
+        for (int i = 0; i < LINE_VERDICTS; i++) {
+            fprintf(stderr, "%s %s %llu", i ? "," : ":", line_verdict_names[i], (unsigned long long)ls->verdicts[i]);
+        }
+        fprintf(stderr, "; %llu records with fewer than %d RTTs\n", (unsigned long long)ls->partial, FULL_REPLIES);
+    }
+    return rc ? 1 : 0;
+}
+#endif
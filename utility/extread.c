@@ -0,0 +1,700 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+
+static int fail(struct ext_file *f, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(f->error, sizeof(f->error), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static size_t type_size(uint8_t type) {
+    switch (type) {
+    case EXT_TYPE_U8: return 1;
+    case EXT_TYPE_U16: return 2;
+    case EXT_TYPE_U32: return 4;
+    case EXT_TYPE_U64: return 8;
+    case EXT_TYPE_F32: return 4;
+    case EXT_TYPE_IPV4: return 4;
+    case EXT_TYPE_IPV6: return 16;
+    default: return 0;
+    }
+}
+
+const struct ext_field *ext_find_field(const struct ext_file *f, uint16_t id) {
+    for (uint16_t i = 0; i < f->hdr->nfields; i++) {
+        if (f->fields[i].id == id) return &f->fields[i];
+    }
+    return NULL;
+}
+
+static const struct ext_column *find_column(const struct ext_block_header *hdr, const struct ext_column *cols, uint16_t field) {
+    for (uint32_t i = 0; i < hdr->ncols; i++) {
+        if (cols[i].field == field) return &cols[i];
+    }
+    return NULL;
+}
+
+// The fields this library and the tools read directly must have the count
+// and stored type they are read with, whatever the schema claims.
+static int shape_ok(const struct ext_block_header *hdr, const struct ext_column *c) {
+    switch (c->field) {
+    case EXT_FIELD_SRC_ADDR:
+    case EXT_FIELD_DST_ADDR:
+        return c->count == hdr->nrecords && c->type == EXT_TYPE_IPV4 && c->encoding == EXT_ENC_RAW;
+    case EXT_FIELD_RTT_COUNT:
+        return c->count == hdr->nrecords && c->type == EXT_TYPE_U8 && c->encoding == EXT_ENC_RAW;
+    case EXT_FIELD_SRC_ID:
+    case EXT_FIELD_DST_ID:
+    case EXT_FIELD_PRB_ID:
+    case EXT_FIELD_MSM_ID:
+        return c->count == hdr->nrecords && c->type == EXT_TYPE_U32 && c->encoding == EXT_ENC_RAW;
+    case EXT_FIELD_RTT:
+        return c->count == hdr->nvalues && ((c->type == EXT_TYPE_F32 && c->encoding == EXT_ENC_RAW) ||
+            (c->type == EXT_TYPE_U32 && c->encoding == EXT_ENC_USEC));
+    case EXT_FIELD_TIMESTAMP:
+        return c->count == hdr->nrecords && c->type >= EXT_TYPE_U8 && c->type <= EXT_TYPE_U64 &&
+            (c->encoding == EXT_ENC_RAW || c->encoding == EXT_ENC_FOR);
+    case EXT_FIELD_ADDR_TABLE:
+        return c->type == EXT_TYPE_IPV6 && c->encoding == EXT_ENC_RAW;
+    default:
+        return 1;
+    }
+}
+
+static int validate_block(struct ext_file *f, uint64_t off, const struct ext_block_header **out) {
+    if (f->size - off < sizeof(struct ext_block_header)) return fail(f, "truncated block header at %llu", (unsigned long long)off);
+    const struct ext_block_header *hdr = (const void *)(f->data + off);
+    if (hdr->magic != EXT_BLOCK_MAGIC) return fail(f, "bad block magic at %llu", (unsigned long long)off);
+    if (hdr->size > f->size - off || hdr->size % 8 ||
+        hdr->size < sizeof(*hdr) + (uint64_t)hdr->ncols * sizeof(struct ext_column))
+        return fail(f, "bad block size at %llu", (unsigned long long)off);
+
+    const struct ext_column *cols = (const void *)(hdr + 1);
+    uint64_t table_end = sizeof(*hdr) + (uint64_t)hdr->ncols * sizeof(*cols);
+    for (uint32_t i = 0; i < hdr->ncols; i++) {
+        const struct ext_column *c = &cols[i];
+        if (c->offset < table_end || c->offset % 8 || c->offset > hdr->size || c->size > hdr->size - c->offset)
+            return fail(f, "column %u out of bounds in block at %llu", c->field, (unsigned long long)off);
+
+        // Every field a block carries must be in the schema, which tells
+        // how many values it holds
+        const struct ext_field *fd = ext_find_field(f, c->field);
+        if (!fd) return fail(f, "column %u not in the schema in block at %llu", c->field, (unsigned long long)off);
+        uint32_t want = fd->flags & EXT_FIELD_TABLE ? c->count
+            : fd->flags & EXT_FIELD_PER_REPLY ? hdr->nvalues : hdr->nrecords;
+        size_t ts = type_size(c->type);
+        uint64_t head = c->encoding == EXT_ENC_FOR ? 8 : 0;
+        int known = c->encoding == EXT_ENC_RAW || c->encoding == EXT_ENC_FOR || c->encoding == EXT_ENC_USEC;
+        if (c->count != want || !shape_ok(hdr, c) || (known && ts && c->size != head + (uint64_t)c->count * ts))
+            return fail(f, "column %u has the wrong size or type in block at %llu", c->field, (unsigned long long)off);
+    }
+
+    // The record iterator walks rtt values by rtt_count, so the counts
+    // must add up to the values stored.
+    const struct ext_column *cnt = find_column(hdr, cols, EXT_FIELD_RTT_COUNT);
+    if (cnt) {
+        const uint8_t *p = (const uint8_t *)hdr + cnt->offset;
+        uint64_t sum = 0;
+        for (uint32_t i = 0; i < cnt->count; i++) sum += p[i];
+        if (sum != hdr->nvalues) return fail(f, "rtt counts do not match values in block at %llu", (unsigned long long)off);
+    }
+
+    // Extend the dictionary, then make sure every id the block uses is in
+    // it, so readers can index f->addrs without checking.
+    const struct ext_column *table = find_column(hdr, cols, EXT_FIELD_ADDR_TABLE);
+    if (table && table->count) {
+        if (table->count > UINT32_MAX - f->naddrs) return fail(f, "address dictionary too large");
+        uint8_t (*addrs)[16] = realloc(f->addrs, ((size_t)f->naddrs + table->count) * 16);
+        if (!addrs) return fail(f, "out of memory");
+        memcpy(addrs[f->naddrs], (const char *)hdr + table->offset, (size_t)table->count * 16);
+        f->addrs = addrs;
+        f->naddrs += table->count;
+    }
+    static const uint16_t id_fields[] = { EXT_FIELD_SRC_ID, EXT_FIELD_DST_ID };
+    for (int k = 0; k < 2; k++) {
+        const struct ext_column *c = find_column(hdr, cols, id_fields[k]);
+        if (!c) continue;
+        const uint32_t *id = (const void *)((const char *)hdr + c->offset);
+        uint32_t bad = 0;
+        for (uint32_t i = 0; i < c->count; i++) bad |= id[i] >= f->naddrs;
+        if (bad) return fail(f, "address id out of range in block at %llu", (unsigned long long)off);
+    }
+
+    *out = hdr;
+    return 0;
+}
+
+int ext_open(struct ext_file *f, const char *path, int flags) {
+    struct stat st;
+
+    memset(f, 0, sizeof(*f));
+    f->fd = open(path, O_RDONLY);
+    if (f->fd < 0) return fail(f, "%s", strerror(errno));
+    if (fstat(f->fd, &st)) {
+        fail(f, "%s", strerror(errno));
+        goto FAIL;
+    }
+    f->size = st.st_size;
+    if (f->size < sizeof(struct ext_file_header)) {
+        fail(f, "file too short");
+        goto FAIL;
+    }
+
+    f->data = mmap(NULL, f->size, PROT_READ, MAP_SHARED, f->fd, 0);
+    if (f->data == MAP_FAILED) {
+        f->data = NULL;
+        fail(f, "mmap: %s", strerror(errno));
+        goto FAIL;
+    }
+    // The mapping keeps the file; tools open hundreds of inputs at once
+    close(f->fd);
+    f->fd = -1;
+    madvise((void *)f->data, f->size, flags & EXT_OPEN_RANDOM ? MADV_RANDOM : MADV_SEQUENTIAL);
+#ifdef MADV_HUGEPAGE
+    if (flags & EXT_OPEN_HUGEPAGE) madvise((void *)f->data, f->size, MADV_HUGEPAGE);
+#endif
+
+    f->hdr = (const void *)f->data;
+    if (memcmp(f->hdr->magic, EXT_MAGIC, sizeof(f->hdr->magic)) != 0) {
+        fail(f, "not an extract file");
+        goto FAIL;
+    }
+    if (f->hdr->byte_order != EXT_BYTE_ORDER) {
+        fail(f, "written with a different byte order");
+        goto FAIL;
+    }
+    if (f->hdr->version < EXT_MIN_VERSION || f->hdr->version > EXT_VERSION) {
+        fail(f, "unsupported format version %u", f->hdr->version);
+        goto FAIL;
+    }
+    f->blocks_offset = sizeof(struct ext_file_header) + (uint64_t)f->hdr->nfields * sizeof(struct ext_field);
+    if (f->blocks_offset > f->size) {
+        fail(f, "truncated field schema");
+        goto FAIL;
+    }
+    f->fields = (const void *)(f->hdr + 1);
+
+    size_t cap = f->hdr->block_count ? f->hdr->block_count : 16;
+    f->block_offsets = malloc(cap * sizeof(uint64_t));
+    f->block_first = malloc(cap * sizeof(uint64_t));
+    if (!f->block_offsets || !f->block_first) {
+        fail(f, "out of memory");
+        goto FAIL;
+    }
+
+    for (uint64_t off = f->blocks_offset; off < f->size;) {
+        const struct ext_block_header *hdr = NULL;
+        if (validate_block(f, off, &hdr)) goto FAIL;
+        if (f->block_count == cap) {
+            cap *= 2;
+            uint64_t *o = realloc(f->block_offsets, cap * sizeof(uint64_t));
+            if (o) f->block_offsets = o;
+            uint64_t *r = realloc(f->block_first, cap * sizeof(uint64_t));
+            if (r) f->block_first = r;
+            if (!o || !r) {
+                fail(f, "out of memory");
+                goto FAIL;
+            }
+        }
+        f->block_offsets[f->block_count] = off;
+        f->block_first[f->block_count] = f->record_count;
+        f->block_count++;
+        f->record_count += hdr->nrecords;
+        off += hdr->size;
+    }
+
+    if (f->record_count != f->hdr->record_count || f->block_count != f->hdr->block_count) {
+        fail(f, "header counts do not match the blocks (unfinished write?)");
+        goto FAIL;
+    }
+    return 0;
+
+FAIL:
+    {
+        int err = errno;
+        char error[sizeof(f->error)];
+        memcpy(error, f->error, sizeof(error));
+        ext_close(f);
+        memcpy(f->error, error, sizeof(error));
+        errno = err;
+    }
+    return -1;
+}
+
+void ext_close(struct ext_file *f) {
+    if (f->data) munmap((void *)f->data, f->size);
+    if (f->fd >= 0) close(f->fd);
+    free(f->block_offsets);
+    free(f->block_first);
+    free(f->addrs);
+    memset(f, 0, sizeof(*f));
+    f->fd = -1;
+}
+
+static void load_block(const struct ext_file *f, uint64_t i, struct ext_block *b) {
+    b->index = i;
+    b->offset = f->block_offsets[i];
+    b->hdr = (const void *)(f->data + b->offset);
+    b->cols = (const void *)(b->hdr + 1);
+    b->first_record = f->block_first[i];
+}
+
+int ext_next_block(const struct ext_file *f, struct ext_block *b) {
+    uint64_t i = b->hdr ? b->index + 1 : 0;
+    if (i >= f->block_count) return 0;
+    load_block(f, i, b);
+    return 1;
+}
+
+int ext_seek_block(const struct ext_file *f, uint64_t index, struct ext_block *b) {
+    if (index >= f->record_count) return 0;
+    uint64_t lo = 0, hi = f->block_count;
+    while (hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if (f->block_first[mid] <= index) lo = mid;
+        else hi = mid;
+    }
+    load_block(f, lo, b);
+    return 1;
+}
+
+const struct ext_column *ext_block_find_column(const struct ext_block *b, uint16_t field) {
+    return find_column(b->hdr, b->cols, field);
+}
+
+const void *ext_block_column(const struct ext_file *f, const struct ext_block *b, uint16_t field, uint32_t *count) {
+    (void)f;
+    const struct ext_column *c = find_column(b->hdr, b->cols, field);
+    if (!c) return NULL;
+    if (count) *count = c->count;
+    return (const char *)b->hdr + c->offset;
+}
+
+// Loads the columns a record needs from it->block; blocks without them
+// yield no records.
+static void iter_load(struct ext_iter *it) {
+    const struct ext_column *rtt = ext_block_find_column(&it->block, EXT_FIELD_RTT);
+    const struct ext_column *ts = ext_block_find_column(&it->block, EXT_FIELD_TIMESTAMP);
+
+    it->src = ext_block_column(it->f, &it->block, EXT_FIELD_SRC_ADDR, NULL);
+    it->dst = ext_block_column(it->f, &it->block, EXT_FIELD_DST_ADDR, NULL);
+    it->src_id = ext_block_column(it->f, &it->block, EXT_FIELD_SRC_ID, NULL);
+    it->dst_id = ext_block_column(it->f, &it->block, EXT_FIELD_DST_ID, NULL);
+    if (!it->src_id || !it->dst_id) it->src_id = it->dst_id = NULL;
+    it->rtt_count = ext_block_column(it->f, &it->block, EXT_FIELD_RTT_COUNT, NULL);
+    it->rtt = ext_block_column(it->f, &it->block, EXT_FIELD_RTT, NULL);
+    it->rtt_type = rtt ? rtt->type : 0;
+    it->prb_id = ext_block_column(it->f, &it->block, EXT_FIELD_PRB_ID, NULL);
+    it->msm_id = ext_block_column(it->f, &it->block, EXT_FIELD_MSM_ID, NULL);
+    it->ts = NULL;
+    if (ts && ts->encoding == EXT_ENC_FOR) {
+        const char *p = (const char *)it->block.hdr + ts->offset;
+        memcpy(&it->ts_base, p, 8);
+        it->ts = p + 8;
+        it->ts_type = ts->type;
+    }
+    it->i = 0;
+    it->n = ((it->src && it->dst) || it->src_id) && it->rtt_count && it->rtt && type_size(it->rtt_type) == 4 ? it->block.hdr->nrecords : 0;
+}
+
+void ext_iter_init(struct ext_iter *it, const struct ext_file *f, uint64_t start) {
+    memset(it, 0, sizeof(*it));
+    it->f = f;
+    if (start == 0) return;
+
+    if (!ext_seek_block(f, start, &it->block)) {
+        it->next_block = f->block_count;
+        return;
+    }
+    it->next_block = it->block.index + 1;
+    iter_load(it);
+    uint64_t skip = start - it->block.first_record;
+    while (it->i < it->n && it->i < skip) it->rtt += 4 * it->rtt_count[it->i++];
+}
+
+int ext_iter_next(struct ext_iter *it, struct ext_record *r) {
+    while (it->i >= it->n) {
+        if (it->next_block >= it->f->block_count) return 0;
+        load_block(it->f, it->next_block++, &it->block);
+        iter_load(it);
+    }
+
+    uint32_t i = it->i++;
+    r->index = it->block.first_record + i;
+    if (it->src_id) {
+        r->src_id = it->src_id[i];
+        r->dst_id = it->dst_id[i];
+        r->src_addr = it->f->addrs[r->src_id];
+        r->dst_addr = it->f->addrs[r->dst_id];
+    } else {
+        memcpy(it->src_buf, ext_v4_prefix, 12);
+        memcpy(it->dst_buf, ext_v4_prefix, 12);
+        memcpy(it->src_buf + 12, it->src + i * 4, 4);
+        memcpy(it->dst_buf + 12, it->dst + i * 4, 4);
+        r->src_id = r->dst_id = EXT_NO_ID;
+        r->src_addr = it->src_buf;
+        r->dst_addr = it->dst_buf;
+    }
+    r->rtt_count = it->rtt_count[i];
+    r->rtt = it->rtt;
+    r->rtt_type = it->rtt_type;
+    it->rtt += 4 * r->rtt_count;
+    r->timestamp = it->ts ? it->ts_base + ext_uint_at(it->ts, it->ts_type, i) : 0;
+    r->prb_id = it->prb_id ? it->prb_id[i] : 0;
+    r->msm_id = it->msm_id ? it->msm_id[i] : 0;
+    return 1;
+}
+
+char *ext_format_addr(const uint8_t *a, char *buf, size_t len) {
+    if (ext_addr_is_v4(a)) inet_ntop(AF_INET, a + 12, buf, len);
+    else inet_ntop(AF_INET6, a, buf, len);
+    return buf;
+}
+
+int ext_parse_addr(const char *s, uint8_t *out) {
+    memcpy(out, ext_v4_prefix, 12);
+    if (inet_pton(AF_INET, s, out + 12) == 1) return 0;
+    return inet_pton(AF_INET6, s, out) == 1 ? 0 : -1;
+}
+
+static int addr_index_rehash(struct ext_addr_index *ix, size_t mask) {
+    uint32_t *slots = calloc(mask + 1, sizeof(*slots));
+    if (!slots) return -1;
+    for (uint32_t i = 0; i < ix->n; i++) {
+        size_t h = ext_addr_hash(ix->addr[i]) & mask;
+        while (slots[h]) h = (h + 1) & mask;
+        slots[h] = i + 1;
+    }
+    free(ix->slots);
+    ix->slots = slots;
+    ix->mask = mask;
+    return 0;
+}
+
+uint32_t ext_addr_index_get(const struct ext_addr_index *ix, const uint8_t *a) {
+    if (!ix->slots) return 0;
+    for (size_t h = ext_addr_hash(a) & ix->mask; ix->slots[h]; h = (h + 1) & ix->mask) {
+        if (memcmp(ix->addr[ix->slots[h] - 1], a, 16) == 0) return ix->slots[h];
+    }
+    return 0;
+}
+
+int ext_addr_index_add(struct ext_addr_index *ix, const uint8_t *a) {
+    if ((size_t)ix->n * 10 >= ix->mask * 7 && addr_index_rehash(ix, ix->mask ? ix->mask * 2 + 1 : 4095)) return -1;
+    if (ext_addr_index_get(ix, a)) return 0;
+    if (ix->n == ix->cap) {
+        uint32_t cap = ix->cap ? ix->cap * 2 : 4096;
+        void *na = realloc(ix->addr, (size_t)cap * 16);
+        if (!na) return -1;
+        ix->addr = na;
+        ix->cap = cap;
+    }
+    memcpy(ix->addr[ix->n++], a, 16);
+    size_t h = ext_addr_hash(a) & ix->mask;
+    while (ix->slots[h]) h = (h + 1) & ix->mask;
+    ix->slots[h] = ix->n;
+    return 0;
+}
+
+// Version 3 files carry a dictionary; older ones only have IPv4 columns,
+// which are walked record by record.
+int ext_addr_index_add_file(struct ext_addr_index *ix, const struct ext_file *f) {
+    for (uint32_t id = 0; id < f->naddrs; id++) {
+        if (ext_addr_index_add(ix, f->addrs[id])) return -1;
+    }
+    if (f->naddrs) return 0;
+
+    struct ext_block b = { 0 };
+    uint8_t a[16];
+    memcpy(a, ext_v4_prefix, 12);
+    while (ext_next_block(f, &b)) {
+        const uint8_t *src = ext_block_column(f, &b, EXT_FIELD_SRC_ADDR, NULL);
+        const uint8_t *dst = ext_block_column(f, &b, EXT_FIELD_DST_ADDR, NULL);
+        if (!src || !dst) continue;
+        for (uint32_t i = 0; i < b.hdr->nrecords; i++) {
+            memcpy(a + 12, src + i * 4, 4);
+            if (ext_addr_index_add(ix, a)) return -1;
+            memcpy(a + 12, dst + i * 4, 4);
+            if (ext_addr_index_add(ix, a)) return -1;
+        }
+    }
+    return 0;
+}
+
+static int addr_cmp(const void *a, const void *b) {
+    return memcmp(a, b, 16);
+}
+
+int ext_addr_index_sort(struct ext_addr_index *ix) {
+    qsort(ix->addr, ix->n, 16, addr_cmp);
+    return addr_index_rehash(ix, ix->mask ? ix->mask : 4095);
+}
+
+int ext_addr_index_map_file(const struct ext_addr_index *ix, const struct ext_file *f, uint32_t **gid) {
+    *gid = NULL;
+    if (!f->naddrs) return 0;
+    if (!(*gid = malloc((size_t)f->naddrs * sizeof(**gid)))) return -1;
+    for (uint32_t id = 0; id < f->naddrs; id++) (*gid)[id] = ext_addr_index_get(ix, f->addrs[id]);
+    return 0;
+}
+
+void ext_addr_index_free(struct ext_addr_index *ix) {
+    free(ix->addr);
+    free(ix->slots);
+    memset(ix, 0, sizeof(*ix));
+}
+
+// ------------------------------------------------------------------
+// Pair table
+// ------------------------------------------------------------------
+
+int ext_pair_table_init(struct ext_pair_table *t, size_t entry_size, size_t cap) {
+    t->entry_size = entry_size;
+    t->cap = cap;
+    t->used = 0;
+    t->slots = calloc(cap, entry_size);
+    return t->slots ? 0 : -1;
+}
+
+static void *pair_table_find(const struct ext_pair_table *t, uint64_t key) {
+    size_t mask = t->cap - 1;
+    size_t i = (ext_mix64(key) >> 8) & mask;
+    for (;;) {
+        char *e = t->slots + i * t->entry_size;
+        uint64_t k;
+        memcpy(&k, e, sizeof(k));
+        if (!k || k == key) return e;
+        i = (i + 1) & mask;
+    }
+}
+
+static int pair_table_grow(struct ext_pair_table *t) {
+    struct ext_pair_table n;
+    if (ext_pair_table_init(&n, t->entry_size, t->cap * 2)) return -1;
+    for (size_t i = 0; i < t->cap; i++) {
+        const char *e = ext_pair_table_slot(t, i);
+        uint64_t k;
+        memcpy(&k, e, sizeof(k));
+        if (k) memcpy(pair_table_find(&n, k), e, t->entry_size);
+    }
+    n.used = t->used;
+    free(t->slots);
+    *t = n;
+    return 0;
+}
+
+void *ext_pair_table_get(struct ext_pair_table *t, uint64_t key) {
+    char *e = pair_table_find(t, key);
+    uint64_t k;
+    memcpy(&k, e, sizeof(k));
+    if (k) return e;
+    if ((t->used + 1) * 10 > t->cap * 7) {
+        if (pair_table_grow(t)) return NULL;
+        e = pair_table_find(t, key);
+    }
+    memcpy(e, &key, sizeof(key));
+    t->used++;
+    return e;
+}
+
+void ext_pair_table_free(struct ext_pair_table *t) {
+    free(t->slots);
+    memset(t, 0, sizeof(*t));
+}
+
+// ------------------------------------------------------------------
+// Input files
+// ------------------------------------------------------------------
+
+static int name_cmp(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+int ext_walk(const char *arg, int (*add)(void *ctx, const char *path), void *ctx) {
+    struct stat st;
+    if (stat(arg, &st)) {
+        perror(arg);
+        return -1;
+    }
+    if (!S_ISDIR(st.st_mode)) return add(ctx, arg);
+
+    DIR *d = opendir(arg);
+    if (!d) {
+        perror(arg);
+        return -1;
+    }
+    char **names = NULL;
+    size_t n = 0, ncap = 0;
+    int rc = 0;
+    struct dirent *de;
+    while (!rc && (de = readdir(d))) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", arg, de->d_name);
+        if (stat(path, &st) || !S_ISREG(st.st_mode)) continue;
+        if (n == ncap) {
+            ncap = ncap ? ncap * 2 : 64;
+            char **nn = realloc(names, ncap * sizeof(*names));
+            if (!nn) {
+                rc = -1;
+                break;
+            }
+            names = nn;
+        }
+        if (!(names[n] = strdup(path))) rc = -1;
+        else n++;
+    }
+    closedir(d);
+
+    qsort(names, n, sizeof(*names), name_cmp);
+    for (size_t i = 0; i < n; i++) {
+        if (!rc && add(ctx, names[i])) rc = -1;
+        free(names[i]);
+    }
+    free(names);
+    return rc;
+}
+
+int ext_file_append(struct ext_file **files, size_t *nfiles, size_t *cap, const char *path) {
+    if (*nfiles == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 64;
+        struct ext_file *f = realloc(*files, ncap * sizeof(**files));
+        if (!f) return -1;
+        *files = f;
+        *cap = ncap;
+    }
+    struct ext_file *f = &(*files)[*nfiles];
+    if (ext_open(f, path, 0)) {
+        fprintf(stderr, "Error processing %s: %s\n", path, f->error);
+        return -1;
+    }
+    (*nfiles)++;
+    return 0;
+}
+
+// ------------------------------------------------------------------
+// Address maps
+// ------------------------------------------------------------------
+
+static int map_group(struct ext_addr_map *m, const char *name, uint32_t *g) {
+    for (*g = 0; *g < m->nnames; (*g)++) {
+        if (!strcmp(m->names[*g], name)) return 0;
+    }
+    char **nn = realloc(m->names, (m->nnames + 1) * sizeof(*nn));
+    if (!nn) return -1;
+    m->names = nn;
+    if (!(m->names[m->nnames] = strdup(name))) return -1;
+    m->nnames++;
+    return 0;
+}
+
+static int map_add(struct ext_addr_map *m, const uint8_t *a, uint32_t g, size_t *cap) {
+    if (m->n == *cap) {
+        size_t ncap = *cap ? *cap * 2 : 64;
+        struct ext_addr_map_entry *e = realloc(m->entries, ncap * sizeof(*e));
+        if (!e) return -1;
+        m->entries = e;
+        *cap = ncap;
+    }
+    memcpy(m->entries[m->n].addr, a, 16);
+    m->entries[m->n++].group = g;
+    return 0;
+}
+
+int ext_addr_map_load(struct ext_addr_map *m, const char *path) {
+    memset(m, 0, sizeof(*m));
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char line[512], addr[256], name[256];
+    size_t cap = 0;
+    int lineno = 0, rc = 0;
+    while (!rc && fgets(line, sizeof(line), f)) {
+        lineno++;
+        int k = sscanf(line, "%255s %255s", addr, name);
+        if (k < 1 || addr[0] == '#') continue;
+        uint8_t a[16];
+        uint32_t g;
+        if (k != 2 || ext_parse_addr(addr, a)) {
+            fprintf(stderr, "%s:%d: expected an address and a name\n", path, lineno);
+            rc = 1;
+        } else if (map_group(m, name, &g) || map_add(m, a, g, &cap)) {
+            rc = -1;
+        }
+    }
+    if (!rc && ferror(f)) rc = -1;
+    if (rc < 0) perror(path);
+    fclose(f);
+
+    if (!rc) qsort(m->entries, m->n, sizeof(*m->entries), addr_cmp);
+    for (size_t i = 1; i < m->n && !rc; i++) {
+        const struct ext_addr_map_entry *p = &m->entries[i - 1], *e = &m->entries[i];
+        if (!memcmp(p->addr, e->addr, 16) && p->group != e->group) {
+            char buf[INET6_ADDRSTRLEN];
+            fprintf(stderr, "%s: %s is mapped to both %s and %s\n", path, ext_format_addr(e->addr, buf, sizeof(buf)),
+                m->names[p->group], m->names[e->group]);
+            rc = 1;
+        }
+    }
+    if (rc) {
+        ext_addr_map_free(m);
+        return -1;
+    }
+    return 0;
+}
+
+int64_t ext_addr_map_find(const struct ext_addr_map *m, const uint8_t *a) {
+    const struct ext_addr_map_entry *e = m->n ? bsearch(a, m->entries, m->n, sizeof(*m->entries), addr_cmp) : NULL;
+    return e ? (int64_t)e->group : -1;
+}
+
+void ext_addr_map_free(struct ext_addr_map *m) {
+    for (uint32_t g = 0; g < m->nnames; g++) free(m->names[g]);
+    free(m->names);
+    free(m->entries);
+    memset(m, 0, sizeof(*m));
+}
+
+// ------------------------------------------------------------------
+// Output files
+// ------------------------------------------------------------------
+
+int ext_commit_fd(int fd, const char *tmp, const char *path) {
+    int rc = fsync(fd);
+    if (close(fd)) rc = -1;
+    if (!rc && rename(tmp, path)) rc = -1;
+    if (rc) {
+        int e = errno;
+        unlink(tmp);
+        errno = e;
+    }
+    return rc;
+}
+
+int ext_commit_file(FILE *f, const char *tmp, const char *path) {
+    int rc = fflush(f) ? -1 : fsync(fileno(f));
+    if (fclose(f)) rc = -1;
+    if (!rc && rename(tmp, path)) rc = -1;
+    if (rc) {
+        int e = errno;
+        unlink(tmp);
+        errno = e;
+    }
+    return rc;
+}
@@ -0,0 +1,251 @@
+#ifndef EXTREAD_H
+#define EXTREAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "extfmt.h"
+
+// Zero-copy reader for extract output (see extfmt.h).
+//
+// ext_open maps the whole file read-only and validates the header and
+// every block's column table once, so blocks and columns handed out
+// afterwards are plain pointers into the page cache and need no further
+// bounds checks.
+
+#define EXT_OPEN_HUGEPAGE 0x1   // ask for transparent huge pages
+#define EXT_OPEN_RANDOM 0x2     // random access instead of MADV_SEQUENTIAL
+
+#define EXT_NO_ID UINT32_MAX    // record ids of files without a dictionary
+
+// Value i of a raw integer column of the given stored type.
+static inline uint64_t ext_uint_at(const void *data, uint8_t type, uint32_t i) {
+    switch (type) {
+    case EXT_TYPE_U8: return ((const uint8_t *)data)[i];
+    case EXT_TYPE_U16: return ((const uint16_t *)data)[i];
+    case EXT_TYPE_U32: return ((const uint32_t *)data)[i];
+    case EXT_TYPE_U64: return ((const uint64_t *)data)[i];
+    default: return 0;
+    }
+}
+
+// RTT value i in ms: version 1 files store F32 ms, version 2 U32 us.
+static inline double ext_rtt_ms(const void *data, uint8_t type, uint32_t i) {
+    if (type == EXT_TYPE_F32) return ((const float *)data)[i];
+    return ((const uint32_t *)data)[i] / 1000.0;
+}
+
+// The same value in integer microseconds, exact for version 2 files.
+static inline uint32_t ext_rtt_us(const void *data, uint8_t type, uint32_t i) {
+    if (type == EXT_TYPE_F32) return (uint32_t)(((const float *)data)[i] * 1000.0 + 0.5);
+    return ((const uint32_t *)data)[i];
+}
+
+// IPv4 addresses in the 16-byte form are ::ffff:a.b.c.d.
+static const uint8_t ext_v4_prefix[12] = { 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0xff, 0xff };
+
+static inline int ext_addr_is_v4(const uint8_t *a) {
+    for (int i = 0; i < 12; i++) {
+        if (a[i] != ext_v4_prefix[i]) return 0;
+    }
+    return 1;
+}
+
+struct ext_file {
+    int fd;                     // -1 once the file is mapped
+    const char *data;
+    size_t size;
+    const struct ext_file_header *hdr;
+    const struct ext_field *fields;
+    uint64_t blocks_offset;     // first block
+    uint64_t record_count;      // as counted while validating
+    uint64_t block_count;
+    uint64_t *block_offsets;    // [block_count]
+    uint64_t *block_first;      // first record index of each block
+    uint8_t (*addrs)[16];       // address dictionary by id
+    uint32_t naddrs;            // 0 before version 3
+    char error[128];            // reason for the last failure
+};
+
+struct ext_block {
+    const struct ext_block_header *hdr;
+    const struct ext_column *cols;
+    uint64_t index;             // block number
+    uint64_t offset;            // of this block in the file
+    uint64_t first_record;      // index of its first record in the file
+};
+
+struct ext_record {
+    uint64_t index;
+    const uint8_t *src_addr;    // 16 octets, IPv4 as ::ffff:a.b.c.d
+    const uint8_t *dst_addr;
+    uint32_t src_id;            // dictionary ids, or EXT_NO_ID
+    uint32_t dst_id;
+    uint32_t rtt_count;
+    const void *rtt;            // read with ext_rtt_ms(rtt, rtt_type, k)
+    uint8_t rtt_type;
+    uint64_t timestamp;         // 0 when the file predates these fields
+    uint32_t prb_id;
+    uint32_t msm_id;
+};
+
+struct ext_iter {
+    const struct ext_file *f;
+    struct ext_block block;
+    uint64_t next_block;
+    uint32_t i, n;              // next record in block, records usable
+    const uint8_t *src, *dst, *rtt_count;     // src, dst: 4-octet columns
+    const uint32_t *src_id, *dst_id;
+    uint8_t src_buf[16], dst_buf[16];         // src, dst in record form
+    const char *rtt;
+    uint8_t rtt_type;
+    uint64_t ts_base;
+    const void *ts;             // offsets from ts_base of type ts_type
+    uint8_t ts_type;
+    const uint32_t *prb_id, *msm_id;
+};
+
+// Returns 0, or -1 with f->error filled in (and errno set for I/O errors).
+int ext_open(struct ext_file *f, const char *path, int flags);
+void ext_close(struct ext_file *f);
+
+const struct ext_field *ext_find_field(const struct ext_file *f, uint16_t id);
+
+// Block iteration: zero *b, then call until it returns 0. Blocks are
+// returned in file order.
+int ext_next_block(const struct ext_file *f, struct ext_block *b);
+
+// Finds the block holding record index; returns 0 if out of range.
+int ext_seek_block(const struct ext_file *f, uint64_t index, struct ext_block *b);
+
+// Column data of a block, or NULL if the block does not carry the field.
+// For EXT_ENC_FOR columns this points at the u64 base.
+const void *ext_block_column(const struct ext_file *f, const struct ext_block *b, uint16_t field, uint32_t *count);
+
+// Column table entry, for the stored type and encoding; NULL if absent.
+const struct ext_column *ext_block_find_column(const struct ext_block *b, uint16_t field);
+
+// Address of dictionary id, or NULL if id is out of range.
+static inline const uint8_t *ext_addr(const struct ext_file *f, uint32_t id) {
+    return id < f->naddrs ? f->addrs[id] : NULL;
+}
+
+// Address index
+//
+// The union of the addresses of any number of files, for tools that key
+// on dense ids across files. Add every file, sort once, and from then on
+// an address's id is its position + 1 in addr (0 means absent); lookups
+// after sorting are read-only and safe from any thread.
+struct ext_addr_index {
+    uint8_t (*addr)[16];        // sorted by ext_addr_index_sort
+    uint32_t n, cap;
+    uint32_t *slots;            // position + 1, 0 = empty
+    size_t mask;
+};
+
+// All return 0, or -1 when out of memory.
+int ext_addr_index_add(struct ext_addr_index *ix, const uint8_t *a);
+int ext_addr_index_add_file(struct ext_addr_index *ix, const struct ext_file *f);
+int ext_addr_index_sort(struct ext_addr_index *ix);
+uint32_t ext_addr_index_get(const struct ext_addr_index *ix, const uint8_t *a);
+// *gid = malloc'd file id -> index id map, NULL for files without a
+// dictionary (look those up record by record).
+int ext_addr_index_map_file(const struct ext_addr_index *ix, const struct ext_file *f, uint32_t **gid);
+void ext_addr_index_free(struct ext_addr_index *ix);
+
+// Pair table
+//
+// Open-addressing hash table for the tools that accumulate per pair of
+// address ids. Entries are entry_size bytes and start with a uint64_t key,
+// (src << 32) | dst of ids that start at 1, so key 0 marks an empty slot.
+// The table doubles at 70% load, which moves the entries: a pointer from
+// ext_pair_table_get is valid until the next insert.
+struct ext_pair_table {
+    char *slots;
+    size_t entry_size;
+    size_t cap;                 // power of two
+    size_t used;
+};
+
+static inline uint64_t ext_mix64(uint64_t x) {
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Slot i of the table, for walking every entry; empty slots have key 0.
+static inline void *ext_pair_table_slot(const struct ext_pair_table *t, size_t i) {
+    return t->slots + i * t->entry_size;
+}
+
+// Returns 0, or -1 when out of memory.
+int ext_pair_table_init(struct ext_pair_table *t, size_t entry_size, size_t cap);
+// Entry of key, inserted zeroed but for the key if new; NULL when out of
+// memory. Whether it was new shows in t->used.
+void *ext_pair_table_get(struct ext_pair_table *t, uint64_t key);
+void ext_pair_table_free(struct ext_pair_table *t);
+
+// Input files
+//
+// The tools taking "<directory|file>..." treat a directory as its regular
+// files in name order. ext_walk stats arg and calls add for it, or for each
+// file under it; add returns 0, or -1 to stop the walk. Errors reading arg
+// itself are reported on stderr. Returns 0, or -1.
+int ext_walk(const char *arg, int (*add)(void *ctx, const char *path), void *ctx);
+
+// Opens path as (*files)[*nfiles], growing the array, and counts it.
+// Returns 0, or -1 when out of memory or when the file fails to open, which
+// is reported on stderr: a tool must not write results from only some of
+// its inputs.
+int ext_file_append(struct ext_file **files, size_t *nfiles, size_t *cap, const char *path);
+
+// Address maps
+//
+// An "address name" file, one pair per line as printed by
+// anchors-by-city/main.py --map, groups addresses under names; blank lines
+// and '#' comments are skipped. Groups are numbered from 0 in order of
+// first use.
+struct ext_addr_map_entry {
+    uint8_t addr[16];
+    uint32_t group;
+};
+
+struct ext_addr_map {
+    struct ext_addr_map_entry *entries;     // sorted by address
+    size_t n;
+    char **names;               // group -> name
+    uint32_t nnames;
+};
+
+// Returns 0, or -1 after printing why: a malformed line, an address mapped
+// to two names, or a failure to read or allocate.
+int ext_addr_map_load(struct ext_addr_map *m, const char *path);
+// Group of address a, or -1 if the map does not list it.
+int64_t ext_addr_map_find(const struct ext_addr_map *m, const uint8_t *a);
+void ext_addr_map_free(struct ext_addr_map *m);
+
+// Output files
+//
+// Written as "<path>.tmp" and renamed over path once complete and synced,
+// so a crash never leaves a valid-looking half file behind. Both sync and
+// close the temporary and rename it; on failure they unlink it and return
+// -1 with errno set.
+int ext_commit_fd(int fd, const char *tmp, const char *path);
+int ext_commit_file(FILE *f, const char *tmp, const char *path);
+
+// Formats a 16-byte address, IPv4 as a dotted quad; returns buf.
+char *ext_format_addr(const uint8_t *a, char *buf, size_t len);
+
+// Parses an IPv4 or IPv6 address into the 16-byte form; returns 0 or -1.
+int ext_parse_addr(const char *s, uint8_t *out);
+
+// Record iteration over all blocks, optionally starting at record index.
+// The record's address pointers stay valid until the next call.
+void ext_iter_init(struct ext_iter *it, const struct ext_file *f, uint64_t start);
+int ext_iter_next(struct ext_iter *it, struct ext_record *r);
+
+#endif
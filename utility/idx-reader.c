@@ -0,0 +1,110 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "pairidx.h"
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-i] [-l] [-a addr [-b addr]] <index>\n"
+        "  -i  print the header\n"
+        "  -l  list every address with its id and number of peers\n"
+        "  -a  list the peers of addr with sample count and mean\n"
+        "  -b  with -a, print every sample of the pair in ms instead\n",
+        argv0);
+}
+
+static int lookup(const struct pidx *p, const char *s, uint32_t *id) {
+    uint8_t a[16];
+    if (ext_parse_addr(s, a)) {
+        fprintf(stderr, "invalid address: %s\n", s);
+        return -1;
+    }
+    int64_t i = pidx_find_addr(p, a);
+    if (i < 0) {
+        fprintf(stderr, "%s is not in the index\n", s);
+        return -1;
+    }
+    *id = (uint32_t)i;
+    return 0;
+}
+
+static double mean_ms(const struct pidx *p, const struct pidx_edge *e) {
+    uint64_t sum = 0;
+    for (uint32_t k = 0; k < e->count; k++) sum += p->samples[e->first + k];
+    return e->count ? sum / 1000.0 / e->count : 0;
+}
+
+int main(int argc, char* argv[]) {
+    int info = 0, list = 0;
+    const char *addr_a = NULL, *addr_b = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "ila:b:")) != -1) {
+        switch (opt) {
+        case 'i': info = 1; break;
+        case 'l': list = 1; break;
+        case 'a': addr_a = optarg; break;
+        case 'b': addr_b = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1 || (addr_b && !addr_a)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct pidx p;
+    if (pidx_open(&p, argv[optind])) {
+        fprintf(stderr, "%s: %s\n", argv[optind], p.error);
+        return 1;
+    }
+
+    char buf[INET6_ADDRSTRLEN];
+    if (info) {
+        printf("version %u, %llu addresses, %llu pairs, %llu samples\n", p.hdr->version,
+            (unsigned long long)p.hdr->naddrs, (unsigned long long)p.hdr->npairs,
+            (unsigned long long)p.hdr->nsamples);
+    }
+    if (list) {
+        for (uint64_t a = 0; a < p.hdr->naddrs; a++) {
+            printf("%llu\t%s\t%llu\n", (unsigned long long)a, ext_format_addr(p.addrs[a], buf, sizeof(buf)),
+                (unsigned long long)(p.rows[a + 1] - p.rows[a]));
+        }
+    }
+
+    int rc = 0;
+    uint32_t a, b;
+    if (addr_a && addr_b) {
+        if (lookup(&p, addr_a, &a) || lookup(&p, addr_b, &b)) {
+            rc = 1;
+        } else {
+            const struct pidx_edge *e = pidx_find_pair(&p, a, b);
+            if (e) {
+                for (uint32_t k = 0; k < e->count; k++) printf("%.3f\n", p.samples[e->first + k] / 1000.0);
+            } else {
+                fprintf(stderr, "no samples between %s and %s\n", addr_a, addr_b);
+                rc = 1;
+            }
+        }
+    } else if (addr_a) {
+        if (lookup(&p, addr_a, &a)) {
+            rc = 1;
+        } else {
+            uint64_t n;
+            const struct pidx_edge *e = pidx_peers(&p, a, &n);
+            for (uint64_t i = 0; i < n; i++) {
+                printf("%s\t%u\t%f\n", ext_format_addr(p.addrs[e[i].peer], buf, sizeof(buf)), e[i].count, mean_ms(&p, &e[i]));
+            }
+        }
+    }
+
+    pidx_close(&p);
+    return rc;
+}
@@ -0,0 +1,363 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_link.h>
+
+#include "ifseries.h"
+
+// Samples the byte counters of many interfaces on one timer and appends
+// them to an ifseries.h time series, in place of one ifstat process per
+// mininet peer.
+//
+// All counters come from a single RTM_GETSTATS dump per sample, filtered
+// to the 64-bit link stats, so the cost of a sample is one netlink round
+// trip whatever the number of interfaces, and nothing runs inside the
+// peers' namespaces. The timer is absolute, so a late sample does not move
+// the ones after it; each sample carries its own timestamp for the reader.
+// Runs until SIGINT or SIGTERM.
+
+#define DEFAULT_INTERVAL_MS 100
+#define RECV_BUF (1 << 20)
+
+struct intf {
+    int ifindex;
+    uint32_t slot;              // position in the series
+};
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static int intf_cmp(const void *a, const void *b) {
+    const struct intf *x = a, *y = b;
+    return (x->ifindex > y->ifindex) - (x->ifindex < y->ifindex);
+}
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ------------------------------------------------------------------
+// Netlink stats dump
+// ------------------------------------------------------------------
+
+// Reads the rx/tx byte counters of every interface in is (sorted by
+// ifindex) into rx[slot], tx[slot]; seen[slot] is set for those the
+// kernel reported. Returns 0, or -1 with errno set.
+static int read_counters(int fd, uint32_t seq, const struct intf *is, size_t n,
+                         uint64_t *rx, uint64_t *tx, uint8_t *seen) {
+    static char buf[RECV_BUF];
+    struct {
+        struct nlmsghdr nh;
+        struct if_stats_msg ifsm;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = sizeof(req);
+    req.nh.nlmsg_type = RTM_GETSTATS;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.nh.nlmsg_seq = seq;
+    req.ifsm.family = AF_UNSPEC;
+    req.ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+    if (send(fd, &req, sizeof(req), 0) < 0) return -1;
+
+    memset(seen, 0, n);
+    for (;;) {
+        ssize_t len = recv(fd, buf, sizeof(buf), 0);
+        if (len < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, len); nh = NLMSG_NEXT(nh, len)) {
+            if (nh->nlmsg_seq != seq) continue;
+            if (nh->nlmsg_type == NLMSG_DONE) return 0;
+            if (nh->nlmsg_type == NLMSG_ERROR) {
+                const struct nlmsgerr *err = NLMSG_DATA(nh);
+                errno = err->error ? -err->error : EPROTO;
+                return -1;
+            }
+            if (nh->nlmsg_type != RTM_NEWSTATS) continue;
+
+            const struct if_stats_msg *ifsm = NLMSG_DATA(nh);
+            struct intf key = { .ifindex = (int)ifsm->ifindex };
+            const struct intf *it = bsearch(&key, is, n, sizeof(*is), intf_cmp);
+            if (!it) continue;
+            int rtlen = (int)(nh->nlmsg_len - NLMSG_LENGTH(sizeof(*ifsm)));
+            for (struct rtattr *rta = (struct rtattr *)((char *)ifsm + NLMSG_ALIGN(sizeof(*ifsm)));
+                 RTA_OK(rta, rtlen); rta = RTA_NEXT(rta, rtlen)) {
+                if (rta->rta_type != IFLA_STATS_LINK_64 || RTA_PAYLOAD(rta) < sizeof(struct rtnl_link_stats64)) continue;
+                struct rtnl_link_stats64 st;
+                memcpy(&st, RTA_DATA(rta), sizeof(st));
+                // The port's tx is the peer's rx
+                rx[it->slot] = st.tx_bytes;
+                tx[it->slot] = st.rx_bytes;
+                seen[it->slot] = 1;
+            }
+        }
+    }
+}
+
+static inline uint32_t delta(uint64_t now, uint64_t before) {
+    uint64_t d = now - before;
+    return d > UINT32_MAX ? UINT32_MAX : (uint32_t)d;
+}
+
+// Appends one interface name per line of path ("-" for stdin) to *names;
+// blank lines are skipped. With a list, the number of interfaces is not
+// bounded by the size of the argument vector. Returns 0, or -1.
+static int read_list(const char *path, char ***names, size_t *n, size_t *cap) {
+    FILE *f = strcmp(path, "-") ? fopen(path, "r") : stdin;
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    char *line = NULL;
+    size_t len = 0;
+    ssize_t got;
+    int rc = 0;
+    while (!rc && (got = getline(&line, &len, f)) >= 0) {
+        while (got && (line[got - 1] == '\n' || line[got - 1] == '\r')) line[--got] = 0;
+        if (!got) continue;
+        if (*n == *cap) {
+            size_t ncap = *cap ? *cap * 2 : 1024;
+            char **nn = realloc(*names, ncap * sizeof(*nn));
+            if (!nn) {
+                rc = -1;
+                break;
+            }
+            *names = nn;
+            *cap = ncap;
+        }
+        if (!((*names)[*n] = strdup(line))) rc = -1;
+        else (*n)++;
+    }
+    if (rc) perror("failed to read interface list");
+    else if (ferror(f)) {
+        perror(path);
+        rc = -1;
+    }
+    free(line);
+    if (f != stdin) fclose(f);
+    return rc;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-i interval_ms=%d] [-f list] -o output.ifs [interface...]\n"
+        "  -i  sampling period in milliseconds\n"
+        "  -f  also sample the interfaces named one per line in list (- for stdin)\n"
+        "  -o  time series to write (ifseries.h)\n",
+        argv0, DEFAULT_INTERVAL_MS);
+}
+
+int main(int argc, char* argv[]) {
+    const char *out_path = NULL, *list_path = NULL;
+    long interval_ms = DEFAULT_INTERVAL_MS;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "f:i:o:")) != -1) {
+        switch (opt) {
+        case 'f': list_path = optarg; break;
+        case 'i': interval_ms = strtol(optarg, NULL, 10); break;
+        case 'o': out_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!out_path || (optind >= argc && !list_path) || interval_ms <= 0 || interval_ms > 3600000) {
+        usage(argv[0]);
+        return 1;
+    }
+    char **ifnames = NULL;
+    size_t n = 0, ncap = 0;
+    for (int i = optind; i < argc; i++) {
+        if (n == ncap) {
+            ncap = ncap ? ncap * 2 : 1024;
+            char **nn = realloc(ifnames, ncap * sizeof(*nn));
+            if (!nn) {
+                perror("failed to allocate");
+                return 1;
+            }
+            ifnames = nn;
+        }
+        ifnames[n++] = argv[i];
+    }
+    if (list_path && read_list(list_path, &ifnames, &n, &ncap)) return 1;
+    if (!n) {
+        fprintf(stderr, "%s: no interfaces\n", list_path);
+        return 1;
+    }
+
+    struct intf *is = malloc(n * sizeof(*is));
+    char (*names)[IFS_NAME] = calloc(n, IFS_NAME);
+    uint64_t *rx = calloc(n, sizeof(*rx)), *tx = calloc(n, sizeof(*tx));
+    uint64_t *rx0 = calloc(n, sizeof(*rx0)), *tx0 = calloc(n, sizeof(*tx0));
+    uint8_t *seen = calloc(n, 1);
+    struct ifs_count *counts = calloc(n, sizeof(*counts));
+    if (!is || !names || !rx || !tx || !rx0 || !tx0 || !seen || !counts) {
+        perror("failed to allocate");
+        return 1;
+    }
+    for (size_t i = 0; i < n; i++) {
+        const char *name = ifnames[i];
+        if (strlen(name) >= IFS_NAME) {
+            fprintf(stderr, "%s: interface name too long\n", name);
+            return 1;
+        }
+        strcpy(names[i], name);
+        if (!(is[i].ifindex = (int)if_nametoindex(name))) {
+            perror(name);
+            return 1;
+        }
+        is[i].slot = (uint32_t)i;
+    }
+    qsort(is, n, sizeof(*is), intf_cmp);
+    for (size_t i = 1; i < n; i++) {
+        if (is[i].ifindex == is[i - 1].ifindex) {
+            fprintf(stderr, "%s: interface given twice\n", names[is[i].slot]);
+            return 1;
+        }
+    }
+
+    int fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (fd < 0) {
+        perror("netlink socket");
+        return 1;
+    }
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa))) {
+        perror("netlink bind");
+        return 1;
+    }
+    int rcvbuf = RECV_BUF;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    uint32_t seq = 1;
+    if (read_counters(fd, seq++, is, n, rx0, tx0, seen)) {
+        perror("RTM_GETSTATS");
+        return 1;
+    }
+    int64_t start_ns = now_ns();
+    for (size_t i = 0; i < n; i++) {
+        if (!seen[i]) {
+            fprintf(stderr, "%s: no counters\n", names[i]);
+            return 1;
+        }
+    }
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    struct ifs_header hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, IFS_MAGIC, 8);
+    hdr.byte_order = IFS_BYTE_ORDER;
+    hdr.version = IFS_VERSION;
+    hdr.nintfs = (uint32_t)n;
+    hdr.interval_us = (uint32_t)(interval_ms * 1000);
+    hdr.start_ns = start_ns;
+    hdr.names_offset = sizeof(hdr);
+    hdr.data_offset = sizeof(hdr) + (uint64_t)n * IFS_NAME;  // IFS_NAME keeps it 8-aligned
+    if (fwrite(&hdr, sizeof(hdr), 1, out) != 1 || fwrite(names, IFS_NAME, n, out) != n || fflush(out)) {
+        perror(out_path);
+        return 1;
+    }
+
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    struct itimerspec its = {
+        .it_interval = { interval_ms / 1000, (interval_ms % 1000) * 1000000 },
+    };
+    if (tfd < 0 || clock_gettime(CLOCK_MONOTONIC, &its.it_value)) {
+        perror("timerfd");
+        return 1;
+    }
+    its.it_value.tv_sec += its.it_interval.tv_sec;
+    its.it_value.tv_nsec += its.it_interval.tv_nsec;
+    if (its.it_value.tv_nsec >= 1000000000) {
+        its.it_value.tv_sec++;
+        its.it_value.tv_nsec -= 1000000000;
+    }
+    if (timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, NULL)) {
+        perror("timerfd");
+        return 1;
+    }
+
+    struct sigaction sig = { .sa_handler = on_signal };
+    sigaction(SIGINT, &sig, NULL);
+    sigaction(SIGTERM, &sig, NULL);
+
+    uint64_t nsamples = 0, missed = 0;
+    int rc = 0;
+    while (!stop) {
+        uint64_t expirations;
+        if (read(tfd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+            if (errno == EINTR) continue;
+            perror("timerfd");
+            rc = 1;
+            break;
+        }
+        missed += expirations - 1;
+        if (read_counters(fd, seq++, is, n, rx, tx, seen)) {
+            perror("RTM_GETSTATS");
+            rc = 1;
+            break;
+        }
+        int64_t t = now_ns();
+        // An interface that went away (the network being torn down) counts
+        // nothing from then on
+        for (size_t i = 0; i < n; i++) {
+            if (!seen[i]) {
+                rx[i] = rx0[i];
+                tx[i] = tx0[i];
+            }
+            counts[i].rx_bytes = delta(rx[i], rx0[i]);
+            counts[i].tx_bytes = delta(tx[i], tx0[i]);
+            rx0[i] = rx[i];
+            tx0[i] = tx[i];
+        }
+        if (fwrite(&t, sizeof(t), 1, out) != 1 || fwrite(counts, sizeof(*counts), n, out) != n || fflush(out)) {
+            perror(out_path);
+            rc = 1;
+            break;
+        }
+        nsamples++;
+    }
+    if (fclose(out) && !rc) {
+        perror(out_path);
+        rc = 1;
+    }
+    fprintf(stderr, "%llu samples of %zu interfaces, %llu missed ticks\n",
+        (unsigned long long)nsamples, n, (unsigned long long)missed);
+
+    close(tfd);
+    close(fd);
+    for (size_t i = (size_t)(argc - optind); i < n; i++) free(ifnames[i]);
+    free(ifnames);
+    free(is);
+    free(names);
+    free(rx);
+    free(tx);
+    free(rx0);
+    free(tx0);
+    free(seen);
+    free(counts);
+    return rc;
+}
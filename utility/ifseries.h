@@ -0,0 +1,49 @@
+#ifndef IFSERIES_H
+#define IFSERIES_H
+
+#include <stdint.h>
+
+// Per-interface traffic time series, written by ifcount while a mininet
+// simulation runs and read by mininet-control/plotter.
+//
+//   ifs_header
+//   names[nintfs]              IFS_NAME bytes each, NUL-padded
+//   samples...                 from data_offset to the end of the file
+//
+// Each sample is an int64_t CLOCK_REALTIME timestamp in nanoseconds
+// followed by one ifs_count per interface: the bytes that went through it
+// since the previous sample (the first one since start_ns). The file is
+// appended sample by sample and has no count, so a collector that was
+// killed still leaves a readable series; a reader takes the whole samples
+// that fit. Integers are in the writer's native byte order.
+//
+// The interfaces are the switch-side ends of the peers' access links, so
+// the counts are turned around to the peer's point of view: rx is what the
+// peer received (sent by the port), tx what it sent.
+
+#define IFS_MAGIC "RIPEIFS\0"
+#define IFS_VERSION 1
+#define IFS_BYTE_ORDER 0x01020304u
+#define IFS_NAME 16
+
+struct ifs_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t reserved;
+    uint32_t nintfs;
+    uint32_t interval_us;       // sampling period asked for
+    int64_t start_ns;           // CLOCK_REALTIME of the baseline reading
+    uint64_t names_offset;
+    uint64_t data_offset;
+    uint64_t reserved2[2];
+};
+
+struct ifs_count {
+    uint32_t rx_bytes;          // saturate at UINT32_MAX
+    uint32_t tx_bytes;
+};
+
+_Static_assert(sizeof(struct ifs_header) == 64, "ifs_header layout");
+
+#endif
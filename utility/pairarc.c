@@ -0,0 +1,291 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pairarc.h"
+
+static int fail(struct parc *a, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(a->error, sizeof(a->error), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+// Whether [off, off + count * elem) lies inside the file, aligned.
+static int section_ok(const struct parc *a, uint64_t off, uint64_t count, uint64_t elem) {
+    return off % 8 == 0 && off <= a->size && count <= (a->size - off) / elem;
+}
+
+// Checks everything lookups rely on, once; chunk contents are checked as
+// they are decoded.
+static int validate(struct parc *a) {
+    const struct parc_header *h = a->hdr;
+    if (memcmp(h->magic, PARC_MAGIC, sizeof(h->magic)) != 0) return fail(a, "not a pair archive");
+    if (h->byte_order != PARC_BYTE_ORDER) return fail(a, "written with a different byte order");
+    if (h->version != PARC_VERSION) return fail(a, "unsupported archive version %u", h->version);
+    if (h->naddrs >= UINT32_MAX || h->data_offset > a->size || h->data_size > a->size - h->data_offset ||
+        !section_ok(a, h->addrs_offset, h->naddrs, 16) ||
+        !section_ok(a, h->pairs_offset, h->npairs, sizeof(struct parc_pair)) ||
+        !section_ok(a, h->chunks_offset, h->nchunks, sizeof(struct parc_chunk)))
+        return fail(a, "truncated archive");
+
+    a->chunk_data = (const uint8_t *)a->data + h->data_offset;
+    a->addrs = (const void *)(a->data + h->addrs_offset);
+    a->pairs = (const void *)(a->data + h->pairs_offset);
+    a->chunks = (const void *)(a->data + h->chunks_offset);
+
+    for (uint64_t i = 1; i < h->naddrs; i++) {
+        if (memcmp(a->addrs[i - 1], a->addrs[i], 16) >= 0) return fail(a, "address table not sorted");
+    }
+    uint64_t next_chunk = 0;
+    for (uint64_t i = 0; i < h->npairs; i++) {
+        const struct parc_pair *p = &a->pairs[i];
+        if (p->src >= h->naddrs || p->dst >= h->naddrs || p->first_chunk != next_chunk ||
+            p->nchunks > h->nchunks - next_chunk ||
+            (i && ((uint64_t)p[-1].src << 32 | p[-1].dst) >= ((uint64_t)p->src << 32 | p->dst)))
+            return fail(a, "bad pair %llu", (unsigned long long)i);
+        next_chunk += p->nchunks;
+    }
+    if (next_chunk != h->nchunks) return fail(a, "chunks without a pair");
+    for (uint64_t i = 0; i < h->nchunks; i++) {
+        const struct parc_chunk *c = &a->chunks[i];
+        if (c->offset > h->data_size || c->size > h->data_size - c->offset || c->t_first > c->t_last)
+            return fail(a, "bad chunk %llu", (unsigned long long)i);
+    }
+    return 0;
+}
+
+int parc_open(struct parc *a, const char *path) {
+    struct stat st;
+
+    memset(a, 0, sizeof(*a));
+    a->fd = open(path, O_RDONLY);
+    if (a->fd < 0) return fail(a, "%s", strerror(errno));
+    if (fstat(a->fd, &st)) {
+        fail(a, "%s", strerror(errno));
+        goto FAIL;
+    }
+    a->size = st.st_size;
+    if (a->size < sizeof(struct parc_header)) {
+        fail(a, "file too short");
+        goto FAIL;
+    }
+    a->data = mmap(NULL, a->size, PROT_READ, MAP_SHARED, a->fd, 0);
+    if (a->data == MAP_FAILED) {
+        a->data = NULL;
+        fail(a, "mmap: %s", strerror(errno));
+        goto FAIL;
+    }
+    close(a->fd);
+    a->fd = -1;
+    a->hdr = (const void *)a->data;
+    if (validate(a)) goto FAIL;
+    // Queries decode a few runs of chunks; don't read ahead the rest.
+    madvise((void *)a->data, a->size, MADV_RANDOM);
+    return 0;
+
+FAIL:
+    {
+        char error[sizeof(a->error)];
+        memcpy(error, a->error, sizeof(error));
+        parc_close(a);
+        memcpy(a->error, error, sizeof(error));
+    }
+    return -1;
+}
+
+void parc_close(struct parc *a) {
+    if (a->data) munmap((void *)a->data, a->size);
+    if (a->fd >= 0) close(a->fd);
+    memset(a, 0, sizeof(*a));
+    a->fd = -1;
+}
+
+int parc_is_archive(const char *path) {
+    char magic[8];
+    FILE *f = fopen(path, "r");
+    if (!f) return 0;
+    int is = fread(magic, 1, sizeof(magic), f) == sizeof(magic) && !memcmp(magic, PARC_MAGIC, sizeof(magic));
+    fclose(f);
+    return is;
+}
+
+int parc_list_add(struct parc_list *l, const char *path) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 16;
+        struct parc *a = realloc(l->a, cap * sizeof(*a));
+        if (!a) return -1;
+        l->a = a;
+        l->cap = cap;
+    }
+    struct parc *a = &l->a[l->n];
+    if (parc_open(a, path)) {
+        fprintf(stderr, "Error processing %s: %s\n", path, a->error);
+        return -1;
+    }
+    l->n++;
+    return 0;
+}
+
+void parc_list_free(struct parc_list *l) {
+    for (size_t i = 0; i < l->n; i++) parc_close(&l->a[i]);
+    free(l->a);
+    memset(l, 0, sizeof(*l));
+}
+
+int parc_inputs_add(void *ctx, const char *path) {
+    struct parc_inputs *in = ctx;
+    if (parc_is_archive(path)) return parc_list_add(&in->archives, path);
+    return ext_file_append(&in->files, &in->nfiles, &in->cap, path);
+}
+
+int64_t parc_find_addr(const struct parc *a, const uint8_t *addr) {
+    uint64_t lo = 0, hi = a->hdr->naddrs;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        int c = memcmp(a->addrs[mid], addr, 16);
+        if (c == 0) return (int64_t)mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+const struct parc_pair *parc_find_pair(const struct parc *a, uint32_t src, uint32_t dst) {
+    uint64_t key = (uint64_t)src << 32 | dst;
+    uint64_t lo = 0, hi = a->hdr->npairs;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        uint64_t k = (uint64_t)a->pairs[mid].src << 32 | a->pairs[mid].dst;
+        if (k == key) return &a->pairs[mid];
+        if (k < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
+
+// ------------------------------------------------------------------
+// Chunk coding
+// ------------------------------------------------------------------
+
+static inline uint64_t zigzag(int64_t v) {
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t unzigzag(uint64_t v) {
+    return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+static inline size_t put_varint(uint8_t *buf, uint64_t v) {
+    size_t n = 0;
+    while (v >= 0x80) {
+        buf[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    buf[n++] = (uint8_t)v;
+    return n;
+}
+
+static inline int get_varint(const uint8_t **p, const uint8_t *end, uint64_t *v) {
+    uint64_t x = 0;
+    for (int shift = 0; shift < 64 && *p < end; shift += 7) {
+        uint8_t b = *(*p)++;
+        x |= (uint64_t)(b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            *v = x;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+size_t parc_encode(struct parc_encoder *e, uint8_t *buf, const struct parc_record *r) {
+    int64_t delta = (int64_t)(r->timestamp - e->ts);
+    size_t n = put_varint(buf, zigzag(delta - e->delta));
+    e->ts = r->timestamp;
+    e->delta = delta;
+    n += put_varint(buf + n, zigzag((int64_t)r->prb_id - e->prb));
+    n += put_varint(buf + n, zigzag((int64_t)r->msm_id - e->msm));
+    e->prb = r->prb_id;
+    e->msm = r->msm_id;
+    n += put_varint(buf + n, r->rtt_count);
+    for (uint32_t k = 0; k < r->rtt_count; k++) {
+        n += put_varint(buf + n, zigzag((int64_t)r->rtt_us[k] - e->rtt));
+        e->rtt = r->rtt_us[k];
+    }
+    return n;
+}
+
+void parc_cursor_init(struct parc_cursor *c, const struct parc *a, const struct parc_pair *p, uint64_t t0, uint64_t t1) {
+    memset(c, 0, sizeof(*c));
+    c->a = a;
+    c->t0 = t0;
+    c->t1 = t1;
+    if (!p) return;
+
+    // First chunk that ends at or after t0
+    uint64_t lo = p->first_chunk, hi = p->first_chunk + p->nchunks;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (a->chunks[mid].t_last < t0) lo = mid + 1;
+        else hi = mid;
+    }
+    c->chunk = lo;
+    c->end_chunk = p->first_chunk + p->nchunks;
+}
+
+int parc_cursor_next(struct parc_cursor *c, struct parc_record *r) {
+    for (;;) {
+        while (!c->left) {
+            if (c->chunk >= c->end_chunk) return 0;
+            const struct parc_chunk *ch = &c->a->chunks[c->chunk++];
+            if (ch->t_first >= c->t1) {
+                c->chunk = c->end_chunk;
+                return 0;
+            }
+            c->p = c->a->chunk_data + ch->offset;
+            c->end = c->p + ch->size;
+            c->left = ch->nrecords;
+            c->ts = ch->t_first;
+            c->delta = c->prb = c->msm = c->rtt = 0;
+        }
+
+        uint64_t dd, prb, msm, count;
+        if (get_varint(&c->p, c->end, &dd) || get_varint(&c->p, c->end, &prb) ||
+            get_varint(&c->p, c->end, &msm) || get_varint(&c->p, c->end, &count) || count > PARC_MAX_REPLIES)
+            return -1;
+        c->delta += unzigzag(dd);
+        c->ts += c->delta;
+        c->prb += unzigzag(prb);
+        c->msm += unzigzag(msm);
+        for (uint32_t k = 0; k < count; k++) {
+            uint64_t v;
+            if (get_varint(&c->p, c->end, &v)) return -1;
+            c->rtt += unzigzag(v);
+            c->rtts[k] = (uint32_t)c->rtt;
+        }
+        c->left--;
+
+        if (c->ts >= c->t1) {
+            c->left = 0;
+            c->chunk = c->end_chunk;
+            return 0;
+        }
+        if (c->ts < c->t0) continue;
+        r->timestamp = c->ts;
+        r->prb_id = (uint32_t)c->prb;
+        r->msm_id = (uint32_t)c->msm;
+        r->rtt_count = (uint32_t)count;
+        r->rtt_us = c->rtts;
+        return 1;
+    }
+}
@@ -0,0 +1,174 @@
+#ifndef PAIRARC_H
+#define PAIRARC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "extread.h"
+
+// Long-term archive of extract records, written by pairarchive and read
+// in place through mmap.
+//
+//   parc_header
+//   data[data_size]            encoded chunks, back to back
+//   addrs[naddrs][16]          sorted; an address's id is its position
+//   pairs[npairs]              parc_pair, sorted by (src, dst)
+//   chunks[nchunks]            parc_chunk, each pair's run in time order
+//
+// Records are grouped by directed pair (src, dst) and sorted by time, so
+// the addresses are stored once per pair instead of once per record, and
+// exact duplicates, as left by extracting an hour twice, are dropped. A
+// pair's records are cut into chunks of at most chunk_records; the chunk
+// table is the block index, and a reader looking up one pair over a time
+// range decodes only the chunks that overlap it.
+//
+// A chunk is a sequence of records, each as LEB128 varints:
+//
+//   zigzag(timestamp delta - previous delta)
+//   zigzag(prb_id - previous prb_id)
+//   zigzag(msm_id - previous msm_id)
+//   rtt_count
+//   rtt_count x zigzag(rtt - previous rtt)    integer microseconds
+//
+// Every "previous" starts at 0 in each chunk, the timestamp at the chunk's
+// t_first, so chunks decode independently. Measurements of one pair come
+// at a steady interval from one probe with a handful of msm_ids, so most
+// records take one byte for each of the first four fields. RTTs are
+// already integers, which makes a plain delta code a better fit than XOR
+// encoding of floats.
+//
+// Addresses use the 16-byte form of extfmt.h, IPv4 as ::ffff:a.b.c.d.
+// Integers are in the writer's native byte order; the tables start 8-byte
+// aligned.
+
+#define PARC_MAGIC "RIPEARC\0"
+#define PARC_VERSION 1
+#define PARC_BYTE_ORDER 0x01020304u
+#define PARC_MAX_REPLIES 255        // rtt_count is a u8 in extract output
+
+struct parc_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t chunk_records;     // of the writer, informational
+    uint64_t naddrs;
+    uint64_t npairs;
+    uint64_t nchunks;
+    uint64_t nrecords;
+    uint64_t nsamples;
+    uint64_t t_min;             // unix seconds over all records
+    uint64_t t_max;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t addrs_offset;
+    uint64_t pairs_offset;
+    uint64_t chunks_offset;
+};
+
+struct parc_pair {
+    uint32_t src, dst;          // address ids
+    uint64_t first_chunk;
+    uint64_t nchunks;
+    uint64_t nrecords;
+};
+
+struct parc_chunk {
+    uint64_t offset;            // into data
+    uint32_t size;              // bytes
+    uint32_t nrecords;
+    uint64_t nsamples;
+    uint64_t t_first, t_last;
+};
+
+_Static_assert(sizeof(struct parc_header) == 112, "parc_header layout");
+_Static_assert(sizeof(struct parc_pair) == 32, "parc_pair layout");
+_Static_assert(sizeof(struct parc_chunk) == 40, "parc_chunk layout");
+
+struct parc {
+    int fd;                     // -1 once the file is mapped
+    const char *data;
+    size_t size;
+    const struct parc_header *hdr;
+    const uint8_t *chunk_data;
+    const uint8_t (*addrs)[16];
+    const struct parc_pair *pairs;
+    const struct parc_chunk *chunks;
+    char error[128];            // reason for the last failure
+};
+
+struct parc_record {
+    uint64_t timestamp;
+    uint32_t prb_id;
+    uint32_t msm_id;
+    uint32_t rtt_count;
+    const uint32_t *rtt_us;     // valid until the next call
+};
+
+// Records of one pair with timestamps in [t0, t1).
+struct parc_cursor {
+    const struct parc *a;
+    uint64_t chunk, end_chunk;  // next chunk to load, end of the pair's run
+    uint64_t t0, t1;
+    const uint8_t *p, *end;     // rest of the loaded chunk
+    uint32_t left;              // its records not yet decoded
+    uint64_t ts;
+    int64_t delta;
+    int64_t prb, msm, rtt;
+    uint32_t rtts[PARC_MAX_REPLIES];
+};
+
+// Maps and validates an archive; returns 0, or -1 with a->error filled in.
+int parc_open(struct parc *a, const char *path);
+void parc_close(struct parc *a);
+
+// Whether the file at path starts with the archive magic.
+int parc_is_archive(const char *path);
+
+// Open archives given alongside extract files.
+struct parc_list {
+    struct parc *a;
+    size_t n, cap;
+};
+
+// Opens path as the next archive of l. Returns 0, or -1 when out of memory
+// or when the archive fails to open, which is reported on stderr.
+int parc_list_add(struct parc_list *l, const char *path);
+void parc_list_free(struct parc_list *l);
+
+// Extract files and archives given together. parc_inputs_add is an
+// ext_walk callback that tells them apart by the archive magic.
+struct parc_inputs {
+    struct ext_file *files;
+    size_t nfiles, cap;
+    struct parc_list archives;
+};
+
+int parc_inputs_add(void *ctx, const char *path);
+
+// Id of an address, or -1.
+int64_t parc_find_addr(const struct parc *a, const uint8_t *addr);
+
+// The pair src -> dst, or NULL.
+const struct parc_pair *parc_find_pair(const struct parc *a, uint32_t src, uint32_t dst);
+
+void parc_cursor_init(struct parc_cursor *c, const struct parc *a, const struct parc_pair *p, uint64_t t0, uint64_t t1);
+// Returns 1 with *r filled in, 0 at the end, or -1 on a corrupt chunk.
+int parc_cursor_next(struct parc_cursor *c, struct parc_record *r);
+
+// Chunk encoder of pairarchive. Appends one record to buf, which must have
+// room for parc_record_max(rtt_count) bytes; returns the bytes written.
+// The state fields are those of parc_cursor and start zeroed per chunk,
+// with ts at the chunk's t_first.
+struct parc_encoder {
+    uint64_t ts;
+    int64_t delta;
+    int64_t prb, msm, rtt;
+};
+
+static inline size_t parc_record_max(uint32_t rtt_count) {
+    return 10 * 4 + 5 * (size_t)rtt_count;
+}
+
+size_t parc_encode(struct parc_encoder *e, uint8_t *buf, const struct parc_record *r);
+
+#endif
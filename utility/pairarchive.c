@@ -0,0 +1,481 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "extread.h"
+#include "pairarc.h"
+
+// Packs extract files into the pair archive of pairarc.h. Inputs may also
+// be archives, so a day can be archived hour by hour: each run merges the
+// old archive with the new hours, and records present in both are kept
+// once.
+//
+// pass 1: count the records and samples of every directed pair
+// layout: sort the pairs and give each its run in a scratch mapping
+// pass 2: copy every record and its RTTs to the next free slot of its run
+// pass 3: sort each run by time, drop duplicates and encode it in chunks
+//
+// The scratch mapping is an unlinked file next to the output, so the
+// records of a day need disk rather than memory; the output is streamed.
+// With -r the extract inputs are removed once the archive is on disk.
+
+#define DEFAULT_OUTPUT "pairs.arc"
+#define DEFAULT_CHUNK_RECORDS 1024
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+// ------------------------------------------------------------------
+// Pair table entries
+// ------------------------------------------------------------------
+
+struct pair_entry {
+    uint64_t key;               // 0 = empty; (src << 32) | dst index id otherwise
+    uint64_t nrecords, nsamples;
+    uint64_t rec_base, rec_next;        // pass 2: records of the pair
+    uint64_t sample_base, sample_next;
+};
+
+// ------------------------------------------------------------------
+// Build
+// ------------------------------------------------------------------
+
+struct input {
+    char *path;
+    int is_archive;
+    struct ext_file f;
+    struct parc a;
+    uint32_t *gid;              // file or archive id -> index id
+};
+
+// A record in the scratch mapping; its RTTs are the pair's samples from
+// sample on.
+struct stage_rec {
+    uint64_t timestamp;
+    uint32_t prb_id, msm_id;
+    uint32_t sample;            // relative to the pair's sample_base
+    uint16_t rtt_count;
+    uint16_t reserved;
+};
+
+_Static_assert(sizeof(struct stage_rec) == 24, "stage_rec layout");
+
+struct build {
+    struct input *inputs;
+    size_t ninputs, inputs_cap;
+    struct ext_addr_index addrs;
+    struct ext_pair_table pairs;
+    struct stage_rec *recs;     // pass 2: the scratch mapping
+    uint32_t *samples;
+};
+
+static void stage(struct build *bd, struct pair_entry *e, uint64_t timestamp, uint32_t prb_id, uint32_t msm_id,
+                  uint32_t rtt_count, const uint32_t *rtt_us) {
+    bd->recs[e->rec_next++] = (struct stage_rec){
+        .timestamp = timestamp, .prb_id = prb_id, .msm_id = msm_id,
+        .sample = (uint32_t)(e->sample_next - e->sample_base), .rtt_count = (uint16_t)rtt_count,
+    };
+    memcpy(bd->samples + e->sample_next, rtt_us, rtt_count * sizeof(*rtt_us));
+    e->sample_next += rtt_count;
+}
+
+static struct pair_entry *pair_get(struct build *bd, uint64_t key) {
+    struct pair_entry *e = ext_pair_table_get(&bd->pairs, key);
+    if (!e) {
+        perror("failed to allocate pair table");
+        exit(1);
+    }
+    return e;
+}
+
+// One pass over every record of every input.
+static int scan(struct build *bd, int pass) {
+    uint32_t rtts[PARC_MAX_REPLIES];
+
+    for (size_t ii = 0; ii < bd->ninputs; ii++) {
+        struct input *in = &bd->inputs[ii];
+        if (in->is_archive) {
+            const struct parc *a = &in->a;
+            for (uint64_t i = 0; i < a->hdr->npairs; i++) {
+                const struct parc_pair *p = &a->pairs[i];
+                struct pair_entry *e = pair_get(bd, (uint64_t)in->gid[p->src] << 32 | in->gid[p->dst]);
+                if (pass == 1) {
+                    e->nrecords += p->nrecords;
+                    for (uint64_t c = 0; c < p->nchunks; c++) e->nsamples += a->chunks[p->first_chunk + c].nsamples;
+                    continue;
+                }
+                struct parc_cursor c;
+                struct parc_record r;
+                int rc;
+                parc_cursor_init(&c, a, p, 0, UINT64_MAX);
+                while ((rc = parc_cursor_next(&c, &r)) == 1) {
+                    stage(bd, e, r.timestamp, r.prb_id, r.msm_id, r.rtt_count, r.rtt_us);
+                }
+                if (rc < 0) {
+                    fprintf(stderr, "%s: corrupt chunk in pair %llu\n", in->path, (unsigned long long)i);
+                    return -1;
+                }
+            }
+            continue;
+        }
+
+        struct ext_iter it;
+        struct ext_record r;
+        ext_iter_init(&it, &in->f, 0);
+        while (ext_iter_next(&it, &r)) {
+            uint32_t s = r.src_id != EXT_NO_ID ? in->gid[r.src_id] : ext_addr_index_get(&bd->addrs, r.src_addr);
+            uint32_t d = r.dst_id != EXT_NO_ID ? in->gid[r.dst_id] : ext_addr_index_get(&bd->addrs, r.dst_addr);
+            struct pair_entry *e = pair_get(bd, (uint64_t)s << 32 | d);
+            if (pass == 1) {
+                e->nrecords++;
+                e->nsamples += r.rtt_count;
+                continue;
+            }
+            for (uint32_t k = 0; k < r.rtt_count; k++) rtts[k] = (uint32_t)(ext_rtt_ms(r.rtt, r.rtt_type, k) * 1000.0 + 0.5);
+            stage(bd, e, r.timestamp, r.prb_id, r.msm_id, r.rtt_count, rtts);
+        }
+    }
+    return 0;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    uint64_t x = (*(struct pair_entry *const *)a)->key;
+    uint64_t y = (*(struct pair_entry *const *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts the pairs and lays out their runs in a scratch file created next
+// to tmp. Returns the pairs in key order, or NULL.
+static struct pair_entry **layout(struct build *bd, const char *tmp, size_t *npairs_out, void **map, size_t *size_out) {
+    struct pair_entry **order = malloc((bd->pairs.used ? bd->pairs.used : 1) * sizeof(*order));
+    if (!order) {
+        perror("failed to allocate");
+        exit(1);
+    }
+    size_t npairs = 0;
+    uint64_t nrecords = 0, nsamples = 0;
+    for (size_t i = 0; i < bd->pairs.cap; i++) {
+        struct pair_entry *e = ext_pair_table_slot(&bd->pairs, i);
+        if (e->key) order[npairs++] = e;
+    }
+    qsort(order, npairs, sizeof(*order), entry_cmp);
+    for (size_t i = 0; i < npairs; i++) {
+        struct pair_entry *e = order[i];
+        if (e->nsamples > UINT32_MAX) {
+            fprintf(stderr, "too many samples for one pair\n");
+            exit(1);
+        }
+        e->rec_base = e->rec_next = nrecords;
+        e->sample_base = e->sample_next = nsamples;
+        nrecords += e->nrecords;
+        nsamples += e->nsamples;
+    }
+
+    char path[4096 + 8];
+    snprintf(path, sizeof(path), "%s.stage", tmp);
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (fd < 0) {
+        perror(path);
+        free(order);
+        return NULL;
+    }
+    unlink(path);
+    size_t size = ALIGN8(nrecords * sizeof(struct stage_rec) + nsamples * 4) + 8;
+    char *m = MAP_FAILED;
+    if (!ftruncate(fd, size)) m = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        perror(path);
+        free(order);
+        return NULL;
+    }
+    bd->recs = (struct stage_rec *)m;
+    bd->samples = (uint32_t *)(m + nrecords * sizeof(struct stage_rec));
+
+    *npairs_out = npairs;
+    *map = m;
+    *size_out = size;
+    return order;
+}
+
+// Orders by the whole record, RTTs included, so that exact duplicates
+// end up next to each other even when other records share their
+// (timestamp, prb_id, msm_id); ctx is the samples.
+static int rec_cmp(const void *a, const void *b, void *ctx) {
+    const struct stage_rec *x = a, *y = b;
+    const uint32_t *samples = ctx;
+    if (x->timestamp != y->timestamp) return x->timestamp < y->timestamp ? -1 : 1;
+    if (x->prb_id != y->prb_id) return x->prb_id < y->prb_id ? -1 : 1;
+    if (x->msm_id != y->msm_id) return x->msm_id < y->msm_id ? -1 : 1;
+    if (x->rtt_count != y->rtt_count) return x->rtt_count < y->rtt_count ? -1 : 1;
+    for (uint32_t k = 0; k < x->rtt_count; k++) {
+        uint32_t u = samples[x->sample + k], v = samples[y->sample + k];
+        if (u != v) return u < v ? -1 : 1;
+    }
+    return x->sample < y->sample ? -1 : x->sample > y->sample;
+}
+
+static int rec_same(const struct stage_rec *x, const struct stage_rec *y, const uint32_t *samples) {
+    return x->timestamp == y->timestamp && x->prb_id == y->prb_id && x->msm_id == y->msm_id &&
+        x->rtt_count == y->rtt_count && !memcmp(samples + x->sample, samples + y->sample, x->rtt_count * 4);
+}
+
+struct writer {
+    FILE *f;
+    struct parc_header h;
+    struct parc_pair *pairs;
+    struct parc_chunk *chunks;
+    size_t pairs_cap, chunks_cap;
+    uint8_t *buf;               // the chunk being encoded
+    size_t used;
+    struct parc_chunk chunk;
+    struct parc_encoder enc;
+    uint16_t chunk_records;
+};
+
+static int chunk_flush(struct writer *w) {
+    if (!w->chunk.nrecords) return 0;
+    if (fwrite(w->buf, 1, w->used, w->f) != w->used) return -1;
+    if (w->h.nchunks == w->chunks_cap) {
+        w->chunks_cap = w->chunks_cap ? w->chunks_cap * 2 : 1024;
+        struct parc_chunk *n = realloc(w->chunks, w->chunks_cap * sizeof(*n));
+        if (!n) return -1;
+        w->chunks = n;
+    }
+    w->chunk.offset = w->h.data_size;
+    w->chunk.size = (uint32_t)w->used;
+    w->chunks[w->h.nchunks++] = w->chunk;
+    w->h.data_size += w->used;
+    w->used = 0;
+    memset(&w->chunk, 0, sizeof(w->chunk));
+    return 0;
+}
+
+// Encodes the sorted, deduplicated run of one pair.
+static int write_pair(struct writer *w, uint32_t src, uint32_t dst, struct stage_rec *recs, uint64_t n,
+                      const uint32_t *samples, uint64_t *dropped) {
+    if (w->h.npairs == w->pairs_cap) {
+        w->pairs_cap = w->pairs_cap ? w->pairs_cap * 2 : 1024;
+        struct parc_pair *np = realloc(w->pairs, w->pairs_cap * sizeof(*np));
+        if (!np) return -1;
+        w->pairs = np;
+    }
+    struct parc_pair *p = &w->pairs[w->h.npairs];
+    *p = (struct parc_pair){ .src = src, .dst = dst, .first_chunk = w->h.nchunks };
+
+    qsort_r(recs, n, sizeof(*recs), rec_cmp, (void *)samples);
+    for (uint64_t i = 0; i < n; i++) {
+        const struct stage_rec *s = &recs[i];
+        if (i && rec_same(s, &recs[i - 1], samples)) {
+            (*dropped)++;
+            continue;
+        }
+        if (!w->chunk.nrecords) {
+            w->chunk.t_first = s->timestamp;
+            memset(&w->enc, 0, sizeof(w->enc));
+            w->enc.ts = s->timestamp;
+        }
+        struct parc_record r = {
+            .timestamp = s->timestamp, .prb_id = s->prb_id, .msm_id = s->msm_id,
+            .rtt_count = s->rtt_count, .rtt_us = samples + s->sample,
+        };
+        w->used += parc_encode(&w->enc, w->buf + w->used, &r);
+        w->chunk.t_last = s->timestamp;
+        w->chunk.nrecords++;
+        w->chunk.nsamples += s->rtt_count;
+        p->nrecords++;
+        w->h.nrecords++;
+        w->h.nsamples += s->rtt_count;
+        if (w->h.nrecords == 1 || s->timestamp < w->h.t_min) w->h.t_min = s->timestamp;
+        if (s->timestamp > w->h.t_max) w->h.t_max = s->timestamp;
+        if (w->chunk.nrecords == w->chunk_records && chunk_flush(w)) return -1;
+    }
+    if (chunk_flush(w)) return -1;
+    p->nchunks = w->h.nchunks - p->first_chunk;
+    w->h.npairs++;
+    return 0;
+}
+
+static int write_tables(struct writer *w, const uint8_t (*addrs)[16], uint64_t naddrs) {
+    static const char zero[8];
+    uint64_t pos = w->h.data_offset + w->h.data_size;
+    if (fwrite(zero, 1, ALIGN8(pos) - pos, w->f) != ALIGN8(pos) - pos) return -1;
+    w->h.naddrs = naddrs;
+    w->h.addrs_offset = ALIGN8(pos);
+    w->h.pairs_offset = w->h.addrs_offset + naddrs * 16;
+    w->h.chunks_offset = w->h.pairs_offset + w->h.npairs * sizeof(struct parc_pair);
+    if (fwrite(addrs, 16, naddrs, w->f) != naddrs ||
+        fwrite(w->pairs, sizeof(*w->pairs), w->h.npairs, w->f) != w->h.npairs ||
+        fwrite(w->chunks, sizeof(*w->chunks), w->h.nchunks, w->f) != w->h.nchunks)
+        return -1;
+    if (fseeko(w->f, 0, SEEK_SET) || fwrite(&w->h, sizeof(w->h), 1, w->f) != 1) return -1;
+    return 0;
+}
+
+// ------------------------------------------------------------------
+// Driver
+// ------------------------------------------------------------------
+
+// Archives are told apart from extract files by their magic. An input
+// that fails to open stops the run before anything is written: the output
+// may replace an input archive, and -r would then drop its hours for good.
+static int add_path(void *ctx, const char *path) {
+    struct build *bd = ctx;
+    if (bd->ninputs == bd->inputs_cap) {
+        size_t cap = bd->inputs_cap ? bd->inputs_cap * 2 : 64;
+        struct input *n = realloc(bd->inputs, cap * sizeof(*n));
+        if (!n) return -1;
+        bd->inputs = n;
+        bd->inputs_cap = cap;
+    }
+    struct input *in = &bd->inputs[bd->ninputs];
+    memset(in, 0, sizeof(*in));
+    in->is_archive = parc_is_archive(path);
+    if (in->is_archive ? parc_open(&in->a, path) : ext_open(&in->f, path, 0)) {
+        fprintf(stderr, "Error processing %s: %s\n", path, in->is_archive ? in->a.error : in->f.error);
+        return -1;
+    }
+    if (!(in->path = strdup(path))) return -1;
+    bd->ninputs++;
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-c chunk-records=%d] [-r] [-o archive=%s] <directory|file>...\n"
+        "  -c  records per chunk, the unit a reader decodes\n"
+        "  -r  remove the extract inputs once the archive is written\n"
+        "  inputs may be extract files or archives\n",
+        argv0, DEFAULT_CHUNK_RECORDS, DEFAULT_OUTPUT);
+}
+
+int main(int argc, char* argv[]) {
+    const char *out_path = DEFAULT_OUTPUT;
+    long chunk_records = DEFAULT_CHUNK_RECORDS;
+    int remove_inputs = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:o:r")) != -1) {
+        switch (opt) {
+        case 'c': chunk_records = strtol(optarg, NULL, 10); break;
+        case 'o': out_path = optarg; break;
+        case 'r': remove_inputs = 1; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || chunk_records < 1 || chunk_records > UINT16_MAX) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct build bd = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (ext_walk(argv[i], add_path, &bd)) return 1;
+    }
+
+    int rc = 0;
+    for (size_t i = 0; i < bd.ninputs && !rc; i++) {
+        struct input *in = &bd.inputs[i];
+        if (!in->is_archive) {
+            rc = ext_addr_index_add_file(&bd.addrs, &in->f);
+            continue;
+        }
+        for (uint64_t k = 0; k < in->a.hdr->naddrs && !rc; k++) rc = ext_addr_index_add(&bd.addrs, in->a.addrs[k]);
+    }
+    if (!rc) rc = ext_addr_index_sort(&bd.addrs);
+    for (size_t i = 0; i < bd.ninputs && !rc; i++) {
+        struct input *in = &bd.inputs[i];
+        if (!in->is_archive) {
+            rc = ext_addr_index_map_file(&bd.addrs, &in->f, &in->gid);
+            continue;
+        }
+        if (!(in->gid = malloc((in->a.hdr->naddrs ? in->a.hdr->naddrs : 1) * sizeof(*in->gid)))) {
+            rc = -1;
+            break;
+        }
+        for (uint64_t k = 0; k < in->a.hdr->naddrs; k++) in->gid[k] = ext_addr_index_get(&bd.addrs, in->a.addrs[k]);
+    }
+    if (rc) {
+        perror("failed to index addresses");
+        return 1;
+    }
+
+    if (ext_pair_table_init(&bd.pairs, sizeof(struct pair_entry), 1024)) {
+        perror("failed to allocate pair table");
+        return 1;
+    }
+    scan(&bd, 1);
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    size_t npairs, stage_size;
+    void *stage_map;
+    struct pair_entry **order = layout(&bd, tmp, &npairs, &stage_map, &stage_size);
+    if (!order || scan(&bd, 2)) return 1;
+
+    struct writer w = { .chunk_records = (uint16_t)chunk_records };
+    memcpy(w.h.magic, PARC_MAGIC, sizeof(w.h.magic));
+    w.h.byte_order = PARC_BYTE_ORDER;
+    w.h.version = PARC_VERSION;
+    w.h.chunk_records = (uint16_t)chunk_records;
+    w.h.data_offset = ALIGN8(sizeof(w.h));
+    w.buf = malloc(chunk_records * parc_record_max(PARC_MAX_REPLIES));
+    w.f = fopen(tmp, "w");
+    if (!w.buf || !w.f || fwrite(&w.h, sizeof(w.h), 1, w.f) != 1) {
+        perror(tmp);
+        if (w.f) unlink(tmp);
+        return 1;
+    }
+
+    uint64_t dropped = 0;
+    for (size_t i = 0; i < npairs && !rc; i++) {
+        const struct pair_entry *e = order[i];
+        rc = write_pair(&w, (uint32_t)(e->key >> 32) - 1, (uint32_t)e->key - 1, bd.recs + e->rec_base, e->nrecords,
+            bd.samples + e->sample_base, &dropped);
+    }
+    if (!rc) rc = write_tables(&w, (const uint8_t (*)[16])bd.addrs.addr, bd.addrs.n);
+    if (rc) {
+        perror(out_path);
+        fclose(w.f);
+        unlink(tmp);
+        return 1;
+    }
+    if (ext_commit_file(w.f, tmp, out_path)) {
+        perror(out_path);
+        return 1;
+    }
+    uint64_t in_size = 0, out_size = w.h.chunks_offset + w.h.nchunks * sizeof(struct parc_chunk);
+    for (size_t i = 0; i < bd.ninputs; i++) in_size += bd.inputs[i].is_archive ? bd.inputs[i].a.size : bd.inputs[i].f.size;
+    fprintf(stderr, "%llu records, %llu duplicates dropped, %llu pairs, %llu chunks, %.2f bytes per record, "
+        "input/output %.2f over %zu inputs\n",
+        (unsigned long long)w.h.nrecords, (unsigned long long)dropped, (unsigned long long)w.h.npairs,
+        (unsigned long long)w.h.nchunks, w.h.nrecords ? (double)out_size / w.h.nrecords : 0,
+        out_size ? (double)in_size / out_size : 0, bd.ninputs);
+
+    munmap(stage_map, stage_size);
+    for (size_t i = 0; i < bd.ninputs; i++) {
+        struct input *in = &bd.inputs[i];
+        if (in->is_archive) {
+            parc_close(&in->a);
+        } else {
+            ext_close(&in->f);
+            if (remove_inputs && unlink(in->path)) perror(in->path);
+        }
+        free(in->gid);
+        free(in->path);
+    }
+    free(bd.inputs);
+    ext_pair_table_free(&bd.pairs);
+    free(order);
+    free(w.buf);
+    free(w.pairs);
+    free(w.chunks);
+    ext_addr_index_free(&bd.addrs);
+    return 0;
+}
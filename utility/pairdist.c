@@ -0,0 +1,251 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <math.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/stat.h>
+
+#include "extread.h"
+#include "pairsum.h"
+#include "rtthist.h"
+
+// Turns the histograms of a pair summary (pairsum.h) into netem delay
+// distribution tables, so a simulated link draws its delay from the
+// measured RTT distribution instead of netem's default around the mean.
+//
+// netem adds table[random] * jitter / NETEM_DIST_SCALE to the delay, with
+// table values in a signed 16-bit range. Each table holds DIST_SIZE
+// quantiles of the pair's RTT, standardized as (x - mean) / scale; scale
+// is the stddev, widened where the tail would not fit into 16 bits, and
+// is what the link must be given as jitter. The index lists every table:
+//
+//   name_a name_b samples mean_ms stddev_ms jitter_ms table
+//
+// As with pairprofile, -m groups addresses under names ("address name"
+// lines), merging the histograms of all pairs between two groups; mapping
+// city anchors to city abbreviations gives one table per city link.
+
+#define DIST_SIZE 4096
+#define NETEM_DIST_SCALE 8192
+#define NETEM_DIST_MAX 32767
+#define DEFAULT_MIN_SAMPLES 100
+
+struct node_pair {
+    uint32_t a, b;              // group (or address) nodes, a <= b
+    uint64_t pair;              // index into the summary's pairs
+};
+
+static int node_pair_cmp(const void *a, const void *b) {
+    const struct node_pair *x = a, *y = b;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    if (x->b != y->b) return x->b < y->b ? -1 : 1;
+    return x->pair < y->pair ? -1 : x->pair > y->pair;
+}
+
+// Writes path via a temporary file, so tc never reads a half table.
+static FILE *open_tmp(const char *path, char *tmp, size_t len) {
+    snprintf(tmp, len, "%s.tmp", path);
+    return fopen(tmp, "w");
+}
+
+static int close_tmp(FILE *f, const char *tmp, const char *path) {
+    int rc = ferror(f) ? -1 : 0;
+    if (fclose(f)) rc = -1;
+    if (!rc && rename(tmp, path)) rc = -1;
+    if (rc) unlink(tmp);
+    return rc;
+}
+
+// DIST_SIZE evenly spaced quantiles of the merged histogram, through the
+// piecewise-linear CDF that puts each bin's samples around its value.
+static void quantiles(const uint64_t *acc, uint32_t lo, uint32_t hi, uint64_t total, double *q) {
+    double cum = 0, prev_pos = 0, prev_val = 0;
+    int have_prev = 0;
+    uint32_t j = 0;
+    for (uint32_t k = lo; k < hi && j < DIST_SIZE; k++) {
+        if (!acc[k]) continue;
+        double pos = cum + acc[k] / 2.0, val = hist_value(k);
+        for (; j < DIST_SIZE; j++) {
+            double r = (j + 0.5) * total / DIST_SIZE;
+            if (r > pos) break;
+            q[j] = have_prev ? prev_val + (val - prev_val) * (r - prev_pos) / (pos - prev_pos) : val;
+        }
+        cum += acc[k];
+        prev_pos = pos;
+        prev_val = val;
+        have_prev = 1;
+    }
+    for (; j < DIST_SIZE; j++) q[j] = prev_val;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-m address-map] [-n min-samples=%d] -o directory <summary>\n"
+        "  -m  group addresses by the name on their \"address name\" line\n"
+        "  -n  skip pairs with fewer samples\n"
+        "  -o  directory for the <a>-<b>.dist tables and their index.tsv\n",
+        argv0, DEFAULT_MIN_SAMPLES);
+}
+
+int main(int argc, char* argv[]) {
+    const char *out_dir = NULL, *map_path = NULL;
+    uint64_t min_samples = DEFAULT_MIN_SAMPLES;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:n:o:")) != -1) {
+        switch (opt) {
+        case 'm': map_path = optarg; break;
+        case 'n': min_samples = strtoull(optarg, NULL, 10); break;
+        case 'o': out_dir = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (argc - optind != 1 || !out_dir) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct psum s;
+    if (psum_open(&s, argv[optind])) {
+        fprintf(stderr, "%s: %s\n", argv[optind], s.error);
+        return 1;
+    }
+    if (mkdir(out_dir, 0755) && errno != EEXIST) {
+        perror(out_dir);
+        return 1;
+    }
+
+    // Node of every summary address: its group, or itself without a map.
+    uint64_t naddrs = s.hdr->naddrs;
+    uint32_t *node = malloc((naddrs ? naddrs : 1) * sizeof(*node));
+    struct ext_addr_map map = { 0 };
+    if (!node) {
+        perror("failed to allocate");
+        return 1;
+    }
+    if (map_path) {
+        if (ext_addr_map_load(&map, map_path)) return 1;
+        for (uint64_t a = 0; a < naddrs; a++) {
+            int64_t g = ext_addr_map_find(&map, s.addrs[a]);
+            node[a] = g < 0 ? UINT32_MAX : (uint32_t)g;
+        }
+    } else {
+        for (uint64_t a = 0; a < naddrs; a++) node[a] = (uint32_t)a;
+    }
+
+    // Pairs in node order, so every output is one run of summary pairs.
+    struct node_pair *order = malloc((s.hdr->npairs ? s.hdr->npairs : 1) * sizeof(*order));
+    uint64_t *acc = calloc(HIST_BINS, sizeof(*acc));
+    double *q = malloc(DIST_SIZE * sizeof(*q));
+    if (!order || !acc || !q) {
+        perror("failed to allocate");
+        return 1;
+    }
+    uint64_t n = 0;
+    for (uint64_t i = 0; i < s.hdr->npairs; i++) {
+        uint32_t a = node[s.pairs[i].a], b = node[s.pairs[i].b];
+        if (a == UINT32_MAX || b == UINT32_MAX) continue;
+        order[n++] = (struct node_pair){ a < b ? a : b, a < b ? b : a, i };
+    }
+    qsort(order, n, sizeof(*order), node_pair_cmp);
+
+    char index_path[4096], index_tmp[4096 + 4];
+    snprintf(index_path, sizeof(index_path), "%s/index.tsv", out_dir);
+    FILE *index = open_tmp(index_path, index_tmp, sizeof(index_tmp));
+    if (!index) {
+        perror(index_tmp);
+        return 1;
+    }
+    fprintf(index, "name_a\tname_b\tsamples\tmean_ms\tstddev_ms\tjitter_ms\ttable\n");
+
+    uint64_t tables = 0, skipped = 0;
+    int rc = 0;
+    for (uint64_t i = 0; i < n && !rc;) {
+        uint64_t end = i;
+        uint64_t count = 0;
+        unsigned __int128 sum = 0, sumsq = 0;
+        uint32_t lo = HIST_BINS, hi = 0;
+        for (; end < n && order[end].a == order[i].a && order[end].b == order[i].b; end++) {
+            const struct psum_pair *p = &s.pairs[order[end].pair];
+            for (uint32_t k = 0; k < p->nbins; k++) acc[p->lo + k] += s.bins[p->bins_first + k];
+            if (p->nbins && p->lo < lo) lo = p->lo;
+            if (p->nbins && (uint32_t)p->lo + p->nbins > hi) hi = p->lo + p->nbins;
+            count += p->count;
+            sum += p->sum_us;
+            sumsq += psum_sumsq(p);
+        }
+
+        // Exact moments from the sums; the quantiles only shape the table.
+        double mean = count ? (double)sum / count / 1000.0 : 0, stddev = 0;
+        if (count > 1) stddev = sqrt((double)(sumsq * count - sum * sum) / count / (count - 1)) / 1000.0;
+        if (count < min_samples || stddev <= 0) {
+            skipped++;
+        } else {
+            quantiles(acc, lo, hi, count, q);
+            double scale = stddev;
+            for (uint32_t j = 0; j < DIST_SIZE; j++) {
+                double need = fabs(q[j] - mean) * NETEM_DIST_SCALE / NETEM_DIST_MAX;
+                if (need > scale) scale = need;
+            }
+
+            char na[INET6_ADDRSTRLEN], nb[INET6_ADDRSTRLEN], table[2 * INET6_ADDRSTRLEN + 2];
+            const char *name_a = map_path ? map.names[order[i].a] : ext_format_addr(s.addrs[order[i].a], na, sizeof(na));
+            const char *name_b = map_path ? map.names[order[i].b] : ext_format_addr(s.addrs[order[i].b], nb, sizeof(nb));
+            snprintf(table, sizeof(table), "%s-%s", name_a, name_b);
+            for (char *c = table; *c; c++) {
+                if (*c == '/') *c = '_';
+            }
+
+            char path[4096], tmp[4096 + 4];
+            snprintf(path, sizeof(path), "%s/%s.dist", out_dir, table);
+            FILE *f = open_tmp(path, tmp, sizeof(tmp));
+            if (!f) {
+                perror(tmp);
+                rc = 1;
+                break;
+            }
+            fprintf(f, "# %s %s: %llu samples, mean %.3f ms, jitter %.3f ms\n", name_a, name_b,
+                (unsigned long long)count, mean, scale);
+            for (uint32_t j = 0; j < DIST_SIZE; j++) {
+                long v = lround((q[j] - mean) / scale * NETEM_DIST_SCALE);
+                if (v > NETEM_DIST_MAX) v = NETEM_DIST_MAX;
+                if (v < -NETEM_DIST_MAX) v = -NETEM_DIST_MAX;
+                fprintf(f, "%ld%c", v, j % 8 == 7 ? '\n' : ' ');
+            }
+            if (close_tmp(f, tmp, path)) {
+                perror(path);
+                rc = 1;
+                break;
+            }
+            fprintf(index, "%s\t%s\t%llu\t%f\t%f\t%f\t%s\n", name_a, name_b, (unsigned long long)count, mean, stddev, scale,
+                table);
+            tables++;
+        }
+        for (uint32_t k = lo; k < hi; k++) acc[k] = 0;
+        i = end;
+    }
+
+    if (rc) {
+        fclose(index);
+        unlink(index_tmp);
+    } else if (close_tmp(index, index_tmp, index_path)) {
+        perror(index_path);
+        rc = 1;
+    }
+    if (!rc) fprintf(stderr, "%llu tables, %llu pairs below %llu samples or without spread\n",
+        (unsigned long long)tables, (unsigned long long)skipped, (unsigned long long)min_samples);
+
+    psum_close(&s);
+    ext_addr_map_free(&map);
+    free(node);
+    free(order);
+    free(acc);
+    free(q);
+    return rc;
+}
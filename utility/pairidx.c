@@ -0,0 +1,130 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pairidx.h"
+
+static int fail(struct pidx *p, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(p->error, sizeof(p->error), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+// Whether [off, off + count * elem) lies inside the file, aligned.
+static int section_ok(const struct pidx *p, uint64_t off, uint64_t count, uint64_t elem) {
+    return off % 8 == 0 && off <= p->size && count <= (p->size - off) / elem;
+}
+
+// Checks everything lookups rely on, once, so they need no bounds checks.
+static int validate(struct pidx *p) {
+    const struct pidx_header *h = p->hdr;
+    if (memcmp(h->magic, PIDX_MAGIC, sizeof(h->magic)) != 0) return fail(p, "not a pair index");
+    if (h->byte_order != PIDX_BYTE_ORDER) return fail(p, "written with a different byte order");
+    if (h->version != PIDX_VERSION) return fail(p, "unsupported index version %u", h->version);
+    if (h->naddrs >= UINT32_MAX || !section_ok(p, h->addrs_offset, h->naddrs, 16) ||
+        !section_ok(p, h->rows_offset, h->naddrs + 1, 8) ||
+        !section_ok(p, h->edges_offset, h->nedges, sizeof(struct pidx_edge)) ||
+        !section_ok(p, h->samples_offset, h->nsamples, 4))
+        return fail(p, "truncated index");
+
+    p->addrs = (const void *)(p->data + h->addrs_offset);
+    p->rows = (const void *)(p->data + h->rows_offset);
+    p->edges = (const void *)(p->data + h->edges_offset);
+    p->samples = (const void *)(p->data + h->samples_offset);
+
+    if (p->rows[0] != 0 || p->rows[h->naddrs] != h->nedges) return fail(p, "bad row table");
+    for (uint64_t a = 0; a < h->naddrs; a++) {
+        if (p->rows[a + 1] < p->rows[a]) return fail(p, "bad row table");
+        if (a && memcmp(p->addrs[a - 1], p->addrs[a], 16) >= 0) return fail(p, "address table not sorted");
+    }
+    for (uint64_t a = 0; a < h->naddrs; a++) {
+        for (uint64_t i = p->rows[a]; i < p->rows[a + 1]; i++) {
+            const struct pidx_edge *e = &p->edges[i];
+            if (e->peer >= h->naddrs || (i > p->rows[a] && e->peer <= e[-1].peer) ||
+                e->first > h->nsamples || e->count > h->nsamples - e->first)
+                return fail(p, "bad edge %llu", (unsigned long long)i);
+        }
+    }
+    return 0;
+}
+
+int pidx_open(struct pidx *p, const char *path) {
+    struct stat st;
+
+    memset(p, 0, sizeof(*p));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(p, "%s", strerror(errno));
+    if (fstat(fd, &st)) {
+        fail(p, "%s", strerror(errno));
+        goto FAIL;
+    }
+    p->size = st.st_size;
+    if (p->size < sizeof(struct pidx_header)) {
+        fail(p, "file too short");
+        goto FAIL;
+    }
+    p->data = mmap(NULL, p->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p->data == MAP_FAILED) {
+        p->data = NULL;
+        fail(p, "mmap: %s", strerror(errno));
+        goto FAIL;
+    }
+    // The mapping keeps the file
+    close(fd);
+    fd = -1;
+    p->hdr = (const void *)p->data;
+    if (validate(p)) goto FAIL;
+    // Queries touch a few rows and runs each; don't read ahead the rest.
+    madvise((void *)p->data, p->size, MADV_RANDOM);
+    return 0;
+
+FAIL:
+    if (fd >= 0) close(fd);
+    {
+        char error[sizeof(p->error)];
+        memcpy(error, p->error, sizeof(error));
+        pidx_close(p);
+        memcpy(p->error, error, sizeof(error));
+    }
+    return -1;
+}
+
+void pidx_close(struct pidx *p) {
+    if (p->data) munmap((void *)p->data, p->size);
+    memset(p, 0, sizeof(*p));
+}
+
+int64_t pidx_find_addr(const struct pidx *p, const uint8_t *addr) {
+    uint64_t lo = 0, hi = p->hdr->naddrs;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        int c = memcmp(p->addrs[mid], addr, 16);
+        if (c == 0) return (int64_t)mid;
+        if (c < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return -1;
+}
+
+const struct pidx_edge *pidx_find_pair(const struct pidx *p, uint32_t a, uint32_t b) {
+    uint64_t n;
+    const struct pidx_edge *e = pidx_peers(p, a, &n);
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = (lo + hi) / 2;
+        if (e[mid].peer == b) return &e[mid];
+        if (e[mid].peer < b) lo = mid + 1;
+        else hi = mid;
+    }
+    return NULL;
+}
@@ -0,0 +1,80 @@
+#ifndef PAIRIDX_H
+#define PAIRIDX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Address and pair index over a set of extract files, written by
+// pairindex and read in place through mmap.
+//
+//   pidx_header
+//   addrs[naddrs][16]          sorted; an address's id is its position
+//   rows[naddrs + 1]           u64: edges of id a are edges[rows[a], rows[a+1])
+//   edges[nedges]              pidx_edge, sorted by peer within a row
+//   samples[nsamples]          u32 microseconds, grouped by pair
+//
+// The adjacency is CSR (compressed sparse row). Pairs are unordered, as in
+// pairstats: the pair a-b is listed in the rows of both a and b, and both
+// edges point at the same run of samples, which holds the RTTs measured
+// in either direction. Runs are laid out in (min id, max id) order.
+// Addresses use the 16-byte form of extfmt.h, IPv4 as ::ffff:a.b.c.d.
+//
+// Integers are in the writer's native byte order; every section starts
+// 8-byte aligned.
+
+#define PIDX_MAGIC "RIPEIDX\0"
+#define PIDX_VERSION 1
+#define PIDX_BYTE_ORDER 0x01020304u
+
+struct pidx_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t flags;             // 0
+    uint64_t naddrs;
+    uint64_t npairs;
+    uint64_t nedges;            // 2 * npairs, less one per self pair
+    uint64_t nsamples;
+    uint64_t addrs_offset;
+    uint64_t rows_offset;
+    uint64_t edges_offset;
+    uint64_t samples_offset;
+};
+
+struct pidx_edge {
+    uint32_t peer;
+    uint32_t count;             // samples of the pair
+    uint64_t first;             // index of its first sample
+};
+
+_Static_assert(sizeof(struct pidx_header) == 80, "pidx_header layout");
+_Static_assert(sizeof(struct pidx_edge) == 16, "pidx_edge layout");
+
+struct pidx {
+    const char *data;
+    size_t size;
+    const struct pidx_header *hdr;
+    const uint8_t (*addrs)[16];
+    const uint64_t *rows;
+    const struct pidx_edge *edges;
+    const uint32_t *samples;
+    char error[128];            // reason for the last failure
+};
+
+// Maps and validates an index; returns 0, or -1 with p->error filled in.
+int pidx_open(struct pidx *p, const char *path);
+void pidx_close(struct pidx *p);
+
+// Id of a 16-byte address, or -1 if it is not in the index.
+int64_t pidx_find_addr(const struct pidx *p, const uint8_t *addr);
+
+// Edges of id a; *n receives their number.
+static inline const struct pidx_edge *pidx_peers(const struct pidx *p, uint32_t a, uint64_t *n) {
+    *n = p->rows[a + 1] - p->rows[a];
+    return p->edges + p->rows[a];
+}
+
+// The edge a-b, or NULL if the pair was never measured.
+const struct pidx_edge *pidx_find_pair(const struct pidx *p, uint32_t a, uint32_t b);
+
+#endif
@@ -0,0 +1,326 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "extread.h"
+#include "pairidx.h"
+#include "pairarc.h"
+
+// Builds the address and pair index of pairidx.h from extract files and
+// archives (pairarc.h), so that listing addresses, looking up a pair or
+// walking the peers of an anchor is an mmap lookup instead of a scan over
+// every file.
+//
+// pass 1: count the samples of every pair in a hash table
+// layout: sort the pairs, give each its run of samples, size the file and
+//         write the address, row and edge tables into the mapping
+// pass 2: copy every sample straight to the next free slot of its run
+//
+// Memory is bounded by the number of pairs; samples only ever live in the
+// output mapping.
+
+#define DEFAULT_OUTPUT "pairs.idx"
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+// ------------------------------------------------------------------
+// Pair table entries
+// ------------------------------------------------------------------
+
+struct pair_entry {
+    uint64_t key;               // 0 = empty; (min << 32) | max index id otherwise
+    uint64_t count;
+    uint64_t next;              // pass 2: where the next sample goes
+};
+
+// ------------------------------------------------------------------
+// Build
+// ------------------------------------------------------------------
+
+struct build {
+    struct ext_file *files;
+    uint32_t **gids;            // per file, from ext_addr_index_map_file
+    size_t nfiles;
+    struct parc_list archives;
+    uint32_t **archive_gids;    // per archive, archive id -> index id
+    struct ext_addr_index addrs;
+    struct ext_pair_table pairs;
+    uint32_t *samples;          // pass 2: the output's sample section
+};
+
+// RTT value i in microseconds, from either stored type.
+static inline uint32_t rtt_us_at(const void *data, uint8_t type, uint32_t i) {
+    if (type == EXT_TYPE_F32) return (uint32_t)(((const float *)data)[i] * 1000.0 + 0.5);
+    return ((const uint32_t *)data)[i];
+}
+
+static struct pair_entry *pair_get(struct build *bd, uint32_t s, uint32_t d) {
+    uint64_t key = s < d ? ((uint64_t)s << 32) | d : ((uint64_t)d << 32) | s;
+    struct pair_entry *e = ext_pair_table_get(&bd->pairs, key);
+    if (!e) {
+        perror("failed to allocate pair table");
+        exit(1);
+    }
+    return e;
+}
+
+// One pass over every record of every file, then every archive. Returns
+// 0, or -1 on a corrupt archive chunk.
+static int scan(struct build *bd, int pass) {
+    uint8_t a[16];
+    memcpy(a, ext_v4_prefix, 12);
+
+    for (size_t fi = 0; fi < bd->nfiles; fi++) {
+        const struct ext_file *f = &bd->files[fi];
+        const uint32_t *gid = bd->gids[fi];
+        struct ext_block b = { 0 };
+
+        while (ext_next_block(f, &b)) {
+            const uint32_t *src_id = ext_block_column(f, &b, EXT_FIELD_SRC_ID, NULL);
+            const uint32_t *dst_id = ext_block_column(f, &b, EXT_FIELD_DST_ID, NULL);
+            const uint8_t *src = ext_block_column(f, &b, EXT_FIELD_SRC_ADDR, NULL);
+            const uint8_t *dst = ext_block_column(f, &b, EXT_FIELD_DST_ADDR, NULL);
+            const uint8_t *cnt = ext_block_column(f, &b, EXT_FIELD_RTT_COUNT, NULL);
+            const void *rtt = ext_block_column(f, &b, EXT_FIELD_RTT, NULL);
+            const struct ext_column *rtt_col = ext_block_find_column(&b, EXT_FIELD_RTT);
+            int by_id = gid && src_id && dst_id;
+            if (!(by_id || (src && dst)) || !cnt || !rtt) continue;
+            uint32_t v = 0;     // pass 2: next rtt value
+
+            for (uint32_t i = 0; i < b.hdr->nrecords; i++) {
+                uint32_t s, d;
+                if (by_id) {
+                    s = gid[src_id[i]];
+                    d = gid[dst_id[i]];
+                } else {
+                    memcpy(a + 12, src + i * 4, 4);
+                    s = ext_addr_index_get(&bd->addrs, a);
+                    memcpy(a + 12, dst + i * 4, 4);
+                    d = ext_addr_index_get(&bd->addrs, a);
+                }
+                struct pair_entry *e = pair_get(bd, s, d);
+                if (pass == 1) {
+                    e->count += cnt[i];
+                    continue;
+                }
+                for (uint32_t k = 0; k < cnt[i]; k++) bd->samples[e->next++] = rtt_us_at(rtt, rtt_col->type, v++);
+            }
+        }
+    }
+
+    for (size_t ai = 0; ai < bd->archives.n; ai++) {
+        const struct parc *a = &bd->archives.a[ai];
+        const uint32_t *gid = bd->archive_gids[ai];
+        for (uint64_t i = 0; i < a->hdr->npairs; i++) {
+            const struct parc_pair *p = &a->pairs[i];
+            struct pair_entry *e = pair_get(bd, gid[p->src], gid[p->dst]);
+            if (pass == 1) {
+                for (uint64_t c = 0; c < p->nchunks; c++) e->count += a->chunks[p->first_chunk + c].nsamples;
+                continue;
+            }
+            struct parc_cursor c;
+            struct parc_record r;
+            int rc;
+            parc_cursor_init(&c, a, p, 0, UINT64_MAX);
+            while ((rc = parc_cursor_next(&c, &r)) == 1) {
+                memcpy(bd->samples + e->next, r.rtt_us, r.rtt_count * sizeof(*r.rtt_us));
+                e->next += r.rtt_count;
+            }
+            if (rc < 0) {
+                fprintf(stderr, "corrupt chunk in archive pair %llu\n", (unsigned long long)i);
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+static int entry_cmp(const void *a, const void *b) {
+    uint64_t x = (*(struct pair_entry *const *)a)->key;
+    uint64_t y = (*(struct pair_entry *const *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+// Sorts the pairs, assigns their sample runs and writes every table but
+// the samples. Returns the mapping, or NULL.
+static char *layout(struct build *bd, int fd, size_t *size_out, struct pidx_header *h) {
+    uint64_t naddrs = bd->addrs.n;
+    struct pair_entry **order = malloc((bd->pairs.used ? bd->pairs.used : 1) * sizeof(*order));
+    uint64_t *rows = calloc(naddrs + 1, sizeof(*rows));
+    if (!order || !rows) {
+        perror("failed to allocate");
+        exit(1);
+    }
+
+    size_t npairs = 0;
+    uint64_t nsamples = 0, nedges = 0;
+    for (size_t i = 0; i < bd->pairs.cap; i++) {
+        struct pair_entry *e = ext_pair_table_slot(&bd->pairs, i);
+        if (e->key) order[npairs++] = e;
+    }
+    qsort(order, npairs, sizeof(*order), entry_cmp);
+    for (size_t i = 0; i < npairs; i++) {
+        struct pair_entry *e = order[i];
+        uint32_t lo = (uint32_t)(e->key >> 32) - 1, hi = (uint32_t)e->key - 1;
+        if (e->count > UINT32_MAX) {
+            fprintf(stderr, "too many samples for one pair\n");
+            exit(1);
+        }
+        e->next = nsamples;
+        nsamples += e->count;
+        rows[lo + 1]++;
+        if (hi != lo) rows[hi + 1]++;
+    }
+    for (uint64_t a = 0; a < naddrs; a++) rows[a + 1] += rows[a];
+    nedges = rows[naddrs];
+
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, PIDX_MAGIC, sizeof(h->magic));
+    h->byte_order = PIDX_BYTE_ORDER;
+    h->version = PIDX_VERSION;
+    h->naddrs = naddrs;
+    h->npairs = npairs;
+    h->nedges = nedges;
+    h->nsamples = nsamples;
+    h->addrs_offset = ALIGN8(sizeof(*h));
+    h->rows_offset = h->addrs_offset + naddrs * 16;
+    h->edges_offset = h->rows_offset + (naddrs + 1) * 8;
+    h->samples_offset = h->edges_offset + nedges * sizeof(struct pidx_edge);
+    size_t size = ALIGN8(h->samples_offset + nsamples * 4);
+
+    if (ftruncate(fd, size)) return NULL;
+    char *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) return NULL;
+
+    memcpy(map, h, sizeof(*h));
+    memcpy(map + h->addrs_offset, bd->addrs.addr, naddrs * 16);
+    memcpy(map + h->rows_offset, rows, (naddrs + 1) * 8);
+
+    // Pairs are in (lo, hi) order, so each row fills in increasing peer
+    // order: first the pairs where it is hi, then those where it is lo.
+    struct pidx_edge *edges = (struct pidx_edge *)(map + h->edges_offset);
+    for (size_t i = 0; i < npairs; i++) {
+        const struct pair_entry *e = order[i];
+        uint32_t lo = (uint32_t)(e->key >> 32) - 1, hi = (uint32_t)e->key - 1;
+        edges[rows[lo]++] = (struct pidx_edge){ hi, (uint32_t)e->count, e->next };
+        if (hi != lo) edges[rows[hi]++] = (struct pidx_edge){ lo, (uint32_t)e->count, e->next };
+    }
+    bd->samples = (uint32_t *)(map + h->samples_offset);
+
+    free(order);
+    free(rows);
+    *size_out = size;
+    return map;
+}
+
+// ------------------------------------------------------------------
+// Driver
+// ------------------------------------------------------------------
+
+static void usage(const char *argv0) {
+    fprintf(stderr, "Usage: %s [-o index=%s] <directory|file|archive>...\n", argv0, DEFAULT_OUTPUT);
+}
+
+int main(int argc, char* argv[]) {
+    const char *out_path = DEFAULT_OUTPUT;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:")) != -1) {
+        switch (opt) {
+        case 'o':
+            out_path = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct parc_inputs in = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (ext_walk(argv[i], parc_inputs_add, &in)) return 1;
+    }
+    struct build bd = { .files = in.files, .nfiles = in.nfiles, .archives = in.archives };
+
+    bd.gids = calloc(bd.nfiles ? bd.nfiles : 1, sizeof(*bd.gids));
+    bd.archive_gids = calloc(bd.archives.n ? bd.archives.n : 1, sizeof(*bd.archive_gids));
+    int rc = bd.gids && bd.archive_gids ? 0 : -1;
+    for (size_t i = 0; i < bd.nfiles && !rc; i++) rc = ext_addr_index_add_file(&bd.addrs, &bd.files[i]);
+    for (size_t i = 0; i < bd.archives.n && !rc; i++) {
+        const struct parc *a = &bd.archives.a[i];
+        for (uint64_t k = 0; k < a->hdr->naddrs && !rc; k++) rc = ext_addr_index_add(&bd.addrs, a->addrs[k]);
+    }
+    if (!rc) rc = ext_addr_index_sort(&bd.addrs);
+    for (size_t i = 0; i < bd.nfiles && !rc; i++) rc = ext_addr_index_map_file(&bd.addrs, &bd.files[i], &bd.gids[i]);
+    for (size_t i = 0; i < bd.archives.n && !rc; i++) {
+        const struct parc *a = &bd.archives.a[i];
+        if (!(bd.archive_gids[i] = malloc((a->hdr->naddrs ? a->hdr->naddrs : 1) * sizeof(**bd.archive_gids)))) {
+            rc = -1;
+            break;
+        }
+        for (uint64_t k = 0; k < a->hdr->naddrs; k++) bd.archive_gids[i][k] = ext_addr_index_get(&bd.addrs, a->addrs[k]);
+    }
+    if (rc) {
+        perror("failed to index addresses");
+        return 1;
+    }
+
+    if (ext_pair_table_init(&bd.pairs, sizeof(struct pair_entry), 1024)) {
+        perror("failed to allocate pair table");
+        return 1;
+    }
+    if (scan(&bd, 1)) return 1;
+
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", out_path);
+    int fd = open(tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(tmp);
+        return 1;
+    }
+    struct pidx_header h;
+    size_t size;
+    char *map = layout(&bd, fd, &size, &h);
+    if (!map) {
+        perror(tmp);
+        unlink(tmp);
+        return 1;
+    }
+    rc = scan(&bd, 2);
+
+    if (munmap(map, size) || rc) {
+        if (!rc) perror(out_path);
+        close(fd);
+        unlink(tmp);
+        return 1;
+    }
+    if (ext_commit_fd(fd, tmp, out_path)) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(stderr, "%llu addresses, %llu pairs, %llu samples from %zu files\n",
+        (unsigned long long)h.naddrs, (unsigned long long)h.npairs, (unsigned long long)h.nsamples,
+        bd.nfiles + bd.archives.n);
+
+    for (size_t i = 0; i < bd.nfiles; i++) {
+        ext_close(&bd.files[i]);
+        free(bd.gids[i]);
+    }
+    for (size_t i = 0; i < bd.archives.n; i++) free(bd.archive_gids[i]);
+    parc_list_free(&bd.archives);
+    free(bd.gids);
+    free(bd.archive_gids);
+    free(bd.files);
+    ext_pair_table_free(&bd.pairs);
+    ext_addr_index_free(&bd.addrs);
+    return 0;
+}
@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "pairsum.h"
+#include "rtthist.h"
+
+// Adds and subtracts pair summaries (pairsum.h) and optionally finishes
+// the result into the pairstats -H TSV.
+//
+// Summaries are merged in one k-way pass over their sorted pair tables.
+// All address tables are first combined into one sorted table; since each
+// input's ids are in address order, mapping them keeps every input sorted.
+// Merging is associative, so days can be merged into weeks and weeks into
+// a month, and a rolling window is kept up to date with one merge a day:
+//
+//   pairstats -S day-new.sum data/<new day>
+//   pairmerge -o window.sum -t window.tsv window.sum day-new.sum -x day-old.sum
+
+#define MAX_INPUTS 4096
+#define CLIP_K 3.0
+#define CLIP_ITER 3
+
+struct input {
+    struct psum s;
+    const char *path;
+    int sign;                   // +1 added, -1 subtracted (-x)
+    uint32_t *map;              // input id -> merged id
+    uint64_t pos;               // next pair
+};
+
+static int addr_cmp(const void *a, const void *b) {
+    return memcmp(a, b, 16);
+}
+
+static uint32_t find_addr(const uint8_t (*addrs)[16], uint64_t n, const uint8_t *a) {
+    uint64_t lo = 0, hi = n;
+    while (hi - lo > 1) {
+        uint64_t mid = (lo + hi) / 2;
+        if (memcmp(addrs[mid], a, 16) <= 0) lo = mid;
+        else hi = mid;
+    }
+    return (uint32_t)lo;
+}
+
+static inline uint64_t pair_key(const struct input *in) {
+    const struct psum_pair *p = &in->s.pairs[in->pos];
+    return (uint64_t)in->map[p->a] << 32 | in->map[p->b];
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-o merged.sum] [-t output.tsv] [-x summary]... <summary>...\n"
+        "  -o  write the merged summary\n"
+        "  -t  write per-pair sigma-clipped statistics, as pairstats -H\n"
+        "  -x  subtract a summary that was merged in before\n",
+        argv0);
+}
+
+int main(int argc, char* argv[]) {
+    static struct input in[MAX_INPUTS];
+    size_t nin = 0;
+    const char *out_path = NULL, *tsv_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "o:t:x:")) != -1) {
+        switch (opt) {
+        case 'o': out_path = optarg; break;
+        case 't': tsv_path = optarg; break;
+        case 'x':
+            if (nin == MAX_INPUTS) {
+                fprintf(stderr, "too many summaries\n");
+                return 1;
+            }
+            in[nin].path = optarg;
+            in[nin++].sign = -1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || (!out_path && !tsv_path)) {
+        usage(argv[0]);
+        return 1;
+    }
+    for (int i = optind; i < argc; i++) {
+        if (nin == MAX_INPUTS) {
+            fprintf(stderr, "too many summaries\n");
+            return 1;
+        }
+        in[nin].path = argv[i];
+        in[nin++].sign = 1;
+    }
+
+    // Union of the address tables.
+    uint64_t naddrs = 0;
+    for (size_t i = 0; i < nin; i++) {
+        if (psum_open(&in[i].s, in[i].path)) {
+            fprintf(stderr, "%s: %s\n", in[i].path, in[i].s.error);
+            return 1;
+        }
+        naddrs += in[i].s.hdr->naddrs;
+    }
+    uint8_t (*addrs)[16] = malloc((naddrs ? naddrs : 1) * 16);
+    if (!addrs) {
+        perror("failed to allocate addresses");
+        return 1;
+    }
+    naddrs = 0;
+    for (size_t i = 0; i < nin; i++) {
+        memcpy(addrs[naddrs], in[i].s.addrs, in[i].s.hdr->naddrs * 16);
+        naddrs += in[i].s.hdr->naddrs;
+    }
+    qsort(addrs, naddrs, 16, addr_cmp);
+    uint64_t kept = 0;
+    for (uint64_t a = 0; a < naddrs; a++) {
+        if (!kept || memcmp(addrs[kept - 1], addrs[a], 16)) memcpy(addrs[kept++], addrs[a], 16);
+    }
+    naddrs = kept;
+    if (naddrs >= UINT32_MAX) {
+        fprintf(stderr, "too many addresses\n");
+        return 1;
+    }
+    for (size_t i = 0; i < nin; i++) {
+        uint64_t n = in[i].s.hdr->naddrs;
+        if (!(in[i].map = malloc((n ? n : 1) * sizeof(uint32_t)))) {
+            perror("failed to allocate address map");
+            return 1;
+        }
+        for (uint64_t a = 0; a < n; a++) in[i].map[a] = find_addr(addrs, naddrs, in[i].s.addrs[a]);
+    }
+
+    struct psum_writer sw;
+    if (out_path && psum_writer_open(&sw, out_path)) {
+        perror(out_path);
+        return 1;
+    }
+    FILE *tsv = NULL;
+    if (tsv_path) {
+        if (!(tsv = strcmp(tsv_path, "-") ? fopen(tsv_path, "w") : stdout)) {
+            perror(tsv_path);
+            return 1;
+        }
+        fprintf(tsv, "addr_a\taddr_b\tsamples\tmean\tstddev\tp50\tp90\tp99\n");
+    }
+
+    // Pair by pair in merged key order. acc covers the whole bin range so
+    // any window fits; only [lo, hi) is touched per pair.
+    int64_t *acc = calloc(HIST_BINS, sizeof(*acc));
+    uint32_t *bins = malloc(HIST_BINS * sizeof(*bins));
+    uint8_t *used = calloc(naddrs ? naddrs : 1, 1);
+    if (!acc || !bins || !used) {
+        perror("failed to allocate");
+        return 1;
+    }
+    uint64_t npairs = 0;
+    int rc = 0;
+    for (;;) {
+        uint64_t key = UINT64_MAX;
+        for (size_t i = 0; i < nin; i++) {
+            if (in[i].pos < in[i].s.hdr->npairs && pair_key(&in[i]) < key) key = pair_key(&in[i]);
+        }
+        if (key == UINT64_MAX) break;
+
+        int64_t count = 0;
+        __int128 sum = 0, sumsq = 0;
+        uint32_t lo = HIST_BINS, hi = 0;
+        for (size_t i = 0; i < nin; i++) {
+            if (in[i].pos >= in[i].s.hdr->npairs || pair_key(&in[i]) != key) continue;
+            const struct psum_pair *p = &in[i].s.pairs[in[i].pos++];
+            const uint32_t *b = in[i].s.bins + p->bins_first;
+            for (uint32_t k = 0; k < p->nbins; k++) acc[p->lo + k] += in[i].sign * (int64_t)b[k];
+            if (p->nbins && p->lo < lo) lo = p->lo;
+            if (p->nbins && (uint32_t)p->lo + p->nbins > hi) hi = p->lo + p->nbins;
+            count += in[i].sign * (int64_t)p->count;
+            sum += in[i].sign * (__int128)p->sum_us;
+            sumsq += in[i].sign * (__int128)psum_sumsq(p);
+        }
+
+        // Trim the window to its non-zero bins, checking that nothing was
+        // taken out that had not been put in and that every bin still fits.
+        int bad = count < 0 || sum < 0 || sumsq < 0, overflow = 0;
+        uint32_t a = lo, z = hi;
+        for (uint32_t k = lo; k < hi; k++) {
+            bad |= acc[k] < 0;
+            overflow |= acc[k] > UINT32_MAX;
+        }
+        while (a < z && !acc[a]) a++;
+        while (z > a && !acc[z - 1]) z--;
+        for (uint32_t k = a; k < z; k++) bins[k - a] = (uint32_t)acc[k];
+        for (uint32_t k = lo; k < hi; k++) acc[k] = 0;
+        char sa[INET6_ADDRSTRLEN], sb[INET6_ADDRSTRLEN];
+        ext_format_addr(addrs[key >> 32], sa, sizeof(sa));
+        ext_format_addr(addrs[(uint32_t)key], sb, sizeof(sb));
+        if (bad) {
+            fprintf(stderr, "pair %s %s: subtracted summaries were not merged in\n", sa, sb);
+            rc = 1;
+            break;
+        }
+        if (overflow) {
+            fprintf(stderr, "pair %s %s: a histogram bin exceeds %u samples\n", sa, sb, UINT32_MAX);
+            rc = 1;
+            break;
+        }
+        if (count == 0) continue;
+
+        struct psum_pair p = {
+            .a = (uint32_t)(key >> 32), .b = (uint32_t)key,
+            .count = (uint64_t)count, .sum_us = (uint64_t)sum, .lo = (uint16_t)a, .nbins = (uint16_t)(z - a),
+        };
+        psum_set_sumsq(&p, (unsigned __int128)sumsq);
+        npairs++;
+        used[p.a] = used[p.b] = 1;
+        if (out_path && psum_writer_add(&sw, &p, bins)) {
+            perror(out_path);
+            rc = 1;
+            break;
+        }
+        if (tsv) {
+            struct hist h = { bins, (uint16_t)a, (uint16_t)(z - a) };
+            double mean, stddev;
+            if (hist_sigma_clip(&h, CLIP_K, CLIP_ITER, &mean, &stddev)) {
+                fprintf(stderr, "pair %s %s: overflow in statistics\n", sa, sb);
+                continue;
+            }
+            fprintf(tsv, "%s\t%s\t%llu\t%f\t%f\t%f\t%f\t%f\n", sa, sb, (unsigned long long)count, mean, stddev,
+                hist_percentile(&h, count, 0.50), hist_percentile(&h, count, 0.90), hist_percentile(&h, count, 0.99));
+        }
+    }
+
+    if (out_path && !rc) {
+        // Drop addresses whose pairs were all subtracted away, so a rolling
+        // window does not accumulate them.
+        uint32_t *renum;
+        if (!(renum = malloc((naddrs ? naddrs : 1) * sizeof(*renum)))) {
+            perror("failed to allocate");
+            return 1;
+        }
+        uint64_t n = 0;
+        for (uint64_t a = 0; a < naddrs; a++) {
+            renum[a] = (uint32_t)n;
+            if (used[a]) memcpy(addrs[n++], addrs[a], 16);
+        }
+        for (uint64_t i = 0; i < sw.hdr.npairs; i++) {
+            sw.pairs[i].a = renum[sw.pairs[i].a];
+            sw.pairs[i].b = renum[sw.pairs[i].b];
+        }
+        free(renum);
+        if (psum_writer_close(&sw, (const uint8_t (*)[16])addrs, n)) {
+            perror(out_path);
+            rc = 1;
+        }
+    } else if (out_path) {
+        psum_writer_abort(&sw);
+    }
+    if (tsv && tsv != stdout && (ferror(tsv) | fclose(tsv))) {
+        perror(tsv_path);
+        return 1;
+    }
+    if (!rc) fprintf(stderr, "%llu pairs from %zu summaries\n", (unsigned long long)npairs, nin);
+
+    for (size_t i = 0; i < nin; i++) {
+        psum_close(&in[i].s);
+        free(in[i].map);
+    }
+    free(addrs);
+    free(acc);
+    free(bins);
+    free(used);
+    return rc;
+}
@@ -0,0 +1,53 @@
+#ifndef PAIRPROF_H
+#define PAIRPROF_H
+
+#include <stdint.h>
+
+// Per-pair hour-of-day RTT profiles, written by pairprofile and read by
+// the mininet link model (mininet-control/setup.py).
+//
+//   prof_header
+//   pairs[npairs]              prof_pair, sorted by (a, b)
+//   names[names_size]          NUL-terminated, sorted by strcmp; a pair's
+//                              a and b are indexes into this list
+//
+// A name is either an address as printed by ext_format_addr or, when
+// pairprofile was given an address map, the group (city) its addresses
+// were mapped to. Pairs are unordered with a <= b. Hour h covers the UTC
+// hour of day [h:00, h+1:00) over every day of input; a slot with count 0
+// had no samples. Integers and floats are in the writer's native byte
+// order; sections start 8-byte aligned.
+
+#define PROF_MAGIC "RIPEPRF\0"
+#define PROF_VERSION 1
+#define PROF_BYTE_ORDER 0x01020304u
+#define PROF_HOURS 24
+
+struct prof_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t hours;             // PROF_HOURS
+    uint64_t nnames;
+    uint64_t npairs;
+    uint64_t nsamples;
+    uint64_t pairs_offset;
+    uint64_t names_offset;
+    uint64_t names_size;
+};
+
+struct prof_slot {
+    uint32_t count;
+    float mean_ms;
+    float stddev_ms;            // sample standard deviation, 0 below 2 samples
+};
+
+struct prof_pair {
+    uint32_t a, b;              // name indexes, a <= b
+    struct prof_slot hour[PROF_HOURS];
+};
+
+_Static_assert(sizeof(struct prof_header) == 64, "prof_header layout");
+_Static_assert(sizeof(struct prof_pair) == 8 + 12 * PROF_HOURS, "prof_pair layout");
+
+#endif
@@ -0,0 +1,371 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "pairprof.h"
+#include "pairarc.h"
+
+// Builds the hour-of-day RTT profiles of pairprof.h from extract files
+// (version 2 on, which carry timestamps) and archives (pairarc.h).
+//
+// Without -m every address is its own profile node. With -m, a map of
+// "address name" lines, addresses are grouped under their name and only
+// records between two mapped addresses count; mapping the anchors of
+// each city to the city's abbreviation gives the per-city-pair profiles
+// the mininet link model replays.
+//
+// Sums are exact integers in microseconds, as in pairsum.h, so mean and
+// stddev do not depend on the order the files are read in.
+
+#define DEFAULT_OUTPUT "profile.bin"
+#define ALIGN8(x) (((x) + 7) & ~(uint64_t)7)
+
+struct hour_acc {
+    uint64_t count;
+    uint64_t sum_us;
+    unsigned __int128 sumsq;
+};
+
+struct pair_acc {
+    uint64_t key;               // (min << 32) | max node
+    struct hour_acc hour[PROF_HOURS];
+};
+
+// ------------------------------------------------------------------
+// Pair table entries, slot -> position in accs
+// ------------------------------------------------------------------
+
+struct pair_entry {
+    uint64_t key;               // 0 = empty; node ids start at 1
+    uint64_t pos;
+};
+
+// ------------------------------------------------------------------
+// Build
+// ------------------------------------------------------------------
+
+struct build {
+    struct ext_addr_index addrs;
+    uint32_t *node_of;          // address index id -> node, 0 = not mapped
+    char **names;               // node - 1 -> name
+    uint32_t nnodes;
+    struct ext_pair_table pairs;
+    struct pair_acc *accs;
+    size_t naccs, cap;
+    uint64_t no_time;           // records without a timestamp
+};
+
+static struct pair_acc *pair_get(struct build *bd, uint64_t key) {
+    size_t used = bd->pairs.used;
+    struct pair_entry *e = ext_pair_table_get(&bd->pairs, key);
+    if (!e) {
+        perror("failed to allocate pairs");
+        exit(1);
+    }
+    if (bd->pairs.used == used) return &bd->accs[e->pos];
+    if (bd->naccs == bd->cap) {
+        bd->cap = bd->cap ? bd->cap * 2 : 1024;
+        struct pair_acc *n = realloc(bd->accs, bd->cap * sizeof(*n));
+        if (!n) {
+            perror("failed to allocate pairs");
+            exit(1);
+        }
+        bd->accs = n;
+    }
+    e->pos = bd->naccs++;
+    struct pair_acc *p = &bd->accs[e->pos];
+    memset(p, 0, sizeof(*p));
+    p->key = key;
+    return p;
+}
+
+static void scan(struct build *bd, const struct ext_file *f) {
+    struct ext_iter it;
+    struct ext_record r;
+
+    ext_iter_init(&it, f, 0);
+    while (ext_iter_next(&it, &r)) {
+        uint32_t s = bd->node_of[ext_addr_index_get(&bd->addrs, r.src_addr)];
+        uint32_t d = bd->node_of[ext_addr_index_get(&bd->addrs, r.dst_addr)];
+        if (!s || !d || !r.rtt_count) continue;
+        if (!r.timestamp) {
+            bd->no_time++;
+            continue;
+        }
+        uint64_t key = s < d ? ((uint64_t)s << 32) | d : ((uint64_t)d << 32) | s;
+        struct hour_acc *h = &pair_get(bd, key)->hour[r.timestamp / 3600 % PROF_HOURS];
+        for (uint32_t k = 0; k < r.rtt_count; k++) {
+            uint64_t us = (uint64_t)(ext_rtt_ms(r.rtt, r.rtt_type, k) * 1000.0 + 0.5);
+            h->count++;
+            h->sum_us += us;
+            h->sumsq += (unsigned __int128)us * us;
+        }
+    }
+}
+
+// Same as scan for an archive, whose RTTs are integer microseconds
+// already. Returns 0, or -1 on a corrupt chunk.
+static int scan_archive(struct build *bd, const struct parc *a) {
+    for (uint64_t i = 0; i < a->hdr->npairs; i++) {
+        const struct parc_pair *p = &a->pairs[i];
+        uint32_t s = bd->node_of[ext_addr_index_get(&bd->addrs, a->addrs[p->src])];
+        uint32_t d = bd->node_of[ext_addr_index_get(&bd->addrs, a->addrs[p->dst])];
+        if (!s || !d) continue;
+        uint64_t key = s < d ? ((uint64_t)s << 32) | d : ((uint64_t)d << 32) | s;
+
+        struct parc_cursor c;
+        struct parc_record r;
+        int rc;
+        parc_cursor_init(&c, a, p, 0, UINT64_MAX);
+        while ((rc = parc_cursor_next(&c, &r)) == 1) {
+            if (!r.rtt_count) continue;
+            if (!r.timestamp) {
+                bd->no_time++;
+                continue;
+            }
+            struct hour_acc *h = &pair_get(bd, key)->hour[r.timestamp / 3600 % PROF_HOURS];
+            for (uint32_t k = 0; k < r.rtt_count; k++) {
+                uint64_t us = r.rtt_us[k];
+                h->count++;
+                h->sum_us += us;
+                h->sumsq += (unsigned __int128)us * us;
+            }
+        }
+        if (rc < 0) {
+            fprintf(stderr, "corrupt chunk in archive pair %llu\n", (unsigned long long)i);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int add_node(struct build *bd, const char *name) {
+    char **n = realloc(bd->names, (bd->nnodes + 1) * sizeof(*n));
+    if (!n) return -1;
+    bd->names = n;
+    if (!(bd->names[bd->nnodes] = strdup(name))) return -1;
+    bd->nnodes++;
+    return 0;
+}
+
+// Every address of the inputs is its own node, named by its address.
+static int nodes_from_addrs(struct build *bd) {
+    char buf[INET6_ADDRSTRLEN];
+    if (!(bd->node_of = calloc(bd->addrs.n + 1, sizeof(*bd->node_of)))) return -1;
+    for (uint32_t a = 0; a < bd->addrs.n; a++) {
+        if (add_node(bd, ext_format_addr(bd->addrs.addr[a], buf, sizeof(buf)))) return -1;
+        bd->node_of[a + 1] = a + 1;
+    }
+    return 0;
+}
+
+// Groups the addresses of an "address name" map (see extread.h); nodes
+// follow the map's groups.
+static int nodes_from_map(struct build *bd, const char *path) {
+    struct ext_addr_map map;
+    if (ext_addr_map_load(&map, path)) return -1;
+    int rc = 0;
+    for (size_t i = 0; i < map.n && !rc; i++) rc = ext_addr_index_add(&bd->addrs, map.entries[i].addr);
+    if (!rc) rc = ext_addr_index_sort(&bd->addrs);
+    if (!rc && !(bd->node_of = calloc(bd->addrs.n + 1, sizeof(*bd->node_of)))) rc = -1;
+    for (uint32_t g = 0; g < map.nnames && !rc; g++) rc = add_node(bd, map.names[g]);
+    for (size_t i = 0; i < map.n && !rc; i++)
+        bd->node_of[ext_addr_index_get(&bd->addrs, map.entries[i].addr)] = map.entries[i].group + 1;
+    ext_addr_map_free(&map);
+    if (rc) perror("failed to load address map");
+    return rc;
+}
+
+// ------------------------------------------------------------------
+// Output
+// ------------------------------------------------------------------
+
+static char **sort_names;
+
+static int node_cmp(const void *a, const void *b) {
+    return strcmp(sort_names[*(const uint32_t *)a], sort_names[*(const uint32_t *)b]);
+}
+
+static int pair_cmp(const void *a, const void *b) {
+    const struct prof_pair *x = a, *y = b;
+    if (x->a != y->a) return x->a < y->a ? -1 : 1;
+    return x->b < y->b ? -1 : x->b > y->b;
+}
+
+static void finish_slot(const struct hour_acc *h, struct prof_slot *s) {
+    s->count = h->count > UINT32_MAX ? UINT32_MAX : (uint32_t)h->count;
+    if (!h->count) return;
+    double mean = (double)h->sum_us / h->count;
+    s->mean_ms = (float)(mean / 1000.0);
+    if (h->count < 2) return;
+    // sumsq - sum^2/n exactly, as n*sumsq - sum^2 over n^2 (n-1)/n.
+    unsigned __int128 sum = h->sum_us;
+    unsigned __int128 m2 = h->sumsq * h->count - sum * sum;
+    double var = (double)m2 / h->count / (h->count - 1);
+    s->stddev_ms = (float)(sqrt(var) / 1000.0);
+}
+
+static int write_profiles(const struct build *bd, const char *path, struct prof_header *h) {
+    // Names sorted by strcmp; rank[node - 1] is a name's index.
+    uint32_t *order = malloc((bd->nnodes ? bd->nnodes : 1) * sizeof(*order));
+    uint32_t *rank = malloc((bd->nnodes ? bd->nnodes : 1) * sizeof(*rank));
+    struct prof_pair *pairs = calloc(bd->naccs ? bd->naccs : 1, sizeof(*pairs));
+    if (!order || !rank || !pairs) return -1;
+    for (uint32_t i = 0; i < bd->nnodes; i++) order[i] = i;
+    sort_names = bd->names;
+    qsort(order, bd->nnodes, sizeof(*order), node_cmp);
+    uint64_t names_size = 0;
+    for (uint32_t i = 0; i < bd->nnodes; i++) {
+        rank[order[i]] = i;
+        names_size += strlen(bd->names[order[i]]) + 1;
+    }
+
+    memset(h, 0, sizeof(*h));
+    for (size_t i = 0; i < bd->naccs; i++) {
+        const struct pair_acc *p = &bd->accs[i];
+        uint32_t a = rank[(uint32_t)(p->key >> 32) - 1], b = rank[(uint32_t)p->key - 1];
+        pairs[i].a = a < b ? a : b;
+        pairs[i].b = a < b ? b : a;
+        for (int k = 0; k < PROF_HOURS; k++) {
+            finish_slot(&p->hour[k], &pairs[i].hour[k]);
+            h->nsamples += p->hour[k].count;
+        }
+    }
+    qsort(pairs, bd->naccs, sizeof(*pairs), pair_cmp);
+
+    memcpy(h->magic, PROF_MAGIC, sizeof(h->magic));
+    h->byte_order = PROF_BYTE_ORDER;
+    h->version = PROF_VERSION;
+    h->hours = PROF_HOURS;
+    h->nnames = bd->nnodes;
+    h->npairs = bd->naccs;
+    h->pairs_offset = ALIGN8(sizeof(*h));
+    h->names_offset = ALIGN8(h->pairs_offset + h->npairs * sizeof(*pairs));
+    h->names_size = names_size;
+
+    static const char zero[8];
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE *f = fopen(tmp, "w");
+    if (!f) return -1;
+    size_t pad1 = h->pairs_offset - sizeof(*h);
+    size_t pad2 = h->names_offset - (h->pairs_offset + h->npairs * sizeof(*pairs));
+    int rc = fwrite(h, sizeof(*h), 1, f) == 1 && fwrite(zero, 1, pad1, f) == pad1 &&
+        fwrite(pairs, sizeof(*pairs), h->npairs, f) == h->npairs && fwrite(zero, 1, pad2, f) == pad2 ? 0 : -1;
+    for (uint32_t i = 0; i < bd->nnodes && !rc; i++) {
+        const char *nm = bd->names[order[i]];
+        if (fwrite(nm, 1, strlen(nm) + 1, f) != strlen(nm) + 1) rc = -1;
+    }
+    if (rc) {
+        fclose(f);
+        unlink(tmp);
+    } else {
+        rc = ext_commit_file(f, tmp, path);
+    }
+
+    free(order);
+    free(rank);
+    free(pairs);
+    return rc;
+}
+
+// ------------------------------------------------------------------
+// Driver
+// ------------------------------------------------------------------
+
+static int add_input(void *ctx, const char *path) {
+    struct parc_inputs *in = ctx;
+    size_t n = in->nfiles;
+    if (parc_inputs_add(in, path)) return -1;
+    const struct ext_file *f = &in->files[n];
+    if (in->nfiles > n && !ext_find_field(f, EXT_FIELD_TIMESTAMP)) {
+        fprintf(stderr, "Skipping %s: no timestamps (format version %u)\n", path, f->hdr->version);
+        ext_close(&in->files[--in->nfiles]);
+    }
+    return 0;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-m address-map] [-o profiles=%s] <directory|file|archive>...\n"
+        "  -m  group addresses by the name on their \"address name\" line\n",
+        argv0, DEFAULT_OUTPUT);
+}
+
+int main(int argc, char* argv[]) {
+    const char *out_path = DEFAULT_OUTPUT, *map_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "m:o:")) != -1) {
+        switch (opt) {
+        case 'm': map_path = optarg; break;
+        case 'o': out_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    struct parc_inputs in = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (ext_walk(argv[i], add_input, &in)) return 1;
+    }
+    struct ext_file *files = in.files;
+    size_t nfiles = in.nfiles;
+    struct parc_list *archives = &in.archives;
+
+    struct build bd = { 0 };
+    if (map_path) {
+        if (nodes_from_map(&bd, map_path)) return 1;
+    } else {
+        int rc = 0;
+        for (size_t i = 0; i < nfiles && !rc; i++) rc = ext_addr_index_add_file(&bd.addrs, &files[i]);
+        for (size_t i = 0; i < archives->n && !rc; i++) {
+            const struct parc *a = &archives->a[i];
+            for (uint64_t k = 0; k < a->hdr->naddrs && !rc; k++) rc = ext_addr_index_add(&bd.addrs, a->addrs[k]);
+        }
+        if (rc || ext_addr_index_sort(&bd.addrs) || nodes_from_addrs(&bd)) {
+            perror("failed to index addresses");
+            return 1;
+        }
+    }
+
+    if (ext_pair_table_init(&bd.pairs, sizeof(struct pair_entry), 1024)) {
+        perror("failed to allocate pair table");
+        return 1;
+    }
+    for (size_t i = 0; i < nfiles; i++) scan(&bd, &files[i]);
+    for (size_t i = 0; i < archives->n; i++) {
+        if (scan_archive(&bd, &archives->a[i])) return 1;
+    }
+    if (bd.no_time) fprintf(stderr, "%llu records without a timestamp skipped\n", (unsigned long long)bd.no_time);
+
+    struct prof_header h;
+    if (write_profiles(&bd, out_path, &h)) {
+        perror(out_path);
+        return 1;
+    }
+    fprintf(stderr, "%llu names, %llu pairs, %llu samples from %zu files\n",
+        (unsigned long long)h.nnames, (unsigned long long)h.npairs, (unsigned long long)h.nsamples, nfiles + archives->n);
+
+    for (size_t i = 0; i < nfiles; i++) ext_close(&files[i]);
+    free(files);
+    parc_list_free(archives);
+    for (uint32_t i = 0; i < bd.nnodes; i++) free(bd.names[i]);
+    free(bd.names);
+    free(bd.node_of);
+    free(bd.accs);
+    ext_pair_table_free(&bd.pairs);
+    ext_addr_index_free(&bd.addrs);
+    return 0;
+}
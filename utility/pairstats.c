@@ -0,0 +1,632 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+
+#include "extread.h"
+#include "rtthist.h"
+#include "pairsum.h"
+#include "pairarc.h"
+
+// Per address pair RTT statistics over a set of extract files; the native
+// replacement for utility/stats.
+//
+// phase 1: threads take blocks from all files and scatter (pair key, rtt)
+//          samples into small per-thread outboxes, one per shard. A full
+//          outbox is applied to its shard's hash table under the shard lock.
+// phase 2: each thread takes one shard, sigma-clips its pairs and sorts
+//          them by key; the shards are then merged and printed.
+//
+// Per pair the table keeps either every sample, in doubling chunks in the
+// shard's arena, or with -H only an HDR-style histogram (see below), which
+// bounds memory by pairs x occupied bins no matter how many files are read.
+// With -S the histograms are not clipped but written out, with exact sums,
+// as a mergeable summary for pairmerge (see pairsum.h).
+//
+// Pairs are keyed on dense address ids rather than raw addresses, so IPv6
+// costs the same as IPv4. Before phase 1 the per-file dictionaries (see
+// extfmt.h) are merged into one sorted address index; a file's ids then
+// map to global ids through a small array, and keys sort in address order.
+//
+// Archives (pairarc.h) can be given alongside extract files; their pairs
+// are handed out to the threads in runs of ARCHIVE_RUN once the blocks of
+// the extract files are taken.
+
+#define MAX_THREADS 256
+#define OUTBOX_SEG 1024         // samples per outbox
+#define ARENA_SLAB (64 * 1024 * 1024)
+#define FIRST_CHUNK 8
+#define MAX_CHUNK 4096
+#define CLIP_K 3.0
+#define CLIP_ITER 3
+#define ARCHIVE_RUN 256         // archive pairs per work item
+
+// ------------------------------------------------------------------
+// Arena and chunked sample vectors
+// ------------------------------------------------------------------
+
+struct slab {
+    struct slab *next;
+    size_t used;
+    char data[];
+};
+
+struct arena {
+    struct slab *head;
+};
+
+static void *arena_alloc(struct arena *a, size_t n) {
+    n = (n + 15) & ~(size_t)15;
+    if (!a->head || a->head->used + n > ARENA_SLAB) {
+        size_t size = n > ARENA_SLAB ? n : ARENA_SLAB;
+        struct slab *s = malloc(sizeof(*s) + size);
+        if (!s) {
+            perror("failed to allocate arena");
+            exit(1);
+        }
+        s->next = a->head;
+        s->used = 0;
+        a->head = s;
+    }
+    void *p = a->head->data + a->head->used;
+    a->head->used += n;
+    return p;
+}
+
+static void arena_free(struct arena *a) {
+    while (a->head) {
+        struct slab *s = a->head;
+        a->head = s->next;
+        free(s);
+    }
+}
+
+// Chunks double in size up to MAX_CHUNK, so a pair with n samples costs
+// O(log n) allocations and at most ~2x slack on small pairs.
+struct sample_chunk {
+    struct sample_chunk *next;
+    uint32_t cap;
+    uint32_t n;
+    float v[];
+};
+
+// ------------------------------------------------------------------
+// Pair table entries
+// ------------------------------------------------------------------
+
+struct pair_entry {
+    uint64_t key;               // 0 = empty; (min << 32) | max global id otherwise
+    uint64_t count;
+    union {
+        struct {
+            struct sample_chunk *first;
+            struct sample_chunk *last;
+        } samples;
+        struct {
+            struct hist hist;
+            uint64_t sum_us;            // -S only
+            unsigned __int128 sumsq;
+        };
+    };
+};
+
+static void sample_add(struct pair_entry *e, struct arena *a, float rtt) {
+    struct sample_chunk *c = e->samples.last;
+    if (!c || c->n == c->cap) {
+        uint32_t cap = c ? (c->cap * 2 < MAX_CHUNK ? c->cap * 2 : MAX_CHUNK) : FIRST_CHUNK;
+        struct sample_chunk *nc = arena_alloc(a, sizeof(*nc) + cap * sizeof(float));
+        nc->next = NULL;
+        nc->cap = cap;
+        nc->n = 0;
+        if (c) c->next = nc;
+        else e->samples.first = nc;
+        e->samples.last = c = nc;
+    }
+    c->v[c->n++] = rtt;
+}
+
+// ------------------------------------------------------------------
+// Statistics
+// ------------------------------------------------------------------
+
+struct pair_result {
+    uint64_t key;
+    uint64_t count;
+    double mean;
+    double stddev;
+    double p50, p90, p99;       // histogram mode only
+    struct hist hist;           // -S only, taken over from the entry
+    uint64_t sum_us;
+    unsigned __int128 sumsq;
+};
+
+// Same procedure as SigmaClipMeanStdDev in utility/stats: MLE mean and
+// stddev, drop values further than k stddev from the mean, repeat until
+// nothing is dropped or maxIter rounds ran. Clipping is done in place.
+static int sigma_clip(float *data, size_t n, double k, int max_iter, double *mean_out, double *stddev_out) {
+    double mean = 0, stddev = 0;
+    for (int iter = 0; iter < max_iter; iter++) {
+        if (n == 0) return -1;
+
+        mean = 0;
+        for (size_t i = 0; i < n; i++) mean += data[i];
+        if (isinf(mean)) return -1;
+        mean /= n;
+
+        stddev = 0;
+        for (size_t i = 0; i < n; i++) {
+            double diff = data[i] - mean;
+            stddev += diff * diff;
+        }
+        if (isinf(stddev)) return -1;
+        stddev = sqrt(stddev / n);
+
+        double threshold = k * stddev;
+        size_t kept = 0;
+        for (size_t i = 0; i < n; i++) {
+            if (fabs(data[i] - mean) <= threshold) data[kept++] = data[i];
+        }
+        if (kept == n) break;
+        n = kept;
+    }
+    *mean_out = mean;
+    *stddev_out = stddev;
+    return 0;
+}
+
+// ------------------------------------------------------------------
+// Driver
+// ------------------------------------------------------------------
+
+struct shard {
+    pthread_mutex_t mtx;
+    struct ext_pair_table table;
+    struct arena arena;
+};
+
+struct outbox {
+    uint32_t n;
+    uint64_t keys[OUTBOX_SEG];
+    uint32_t rtt_us[OUTBOX_SEG];    // exact for archives and version 2 files
+};
+
+struct work {
+    struct ext_file *files;
+    uint32_t **gids;            // per file, from ext_addr_index_map_file
+    size_t nfiles;
+    struct parc_list archives;
+    uint32_t **archive_gids;    // per archive, archive id -> global id
+    struct ext_addr_index addrs;
+    int nthreads;
+    int histogram;
+    int summary;                // -S
+
+    // phase 1 block cursor, then archive pair cursor
+    pthread_mutex_t mtx;
+    size_t file_i;
+    struct ext_block block;
+    size_t archive_i;
+    uint64_t pair_i;
+
+    struct shard *shards;
+    struct pair_result **results;
+    size_t *nresults;
+};
+
+static int next_block(struct work *w, size_t *fi, struct ext_block *b) {
+    int ok = 0;
+    pthread_mutex_lock(&w->mtx);
+    while (w->file_i < w->nfiles) {
+        if (ext_next_block(&w->files[w->file_i], &w->block)) {
+            *fi = w->file_i;
+            *b = w->block;
+            ok = 1;
+            break;
+        }
+        w->file_i++;
+        memset(&w->block, 0, sizeof(w->block));
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return ok;
+}
+
+// Hands out the next run of archive pairs [*first, *end) of archive *ai.
+static int next_pairs(struct work *w, size_t *ai, uint64_t *first, uint64_t *end) {
+    int ok = 0;
+    pthread_mutex_lock(&w->mtx);
+    while (w->archive_i < w->archives.n) {
+        uint64_t npairs = w->archives.a[w->archive_i].hdr->npairs;
+        if (w->pair_i < npairs) {
+            *ai = w->archive_i;
+            *first = w->pair_i;
+            *end = w->pair_i + ARCHIVE_RUN < npairs ? w->pair_i + ARCHIVE_RUN : npairs;
+            w->pair_i = *end;
+            ok = 1;
+            break;
+        }
+        w->archive_i++;
+        w->pair_i = 0;
+    }
+    pthread_mutex_unlock(&w->mtx);
+    return ok;
+}
+
+static void outbox_flush(struct work *w, struct shard *sh, struct outbox *o) {
+    pthread_mutex_lock(&sh->mtx);
+    for (uint32_t i = 0; i < o->n; i++) {
+        struct pair_entry *e = ext_pair_table_get(&sh->table, o->keys[i]);
+        if (!e) {
+            perror("failed to allocate pair table");
+            exit(1);
+        }
+        uint64_t us = o->rtt_us[i];
+        float rtt = (float)(us / 1000.0);
+        if (w->histogram) hist_add(&e->hist, hist_index(rtt));
+        else sample_add(e, &sh->arena, rtt);
+        if (w->summary) {
+            e->sum_us += us;
+            e->sumsq += (unsigned __int128)us * us;
+        }
+        e->count++;
+    }
+    pthread_mutex_unlock(&sh->mtx);
+    o->n = 0;
+}
+
+struct thread_arg {
+    struct work *w;
+    int id;
+};
+
+static void *scatter_main(void *arg) {
+    struct thread_arg *ta = arg;
+    struct work *w = ta->w;
+    size_t fi;
+    struct ext_block b;
+
+    struct outbox *out = calloc(w->nthreads, sizeof(*out));
+    if (!out) {
+        perror("failed to allocate outboxes");
+        exit(1);
+    }
+
+    uint8_t a[16];
+    memcpy(a, ext_v4_prefix, 12);
+
+    while (next_block(w, &fi, &b)) {
+        const struct ext_file *f = &w->files[fi];
+        const uint32_t *gid = w->gids[fi];
+        const uint32_t *src_id = ext_block_column(f, &b, EXT_FIELD_SRC_ID, NULL);
+        const uint32_t *dst_id = ext_block_column(f, &b, EXT_FIELD_DST_ID, NULL);
+        const uint8_t *src = ext_block_column(f, &b, EXT_FIELD_SRC_ADDR, NULL);
+        const uint8_t *dst = ext_block_column(f, &b, EXT_FIELD_DST_ADDR, NULL);
+        const uint8_t *cnt = ext_block_column(f, &b, EXT_FIELD_RTT_COUNT, NULL);
+        const void *rtt = ext_block_column(f, &b, EXT_FIELD_RTT, NULL);
+        const struct ext_column *rtt_col = ext_block_find_column(&b, EXT_FIELD_RTT);
+        int by_id = gid && src_id && dst_id;
+        if (!(by_id || (src && dst)) || !cnt || !rtt) continue;
+        uint32_t v = 0;
+
+        for (uint32_t i = 0; i < b.hdr->nrecords; i++) {
+            uint32_t s, d;
+            if (by_id) {
+                s = gid[src_id[i]];
+                d = gid[dst_id[i]];
+            } else {
+                memcpy(a + 12, src + i * 4, 4);
+                s = ext_addr_index_get(&w->addrs, a);
+                memcpy(a + 12, dst + i * 4, 4);
+                d = ext_addr_index_get(&w->addrs, a);
+            }
+            uint64_t key = s < d ? ((uint64_t)s << 32) | d : ((uint64_t)d << 32) | s;
+            uint32_t shard = ext_mix64(key) % w->nthreads;
+            struct outbox *o = &out[shard];
+            for (uint32_t k = 0; k < cnt[i]; k++) {
+                if (o->n == OUTBOX_SEG) outbox_flush(w, &w->shards[shard], o);
+                o->keys[o->n] = key;
+                o->rtt_us[o->n] = ext_rtt_us(rtt, rtt_col->type, v++);
+                o->n++;
+            }
+        }
+    }
+
+    size_t ai;
+    uint64_t first, end;
+    while (next_pairs(w, &ai, &first, &end)) {
+        const struct parc *arc = &w->archives.a[ai];
+        const uint32_t *gid = w->archive_gids[ai];
+        for (uint64_t i = first; i < end; i++) {
+            uint32_t s = gid[arc->pairs[i].src], d = gid[arc->pairs[i].dst];
+            uint64_t key = s < d ? ((uint64_t)s << 32) | d : ((uint64_t)d << 32) | s;
+            uint32_t shard = ext_mix64(key) % w->nthreads;
+            struct outbox *o = &out[shard];
+            struct parc_cursor c;
+            struct parc_record r;
+            int rc;
+            parc_cursor_init(&c, arc, &arc->pairs[i], 0, UINT64_MAX);
+            while ((rc = parc_cursor_next(&c, &r)) == 1) {
+                for (uint32_t k = 0; k < r.rtt_count; k++) {
+                    if (o->n == OUTBOX_SEG) outbox_flush(w, &w->shards[shard], o);
+                    o->keys[o->n] = key;
+                    o->rtt_us[o->n] = r.rtt_us[k];
+                    o->n++;
+                }
+            }
+            if (rc < 0) {
+                fprintf(stderr, "corrupt chunk in archive pair %llu\n", (unsigned long long)i);
+                exit(1);
+            }
+        }
+    }
+    for (int s = 0; s < w->nthreads; s++) {
+        if (out[s].n) outbox_flush(w, &w->shards[s], &out[s]);
+    }
+    free(out);
+    return NULL;
+}
+
+static int result_cmp(const void *a, const void *b) {
+    uint64_t x = ((const struct pair_result *)a)->key;
+    uint64_t y = ((const struct pair_result *)b)->key;
+    return x < y ? -1 : x > y;
+}
+
+static void *reduce_main(void *arg) {
+    struct thread_arg *ta = arg;
+    struct work *w = ta->w;
+    int shard = ta->id;
+    struct ext_pair_table *t = &w->shards[shard].table;
+
+    struct pair_result *res = malloc((t->used ? t->used : 1) * sizeof(*res));
+    float *scratch = NULL;
+    size_t scratch_cap = 0, n = 0;
+    if (!res) {
+        perror("failed to allocate results");
+        exit(1);
+    }
+
+    for (size_t i = 0; i < t->cap; i++) {
+        struct pair_entry *e = ext_pair_table_slot(t, i);
+        if (!e->key) continue;
+
+        struct pair_result *r = &res[n];
+        r->key = e->key;
+        r->count = e->count;
+        int rc;
+        if (w->summary) {
+            r->hist = e->hist;
+            r->sum_us = e->sum_us;
+            r->sumsq = e->sumsq;
+            rc = 0;
+        } else if (w->histogram) {
+            rc = hist_sigma_clip(&e->hist, CLIP_K, CLIP_ITER, &r->mean, &r->stddev);
+            r->p50 = hist_percentile(&e->hist, e->count, 0.50);
+            r->p90 = hist_percentile(&e->hist, e->count, 0.90);
+            r->p99 = hist_percentile(&e->hist, e->count, 0.99);
+            free(e->hist.bins);
+        } else {
+            if (e->count > scratch_cap) {
+                scratch_cap = e->count;
+                free(scratch);
+                scratch = malloc(scratch_cap * sizeof(float));
+                if (!scratch) {
+                    perror("failed to allocate samples");
+                    exit(1);
+                }
+            }
+            size_t m = 0;
+            for (struct sample_chunk *c = e->samples.first; c; c = c->next) {
+                memcpy(scratch + m, c->v, c->n * sizeof(float));
+                m += c->n;
+            }
+            rc = sigma_clip(scratch, m, CLIP_K, CLIP_ITER, &r->mean, &r->stddev);
+        }
+        if (rc) {
+            fprintf(stderr, "pair %016llx: overflow in statistics\n", (unsigned long long)e->key);
+            continue;
+        }
+        n++;
+    }
+    free(scratch);
+    ext_pair_table_free(t);
+    arena_free(&w->shards[shard].arena);
+
+    qsort(res, n, sizeof(*res), result_cmp);
+    w->results[shard] = res;
+    w->nresults[shard] = n;
+    return NULL;
+}
+
+static void usage(const char *argv0) {
+    fprintf(stderr,
+        "Usage: %s [-H] [-j threads] [-o output.tsv | -S summary] <directory|file|archive>...\n"
+        "  -H  keep histograms instead of every sample; adds p50, p90, p99\n"
+        "  -S  write a mergeable summary for pairmerge instead of the TSV\n", argv0);
+}
+
+
+int main(int argc, char* argv[]) {
+    int nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    int histogram = 0;
+    const char *out_path = NULL, *summary_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "Hj:o:S:")) != -1) {
+        switch (opt) {
+        case 'H':
+            histogram = 1;
+            break;
+        case 'j':
+            nthreads = atoi(optarg);
+            break;
+        case 'o':
+            out_path = optarg;
+            break;
+        case 'S':
+            summary_path = optarg;
+            histogram = 1;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (optind >= argc || (out_path && summary_path)) {
+        usage(argv[0]);
+        return 1;
+    }
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+    struct parc_inputs in = { 0 };
+    for (int i = optind; i < argc; i++) {
+        if (ext_walk(argv[i], parc_inputs_add, &in)) return 1;
+    }
+    struct ext_file *files = in.files;
+    size_t nfiles = in.nfiles;
+    struct parc_list archives = in.archives;
+
+    FILE *out = NULL;
+    struct psum_writer sw;
+    if (summary_path) {
+        if (psum_writer_open(&sw, summary_path)) {
+            perror(summary_path);
+            return 1;
+        }
+    } else if (!(out = out_path ? fopen(out_path, "w") : stdout)) {
+        perror(out_path);
+        return 1;
+    }
+
+    struct work w = { .files = files, .nfiles = nfiles, .archives = archives, .nthreads = nthreads,
+                      .histogram = histogram, .summary = summary_path != NULL };
+    pthread_mutex_init(&w.mtx, NULL);
+    w.gids = calloc(nfiles ? nfiles : 1, sizeof(*w.gids));
+    w.archive_gids = calloc(archives.n ? archives.n : 1, sizeof(*w.archive_gids));
+    if (!w.gids || !w.archive_gids) {
+        perror("failed to allocate");
+        return 1;
+    }
+    int rc = 0;
+    for (size_t i = 0; i < nfiles && !rc; i++) rc = ext_addr_index_add_file(&w.addrs, &files[i]);
+    for (size_t i = 0; i < archives.n && !rc; i++) {
+        for (uint64_t k = 0; k < archives.a[i].hdr->naddrs && !rc; k++) rc = ext_addr_index_add(&w.addrs, archives.a[i].addrs[k]);
+    }
+    if (!rc) rc = ext_addr_index_sort(&w.addrs);
+    for (size_t i = 0; i < nfiles && !rc; i++) rc = ext_addr_index_map_file(&w.addrs, &files[i], &w.gids[i]);
+    for (size_t i = 0; i < archives.n && !rc; i++) {
+        uint64_t n = archives.a[i].hdr->naddrs;
+        if (!(w.archive_gids[i] = malloc((n ? n : 1) * sizeof(**w.archive_gids)))) rc = -1;
+        for (uint64_t k = 0; k < n && !rc; k++) w.archive_gids[i][k] = ext_addr_index_get(&w.addrs, archives.a[i].addrs[k]);
+    }
+    if (rc) {
+        perror("failed to index addresses");
+        return 1;
+    }
+
+    w.shards = calloc(nthreads, sizeof(*w.shards));
+    w.results = calloc(nthreads, sizeof(*w.results));
+    w.nresults = calloc(nthreads, sizeof(*w.nresults));
+    struct thread_arg *args = calloc(nthreads, sizeof(*args));
+    pthread_t *tids = calloc(nthreads, sizeof(*tids));
+    if (!w.shards || !w.results || !w.nresults || !args || !tids) {
+        perror("failed to allocate");
+        return 1;
+    }
+    for (int t = 0; t < nthreads; t++) {
+        pthread_mutex_init(&w.shards[t].mtx, NULL);
+        if (ext_pair_table_init(&w.shards[t].table, sizeof(struct pair_entry), 1024)) {
+            perror("failed to allocate pair table");
+            return 1;
+        }
+    }
+
+    for (int t = 0; t < nthreads; t++) {
+        args[t].w = &w;
+        args[t].id = t;
+        pthread_create(&tids[t], NULL, scatter_main, &args[t]);
+    }
+    for (int t = 0; t < nthreads; t++) pthread_join(tids[t], NULL);
+    for (size_t i = 0; i < nfiles; i++) {
+        ext_close(&files[i]);
+        free(w.gids[i]);
+    }
+    for (size_t i = 0; i < archives.n; i++) {
+        parc_close(&archives.a[i]);
+        free(w.archive_gids[i]);
+    }
+
+    for (int t = 0; t < nthreads; t++) pthread_create(&tids[t], NULL, reduce_main, &args[t]);
+    for (int t = 0; t < nthreads; t++) pthread_join(tids[t], NULL);
+
+    // k-way merge of the per-shard sorted results
+    size_t total = 0;
+    for (int t = 0; t < nthreads; t++) total += w.nresults[t];
+    fprintf(stderr, "%zu unique address pairs from %zu files\n", total, nfiles + archives.n);
+
+    size_t *pos = calloc(nthreads, sizeof(*pos));
+    if (out) {
+        fprintf(out, histogram ? "addr_a\taddr_b\tsamples\tmean\tstddev\tp50\tp90\tp99\n"
+                               : "addr_a\taddr_b\tsamples\tmean\tstddev\n");
+    }
+    for (size_t k = 0; k < total; k++) {
+        int best = -1;
+        for (int t = 0; t < nthreads; t++) {
+            if (pos[t] == w.nresults[t]) continue;
+            if (best < 0 || w.results[t][pos[t]].key < w.results[best][pos[best]].key) best = t;
+        }
+        const struct pair_result *r = &w.results[best][pos[best]++];
+        if (summary_path) {
+            struct psum_pair p = {
+                .a = (uint32_t)(r->key >> 32) - 1, .b = (uint32_t)r->key - 1,
+                .count = r->count, .sum_us = r->sum_us, .lo = r->hist.lo, .nbins = r->hist.n,
+            };
+            psum_set_sumsq(&p, r->sumsq);
+            if (psum_writer_add(&sw, &p, r->hist.bins)) {
+                perror(summary_path);
+                psum_writer_abort(&sw);
+                return 1;
+            }
+            free(r->hist.bins);
+            continue;
+        }
+        char a[INET6_ADDRSTRLEN], b[INET6_ADDRSTRLEN];
+        ext_format_addr(w.addrs.addr[(r->key >> 32) - 1], a, sizeof(a));
+        ext_format_addr(w.addrs.addr[(uint32_t)r->key - 1], b, sizeof(b));
+        fprintf(out, "%s\t%s\t%llu\t%f\t%f", a, b, (unsigned long long)r->count, r->mean, r->stddev);
+        if (histogram) fprintf(out, "\t%f\t%f\t%f", r->p50, r->p90, r->p99);
+        fputc('\n', out);
+    }
+
+    if (summary_path && psum_writer_close(&sw, (const uint8_t (*)[16])w.addrs.addr, w.addrs.n)) {
+        perror(summary_path);
+        return 1;
+    }
+    if (out && out != stdout && (ferror(out) | fclose(out))) {
+        perror(out_path);
+        return 1;
+    }
+    for (int t = 0; t < nthreads; t++) {
+        free(w.results[t]);
+        pthread_mutex_destroy(&w.shards[t].mtx);
+    }
+    free(pos);
+    free(w.shards);
+    free(w.results);
+    free(w.nresults);
+    free(args);
+    free(tids);
+    free(files);
+    free(w.gids);
+    free(w.archive_gids);
+    free(archives.a);
+    ext_addr_index_free(&w.addrs);
+    pthread_mutex_destroy(&w.mtx);
+    return 0;
+}
@@ -0,0 +1,184 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "pairsum.h"
+#include "rtthist.h"
+
+static int fail(struct psum *s, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(s->error, sizeof(s->error), fmt, ap);
+    va_end(ap);
+    return -1;
+}
+
+static int section_ok(const struct psum *s, uint64_t off, uint64_t count, uint64_t elem) {
+    return off % 8 == 0 && off <= s->size && count <= (s->size - off) / elem;
+}
+
+// Checks everything merging relies on, once.
+static int validate(struct psum *s) {
+    const struct psum_header *h = s->hdr;
+    if (memcmp(h->magic, PSUM_MAGIC, sizeof(h->magic)) != 0) return fail(s, "not a pair summary");
+    if (h->byte_order != PSUM_BYTE_ORDER) return fail(s, "written with a different byte order");
+    if (h->version != PSUM_VERSION) return fail(s, "unsupported summary version %u", h->version);
+    if (h->hist_sub_bits != HIST_SUB_BITS || h->hist_units_per_ms != HIST_UNITS_PER_MS)
+        return fail(s, "histogram layout differs from this build");
+    if (h->naddrs >= UINT32_MAX || !section_ok(s, h->bins_offset, h->nbins, 4) ||
+        !section_ok(s, h->pairs_offset, h->npairs, sizeof(struct psum_pair)) ||
+        !section_ok(s, h->addrs_offset, h->naddrs, 16))
+        return fail(s, "truncated summary");
+
+    s->bins = (const void *)(s->data + h->bins_offset);
+    s->pairs = (const void *)(s->data + h->pairs_offset);
+    s->addrs = (const void *)(s->data + h->addrs_offset);
+
+    for (uint64_t a = 1; a < h->naddrs; a++) {
+        if (memcmp(s->addrs[a - 1], s->addrs[a], 16) >= 0) return fail(s, "address table not sorted");
+    }
+    uint64_t samples = 0;
+    for (uint64_t i = 0; i < h->npairs; i++) {
+        const struct psum_pair *p = &s->pairs[i];
+        const struct psum_pair *q = i ? p - 1 : NULL;
+        if (p->a > p->b || p->b >= h->naddrs || (q && (q->a > p->a || (q->a == p->a && q->b >= p->b))) ||
+            p->bins_first > h->nbins || p->nbins > h->nbins - p->bins_first ||
+            (uint32_t)p->lo + p->nbins > HIST_BINS)
+            return fail(s, "bad pair %llu", (unsigned long long)i);
+        uint64_t n = 0;
+        for (uint32_t k = 0; k < p->nbins; k++) n += s->bins[p->bins_first + k];
+        if (n != p->count) return fail(s, "pair %llu: histogram does not match its count", (unsigned long long)i);
+        samples += n;
+    }
+    if (samples != h->nsamples) return fail(s, "sample count does not match the pairs");
+    return 0;
+}
+
+int psum_open(struct psum *s, const char *path) {
+    struct stat st;
+
+    memset(s, 0, sizeof(*s));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return fail(s, "%s", strerror(errno));
+    if (fstat(fd, &st)) {
+        fail(s, "%s", strerror(errno));
+        goto FAIL;
+    }
+    s->size = st.st_size;
+    if (s->size < sizeof(struct psum_header)) {
+        fail(s, "file too short");
+        goto FAIL;
+    }
+    s->data = mmap(NULL, s->size, PROT_READ, MAP_SHARED, fd, 0);
+    if (s->data == MAP_FAILED) {
+        s->data = NULL;
+        fail(s, "mmap: %s", strerror(errno));
+        goto FAIL;
+    }
+    // The mapping keeps the file; pairmerge maps up to MAX_INPUTS summaries
+    close(fd);
+    fd = -1;
+    madvise((void *)s->data, s->size, MADV_SEQUENTIAL);
+    s->hdr = (const void *)s->data;
+    if (validate(s)) goto FAIL;
+    return 0;
+
+FAIL:
+    if (fd >= 0) close(fd);
+    {
+        char error[sizeof(s->error)];
+        memcpy(error, s->error, sizeof(error));
+        psum_close(s);
+        memcpy(s->error, error, sizeof(error));
+    }
+    return -1;
+}
+
+void psum_close(struct psum *s) {
+    if (s->data) munmap((void *)s->data, s->size);
+    memset(s, 0, sizeof(*s));
+}
+
+int psum_writer_open(struct psum_writer *w, const char *path) {
+    memset(w, 0, sizeof(*w));
+    if (snprintf(w->path, sizeof(w->path), "%s", path) >= (int)sizeof(w->path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    char tmp[sizeof(w->path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    if (!(w->f = fopen(tmp, "w"))) return -1;
+
+    memcpy(w->hdr.magic, PSUM_MAGIC, sizeof(w->hdr.magic));
+    w->hdr.byte_order = PSUM_BYTE_ORDER;
+    w->hdr.version = PSUM_VERSION;
+    w->hdr.hist_sub_bits = HIST_SUB_BITS;
+    w->hdr.hist_units_per_ms = HIST_UNITS_PER_MS;
+    w->hdr.bins_offset = sizeof(w->hdr);
+    // The header is rewritten with the counts on close.
+    if (fwrite(&w->hdr, sizeof(w->hdr), 1, w->f) != 1) {
+        psum_writer_abort(w);
+        return -1;
+    }
+    return 0;
+}
+
+int psum_writer_add(struct psum_writer *w, const struct psum_pair *p, const uint32_t *bins) {
+    if (w->hdr.npairs == w->cap) {
+        size_t cap = w->cap ? w->cap * 2 : 4096;
+        struct psum_pair *np = realloc(w->pairs, cap * sizeof(*np));
+        if (!np) return -1;
+        w->pairs = np;
+        w->cap = cap;
+    }
+    struct psum_pair *q = &w->pairs[w->hdr.npairs++];
+    *q = *p;
+    q->bins_first = w->hdr.nbins;
+    q->reserved = 0;
+    w->hdr.nbins += p->nbins;
+    w->hdr.nsamples += p->count;
+    return fwrite(bins, sizeof(*bins), p->nbins, w->f) == p->nbins ? 0 : -1;
+}
+
+int psum_writer_close(struct psum_writer *w, const uint8_t (*addrs)[16], uint64_t naddrs) {
+    static const char zero[8];
+    uint64_t off = w->hdr.bins_offset + w->hdr.nbins * 4;
+    size_t pad = (8 - off % 8) % 8;
+    w->hdr.naddrs = naddrs;
+    w->hdr.pairs_offset = off + pad;
+    w->hdr.addrs_offset = w->hdr.pairs_offset + w->hdr.npairs * sizeof(struct psum_pair);
+
+    char tmp[sizeof(w->path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    int rc = fwrite(zero, 1, pad, w->f) == pad &&
+        fwrite(w->pairs, sizeof(*w->pairs), w->hdr.npairs, w->f) == w->hdr.npairs &&
+        fwrite(addrs, 16, naddrs, w->f) == naddrs &&
+        fseek(w->f, 0, SEEK_SET) == 0 &&
+        fwrite(&w->hdr, sizeof(w->hdr), 1, w->f) == 1 &&
+        fflush(w->f) == 0 && fsync(fileno(w->f)) == 0 ? 0 : -1;
+    if (fclose(w->f)) rc = -1;
+    w->f = NULL;
+    if (!rc && rename(tmp, w->path)) rc = -1;
+    if (rc) unlink(tmp);
+    free(w->pairs);
+    w->pairs = NULL;
+    return rc;
+}
+
+void psum_writer_abort(struct psum_writer *w) {
+    char tmp[sizeof(w->path) + 4];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", w->path);
+    if (w->f) fclose(w->f);
+    unlink(tmp);
+    free(w->pairs);
+    w->f = NULL;
+    w->pairs = NULL;
+}
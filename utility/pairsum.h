@@ -0,0 +1,105 @@
+#ifndef PAIRSUM_H
+#define PAIRSUM_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Mergeable per-pair RTT summaries, written by pairstats -S and combined
+// by pairmerge.
+//
+//   psum_header
+//   bins[nbins]                u32 counts, each pair's window in turn
+//   pairs[npairs]              psum_pair, sorted by (a, b)
+//   addrs[naddrs][16]          sorted; a pair's a and b index this table
+//
+// Per pair the summary holds the sample count, the exact sums of the
+// samples and of their squares in integer microseconds, and the rtthist.h
+// histogram window. Every part adds and subtracts exactly, so summaries
+// can be merged in any order or tree shape and a merged summary can have
+// one of its inputs taken out again; that is what keeps a rolling window
+// cheap. Sigma clipping and percentiles are only done at the end, from the
+// merged histogram.
+//
+// Pairs are unordered with a <= b. Since the address table is sorted, id
+// order is address order, which lets pairmerge merge files by id. Addresses
+// use the 16-byte form of extfmt.h, IPv4 as ::ffff:a.b.c.d. Integers are
+// in the writer's native byte order; sections start 8-byte aligned.
+
+#define PSUM_MAGIC "RIPESUM\0"
+#define PSUM_VERSION 1
+#define PSUM_BYTE_ORDER 0x01020304u
+
+struct psum_header {
+    char magic[8];
+    uint32_t byte_order;
+    uint16_t version;
+    uint16_t hist_sub_bits;     // HIST_SUB_BITS of the writer
+    uint32_t hist_units_per_ms; // HIST_UNITS_PER_MS of the writer
+    uint32_t reserved;
+    uint64_t naddrs;
+    uint64_t npairs;
+    uint64_t nbins;
+    uint64_t nsamples;
+    uint64_t bins_offset;
+    uint64_t pairs_offset;
+    uint64_t addrs_offset;
+};
+
+struct psum_pair {
+    uint32_t a, b;              // ids, a <= b
+    uint64_t count;
+    uint64_t sum_us;
+    uint64_t sumsq_lo;          // 128-bit sum of squared us
+    uint64_t sumsq_hi;
+    uint64_t bins_first;        // index of bin lo in bins[]
+    uint16_t lo;                // histogram bin of bins[bins_first]
+    uint16_t nbins;
+    uint32_t reserved;
+};
+
+_Static_assert(sizeof(struct psum_header) == 80, "psum_header layout");
+_Static_assert(sizeof(struct psum_pair) == 56, "psum_pair layout");
+
+struct psum {
+    const char *data;
+    size_t size;
+    const struct psum_header *hdr;
+    const uint32_t *bins;
+    const struct psum_pair *pairs;
+    const uint8_t (*addrs)[16];
+    char error[128];            // reason for the last failure
+};
+
+// Maps and validates a summary; returns 0, or -1 with s->error filled in.
+int psum_open(struct psum *s, const char *path);
+void psum_close(struct psum *s);
+
+static inline unsigned __int128 psum_sumsq(const struct psum_pair *p) {
+    return (unsigned __int128)p->sumsq_hi << 64 | p->sumsq_lo;
+}
+
+static inline void psum_set_sumsq(struct psum_pair *p, unsigned __int128 v) {
+    p->sumsq_lo = (uint64_t)v;
+    p->sumsq_hi = (uint64_t)(v >> 64);
+}
+
+// Streaming writer: pairs in (a, b) order, each with its bins; the address
+// table comes last. Written under path.tmp and renamed by psum_writer_close.
+struct psum_writer {
+    FILE *f;
+    char path[4096];
+    struct psum_header hdr;
+    struct psum_pair *pairs;    // buffered until close
+    size_t cap;
+};
+
+// All return 0, or -1 with errno set.
+int psum_writer_open(struct psum_writer *w, const char *path);
+// Copies p, filling in bins_first; bins are p->nbins counts from bin p->lo.
+int psum_writer_add(struct psum_writer *w, const struct psum_pair *p, const uint32_t *bins);
+int psum_writer_close(struct psum_writer *w, const uint8_t (*addrs)[16], uint64_t naddrs);
+// Discards a writer after a failure.
+void psum_writer_abort(struct psum_writer *w);
+
+#endif
@@ -0,0 +1,135 @@
+#ifndef RTTHIST_H
+#define RTTHIST_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <math.h>
+
+// RTT histograms shared by pairstats -H and the summary tools (pairsum.h).
+// Bin boundaries are part of the summary format, so changing HIST_* means
+// bumping PSUM_VERSION.
+
+// ------------------------------------------------------------------
+// RTT histogram
+//
+// Values are counted in units of 1/128 ms (7.8 us). Units below 256 get
+// a bin each; above that every power of two is split into 128 bins, so
+// the bin width stays under 0.8% of the value: 15.6 us at 2 ms, 0.5 ms at
+// 64 ms. A pair only stores the window of bins its samples fall in.
+// ------------------------------------------------------------------
+
+#define HIST_UNITS_PER_MS 128
+#define HIST_SUB_BITS 7
+#define HIST_LINEAR (2 << HIST_SUB_BITS)
+#define HIST_BINS (HIST_LINEAR + (31 - HIST_SUB_BITS - 1) * (1 << HIST_SUB_BITS))
+#define HIST_MIN_WINDOW 16
+
+static inline uint32_t hist_index(float rtt) {
+    double u = rtt * (double)HIST_UNITS_PER_MS + 0.5;
+    if (!(u >= 0)) return 0;
+    if (u >= 2147483647.0) return HIST_BINS - 1;
+    uint32_t v = (uint32_t)u;
+    if (v < HIST_LINEAR) return v;
+    int e = 31 - __builtin_clz(v);
+    return HIST_LINEAR + (e - HIST_SUB_BITS - 1) * (1 << HIST_SUB_BITS)
+        + ((v >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1));
+}
+
+// Mean value of the units that map to bin i, in ms.
+static inline double hist_value(uint32_t i) {
+    if (i < HIST_LINEAR) return (double)i / HIST_UNITS_PER_MS;
+    uint32_t r = i - HIST_LINEAR;
+    int shift = r / (1 << HIST_SUB_BITS) + 1;
+    uint64_t lower = ((uint64_t)(1 << HIST_SUB_BITS) + (r & ((1 << HIST_SUB_BITS) - 1))) << shift;
+    return (lower + (((uint64_t)1 << shift) - 1) / 2.0) / HIST_UNITS_PER_MS;
+}
+
+struct hist {
+    uint32_t *bins;
+    uint16_t lo;                // bin index of bins[0]
+    uint16_t n;
+};
+
+static inline void hist_add(struct hist *h, uint32_t i) {
+    if (h->bins && i >= h->lo && i < (uint32_t)h->lo + h->n) {
+        h->bins[i - h->lo]++;
+        return;
+    }
+
+    // Grow the window to cover i, at least doubling it towards that side.
+    uint32_t lo = h->bins ? (i < h->lo ? i : h->lo) : i;
+    uint32_t hi = h->bins ? (i >= (uint32_t)h->lo + h->n ? i + 1 : (uint32_t)h->lo + h->n) : i + 1;
+    uint32_t want = 2 * h->n > HIST_MIN_WINDOW ? 2 * h->n : HIST_MIN_WINDOW;
+    if (hi - lo < want) {
+        if (h->bins && i < h->lo) lo = hi > want ? hi - want : 0;
+        else if (h->bins) hi = lo + want;
+        else lo = lo > want / 2 ? lo - want / 2 : 0, hi = lo + want;
+        if (hi > HIST_BINS) hi = HIST_BINS;
+    }
+
+    uint32_t *bins = calloc(hi - lo, sizeof(*bins));
+    if (!bins) {
+        perror("failed to allocate histogram");
+        exit(1);
+    }
+    if (h->bins) {
+        memcpy(bins + (h->lo - lo), h->bins, h->n * sizeof(*bins));
+        free(h->bins);
+    }
+    h->bins = bins;
+    h->lo = lo;
+    h->n = hi - lo;
+    h->bins[i - lo]++;
+}
+
+// sigma_clip over bin values weighted by their counts. The kept values
+// always form a contiguous run of bins, so clipping just narrows [a, b).
+static inline int hist_sigma_clip(const struct hist *h, double k, int max_iter, double *mean_out, double *stddev_out) {
+    uint32_t a = 0, b = h->n;
+    double mean = 0, stddev = 0;
+    uint64_t n = 0;
+    for (uint32_t i = a; i < b; i++) n += h->bins[i];
+
+    for (int iter = 0; iter < max_iter; iter++) {
+        if (n == 0) return -1;
+
+        mean = 0;
+        for (uint32_t i = a; i < b; i++) mean += h->bins[i] * hist_value(h->lo + i);
+        if (isinf(mean)) return -1;
+        mean /= n;
+
+        stddev = 0;
+        for (uint32_t i = a; i < b; i++) {
+            double diff = hist_value(h->lo + i) - mean;
+            stddev += h->bins[i] * diff * diff;
+        }
+        if (isinf(stddev)) return -1;
+        stddev = sqrt(stddev / n);
+
+        double threshold = k * stddev;
+        uint64_t kept = n;
+        while (a < b && fabs(hist_value(h->lo + a) - mean) > threshold) kept -= h->bins[a++];
+        while (a < b && fabs(hist_value(h->lo + b - 1) - mean) > threshold) kept -= h->bins[--b];
+        if (kept == n) break;
+        n = kept;
+    }
+    *mean_out = mean;
+    *stddev_out = stddev;
+    return 0;
+}
+
+// Nearest-rank percentile over all samples of the pair.
+static inline double hist_percentile(const struct hist *h, uint64_t total, double p) {
+    uint64_t rank = (uint64_t)ceil(p * total);
+    uint64_t seen = 0;
+    if (rank == 0) rank = 1;
+    for (uint32_t i = 0; i < h->n; i++) {
+        seen += h->bins[i];
+        if (seen >= rank) return hist_value(h->lo + i);
+    }
+    return hist_value(h->lo + h->n - 1);
+}
+
+#endif
@@ -4,10 +4,12 @@ import (
 	"encoding/binary"
 	"errors"
 	"fmt"
-	"io"
 	"math"
+	"net/netip"
 	"os"
 	"path/filepath"
+
+	"extfile"
 )
 
 type LatencyInfo struct {
@@ -40,10 +42,11 @@ func main() {
 	}
 
 	dictionary := make(map[uint64][]float32)
+	ids := newAddrIDs()
 
 	// Process each file
 	for _, filePath := range filePaths {
-		err := processFile(filePath, dictionary)
+		err := processFile(filePath, ids, dictionary)
 		if err != nil {
 			fmt.Fprintf(os.Stderr, "Error processing %s: %v\n", filePath, err)
 			continue
@@ -69,34 +72,59 @@ func main() {
 	}
 }
 
-func processFile(filename string, dictionary map[uint64][]float32) error {
-	file, err := os.Open(filename)
-	if err != nil {
-		return err
-	}
-	defer file.Close()
-
-	const structSize = 20
-	buffer := make([]byte, structSize*1024*1024) // 10MB buffer
+// addrIDs hands out dense ids for addresses, starting at 1, so pairs of
+// either address family fit a uint64 key.
+type addrIDs struct {
+	ids map[netip.Addr]uint32
+}
 
-	for {
-		n, err := file.Read(buffer)
-		if n == 0 {
-			break
-		}
+func newAddrIDs() *addrIDs {
+	return &addrIDs{ids: make(map[netip.Addr]uint32)}
+}
 
-		count := n / structSize
-		for i := range count {
-			offset := i * structSize
+func (a *addrIDs) id(addr netip.Addr) uint32 {
+	id, ok := a.ids[addr]
+	if !ok {
+		id = uint32(len(a.ids) + 1)
+		a.ids[addr] = id
+	}
+	return id
+}
 
-			// Read floats directly as uint32, then convert
-			rtt1 := float32frombits(buffer[offset:])
-			rtt2 := float32frombits(buffer[offset+4:])
-			rtt3 := float32frombits(buffer[offset+8:])
+func processFile(filename string, ids *addrIDs, dictionary map[uint64][]float32) error {
+	fields := []uint16{extfile.FieldSrcAddr, extfile.FieldDstAddr, extfile.FieldSrcID, extfile.FieldDstID, extfile.FieldRttCount, extfile.FieldRtt}
+	// Global ids of the file's dictionary entries, extended block by block.
+	var fileIDs []uint32
+	return extfile.Read(filename, fields, func(b *extfile.Block) error {
+		srcID := b.Column(extfile.FieldSrcID)
+		dstID := b.Column(extfile.FieldDstID)
+		counts := b.Column(extfile.FieldRttCount)
+		rtts := b.Column(extfile.FieldRtt)
+		if counts == nil || rtts == nil {
+			return errors.New("block lacks rtt columns")
+		}
+		rttType, _ := b.ColumnInfo(extfile.FieldRtt)
+		for _, a := range b.Dictionary()[len(fileIDs):] {
+			fileIDs = append(fileIDs, ids.id(netip.AddrFrom16([16]byte(a)).Unmap()))
+		}
 
-			// Read addresses
-			dstAddr := binary.NativeEndian.Uint32(buffer[offset+12:])
-			srcAddr := binary.NativeEndian.Uint32(buffer[offset+16:])
+		v := 0
+		for i := range b.NRecords {
+			var srcAddr, dstAddr uint32
+			if srcID != nil && dstID != nil {
+				s := binary.NativeEndian.Uint32(srcID[i*4:])
+				d := binary.NativeEndian.Uint32(dstID[i*4:])
+				if int(s) >= len(fileIDs) || int(d) >= len(fileIDs) {
+					return errors.New("address id out of range")
+				}
+				srcAddr, dstAddr = fileIDs[s], fileIDs[d]
+			} else {
+				src, dst, err := b.Endpoints(i)
+				if err != nil {
+					return err
+				}
+				srcAddr, dstAddr = ids.id(src), ids.id(dst)
+			}
 
 			// Create key with smaller address first
 			var key uint64
@@ -106,18 +134,14 @@ func processFile(filename string, dictionary map[uint64][]float32) error {
 				key = (uint64(srcAddr) << 32) | uint64(dstAddr)
 			}
 
-			// Append all three RTTs at once
-			dictionary[key] = append(dictionary[key], rtt1, rtt2, rtt3)
-		}
-
-		if err == io.EOF {
-			break
-		}
-		if err != nil {
-			return err
+			// Append all RTTs of the record at once
+			for range int(counts[i]) {
+				dictionary[key] = append(dictionary[key], rttAt(rtts, rttType, v))
+				v++
+			}
 		}
-	}
-	return nil
+		return nil
+	})
 }
 
 func SigmaClipMeanStdDev(
@@ -175,7 +199,12 @@ func SigmaClipMeanStdDev(
 	return
 }
 
-func float32frombits(b []byte) float32 {
-	bits := binary.NativeEndian.Uint32(b)
-	return math.Float32frombits(bits)
+// rttAt decodes RTT value i in ms: F32 ms in version 1 files, U32
+// microseconds from version 2 on.
+func rttAt(rtts []byte, typ uint8, i int) float32 {
+	bits := binary.NativeEndian.Uint32(rtts[i*4:])
+	if typ == extfile.TypeF32 {
+		return math.Float32frombits(bits)
+	}
+	return float32(float64(bits) / 1000)
 }